@@ -0,0 +1,101 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * A minimal benchmark runner in the style of Google Benchmark. Each benchmark
+ * is a function that runs its body the given number of iterations. The runner
+ * raises the number of iterations until a run takes long enough to time, and
+ * reports the time per iteration. `make bench` builds and runs them all, a
+ * benchmark program runs only the benchmarks containing its first argument.
+ */
+
+namespace VtcBlockIndexerBench {
+    struct Benchmark {
+        std::string name;
+        std::function<void(size_t iterations)> run;
+    };
+
+    inline std::vector<Benchmark>& benchmarks() {
+        static std::vector<Benchmark> registered;
+        return registered;
+    }
+
+    struct Registration {
+        Registration(const std::string& name, const std::function<void(size_t iterations)>& run) {
+            benchmarks().push_back({ name, run });
+        }
+    };
+
+    /** Keeps the compiler from optimizing away the computation of a value */
+    template <typename T>
+    inline void doNotOptimize(const T& value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    inline int runBenchmarks(int argc, char** argv) {
+        const std::string filter = (argc > 1 ? argv[1] : "");
+        const double minSeconds = 0.5;
+        std::cout << std::left << std::setw(48) << "Benchmark" << std::right << std::setw(14) << "ns/iteration" << std::setw(14) << "iterations" << std::endl;
+        for(const Benchmark& benchmark : benchmarks()) {
+            if(benchmark.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            size_t iterations = 1;
+            double seconds = 0;
+            while(true) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                benchmark.run(iterations);
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if(seconds >= minSeconds || iterations >= ((size_t)1 << 40)) {
+                    break;
+                }
+                // Aim a little past the minimum, at most ten times more per step
+                const double factor = (seconds > 0 ? minSeconds * 1.4 / seconds : 10);
+                iterations = (size_t)(iterations * (factor > 10 ? 10 : (factor < 1.5 ? 1.5 : factor))) + 1;
+            }
+            std::cout << std::left << std::setw(48) << benchmark.name << std::right << std::setw(14) << std::fixed << std::setprecision(1) << (seconds * 1e9 / iterations) << std::setw(14) << iterations << std::endl;
+        }
+        return 0;
+    }
+}
+
+#define BENCHMARK(name) \
+    static void name(size_t iterations); \
+    static VtcBlockIndexerBench::Registration name##Registration(#name, name); \
+    static void name(size_t iterations)
+
+#define BENCHMARK_MAIN() \
+    int main(int argc, char** argv) { \
+        return VtcBlockIndexerBench::runBenchmarks(argc, argv); \
+    }
+
+#endif // BENCH_H_INCLUDED
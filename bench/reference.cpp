@@ -0,0 +1,410 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "reference.h"
+#include <openssl/evp.h>
+#include <assert.h>
+#include <iomanip>
+#include <sstream>
+#include <stdlib.h>
+#include "scriptsolver.h"
+#include "utility.h"
+#include "crypto/bech32.h"
+#include "coinparams.h"
+
+using namespace std;
+
+namespace
+{
+    typedef std::vector<uint8_t> data;
+
+    template<int frombits, int tobits, bool pad>
+    bool convertbits(data& out, const data& in) {
+        int acc = 0;
+        int bits = 0;
+        const int maxv = (1 << tobits) - 1;
+        const int max_acc = (1 << (frombits + tobits - 1)) - 1;
+        for (size_t i = 0; i < in.size(); ++i) {
+            int value = in[i];
+            acc = ((acc << frombits) | value) & max_acc;
+            bits += frombits;
+            while (bits >= tobits) {
+                bits -= tobits;
+                out.push_back((acc >> bits) & maxv);
+            }
+        }
+        if (pad) {
+            if (bits) out.push_back((acc << (tobits - bits)) & maxv);
+        } else if (bits >= frombits || ((acc << (tobits - bits)) & maxv)) {
+            return false;
+        }
+        return true;
+    }
+
+    vector<unsigned char> sha256(vector<unsigned char> input)
+    {
+        unsigned char hash[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        EVP_Digest(input.data(), input.size(), hash, &length, EVP_sha256(), NULL);
+        return vector<unsigned char>(hash, hash + length);
+    }
+
+    const char* pszBase58 = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+}
+
+// The implementations below are kept as they were before they were replaced,
+// to measure the replacements against. They are not used by the indexer.
+
+uint8_t VtcBlockIndexerBench::Reference::getScriptType(vector<unsigned char> script) {
+    uint64_t scriptSize = script.size();
+    
+    // The most common output script type that pays to hash160(pubKey)
+    if(
+        
+            (25==scriptSize                  &&
+            0x76==script.at(0)              &&  // OP_DUP
+            0xA9==script.at(1)              &&  // OP_HASH160
+              20==script.at(2)              &&  // OP_PUSHDATA(20)
+            
+            (0x88==script.at(scriptSize-2)   &&  // OP_EQUALVERIFY
+            0xAC==script.at(scriptSize-1)))      // OP_CHECKSIG
+
+            ||
+// scripts appended with OP_NOP1. Since OP_NOP1 does nothing, this should still be valid.
+
+            (25==scriptSize                  &&
+                0x76==script.at(0)              &&  // OP_DUP
+                0xA9==script.at(1)              &&  // OP_HASH160
+                  20==script.at(2)              &&  // OP_PUSHDATA(20)
+                
+                (0x88==script.at(scriptSize-2)   &&  // OP_EQUALVERIFY
+                0xB0==script.at(scriptSize-1)))      // OP_NOP1
+    
+                ||
+
+            // scripts appended with OP_NOP. Since OP_NOP does nothing, this should still be valid.
+
+            (26==scriptSize                  &&
+            0x76==script.at(0)              &&  // OP_DUP
+            0xA9==script.at(1)              &&  // OP_HASH160
+              20==script.at(2)              &&  // OP_PUSHDATA(20)
+
+            
+            (0x88==script.at(scriptSize-3)   &&  // OP_EQUALVERIFY
+            0xAC==script.at(scriptSize-2)   &&  // OP_CHECKSIG
+            0x61==script.at(scriptSize-1)))     // OP_NOP
+            
+              
+        
+    ) { 
+        return SCRIPT_TYPE_P2PKH;
+    }
+
+    // Output script commonly found in block reward TX, that pays to an explicit pubKey
+    if(
+                67==scriptSize                &&  
+                65==script.at(0)            &&  // OP_PUSHDATA(65)
+                0xAC==script.at(scriptSize-1) // OP_CHECKSIG
+                
+        ) {
+        return SCRIPT_TYPE_P2PK;
+    }
+
+    // Pay to compressed pubkey script
+     if(
+        35==scriptSize                &&
+        0x21==script.at(0)            &&  // OP_PUSHDATA(33)
+        0xAC==script.at(scriptSize-1)     // OP_CHECKSIG
+    ) {
+        return SCRIPT_TYPE_P2CPK;
+    }
+
+    // Pay to witness script hash
+    if(
+        22 == scriptSize            &&
+        0x00 == script.at(0)        &&  
+        0x14 == script.at(1)        
+    ) {
+        return SCRIPT_TYPE_P2WSH;
+    }
+
+    // P2WPKH
+    if(
+        34 == scriptSize            &&
+        0x00 == script.at(0)        &&  
+        0x20 == script.at(1)        
+    ) {
+        return SCRIPT_TYPE_P2WPKH;
+    }
+
+     if(
+        23 == scriptSize                &&
+            0xA9==script.at(0)             &&  // OP_HASH160
+              20==script.at(1)             &&  // OP_PUSHDATA(20)
+            0x87==script.at(scriptSize-1)      // OP_EQUAL
+              
+        
+    ) {
+        return SCRIPT_TYPE_P2SH;
+    }
+
+    // NULLDATA
+    if(
+            scriptSize > 0        && 
+            0x6A == script.at(0)    
+        ) {
+            uint32_t pos = 1;
+            
+            bool foundOpcodes = false;
+            while(pos < script.size()) {
+                if(script.at(pos) >= 0x01 && script.at(pos) <= 0x4B) { 
+                    pos += script.at(pos) + 1;
+                } else {
+                    foundOpcodes = true;
+                    break;
+                } 
+            }
+
+        if(!foundOpcodes)
+            return SCRIPT_TYPE_NULLDATA;
+        else
+            return SCRIPT_TYPE_UNKNOWN;
+    }
+
+    if(isMultiSig(script)) {
+        return SCRIPT_TYPE_MULTISIG;
+    }
+
+    
+    if(
+        // OP_PUSHDATA(32) + data only (Found in litecoin chain - nonstandard script)
+        // Public block explorers show these as "unknown" (https://bchain.info/LTC/tx/265278e51d1b29cdce906a858251b7ce15e2dab09de7dede0acb4c629f780b91)  
+        (   33==scriptSize                  &&
+            0x20==script.at(0))
+        ||
+        // OP_PUSHDATA(36) + data only (Found in litecoin chain - nonstandard script)
+        // Public block explorers show these as "unknown" (http://explorer.litecoin.net/tx/936e8ed1cfca736320fdced61c2d03886b232497ea975e41d101f1d83bb74c44)
+        (   37==scriptSize                  &&
+            0x24==script.at(0))
+        ||
+        // OP_PUSHDATA(20) + data only. Unparseable (BTC)
+        // Public block explorers show these as "unknown" (https://blockchain.info/tx/b8fd633e7713a43d5ac87266adc78444669b987a56b3a65fb92d58c2c4b0e84d)
+        (   24==scriptSize                  &&
+            0x14==script.at(0))
+        ||
+        // Unknown (seems malformed) output script found on Litecoin in p2pool blocks
+        // For example https://bchain.info/LTC/tx/8f1220670b5d4ade8f9c6a82fde3d88a28d2e1c290f2edc6d7a7a13aa0352fc7 
+        (   6 == scriptSize                &&
+            0x73==script.at(0)             &&  // OP_IFDUP
+            0x63==script.at(1)             &&  // OP_IF
+            0x72==script.at(2)             &&  // OP_2SWAP
+            0x69==script.at(3)             &&  // OP_VERIFY
+            0x70==script.at(4)             &&  // OP_2OVER
+            0x74==script.at(5))              // OP_DEPTH)
+        ||
+        // A challenge: anyone who can find X such that 0==RIPEMD160(X) stands to earn a bunch of coins
+        (
+            scriptSize == 5 &&
+            0x76==script[0] &&                  // OP_DUP
+            0xA9==script[1] &&                  // OP_HASH160
+            0x00==script[2] &&                  // OP_0
+            0x88==script[3] &&                  // OP_EQUALVERIFY
+            0xAC==script[4])                    // OP_CHECKSIG
+    )
+    {
+        return SCRIPT_TYPE_KNOWN_NONSTANDARD;
+    }
+
+    return SCRIPT_TYPE_UNKNOWN;
+}
+
+vector<string> VtcBlockIndexerBench::Reference::getAddressesFromScript(vector<unsigned char> script) {
+    vector<string> addresses;
+
+
+    uint8_t scriptType = getScriptType(script);
+    switch(scriptType) {
+        case SCRIPT_TYPE_P2PKH:
+        {
+            addresses.push_back(VtcBlockIndexer::Utility::ripeMD160ToP2PKAddress(vector<unsigned char>(&script[3], &script[23])));
+            break;
+        }
+        case SCRIPT_TYPE_P2PK:
+        {
+            addresses.push_back(VtcBlockIndexer::Utility::publicKeyToAddress(vector<unsigned char>(&script[1], &script[66])));
+            break;
+        }
+        case SCRIPT_TYPE_P2CPK:
+        {
+            addresses.push_back(VtcBlockIndexer::Utility::publicKeyToAddress(vector<unsigned char>(&script[1], &script[34])));
+            break;
+        }
+        case SCRIPT_TYPE_P2WSH:
+        {
+            addresses.push_back(VtcBlockIndexer::Utility::bech32Address(vector<unsigned char>(&script[2], &script[22])));
+            break;
+        }
+        case SCRIPT_TYPE_P2WPKH:
+        {
+            addresses.push_back(VtcBlockIndexer::Utility::bech32Address(vector<unsigned char>(&script[2], &script[34])));
+            break;
+        }
+        case SCRIPT_TYPE_P2SH:
+        {
+            addresses.push_back(VtcBlockIndexer::Utility::ripeMD160ToP2SHAddress(vector<unsigned char>(&script[2], &script[22])));
+            break;
+        }
+        case SCRIPT_TYPE_MULTISIG:
+        {
+            uint32_t pos = 1;
+            while(pos < script.size()-2) {
+                if(script.at(pos) == 0x21) {
+                    addresses.push_back(VtcBlockIndexer::Utility::publicKeyToAddress(vector<unsigned char>(&script[pos+1], &script[pos+34]))); 
+                    pos += 34;
+                }
+                else if(script.at(pos) == 0x41) {
+                    addresses.push_back(VtcBlockIndexer::Utility::publicKeyToAddress(vector<unsigned char>(&script[pos+1], &script[pos+66])));
+                    pos += 66;
+                }
+                else pos = script.size();
+            }
+            break;
+        }
+        case SCRIPT_TYPE_NULLDATA:
+        {
+            // Ignore nulldata entries.
+            break;
+        }
+        case SCRIPT_TYPE_KNOWN_NONSTANDARD:
+        {
+            // Known non-standard format that we can safely ignore
+            break;            
+        }
+        case SCRIPT_TYPE_UNKNOWN:
+        default:
+        {
+            // The logging of unrecognized scripts is left out
+            break;
+        }
+    }
+
+    return addresses;
+}
+
+bool VtcBlockIndexerBench::Reference::isMultiSig(vector<unsigned char> script) {
+    if(script.size() == 0) return false;
+    return (script.at(script.size()-1) == 0xAE);
+}
+
+std::string VtcBlockIndexerBench::Reference::hashToHex(vector<unsigned char> hash) {
+    stringstream ss;
+    for(uint i = 0; i < hash.size(); i++)
+    {
+        ss << hex << setw(2) << setfill('0') << (int)hash.at(i);
+    }
+    return ss.str();
+}
+
+std::string VtcBlockIndexerBench::Reference::hashToReverseHex(vector<unsigned char> hash) {
+    if(hash.size() == 0) return "";
+    stringstream ss;
+    for(uint i = hash.size(); i-- > 0;)
+    {
+        ss << hex << setw(2) << setfill('0') << (int)hash.at(i);
+    }
+    return ss.str();
+}
+
+vector<unsigned char> VtcBlockIndexerBench::Reference::hexToBytes(const std::string hex) {
+    vector<unsigned char> bytes;
+
+    for (unsigned int i = 0; i < hex.length(); i += 2) {
+      string byteString = hex.substr(i, 2);
+      unsigned char byte = (unsigned char) strtol(byteString.c_str(), NULL, 16);
+      bytes.push_back(byte);
+    }
+
+    return bytes;
+}
+
+std::string VtcBlockIndexerBench::Reference::base58(vector<unsigned char> in)
+{
+    unsigned char* pbegin = &in[0];
+    unsigned char* pend = &in[0] + in.size();
+
+    // Skip & count leading zeroes.
+    int zeroes = 0;
+    int length = 0;
+    while (pbegin != pend && *pbegin == 0) {
+        pbegin++;
+        zeroes++;
+    }
+
+    // Allocate enough space in big-endian base58 representation.
+    int size = (in.size()-zeroes) * 138 / 100 + 1; // log(256) / log(58), rounded up.
+
+    std::vector<unsigned char> b58(size);
+    // Process the bytes.
+    while (pbegin != pend) {
+        int carry = *pbegin;
+        int i = 0;
+        // Apply "b58 = b58 * 256 + ch".
+        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
+            carry += 256 * (*it);
+            *it = carry % 58;
+            carry /= 58;
+        }
+
+        assert(carry == 0);
+        length = i;
+        pbegin++;
+    }
+    // Skip leading zeroes in base58 result.
+    std::vector<unsigned char>::iterator it = b58.begin() + (size - length);
+    while (it != b58.end() && *it == 0)
+        it++;
+    // Translate the result into a string.
+    std::string str;
+    str.reserve(zeroes + (b58.end() - it));
+    str.assign(zeroes, '1');
+    while (it != b58.end())
+        str += pszBase58[*(it++)];
+    return str;
+}
+
+string VtcBlockIndexerBench::Reference::ripeMD160ToP2PKAddress(vector<unsigned char> ripeMD) {
+    ripeMD.insert(ripeMD.begin(), VtcBlockIndexer::CoinParams::p2pkhVersion);
+    vector<unsigned char> doubleHashedRipeMD = sha256(sha256(ripeMD));
+    for(int i = 0; i < 4; i++) {
+        ripeMD.push_back(doubleHashedRipeMD.at(i));
+    }
+
+    return base58(ripeMD);
+}
+
+string VtcBlockIndexerBench::Reference::bech32Address(vector<unsigned char> in) {
+    vector<unsigned char> enc;
+    enc.push_back(0); // witness version
+    if(convertbits<8, 5, true>(enc, in)) {
+        return bech32::Encode(VtcBlockIndexer::CoinParams::bech32Prefix, enc);
+    }
+    else{
+        return "";
+    }
+}
@@ -0,0 +1,65 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef REFERENCE_H_INCLUDED
+#define REFERENCE_H_INCLUDED
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Earlier implementations of functions that were rewritten for speed, so the
+ * benchmarks can compare the current code against them.
+ */
+
+namespace VtcBlockIndexerBench {
+namespace Reference {
+    /** ScriptSolver::getScriptType as a chain of conditionals over a copy of the script */
+    uint8_t getScriptType(vector<unsigned char> script);
+
+    /** ScriptSolver::getAddressesFromScript, copying the script and its payload */
+    vector<string> getAddressesFromScript(vector<unsigned char> script);
+
+    /** ScriptSolver::isMultiSig over a copy of the script */
+    bool isMultiSig(vector<unsigned char> script);
+
+    /** Utility::hashToHex and hashToReverseHex, formatting through a stringstream */
+    string hashToHex(vector<unsigned char> hash);
+    string hashToReverseHex(vector<unsigned char> hash);
+
+    /** Utility::hexToBytes, parsing a substring for every byte */
+    vector<unsigned char> hexToBytes(const string hex);
+
+    /** Utility::base58 on a vector of digits */
+    string base58(vector<unsigned char> in);
+
+    /** Utility::ripeMD160ToP2PKAddress, hashing the checksum with OpenSSL */
+    string ripeMD160ToP2PKAddress(vector<unsigned char> ripeMD);
+
+    /** Utility::bech32Address, converting to 5-bit groups before encoding */
+    string bech32Address(vector<unsigned char> in);
+}
+}
+
+#endif // REFERENCE_H_INCLUDED
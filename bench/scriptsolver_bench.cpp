@@ -0,0 +1,108 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <vector>
+
+#include "bench.h"
+#include "reference.h"
+#include "scriptsolver.h"
+
+using namespace std;
+using namespace VtcBlockIndexerBench;
+
+namespace {
+    vector<unsigned char> filled(vector<unsigned char> prefix, size_t payload, unsigned char seed, vector<unsigned char> suffix) {
+        for(size_t i = 0; i < payload; i++) {
+            prefix.push_back((unsigned char)(seed + i * 7));
+        }
+        prefix.insert(prefix.end(), suffix.begin(), suffix.end());
+        return prefix;
+    }
+
+    /** Output scripts roughly in the proportions they appear on chain */
+    vector<vector<unsigned char>> scriptMix() {
+        vector<vector<unsigned char>> scripts;
+        for(unsigned char seed = 0; seed < 8; seed++) {
+            scripts.push_back(filled({ 0x76, 0xA9, 0x14 }, 20, seed, { 0x88, 0xAC }));   // P2PKH
+            scripts.push_back(filled({ 0x76, 0xA9, 0x14 }, 20, seed + 1, { 0x88, 0xAC }));
+            scripts.push_back(filled({ 0x76, 0xA9, 0x14 }, 20, seed + 2, { 0x88, 0xAC }));
+            scripts.push_back(filled({ 0xA9, 0x14 }, 20, seed, { 0x87 }));               // P2SH
+            scripts.push_back(filled({ 0x00, 0x14 }, 20, seed, {}));                     // P2WPKH
+            scripts.push_back(filled({ 0x00, 0x14 }, 20, seed + 3, {}));
+            scripts.push_back(filled({ 0x00, 0x20 }, 32, seed, {}));                     // P2WSH
+        }
+        scripts.push_back(filled({ 0x6A, 0x14 }, 20, 9, {}));                            // OP_RETURN
+        scripts.push_back(filled({ 0x41, 0x04 }, 64, 9, { 0xAC }));                      // P2PK
+        vector<unsigned char> multiSig = filled({ 0x51, 0x21, 0x02 }, 32, 1, { 0x21, 0x03 });
+        multiSig = filled(multiSig, 32, 2, { 0x52, 0xAE });                              // 1-of-2
+        scripts.push_back(multiSig);
+        return scripts;
+    }
+
+    const vector<vector<unsigned char>>& scripts() {
+        static const vector<vector<unsigned char>> mix = scriptMix();
+        return mix;
+    }
+
+    /** Turns the address cache off, so address extraction does the encoding every time */
+    bool withoutAddressCache() {
+        setenv("ADDRESS_CACHE_SIZE", "0", 1);
+        return true;
+    }
+
+    const bool addressCacheDisabled = withoutAddressCache();
+}
+
+BENCHMARK(ScriptTypeReference) {
+    for(size_t i = 0; i < iterations; i++) {
+        for(const vector<unsigned char>& script : scripts()) {
+            doNotOptimize(Reference::getScriptType(script));
+        }
+    }
+}
+
+BENCHMARK(ScriptTypeClassify) {
+    VtcBlockIndexer::ScriptSolver solver;
+    for(size_t i = 0; i < iterations; i++) {
+        for(const vector<unsigned char>& script : scripts()) {
+            doNotOptimize(solver.classify(script.data(), script.size()).type);
+        }
+    }
+}
+
+BENCHMARK(ScriptAddressesReference) {
+    for(size_t i = 0; i < iterations; i++) {
+        for(const vector<unsigned char>& script : scripts()) {
+            doNotOptimize(Reference::getAddressesFromScript(script).size());
+        }
+    }
+}
+
+BENCHMARK(ScriptAddressesClassify) {
+    VtcBlockIndexer::ScriptSolver solver;
+    for(size_t i = 0; i < iterations; i++) {
+        for(const vector<unsigned char>& script : scripts()) {
+            VtcBlockIndexer::ScriptClassification classification = solver.classify(script.data(), script.size());
+            doNotOptimize(solver.getAddressesFromScript(script.data(), script.size(), classification).size());
+        }
+    }
+}
+
+BENCHMARK_MAIN()
@@ -0,0 +1,113 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "reference.h"
+#include "utility.h"
+#include "coinparams.h"
+
+using namespace std;
+using namespace VtcBlockIndexerBench;
+
+namespace {
+    vector<unsigned char> bytes(size_t length, unsigned char seed) {
+        vector<unsigned char> result;
+        for(size_t i = 0; i < length; i++) {
+            result.push_back((unsigned char)(seed + i * 37));
+        }
+        return result;
+    }
+
+    /** Sets the Vertcoin address parameters instead of reading them from a coin file */
+    bool withCoinParams() {
+        VtcBlockIndexer::CoinParams::bech32Prefix = "vtc";
+        VtcBlockIndexer::CoinParams::p2pkhVersion = 71;
+        VtcBlockIndexer::CoinParams::p2shVersion = 5;
+        return true;
+    }
+
+    const bool coinParamsSet = withCoinParams();
+
+    const vector<unsigned char> blockHash = bytes(32, 3);
+    const vector<unsigned char> ripeMD = bytes(20, 5);
+    const string blockHashHex = VtcBlockIndexer::Utility::hashToHex(blockHash);
+}
+
+BENCHMARK(ReverseHashHexReference) {
+    for(size_t i = 0; i < iterations; i++) {
+        doNotOptimize(Reference::hashToReverseHex(blockHash).size());
+    }
+}
+
+BENCHMARK(ReverseHashHex) {
+    for(size_t i = 0; i < iterations; i++) {
+        doNotOptimize(VtcBlockIndexer::Utility::hashToReverseHex(blockHash).size());
+    }
+}
+
+BENCHMARK(HexDecodeReference) {
+    for(size_t i = 0; i < iterations; i++) {
+        doNotOptimize(Reference::hexToBytes(blockHashHex).size());
+    }
+}
+
+BENCHMARK(HexDecode) {
+    for(size_t i = 0; i < iterations; i++) {
+        doNotOptimize(VtcBlockIndexer::Utility::hexToBytes(blockHashHex).size());
+    }
+}
+
+BENCHMARK(P2PKHAddressReference) {
+    for(size_t i = 0; i < iterations; i++) {
+        doNotOptimize(Reference::ripeMD160ToP2PKAddress(ripeMD).size());
+    }
+}
+
+BENCHMARK(P2PKHAddress) {
+    for(size_t i = 0; i < iterations; i++) {
+        doNotOptimize(VtcBlockIndexer::Utility::ripeMD160ToP2PKAddress(ripeMD).size());
+    }
+}
+
+BENCHMARK(Bech32AddressReference) {
+    for(size_t i = 0; i < iterations; i++) {
+        doNotOptimize(Reference::bech32Address(ripeMD).size());
+    }
+}
+
+BENCHMARK(Bech32Address) {
+    for(size_t i = 0; i < iterations; i++) {
+        doNotOptimize(VtcBlockIndexer::Utility::bech32Address(ripeMD).size());
+    }
+}
+
+int main(int argc, char** argv) {
+    // The encoders must agree before their timings mean anything
+    if(Reference::hashToReverseHex(blockHash) != VtcBlockIndexer::Utility::hashToReverseHex(blockHash) ||
+       Reference::hexToBytes(blockHashHex) != VtcBlockIndexer::Utility::hexToBytes(blockHashHex) ||
+       Reference::ripeMD160ToP2PKAddress(ripeMD) != VtcBlockIndexer::Utility::ripeMD160ToP2PKAddress(ripeMD) ||
+       Reference::bech32Address(ripeMD) != VtcBlockIndexer::Utility::bech32Address(ripeMD)) {
+        cerr << "The encoders produce different output than their reference" << endl;
+        return 1;
+    }
+    return runBenchmarks(argc, argv);
+}
@@ -22,10 +22,13 @@ var sortIncidents = function(incidentA, incidentB) {
     return ((incidentA < incidentB) ? -1 : ((incidentA > incidentB) ? 1 : 0));
 }
 
+// Load a static dump by default, or the indexer's /doublespends endpoint given as ?source=
+var source = new URLSearchParams(window.location.search).get("source") || "doublespends.json";
+
 $(document).ready(() => {
     $.ajax({
         dataType: "json",
-        url: "doublespends.json",
+        url: source,
         success: (events) => {
             $('#numSpends').text(events.length);
             events.sort(sortIncidents);
@@ -0,0 +1,86 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "addresscache.h"
+#include "metrics.h"
+#include <stdlib.h>
+
+using namespace std;
+
+VtcBlockIndexer::AddressCache::AddressCache() {
+    const char* size = getenv("ADDRESS_CACHE_SIZE");
+    const size_t entries = (size != NULL && size[0] != 0) ? strtoull(size, NULL, 10) : 250000;
+    // Round up, so a size below the shard count still caches
+    this->entriesPerShard = (entries + SHARD_COUNT - 1) / SHARD_COUNT;
+}
+
+VtcBlockIndexer::AddressCache& VtcBlockIndexer::AddressCache::instance() {
+    static AddressCache cache;
+    return cache;
+}
+
+string VtcBlockIndexer::AddressCache::get(uint8_t scriptType, const unsigned char* payload, size_t payloadLength, const function<string()>& encode) {
+    static VtcBlockIndexer::MetricCounter& hits = VtcBlockIndexer::Metrics::counter("address_cache_hits_total", "Addresses found in the address cache");
+    static VtcBlockIndexer::MetricCounter& misses = VtcBlockIndexer::Metrics::counter("address_cache_misses_total", "Addresses that had to be encoded");
+
+    AddressCache& cache = instance();
+    if(cache.entriesPerShard == 0) {
+        misses.increment();
+        return encode();
+    }
+
+    string key;
+    key.reserve(payloadLength + 1);
+    key.push_back((char)scriptType);
+    key.append((const char*)payload, payloadLength);
+
+    Shard& shard = cache.shards[hash<string>()(key) % SHARD_COUNT];
+    {
+        lock_guard<mutex> lock(shard.lock);
+        auto it = shard.current.find(key);
+        if(it != shard.current.end()) {
+            hits.increment();
+            return it->second;
+        }
+        it = shard.previous.find(key);
+        if(it != shard.previous.end()) {
+            hits.increment();
+            string address = it->second;
+            shard.previous.erase(it);
+            if(shard.current.size() >= cache.entriesPerShard) {
+                shard.previous.swap(shard.current);
+                shard.current.clear();
+            }
+            shard.current.emplace(move(key), address);
+            return address;
+        }
+    }
+
+    // Encode outside the lock, a concurrent miss on the same key just does the work twice
+    misses.increment();
+    string address = encode();
+
+    lock_guard<mutex> lock(shard.lock);
+    if(shard.current.size() >= cache.entriesPerShard) {
+        shard.previous.swap(shard.current);
+        shard.current.clear();
+    }
+    shard.current.emplace(move(key), address);
+    return address;
+}
@@ -0,0 +1,77 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ADDRESSCACHE_H_INCLUDED
+#define ADDRESSCACHE_H_INCLUDED
+
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+/**
+ * The AddressCache class remembers the encoded address for recently seen
+ * script payloads (a hash or public key, with the script type), so outputs
+ * paying the same address again skip the hashing and base58 or bech32
+ * encoding. It is shared by everything in the process that turns scripts
+ * into addresses.
+ *
+ * Entries are spread over shards, each with its own lock. A shard holds two
+ * generations of entries: when the current one is full, it replaces the
+ * previous one, and entries found in the previous one move back to the
+ * current one. Addresses that keep coming back stay cached, and the cache
+ * never holds more than twice its configured size.
+ *
+ * ADDRESS_CACHE_SIZE sets the number of addresses per generation (default
+ * 250000), rounded up to a multiple of the shard count. 0 disables the cache.
+ */
+
+class AddressCache {
+public:
+    /** Returns the address for a payload, calling encode to produce it when
+     * it is not cached
+     */
+    static string get(uint8_t scriptType, const unsigned char* payload, size_t payloadLength, const function<string()>& encode);
+
+private:
+    struct Shard {
+        mutex lock;
+        unordered_map<string, string> current;
+        unordered_map<string, string> previous;
+    };
+
+    static const size_t SHARD_COUNT = 16;
+
+    AddressCache();
+    static AddressCache& instance();
+
+    Shard shards[SHARD_COUNT];
+    size_t entriesPerShard;
+};
+
+}
+
+#endif // ADDRESSCACHE_H_INCLUDED
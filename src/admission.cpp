@@ -0,0 +1,140 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "admission.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+    // Shards holding more buckets than this get their idle buckets evicted
+    const size_t MAX_BUCKETS_PER_SHARD = 4096;
+
+    double envDouble(const char* name, double defaultValue) {
+        const char* value = getenv(name);
+        if(value == NULL || value[0] == 0) return defaultValue;
+        return atof(value);
+    }
+}
+
+VtcBlockIndexer::RequestBudget::RequestBudget(const RequestLimits& limits) {
+    this->limits = limits;
+    this->scannedKeys = 0;
+    this->rpcCalls = 0;
+    this->deadline = chrono::steady_clock::now() + limits.deadline;
+}
+
+bool VtcBlockIndexer::RequestBudget::exhausted() const {
+    if(scannedKeys >= limits.maxScannedKeys || rpcCalls >= limits.maxRpcCalls) {
+        return true;
+    }
+    return chrono::steady_clock::now() >= deadline;
+}
+
+double VtcBlockIndexer::RequestBudget::cost() const {
+    // A thousand scanned keys or ten coind calls weigh as much as a request
+    return scannedKeys / 1000.0 + rpcCalls / 10.0;
+}
+
+VtcBlockIndexer::AdmissionControl::AdmissionControl() {
+    this->ratePerSecond = envDouble("HTTP_RATE_LIMIT", 20);
+    this->burst = max(1.0, envDouble("HTTP_RATE_BURST", 40));
+    this->requestLimits.maxScannedKeys = (uint64_t)envDouble("HTTP_MAX_SCAN_KEYS", 100000);
+    this->requestLimits.maxRpcCalls = (uint64_t)envDouble("HTTP_MAX_RPC_CALLS", 200);
+    this->requestLimits.deadline = chrono::milliseconds((int64_t)envDouble("HTTP_REQUEST_DEADLINE_MS", 10000));
+
+    const char* keys = getenv("HTTP_API_KEYS");
+    if(keys != NULL) {
+        stringstream keyStream(keys);
+        string key;
+        while(getline(keyStream, key, ',')) {
+            if(key.size() > 0) apiKeys.insert(key);
+        }
+    }
+}
+
+string VtcBlockIndexer::AdmissionControl::clientFor(const string& apiKey, const string& origin) {
+    // Unknown keys are ignored, otherwise a client could escape its limit by
+    // sending a different key with every request
+    if(apiKey.size() > 0 && apiKeys.find(apiKey) != apiKeys.end()) {
+        return "key:" + apiKey;
+    }
+
+    // Origin is address:port, the port changes with every connection
+    size_t portSeparator = origin.rfind(':');
+    if(portSeparator == string::npos) return origin;
+    return origin.substr(0, portSeparator);
+}
+
+VtcBlockIndexer::AdmissionControl::TokenBucket& VtcBlockIndexer::AdmissionControl::refill(Shard& shard, const string& client) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    auto it = shard.buckets.find(client);
+    if(it == shard.buckets.end()) {
+        if(shard.buckets.size() >= MAX_BUCKETS_PER_SHARD) {
+            evictIdle(shard);
+        }
+        TokenBucket bucket;
+        bucket.tokens = burst;
+        bucket.updated = now;
+        return shard.buckets.emplace(client, bucket).first->second;
+    }
+
+    TokenBucket& bucket = it->second;
+    double elapsed = chrono::duration<double>(now - bucket.updated).count();
+    bucket.tokens = min(burst, bucket.tokens + elapsed * ratePerSecond);
+    bucket.updated = now;
+    return bucket;
+}
+
+void VtcBlockIndexer::AdmissionControl::evictIdle(Shard& shard) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    for(auto it = shard.buckets.begin(); it != shard.buckets.end(); ) {
+        double elapsed = chrono::duration<double>(now - it->second.updated).count();
+        if(it->second.tokens + elapsed * ratePerSecond >= burst) {
+            it = shard.buckets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool VtcBlockIndexer::AdmissionControl::admit(const string& client) {
+    if(ratePerSecond <= 0) return true;
+
+    Shard& shard = shards[hash<string>()(client) % SHARD_COUNT];
+    lock_guard<mutex> lock(shard.lock);
+    TokenBucket& bucket = refill(shard, client);
+    if(bucket.tokens < 1) return false;
+    bucket.tokens -= 1;
+    return true;
+}
+
+void VtcBlockIndexer::AdmissionControl::charge(const string& client, double tokens) {
+    if(ratePerSecond <= 0 || tokens <= 0) return;
+
+    Shard& shard = shards[hash<string>()(client) % SHARD_COUNT];
+    lock_guard<mutex> lock(shard.lock);
+    TokenBucket& bucket = refill(shard, client);
+    // Bound the debt so a single huge request does not lock a client out for long
+    bucket.tokens = max(-burst, bucket.tokens - tokens);
+}
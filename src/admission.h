@@ -0,0 +1,143 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ADMISSION_H_INCLUDED
+#define ADMISSION_H_INCLUDED
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+/** Per-request limits on the work a single request may do */
+struct RequestLimits {
+    // Index keys a scan may visit before the request is cut short
+    uint64_t maxScannedKeys;
+
+    // Calls to coind a request may make
+    uint64_t maxRpcCalls;
+
+    // Wall-clock time a request may take
+    chrono::milliseconds deadline;
+};
+
+/**
+ * The RequestBudget class tracks the work done by one request against its
+ * limits. Long scans check exhausted() before each step and, when it returns
+ * true, stop and hand the client a cursor to continue from. The check is done
+ * between steps, so a step that is already running may overshoot the limits
+ * slightly.
+ */
+
+class RequestBudget {
+public:
+    RequestBudget(const RequestLimits& limits);
+
+    /** Records a visited index key */
+    void chargeKey() { scannedKeys++; }
+
+    /** Records a call to coind */
+    void chargeRpc() { rpcCalls++; }
+
+    /** Returns true when any of the limits was reached */
+    bool exhausted() const;
+
+    /** Returns the cost of the work done, in rate limiter tokens */
+    double cost() const;
+
+private:
+    RequestLimits limits;
+    uint64_t scannedKeys;
+    uint64_t rpcCalls;
+    chrono::steady_clock::time_point deadline;
+};
+
+/**
+ * The AdmissionControl class decides whether a client may start a request.
+ * Every client has a token bucket: each request takes one token, and requests
+ * that did a lot of work are charged extra afterwards. Clients are identified
+ * by their API key (X-Api-Key header) when it is one of the configured keys,
+ * and by their IP address otherwise. Buckets are spread over shards so
+ * concurrent requests from different clients rarely share a lock.
+ *
+ * Configured from the environment:
+ *   HTTP_RATE_LIMIT           tokens per second per client, 0 disables (default 20)
+ *   HTTP_RATE_BURST           bucket size (default 40)
+ *   HTTP_API_KEYS             comma separated list of accepted API keys
+ *   HTTP_MAX_SCAN_KEYS        index keys per request (default 100000)
+ *   HTTP_MAX_RPC_CALLS        coind calls per request (default 200)
+ *   HTTP_REQUEST_DEADLINE_MS  wall-clock time per request (default 10000)
+ */
+
+class AdmissionControl {
+public:
+    AdmissionControl();
+
+    /** Returns the client identity for the given API key header and origin */
+    string clientFor(const string& apiKey, const string& origin);
+
+    /** Takes one token from the client's bucket. Returns false when the
+     * client should be turned away.
+     */
+    bool admit(const string& client);
+
+    /** Takes additional tokens for expensive requests. The bucket may go
+     * negative, which delays the client's next requests.
+     */
+    void charge(const string& client, double tokens);
+
+    /** Returns the per-request limits */
+    const RequestLimits& limits() const { return requestLimits; }
+
+private:
+    struct TokenBucket {
+        double tokens;
+        chrono::steady_clock::time_point updated;
+    };
+
+    struct Shard {
+        mutex lock;
+        unordered_map<string, TokenBucket> buckets;
+    };
+
+    static const size_t SHARD_COUNT = 16;
+
+    /** Returns the bucket for the client, refilled up to now. Caller holds the shard lock. */
+    TokenBucket& refill(Shard& shard, const string& client);
+
+    /** Removes buckets that have refilled completely. Caller holds the shard lock. */
+    void evictIdle(Shard& shard);
+
+    Shard shards[SHARD_COUNT];
+    double ratePerSecond;
+    double burst;
+    unordered_set<string> apiKeys;
+    RequestLimits requestLimits;
+};
+
+}
+
+#endif // ADMISSION_H_INCLUDED
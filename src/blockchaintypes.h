@@ -43,6 +43,9 @@ struct ScannedBlock {
     // The hash of the previous block used to form the chain. This string is the the "reverse hash" used on block explorers
     string previousBlockHash; 
 
+    // The time in the block header
+    uint32_t time;
+
     // The block is part of the main chain
     bool mainChain;
 };
@@ -155,26 +158,31 @@ struct Block {
 };
 
 
+// The structures used while analyzing double spends point into the blocks being
+// analyzed, which outlive them.
 struct PotentialDoubleSpend {
-    Transaction tx;
-    Block block;
+    const Transaction* tx;
+    const Block* block;
+
+    // The input spending the outpoint
+    const TransactionInput* input;
 };
 
 struct DoubleSpentOutpoint {
     std::string outpoint;
-    Transaction alsoSpentInTx;
-    Block alsoSpentInBlock;
+    const Transaction* alsoSpentInTx;
+    const Block* alsoSpentInBlock;
 };
 
 struct DoubleSpend {
-    Transaction tx;
-    Block block;
+    const Transaction* tx;
+    const Block* block;
     vector<DoubleSpentOutpoint> outpoints;
 };
 
 struct DoubleSpentCoinBase {
-    Transaction tx;
-    Block block;
+    const Transaction* tx;
+    const Block* block;
     vector<string> outpoints;
 };
 
@@ -0,0 +1,245 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the 
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+    
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "blockfile.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    const size_t OBFUSCATION_KEY_SIZE = 8;
+
+    // The key of the blocks directory, all zero when the files are not obfuscated
+    unsigned char obfuscationKey[OBFUSCATION_KEY_SIZE] = { 0 };
+    bool obfuscated = false;
+
+    // Large enough to hold many small blocks, so scanning them seeks within it
+    const size_t BUFFER_SIZE = 64 * 1024;
+}
+
+VtcBlockIndexer::BlockFileBuffer::BlockFileBuffer() : fd(-1), bufferPosition(0), buffer(BUFFER_SIZE) {
+    setg(buffer.data(), buffer.data(), buffer.data());
+}
+
+VtcBlockIndexer::BlockFileBuffer::~BlockFileBuffer() {
+    close();
+}
+
+bool VtcBlockIndexer::BlockFileBuffer::open(const string& path) {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    return fd >= 0;
+}
+
+bool VtcBlockIndexer::BlockFileBuffer::is_open() const {
+    return fd >= 0;
+}
+
+void VtcBlockIndexer::BlockFileBuffer::close() {
+    if(fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    bufferPosition = 0;
+    setg(buffer.data(), buffer.data(), buffer.data());
+}
+
+size_t VtcBlockIndexer::BlockFileBuffer::readAt(char* out, size_t length, uint64_t position) {
+    size_t total = 0;
+    while(fd >= 0 && total < length) {
+        ssize_t bytesRead = pread(fd, out + total, length - total, position + total);
+        if(bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if(bytesRead <= 0) {
+            break;
+        }
+        total += bytesRead;
+    }
+    VtcBlockIndexer::BlockFile::deobfuscate(reinterpret_cast<unsigned char*>(out), total, position);
+    return total;
+}
+
+VtcBlockIndexer::BlockFileBuffer::int_type VtcBlockIndexer::BlockFileBuffer::underflow() {
+    if(gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    bufferPosition += egptr() - eback();
+    size_t bytesRead = readAt(buffer.data(), buffer.size(), bufferPosition);
+    setg(buffer.data(), buffer.data(), buffer.data() + bytesRead);
+    if(bytesRead == 0) {
+        return traits_type::eof();
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+streamsize VtcBlockIndexer::BlockFileBuffer::xsgetn(char* out, streamsize length) {
+    streamsize done = min(length, (streamsize)(egptr() - gptr()));
+    memcpy(out, gptr(), done);
+    gbump(done);
+
+    if(length - done >= (streamsize)buffer.size()) {
+        // Too large for the buffer, read it in place
+        const uint64_t position = bufferPosition + (gptr() - eback());
+        const size_t bytesRead = readAt(out + done, length - done, position);
+        bufferPosition = position + bytesRead;
+        setg(buffer.data(), buffer.data(), buffer.data());
+        return done + bytesRead;
+    }
+
+    while(done < length && underflow() != traits_type::eof()) {
+        streamsize chunk = min(length - done, (streamsize)(egptr() - gptr()));
+        memcpy(out + done, gptr(), chunk);
+        gbump(chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+VtcBlockIndexer::BlockFileBuffer::pos_type VtcBlockIndexer::BlockFileBuffer::seekoff(off_type offset, ios_base::seekdir direction, ios_base::openmode) {
+    const uint64_t current = bufferPosition + (gptr() - eback());
+    int64_t target = offset;
+    if(direction == ios_base::cur) {
+        target += current;
+    } else if(direction == ios_base::end) {
+        struct stat result;
+        if(fd < 0 || fstat(fd, &result) != 0) {
+            return pos_type(off_type(-1));
+        }
+        target += result.st_size;
+    }
+    if(fd < 0 || target < 0) {
+        return pos_type(off_type(-1));
+    }
+
+    // Stay in the buffer when the target is in it, scanning small blocks seeks
+    // a short distance ahead all the time
+    if((uint64_t)target >= bufferPosition && (uint64_t)target <= bufferPosition + (egptr() - eback())) {
+        setg(eback(), eback() + (target - bufferPosition), egptr());
+    } else {
+        bufferPosition = target;
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+    return pos_type(target);
+}
+
+VtcBlockIndexer::BlockFileBuffer::pos_type VtcBlockIndexer::BlockFileBuffer::seekpos(pos_type position, ios_base::openmode which) {
+    return seekoff(off_type(position), ios_base::beg, which);
+}
+
+VtcBlockIndexer::BlockFile::BlockFile() : istream(nullptr) {
+    rdbuf(&buffer);
+}
+
+VtcBlockIndexer::BlockFile::BlockFile(const string& path) : istream(nullptr) {
+    rdbuf(&buffer);
+    open(path);
+}
+
+void VtcBlockIndexer::BlockFile::open(const string& path) {
+    if(buffer.open(path)) {
+        clear();
+    } else {
+        setstate(ios_base::failbit);
+    }
+}
+
+bool VtcBlockIndexer::BlockFile::is_open() const {
+    return buffer.is_open();
+}
+
+void VtcBlockIndexer::BlockFile::close() {
+    buffer.close();
+}
+
+bool VtcBlockIndexer::BlockFile::readObfuscationKey(const string& blocksDir) {
+    ifstream keyFile(blocksDir + "/xor.dat", ios_base::in | ios_base::binary);
+    if(!keyFile.is_open()) {
+        return false;
+    }
+    vector<unsigned char> key((istreambuf_iterator<char>(keyFile)), istreambuf_iterator<char>());
+
+    // The key is stored as is, or with a length in front of it
+    if(key.size() == OBFUSCATION_KEY_SIZE + 1 && key[0] == OBFUSCATION_KEY_SIZE) {
+        key.erase(key.begin());
+    }
+    if(key.size() != OBFUSCATION_KEY_SIZE) {
+        cerr << "Obfuscation key [" << blocksDir << "/xor.dat] has an unexpected size of " << key.size() << " bytes" << endl;
+        exit(0);
+    }
+
+    memcpy(obfuscationKey, key.data(), OBFUSCATION_KEY_SIZE);
+    obfuscated = false;
+    for(size_t i = 0; i < OBFUSCATION_KEY_SIZE; i++) {
+        obfuscated = obfuscated || obfuscationKey[i] != 0;
+    }
+    return obfuscated;
+}
+
+void VtcBlockIndexer::BlockFile::deobfuscate(unsigned char* data, size_t length, uint64_t position) {
+    if(!obfuscated) {
+        return;
+    }
+
+    // The key lined up with the data, repeated to fill 16 bytes
+    unsigned char key[16];
+    for(size_t i = 0; i < sizeof(key); i++) {
+        key[i] = obfuscationKey[(position + i) % OBFUSCATION_KEY_SIZE];
+    }
+
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i keyVector = _mm_loadu_si128((const __m128i*)key);
+    for(; i + 64 <= length; i += 64) {
+        __m128i* block = (__m128i*)(data + i);
+        _mm_storeu_si128(block, _mm_xor_si128(_mm_loadu_si128(block), keyVector));
+        _mm_storeu_si128(block + 1, _mm_xor_si128(_mm_loadu_si128(block + 1), keyVector));
+        _mm_storeu_si128(block + 2, _mm_xor_si128(_mm_loadu_si128(block + 2), keyVector));
+        _mm_storeu_si128(block + 3, _mm_xor_si128(_mm_loadu_si128(block + 3), keyVector));
+    }
+    for(; i + 16 <= length; i += 16) {
+        __m128i* block = (__m128i*)(data + i);
+        _mm_storeu_si128(block, _mm_xor_si128(_mm_loadu_si128(block), keyVector));
+    }
+#else
+    uint64_t keyWord;
+    memcpy(&keyWord, key, sizeof(keyWord));
+    for(; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        word ^= keyWord;
+        memcpy(data + i, &word, sizeof(word));
+    }
+#endif
+    for(; i < length; i++) {
+        data[i] ^= key[i % OBFUSCATION_KEY_SIZE];
+    }
+}
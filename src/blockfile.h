@@ -0,0 +1,111 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the 
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+    
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BLOCKFILE_H_INCLUDED
+#define BLOCKFILE_H_INCLUDED
+
+#include <stdint.h>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace VtcBlockIndexer {
+
+/**
+ * Stream buffer over a blk????.dat or rev????.dat file that undoes the
+ * obfuscation of the file while reading. Reads are buffered, and reads larger
+ * than the buffer go straight to the destination.
+ */
+class BlockFileBuffer : public std::streambuf {
+public:
+    BlockFileBuffer();
+    ~BlockFileBuffer();
+
+    /** Opens the file, returns false if it could not be opened */
+    bool open(const std::string& path);
+
+    bool is_open() const;
+
+    void close();
+
+protected:
+    int_type underflow();
+    std::streamsize xsgetn(char* out, std::streamsize length);
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which);
+    pos_type seekpos(pos_type position, std::ios_base::openmode which);
+
+private:
+    BlockFileBuffer(const BlockFileBuffer&);
+    BlockFileBuffer& operator=(const BlockFileBuffer&);
+
+    /** Reads up to length bytes from the position in the file and removes the
+     * obfuscation. Returns the number of bytes read.
+     */
+    size_t readAt(char* out, size_t length, uint64_t position);
+
+    int fd;
+
+    // Position in the file of the first byte in the buffer
+    uint64_t bufferPosition;
+
+    std::vector<char> buffer;
+};
+
+/**
+ * The BlockFile class is an input stream over a block or undo file, used in
+ * place of an ifstream. Vertcoin Core 28 and later obfuscate these files by
+ * XORing each byte with a byte of the key in blocks/xor.dat, picked by the
+ * position of the byte in the file. Once the key is read, every BlockFile
+ * removes the obfuscation, so positions in the files stay the same.
+ */
+class BlockFile : public std::istream {
+public:
+    BlockFile();
+
+    /** Constructs a BlockFile and opens the file at the path */
+    BlockFile(const std::string& path);
+
+    /** Opens the file, sets the failbit if it could not be opened */
+    void open(const std::string& path);
+
+    bool is_open() const;
+
+    void close();
+
+    /** Reads the obfuscation key from xor.dat in the blocks directory. Returns
+     * true when the block files are obfuscated. Not thread safe, call it before
+     * any block file is read.
+     */
+    static bool readObfuscationKey(const std::string& blocksDir);
+
+    /** Removes the obfuscation from data that was read from the position in
+     * a block file. Does nothing when the files are not obfuscated.
+     */
+    static void deobfuscate(unsigned char* data, size_t length, uint64_t position);
+
+private:
+    BlockFileBuffer buffer;
+};
+
+}
+
+#endif // BLOCKFILE_H_INCLUDED
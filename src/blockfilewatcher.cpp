@@ -20,6 +20,8 @@
 #include "blockfilewatcher.h"
 #include "scriptsolver.h"
 #include "blockchaintypes.h"
+#include "utility.h"
+#include "metrics.h"
 #include <iostream>
 #include <sstream>
 #include <dirent.h>
@@ -27,25 +29,74 @@
 #include <memory>
 #include <iomanip>
 #include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 #include "blockscanner.h"
+#include "coreblockindex.h"
 
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <time.h>
 
 using namespace std;
 using json = nlohmann::json;
 
+namespace
+{
+    const string COINBASE_HASH = "0000000000000000000000000000000000000000000000000000000000000000";
+
+    // Hashes and outpoints are compared in binary form while analyzing double spends
+    string binaryHash(const string& hash) {
+        string binary(hash.size() / 2, '\0');
+        VtcBlockIndexer::Utility::hexToBytes(hash.data(), hash.size(), (unsigned char*)&binary[0]);
+        return binary;
+    }
+
+    string binaryOutpoint(const string& txHash, uint32_t txoIndex) {
+        string binary = binaryHash(txHash);
+        for(int i = 0; i < 4; i++) {
+            binary.push_back((char)(txoIndex >> (8 * i)));
+        }
+        return binary;
+    }
+}
+
 // Constructor
-VtcBlockIndexer::BlockFileWatcher::BlockFileWatcher(string blocksDir, const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor) {
+VtcBlockIndexer::BlockFileWatcher::BlockFileWatcher(string blocksDir, string coreBlockIndexDir, const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor, const shared_ptr<VtcBlockIndexer::EventHub> eventHub) {
     this->db = db;
     this->mempoolMonitor = mempoolMonitor;
-    blockIndexer.reset(new VtcBlockIndexer::BlockIndexer(this->db, this->mempoolMonitor));
+    blockIndexer.reset(new VtcBlockIndexer::BlockIndexer(this->db, this->mempoolMonitor, eventHub));
     blockReader.reset(new VtcBlockIndexer::BlockReader(blocksDir));
+    revReader.reset(new VtcBlockIndexer::RevReader(blocksDir));
     this->blocksDir = blocksDir;
+    this->coreBlockIndexDir = coreBlockIndexDir;
     this->maxLastModified.tv_sec = 0;
     this->maxLastModified.tv_nsec = 0;
     this->scriptSolver = make_unique<VtcBlockIndexer::ScriptSolver>();
+    this->totalBlocks = 0;
+    this->keepScannedBlocks = false;
+    this->firstBlockFile = 0;
+    if(!this->coreBlockIndexDir.empty()) {
+        readCoreBlockIndex();
+    }
+
+    string snapshotHeight;
+    this->snapshotHeight = -1;
+    this->backfillNext = 0;
+    if(this->db->Get(leveldb::ReadOptions(), "snapshot-height", &snapshotHeight).ok()) {
+        this->snapshotHeight = stoi(snapshotHeight);
+        this->db->Get(leveldb::ReadOptions(), "snapshot-blockhash", &this->snapshotBlockHash);
+        string backfillNext;
+        if(this->db->Get(leveldb::ReadOptions(), "snapshot-backfill-next", &backfillNext).ok()) {
+            this->backfillNext = stoi(backfillNext);
+        }
+    }
+    const char* backfillBlocks = std::getenv("SNAPSHOT_BACKFILL_BLOCKS");
+    this->backfillBlocks = (backfillBlocks != NULL && backfillBlocks[0] != 0) ? atoi(backfillBlocks) : 0;
+    this->backfillBudget = 0;
+    this->backfillPending = false;
 }
 
 void VtcBlockIndexer::BlockFileWatcher::startWatcher() {
@@ -79,7 +130,7 @@ void VtcBlockIndexer::BlockFileWatcher::startWatcher() {
 
         closedir(dir);
 
-        if(shouldUpdate) { 
+        if(shouldUpdate || this->backfillPending) { 
             updateIndex();
         }
 
@@ -91,51 +142,78 @@ void VtcBlockIndexer::BlockFileWatcher::scanBlocks(string fileName) {
     unique_ptr<VtcBlockIndexer::BlockScanner> blockScanner(new VtcBlockIndexer::BlockScanner(blocksDir, fileName));
     if(blockScanner->open())
     {
-        while(blockScanner->moveNext()) {
-            this->totalBlocks++;
-            VtcBlockIndexer::ScannedBlock block = blockScanner->scanNextBlock();
-            // Create an empty vector inside the unordered map if this previousBlockHash
-            // was not found before.
-            if(this->blocks.find(block.previousBlockHash) == this->blocks.end()) {
-                this->blocks[block.previousBlockHash] = {};
-            }
+        for(const VtcBlockIndexer::ScannedBlock& block : blockScanner->scanAllBlocks()) {
+            addScannedBlock(block);
+        }
+        blockScanner->close();
+    }
+}
 
-            // Check if a block with the same hash already exists. Unfortunately, I found
-            // instances where a block is included in the block files more than once.
-            vector<VtcBlockIndexer::ScannedBlock> matchingBlocks = this->blocks[block.previousBlockHash];
-            bool blockFound = false;
-            for(VtcBlockIndexer::ScannedBlock matchingBlock : matchingBlocks) {
-                if(matchingBlock.blockHash == block.blockHash) {
-                    blockFound = true;
-                }
-            }
+void VtcBlockIndexer::BlockFileWatcher::addScannedBlock(const VtcBlockIndexer::ScannedBlock& block) {
+    // Create an empty vector inside the unordered map if this previousBlockHash
+    // was not found before.
+    vector<VtcBlockIndexer::ScannedBlock>& matchingBlocks = this->blocks[block.previousBlockHash];
 
-            // If the block is not present, add it to the vector.
-            if(!blockFound) {
-                this->blocks[block.previousBlockHash].push_back(block);
-            }
+    // Check if a block with the same hash already exists. Unfortunately, I found
+    // instances where a block is included in the block files more than once.
+    // Blocks read from the node's block index are found again when scanning
+    // the last block files.
+    bool blockFound = false;
+    for(const VtcBlockIndexer::ScannedBlock& matchingBlock : matchingBlocks) {
+        if(matchingBlock.blockHash == block.blockHash) {
+            blockFound = true;
         }
-        blockScanner->close();
+    }
+
+    // If the block is not present, add it to the vector.
+    if(!blockFound) {
+        matchingBlocks.push_back(block);
+        this->totalBlocks++;
     }
 }
 
+void VtcBlockIndexer::BlockFileWatcher::readCoreBlockIndex() {
+    VtcBlockIndexer::CoreBlockIndex coreBlockIndex(this->coreBlockIndexDir);
+    int lastBlockFile = coreBlockIndex.readBlocks([this](const VtcBlockIndexer::ScannedBlock& block) {
+        addScannedBlock(block);
+    });
+    if(lastBlockFile < 0) {
+        // Nothing usable was read, all block files are scanned on every update
+        this->blocks.clear();
+        this->totalBlocks = 0;
+        return;
+    }
+    cout << "Read " << this->totalBlocks << " blocks from the block index, scanning block files from number " << lastBlockFile << endl;
+    this->keepScannedBlocks = true;
+    this->firstBlockFile = lastBlockFile;
+}
+
 
 void VtcBlockIndexer::BlockFileWatcher::scanBlockFiles(string dirPath) {
     DIR *dir;
     dirent *ent;
 
+    // Block files before the last one scanned hold no blocks missing from
+    // the kept blocks, the node only appends to the last one
+    int lastBlockFile = this->firstBlockFile;
     dir = opendir(&*dirPath.begin());
     while ((ent = readdir(dir)) != NULL) {
         const string file_name = ent->d_name;
 
         // Check if the filename starts with "blk"
         string prefix = "blk"; 
-        if(strncmp(file_name.c_str(), prefix.c_str(), prefix.size()) == 0)
+        const int blockFile = atoi(file_name.c_str() + min(file_name.size(), prefix.size()));
+        if(strncmp(file_name.c_str(), prefix.c_str(), prefix.size()) == 0 && blockFile >= this->firstBlockFile)
         {
             scanBlocks(file_name);
+            lastBlockFile = max(lastBlockFile, blockFile);
         }
     }
     closedir(dir);
+
+    if(this->keepScannedBlocks) {
+        this->firstBlockFile = lastBlockFile;
+    }
 }
 
 
@@ -195,12 +273,38 @@ string VtcBlockIndexer::BlockFileWatcher::processNextBlock(string prevBlockHash)
         
         if(matchingBlocks.size() > 1) { 
             bestBlock = findLongestChain(matchingBlocks);
+            this->forks.push_back(make_pair(this->blockHeight, prevBlockHash));
         } 
     
+        // The outputs in the index are those of the snapshot's chain, indexing
+        // another chain on top of them would serve wrong balances
+        if(this->blockHeight == this->snapshotHeight && bestBlock.blockHash != this->snapshotBlockHash) {
+            cerr << "Block " << bestBlock.blockHash << " at the height of the imported UTXO snapshot is not its base block " << this->snapshotBlockHash << ". Remove the index and import a snapshot of the current chain. Exiting." << endl;
+            exit(-1);
+        }
+
         if(!blockIndexer->hasIndexedBlock(bestBlock.blockHash, this->blockHeight)) {
+            // The history before an imported UTXO snapshot is indexed oldest
+            // block first, a limited number of blocks per update
+            const bool backfill = (this->blockHeight <= this->snapshotHeight);
+            if(backfill && (this->blockHeight != this->backfillNext || this->backfillBudget <= 0)) {
+                return bestBlock.blockHash;
+            }
+
             VtcBlockIndexer::Block fullBlock = blockReader->readBlock(bestBlock.fileName, bestBlock.filePosition, this->blockHeight, false);
-           
-            blockIndexer->indexBlock(fullBlock);
+
+            // Stays empty when the node has no undo data for the block
+            vector<vector<VtcBlockIndexer::TransactionOutput>> spentOutputs;
+            revReader->readSpentOutputs(fullBlock, spentOutputs);
+            blockIndexer->indexBlock(fullBlock, spentOutputs);
+
+            if(backfill) {
+                this->backfillBudget--;
+                this->backfillNext++;
+                stringstream backfillNext;
+                backfillNext << setw(8) << setfill('0') << this->backfillNext;
+                this->db->Put(leveldb::WriteOptions(), "snapshot-backfill-next", backfillNext.str());
+            }
         }
         return bestBlock.blockHash;
 
@@ -217,7 +321,12 @@ void VtcBlockIndexer::BlockFileWatcher::updateIndex() {
     time(&start);  
    
     this->blockHeight = 0;
-    this->totalBlocks = 0;
+    if(!this->keepScannedBlocks) {
+        this->totalBlocks = 0;
+    }
+    this->forks.clear();
+    this->backfillBudget = this->backfillBlocks;
+    const int backfillStart = this->backfillNext;
     cout << "Scanning blocks..." << endl;
 
     scanBlockFiles(blocksDir);
@@ -243,7 +352,48 @@ void VtcBlockIndexer::BlockFileWatcher::updateIndex() {
 
     cout << "Done. Processed " << this->blockHeight << " blocks. Have a nice day." << endl;
 
-    this->blocks.clear();
+    if(this->backfillNext > backfillStart) {
+        cout << "Backfilled the history before the UTXO snapshot up to height " << (this->backfillNext - 1) << " of " << this->snapshotHeight << endl;
+    }
+    // Continue right away while the last update made progress
+    this->backfillPending = (this->backfillNext > backfillStart && this->backfillNext <= this->snapshotHeight);
+
+    processForks();
+
+    if(!this->keepScannedBlocks) {
+        this->blocks.clear();
+    }
+}
+
+vector<VtcBlockIndexer::ScannedBlock> VtcBlockIndexer::BlockFileWatcher::findChain(const string& blockHash) {
+    if(!this->keepScannedBlocks) {
+        this->totalBlocks = 0;
+    }
+    scanBlockFiles(blocksDir);
+
+    unordered_map<string, VtcBlockIndexer::ScannedBlock> blocksByHash;
+    for(const auto& matchingBlocks : this->blocks) {
+        for(const VtcBlockIndexer::ScannedBlock& block : matchingBlocks.second) {
+            blocksByHash[block.blockHash] = block;
+        }
+    }
+    if(!this->keepScannedBlocks) {
+        this->blocks.clear();
+    }
+
+    // Walk back from the block to the genesis block
+    vector<VtcBlockIndexer::ScannedBlock> chain;
+    string hash = blockHash;
+    while(hash != COINBASE_HASH) {
+        auto block = blocksByHash.find(hash);
+        if(block == blocksByHash.end()) {
+            return {};
+        }
+        chain.push_back(block->second);
+        hash = block->second.previousBlockHash;
+    }
+    reverse(chain.begin(), chain.end());
+    return chain;
 }
 
 vector<VtcBlockIndexer::ScannedBlock> VtcBlockIndexer::BlockFileWatcher::indexBlocksByHeight(int height, vector<VtcBlockIndexer::ScannedBlock> matchingBlocks, VtcBlockIndexer::ScannedBlock blockOnMainChain) {
@@ -284,174 +434,144 @@ vector<VtcBlockIndexer::ScannedBlock> VtcBlockIndexer::BlockFileWatcher::indexBl
     return followUpBlocks;
 }
 
-void VtcBlockIndexer::BlockFileWatcher::analyzeDoubleBlocks(unordered_map<int, vector<VtcBlockIndexer::Block>> doubleBlocks, json& results, vector<string>& reorgedCoinbases) {
+void VtcBlockIndexer::BlockFileWatcher::analyzeDoubleBlocks(const unordered_map<int, vector<VtcBlockIndexer::Block>>& doubleBlocks, json& results, vector<string>& reorgedCoinbases) {
 
-    unordered_map<string, vector<VtcBlockIndexer::PotentialDoubleSpend>> potentialDoubleSpends;
+    // The spends of each outpoint, in the order the outpoints were first seen
+    unordered_map<string, size_t> outpointIndex;
+    vector<vector<VtcBlockIndexer::PotentialDoubleSpend>> potentialDoubleSpends;
 
     for(int i = 0; (doubleBlocks.find(i) != doubleBlocks.end()); i++)
     {
-        for(int j = 0; j < doubleBlocks[i].size(); j++) {
-            VtcBlockIndexer::Block block = doubleBlocks[i][j];
-            for(VtcBlockIndexer::Transaction tx : block.transactions) {
-                if(tx.inputs.at(0).txHash.compare("0000000000000000000000000000000000000000000000000000000000000000") == 0 && !block.mainChain) {
+        for(const VtcBlockIndexer::Block& block : doubleBlocks.at(i)) {
+            for(const VtcBlockIndexer::Transaction& tx : block.transactions) {
+                if(tx.inputs.at(0).txHash.compare(COINBASE_HASH) == 0 && !block.mainChain) {
                     // This is a coinbase transaction that got reorged out. Store its TXID to match spending.
                     // A transaction spending this coinbase will be gone from the main chain after reorg too
                     // without a double spend necessary.
                     reorgedCoinbases.push_back(tx.txHash);
                 }
 
-                for(VtcBlockIndexer::TransactionInput txi : tx.inputs) {
-                    if(txi.txHash.compare("0000000000000000000000000000000000000000000000000000000000000000") != 0)
+                for(const VtcBlockIndexer::TransactionInput& txi : tx.inputs) {
+                    if(txi.txHash.compare(COINBASE_HASH) != 0)
                     {
-                        stringstream ss;
-                        ss << txi.txHash << setw(8) << setfill('0') << txi.txoIndex;
-                        VtcBlockIndexer::PotentialDoubleSpend spend;
-                        spend.block = block;
-                        spend.tx = tx;
-                        if(potentialDoubleSpends.find(ss.str()) == potentialDoubleSpends.end()) {
-                            potentialDoubleSpends[ss.str()] = { spend };
-                        } else {
-                            potentialDoubleSpends[ss.str()].push_back(spend);
+                        auto inserted = outpointIndex.emplace(binaryOutpoint(txi.txHash, txi.txoIndex), potentialDoubleSpends.size());
+                        if(inserted.second) {
+                            potentialDoubleSpends.push_back({});
                         }
+                        potentialDoubleSpends[inserted.first->second].push_back({ &tx, &block, &txi });
                     }
                 }
             }
         }
     } 
 
+    unordered_set<string> reorgedCoinbaseIds;
+    for(const string& txHash : reorgedCoinbases) {
+        reorgedCoinbaseIds.insert(binaryHash(txHash));
+    }
+
+    // Results are grouped by the blocks and transactions involved, these maps
+    // hold their binary hashes concatenated and the position in the results
     vector<DoubleSpend> doubleSpends = {};
+    unordered_map<string, size_t> doubleSpendIndex;
     vector<DoubleSpentCoinBase> orphansSpendingReorgedCoinbase = {};
-    vector<Transaction> orphansMissingFromMainChain = {};
-    for (std::pair<string, vector<VtcBlockIndexer::PotentialDoubleSpend>> potentialDoubleSpend : potentialDoubleSpends)
+    unordered_map<string, size_t> orphanSpendIndex;
+    vector<const Transaction*> orphansMissingFromMainChain = {};
+    unordered_set<string> orphansMissingIndex;
+
+    for (const vector<VtcBlockIndexer::PotentialDoubleSpend>& spends : potentialDoubleSpends)
     {
-        VtcBlockIndexer::PotentialDoubleSpend mainChainSpend;
-        bool foundMainChainSpend = false;
-        for(VtcBlockIndexer::PotentialDoubleSpend spend : potentialDoubleSpend.second) {
-            if(spend.block.mainChain) {
-                mainChainSpend = spend;
-                foundMainChainSpend = true;
+        const VtcBlockIndexer::PotentialDoubleSpend* mainChainSpend = nullptr;
+        for(const VtcBlockIndexer::PotentialDoubleSpend& spend : spends) {
+            if(spend.block->mainChain) {
+                mainChainSpend = &spend;
                 break;
             }
         }
 
-        if(!foundMainChainSpend) {
-            for(VtcBlockIndexer::PotentialDoubleSpend spend : potentialDoubleSpend.second) {
-                bool spentReorgedCoinbase = false;
-                bool spentOtherInputs = false;
+        if(mainChainSpend == nullptr) {
+            for(const VtcBlockIndexer::PotentialDoubleSpend& spend : spends) {
+                // This transaction spends a coinbase that was reorged out if one of
+                // its inputs does. The last such input is reported.
                 string spentCoinbase;
-                for(VtcBlockIndexer::TransactionInput txi : spend.tx.inputs) {
-                    bool inputSpendsReorgedCoinbase = false;
-                    for(string reorgedCoinbase : reorgedCoinbases) {
-                        if(reorgedCoinbase.compare(txi.txHash) == 0) {
-                            // This transaction spends a coinbase that was reorged out.
-                            inputSpendsReorgedCoinbase = true;
+                if(!reorgedCoinbaseIds.empty()) {
+                    for(const VtcBlockIndexer::TransactionInput& txi : spend.tx->inputs) {
+                        if(reorgedCoinbaseIds.find(binaryHash(txi.txHash)) != reorgedCoinbaseIds.end()) {
                             spentCoinbase = txi.txHash + "00000000";
                         }
                     }
-                    if(inputSpendsReorgedCoinbase) {
-                        spentReorgedCoinbase = true;
-                    } else { 
-                        spentOtherInputs = true;
-                    }
                 }
-                if(spentReorgedCoinbase) {
-                    bool foundOrphanSpend = false;
-                    for(VtcBlockIndexer::DoubleSpentCoinBase& existingDso : orphansSpendingReorgedCoinbase) {
-                        if(existingDso.block.blockHash.compare(spend.block.blockHash) == 0 &&
-                            existingDso.tx.txHash.compare(spend.tx.txHash) == 0) {
-                            
-                            bool foundOutpoint = false;
-                            for(string op : existingDso.outpoints) {
-                                if(op.compare(spentCoinbase) == 0) {
-                                    foundOutpoint = true;
-                                }
-                            }
-                            if(!foundOutpoint) {
-                                existingDso.outpoints.push_back(spentCoinbase); 
-                            }
-                            foundOrphanSpend = true;
-                            break;
-                        }
-                    }
-                    if(!foundOrphanSpend) {
+
+                const string spendKey = binaryHash(spend.block->blockHash) + binaryHash(spend.tx->txHash);
+                if(!spentCoinbase.empty()) {
+                    auto inserted = orphanSpendIndex.emplace(spendKey, orphansSpendingReorgedCoinbase.size());
+                    if(inserted.second) {
                         DoubleSpentCoinBase dspend;
                         dspend.tx = spend.tx;
                         dspend.block = spend.block;
                         dspend.outpoints = {spentCoinbase};
                         orphansSpendingReorgedCoinbase.push_back(dspend);
-                    }
-                } else {
-                    bool foundOrphan = false;
-                    for(VtcBlockIndexer::Transaction tx : orphansMissingFromMainChain) {
-                        if(spend.tx.txHash.compare(tx.txHash) == 0) {
-                            foundOrphan = true;
+                    } else {
+                        vector<string>& outpoints = orphansSpendingReorgedCoinbase[inserted.first->second].outpoints;
+                        if(find(outpoints.begin(), outpoints.end(), spentCoinbase) == outpoints.end()) {
+                            outpoints.push_back(spentCoinbase);
                         }
                     }
-                    if(!foundOrphan) {
-                        orphansMissingFromMainChain.push_back(spend.tx);
-                    }
+                } else if(orphansMissingIndex.insert(binaryHash(spend.tx->txHash)).second) {
+                    orphansMissingFromMainChain.push_back(spend.tx);
                 }
             }
             continue;
         }
 
-        if(foundMainChainSpend && potentialDoubleSpend.second.size() > 1) {
-            for(VtcBlockIndexer::PotentialDoubleSpend spend : potentialDoubleSpend.second) {
-                if(spend.tx.txHash.compare(mainChainSpend.tx.txHash) != 0 &&
-                    spend.block.blockHash.compare(mainChainSpend.block.blockHash) != 0) {
+        if(spends.size() > 1) {
+            const string mainChainKey = binaryHash(mainChainSpend->block->blockHash) + binaryHash(mainChainSpend->tx->txHash);
+            for(const VtcBlockIndexer::PotentialDoubleSpend& spend : spends) {
+                if(spend.tx->txHash.compare(mainChainSpend->tx->txHash) != 0 &&
+                    spend.block->blockHash.compare(mainChainSpend->block->blockHash) != 0) {
                     VtcBlockIndexer::DoubleSpentOutpoint dso;
-                    dso.outpoint = potentialDoubleSpend.first;
+                    stringstream ss;
+                    ss << spend.input->txHash << setw(8) << setfill('0') << spend.input->txoIndex;
+                    dso.outpoint = ss.str();
                     dso.alsoSpentInTx = spend.tx;
                     dso.alsoSpentInBlock = spend.block;
-                    bool found = false;
-                    for(VtcBlockIndexer::DoubleSpend& existingDspend : doubleSpends) {
-                        if(found) break;
-                        if(existingDspend.block.blockHash.compare(mainChainSpend.block.blockHash) == 0 &&
-                            existingDspend.tx.txHash.compare(mainChainSpend.tx.txHash) == 0) { 
-                            for(VtcBlockIndexer::DoubleSpentOutpoint& existingDso : existingDspend.outpoints) {
-                                if(existingDso.alsoSpentInBlock.blockHash.compare(dso.alsoSpentInBlock.blockHash) == 0 &&
-                                    existingDso.alsoSpentInTx.txHash.compare(dso.alsoSpentInTx.txHash) == 0) {
-                                    existingDspend.outpoints.push_back(dso); 
-                                    found = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    
-                    if(!found) {
+
+                    auto inserted = doubleSpendIndex.emplace(mainChainKey + binaryHash(spend.block->blockHash) + binaryHash(spend.tx->txHash), doubleSpends.size());
+                    if(inserted.second) {
                         DoubleSpend dspend;
-                        dspend.block = mainChainSpend.block;
-                        dspend.tx = mainChainSpend.tx;
+                        dspend.block = mainChainSpend->block;
+                        dspend.tx = mainChainSpend->tx;
                         dspend.outpoints = {dso};
                         doubleSpends.push_back(dspend);
-                    } 
+                    } else {
+                        doubleSpends[inserted.first->second].outpoints.push_back(dso);
+                    }
                 }
             } 
         }
     }
     
 
-    for(DoubleSpend ds : doubleSpends) {
+    for(const DoubleSpend& ds : doubleSpends) {
         json jsonEvent;
         json jsonSpend;
         json jsonSpendBlock;
 
-        jsonSpendBlock["hash"] = ds.block.blockHash;
-        jsonSpendBlock["height"] = ds.block.height;
+        jsonSpendBlock["hash"] = ds.block->blockHash;
+        jsonSpendBlock["height"] = ds.block->height;
         jsonSpend["mainChainBlock"] = jsonSpendBlock;
-        jsonSpend["mainChainTx"] = txToJson(ds.tx); 
+        jsonSpend["mainChainTx"] = txToJson(*ds.tx);
 
         json jdsos = json::array();
-        for(DoubleSpentOutpoint dso : ds.outpoints) {
+        for(const DoubleSpentOutpoint& dso : ds.outpoints) {
             json jdso;
             jdso["outpoint"] = dso.outpoint;
 
             json alsoSpentIn;
             json alsoSpentInBlock;
-            alsoSpentIn["tx"] = txToJson(dso.alsoSpentInTx);
-            alsoSpentInBlock["hash"] = dso.alsoSpentInBlock.blockHash;
-            alsoSpentInBlock["height"] = dso.alsoSpentInBlock.height;
+            alsoSpentIn["tx"] = txToJson(*dso.alsoSpentInTx);
+            alsoSpentInBlock["hash"] = dso.alsoSpentInBlock->blockHash;
+            alsoSpentInBlock["height"] = dso.alsoSpentInBlock->height;
             alsoSpentIn["block"] = alsoSpentInBlock;
             jdso["alsoSpentIn"] = alsoSpentIn;
             jdsos.push_back(jdso);
@@ -463,17 +583,17 @@ void VtcBlockIndexer::BlockFileWatcher::analyzeDoubleBlocks(unordered_map<int, v
         results.push_back(jsonEvent);
     }
 
-    for(DoubleSpentCoinBase dspend : orphansSpendingReorgedCoinbase) {
+    for(const DoubleSpentCoinBase& dspend : orphansSpendingReorgedCoinbase) {
         json jsonEvent;
         jsonEvent["event"] = "spendingReorgedCoinbase";
         
         json jsonDetails;
 
-        jsonDetails["orphanedTx"] = txToJson(dspend.tx);
+        jsonDetails["orphanedTx"] = txToJson(*dspend.tx);
 
         json jsonBlock;
-        jsonBlock["hash"] = dspend.block.blockHash;
-        jsonBlock["height"] = dspend.block.height;
+        jsonBlock["hash"] = dspend.block->blockHash;
+        jsonBlock["height"] = dspend.block->height;
         jsonDetails["orphanedBlock"] = jsonBlock;
         
         jsonDetails["coinbasesSpent"] = dspend.outpoints;
@@ -481,16 +601,161 @@ void VtcBlockIndexer::BlockFileWatcher::analyzeDoubleBlocks(unordered_map<int, v
         results.push_back(jsonEvent);
     }
 
-    /*for(Transaction tx : orphansMissingFromMainChain) {
+    /*for(const Transaction* tx : orphansMissingFromMainChain) {
         json jsonEvent;
         jsonEvent["event"] = "missingFromMainChain";
-        jsonEvent["details"] = txToJson(tx);
+        jsonEvent["details"] = txToJson(*tx);
         results.push_back(jsonEvent);
     }*/
 
 
 }
 
+void VtcBlockIndexer::BlockFileWatcher::collectForkBlocks(const VtcBlockIndexer::ScannedBlock& block, int height, vector<pair<int, VtcBlockIndexer::ScannedBlock>>& forkBlocks) {
+    forkBlocks.push_back(make_pair(height, block));
+    if(this->blocks.find(block.blockHash) != this->blocks.end()) {
+        for(const VtcBlockIndexer::ScannedBlock& nextBlock : this->blocks[block.blockHash]) {
+            collectForkBlocks(nextBlock, height + 1, forkBlocks);
+        }
+    }
+}
+
+void VtcBlockIndexer::BlockFileWatcher::processForks() {
+    for(const pair<int, string>& fork : this->forks) {
+        const int forkHeight = fork.first;
+        stringstream mainChainKey;
+        mainChainKey << "block-" << setw(8) << setfill('0') << forkHeight;
+        string mainChainHash;
+        if(!this->db->Get(leveldb::ReadOptions(), mainChainKey.str(), &mainChainHash).ok()) {
+            continue;
+        }
+
+        for(const VtcBlockIndexer::ScannedBlock& orphan : this->blocks[fork.second]) {
+            if(orphan.blockHash == mainChainHash) {
+                continue;
+            }
+
+            vector<pair<int, VtcBlockIndexer::ScannedBlock>> orphanedBlocks;
+            collectForkBlocks(orphan, forkHeight, orphanedBlocks);
+            storeForkBlocks(forkHeight, orphanedBlocks);
+            detectDoubleSpends(forkHeight, mainChainHash, orphanedBlocks);
+        }
+    }
+}
+
+void VtcBlockIndexer::BlockFileWatcher::storeForkBlocks(int forkHeight, const vector<pair<int, VtcBlockIndexer::ScannedBlock>>& forkBlocks) {
+    static VtcBlockIndexer::MetricCounter& staleBlocks = VtcBlockIndexer::Metrics::counter("indexer_stale_blocks_total", "Blocks off the main chain added to the fork index");
+
+    leveldb::WriteBatch batch;
+    int stored = 0;
+    for(const pair<int, VtcBlockIndexer::ScannedBlock>& forkBlock : forkBlocks) {
+        const string hashKey = "fork-hash-" + forkBlock.second.blockHash;
+        string existingHeight;
+        if(this->db->Get(leveldb::ReadOptions(), hashKey, &existingHeight).ok()) {
+            continue;
+        }
+
+        // Only the header is read, for the time
+        VtcBlockIndexer::Block header = blockReader->readBlock(forkBlock.second.fileName, forkBlock.second.filePosition, forkBlock.first, true);
+
+        stringstream height;
+        height << setw(8) << setfill('0') << forkBlock.first;
+        stringstream forkValue;
+        forkValue << forkBlock.second.previousBlockHash << setw(12) << setfill('0') << header.time << setw(8) << setfill('0') << forkHeight;
+        forkValue << forkBlock.second.fileName << setw(12) << setfill('0') << forkBlock.second.filePosition;
+
+        batch.Put("fork-" + height.str() + "-" + forkBlock.second.blockHash, forkValue.str());
+        batch.Put(hashKey, height.str());
+        stored++;
+    }
+
+    if(stored > 0) {
+        this->db->Write(leveldb::WriteOptions(), &batch);
+        staleBlocks.increment(stored);
+    }
+}
+
+void VtcBlockIndexer::BlockFileWatcher::detectDoubleSpends(int forkHeight, const string& mainChainHash, const vector<pair<int, VtcBlockIndexer::ScannedBlock>>& orphanedBlocks) {
+    static VtcBlockIndexer::MetricCounter& forksAnalyzed = VtcBlockIndexer::Metrics::counter("doublespend_forks_analyzed_total", "Orphaned branches analyzed for double spends");
+    static VtcBlockIndexer::MetricCounter& eventsStored = VtcBlockIndexer::Metrics::counter("doublespend_events_total", "Double spend events stored");
+
+    // Remember what the branch was compared against, so the next update
+    // skips it unless it grew or the main chain moved at this height.
+    const string analyzedKey = "doublespend-fork-" + orphanedBlocks.at(0).second.blockHash;
+    const string analyzedValue = mainChainHash + std::to_string(orphanedBlocks.size());
+    string previouslyAnalyzed;
+    if(this->db->Get(leveldb::ReadOptions(), analyzedKey, &previouslyAnalyzed).ok() && previouslyAnalyzed == analyzedValue) {
+        return;
+    }
+
+    unordered_map<int, vector<VtcBlockIndexer::Block>> doubleBlocks;
+    int topHeight = forkHeight;
+    doubleBlocks[1] = {};
+    for(const pair<int, VtcBlockIndexer::ScannedBlock>& orphanedBlock : orphanedBlocks) {
+        VtcBlockIndexer::Block block = blockReader->readBlock(orphanedBlock.second.fileName, orphanedBlock.second.filePosition, orphanedBlock.first, false);
+        block.mainChain = false;
+        doubleBlocks[1].push_back(block);
+        topHeight = max(topHeight, orphanedBlock.first);
+    }
+
+    // The main chain blocks over the same heights, found through the index
+    doubleBlocks[0] = {};
+    for(int height = forkHeight; height <= topHeight; height++) {
+        stringstream filePositionKey;
+        filePositionKey << "block-filePosition-" << setw(8) << setfill('0') << height;
+        string filePosition;
+        if(!this->db->Get(leveldb::ReadOptions(), filePositionKey.str(), &filePosition).ok() || filePosition.size() <= 12) {
+            break;
+        }
+        VtcBlockIndexer::Block block = blockReader->readBlock(filePosition.substr(0, filePosition.size() - 12), stoull(filePosition.substr(filePosition.size() - 12)), height, false);
+        block.mainChain = true;
+        doubleBlocks[0].push_back(block);
+    }
+
+    json results = json::array();
+    vector<string> reorgedCoinbases;
+    analyzeDoubleBlocks(doubleBlocks, results, reorgedCoinbases);
+
+    int stored = 0;
+    for(const json& event : results) {
+        if(storeDoubleSpendEvent(event)) {
+            stored++;
+        }
+    }
+    this->db->Put(leveldb::WriteOptions(), analyzedKey, analyzedValue);
+    forksAnalyzed.increment();
+    eventsStored.increment(stored);
+
+    if(stored > 0) {
+        cout << "Found " << stored << " double spend event(s) in the " << orphanedBlocks.size() << " orphaned block(s) from height " << forkHeight << endl;
+    }
+}
+
+bool VtcBlockIndexer::BlockFileWatcher::storeDoubleSpendEvent(json event) {
+    // The same event is found again when a branch is reanalyzed, recognize it by its contents
+    const string serialized = event.dump();
+    const string seenKey = "doublespend-seen-" + VtcBlockIndexer::Utility::hashToHex(VtcBlockIndexer::Utility::sha256(vector<unsigned char>(serialized.begin(), serialized.end())));
+    string existingId;
+    if(this->db->Get(leveldb::ReadOptions(), seenKey, &existingId).ok()) {
+        return false;
+    }
+
+    uint64_t id = 1;
+    string lastId;
+    if(this->db->Get(leveldb::ReadOptions(), "doublespend-lastid", &lastId).ok()) {
+        id = stoull(lastId) + 1;
+    }
+    stringstream idString;
+    idString << setw(8) << setfill('0') << id;
+    event["id"] = id;
+
+    leveldb::WriteBatch batch;
+    batch.Put("doublespend-" + idString.str(), event.dump());
+    batch.Put(seenKey, idString.str());
+    batch.Put("doublespend-lastid", idString.str());
+    return this->db->Write(leveldb::WriteOptions(), &batch).ok();
+}
+
 json VtcBlockIndexer::BlockFileWatcher::txToJson(VtcBlockIndexer::Transaction tx) { 
     json jtx;
     jtx["txid"] = tx.txHash;
@@ -510,11 +775,12 @@ json VtcBlockIndexer::BlockFileWatcher::txToJson(VtcBlockIndexer::Transaction tx
 
         json scriptPubKey;
         vout["to"] = json::array();
-        vector<string> addresses = scriptSolver->getAddressesFromScript(txo.script);
+        const VtcBlockIndexer::ScriptClassification scriptClass = scriptSolver->classify(txo.script.data(), txo.script.size());
+        vector<string> addresses = scriptSolver->getAddressesFromScript(txo.script.data(), txo.script.size(), scriptClass);
         for(string address : addresses) {
             vout["to"].push_back(address);
         }
-        vout["type"] = scriptSolver->getScriptTypeName(txo.script);
+        vout["type"] = scriptSolver->getScriptTypeName(scriptClass.type);
         vout["valueSat"] = txo.value;
         
         vouts.push_back(vout);
@@ -539,41 +805,94 @@ void VtcBlockIndexer::BlockFileWatcher::dumpDoubleSpends() {
     }
 
     
-    json doubleSpends = json::array();
-
-    unordered_map<int, vector<VtcBlockIndexer::Block>> doubleBlocks;
-    vector<string> reorgedCoinbases;
+    // Every block at a height with more than one candidate, in height order.
+    // Consecutive forked heights form a region that is analyzed as a whole.
+    vector<pair<int, VtcBlockIndexer::ScannedBlock>> forkBlocks;
+    vector<size_t> regionEnds;
     int prevDoubleBlock = -1;
     for(int i = 1; (this->blocksByHeight.find(i) != this->blocksByHeight.end()); i++)
     {
         if(this->blocksByHeight[i].size() > 1) {
-            if (prevDoubleBlock != i-1) {
-                analyzeDoubleBlocks(doubleBlocks, doubleSpends, reorgedCoinbases);
-                doubleBlocks.clear();
+            if (prevDoubleBlock != i-1 && forkBlocks.size() > 0) {
+                regionEnds.push_back(forkBlocks.size());
             }
+            for(const VtcBlockIndexer::ScannedBlock& scannedBlock : this->blocksByHeight[i]) {
+                forkBlocks.push_back(make_pair(i, scannedBlock));
+            }
+            prevDoubleBlock = i;
+        }
+    }
+    if(forkBlocks.size() > 0) {
+        regionEnds.push_back(forkBlocks.size());
+    }
 
-            for(int j = 0; j < this->blocksByHeight[i].size(); j++)
-            {
-                VtcBlockIndexer::ScannedBlock scannedBlock = this->blocksByHeight[i][j];
-                VtcBlockIndexer::Block block = blockReader->readBlock(scannedBlock.fileName, scannedBlock.filePosition, i, false);
-                block.mainChain = scannedBlock.mainChain;
-                if(doubleBlocks.find(j) == doubleBlocks.end()) {
-                    doubleBlocks[j] = {block};
-                } else {
-                    for(int k = 0; doubleBlocks.find(k) != doubleBlocks.end(); k++)
-                    {
-                        if(doubleBlocks[k][doubleBlocks[k].size()-1].blockHash == block.previousBlockHash) {
-                            doubleBlocks[k].push_back(block);
-                        }
+    // A pool of workers reads and parses the blocks, up to a window ahead of
+    // the block the analysis waits for
+    const size_t workerCount = max(std::thread::hardware_concurrency(), 1u);
+    const size_t window = workerCount * 16;
+    vector<unique_ptr<VtcBlockIndexer::Block>> loadedBlocks(forkBlocks.size());
+    mutex loadMutex;
+    condition_variable blockLoaded;
+    condition_variable blockConsumed;
+    size_t nextToLoad = 0;
+    size_t consumed = 0;
+
+    vector<thread> workers;
+    for(size_t i = 0; i < workerCount; i++) {
+        workers.push_back(thread([&]() {
+            while(true) {
+                size_t index;
+                {
+                    unique_lock<mutex> lock(loadMutex);
+                    blockConsumed.wait(lock, [&]() { return nextToLoad >= forkBlocks.size() || nextToLoad < consumed + window; });
+                    if(nextToLoad >= forkBlocks.size()) {
+                        return;
                     }
+                    index = nextToLoad++;
                 }
+
+                const pair<int, VtcBlockIndexer::ScannedBlock>& forkBlock = forkBlocks[index];
+                unique_ptr<VtcBlockIndexer::Block> block(new VtcBlockIndexer::Block(blockReader->readBlock(forkBlock.second.fileName, forkBlock.second.filePosition, forkBlock.first, false)));
+                block->mainChain = forkBlock.second.mainChain;
+                {
+                    lock_guard<mutex> lock(loadMutex);
+                    loadedBlocks[index] = move(block);
+                }
+                blockLoaded.notify_all();
             }
-            
-            prevDoubleBlock = i;
+        }));
+    }
+
+    // The analysis runs in height order while the workers read ahead. Orphaned
+    // coinbases carry over from one region to the next, a spend of one can be
+    // found many blocks later.
+    json doubleSpends = json::array();
+    vector<string> reorgedCoinbases;
+    size_t regionStart = 0;
+    for(size_t regionEnd : regionEnds) {
+        // The main chain blocks of the region and the orphaned ones
+        unordered_map<int, vector<VtcBlockIndexer::Block>> doubleBlocks;
+        doubleBlocks[0] = {};
+        doubleBlocks[1] = {};
+        for(size_t index = regionStart; index < regionEnd; index++) {
+            unique_ptr<VtcBlockIndexer::Block> block;
+            {
+                unique_lock<mutex> lock(loadMutex);
+                blockLoaded.wait(lock, [&]() { return loadedBlocks[index] != nullptr; });
+                block = move(loadedBlocks[index]);
+                consumed = index + 1;
+            }
+            blockConsumed.notify_all();
+            doubleBlocks[block->mainChain ? 0 : 1].push_back(move(*block));
         }
+
+        analyzeDoubleBlocks(doubleBlocks, doubleSpends, reorgedCoinbases);
+        regionStart = regionEnd;
     }
 
-    analyzeDoubleBlocks(doubleBlocks, doubleSpends, reorgedCoinbases);
+    for(thread& worker : workers) {
+        worker.join();
+    }
 
     cout << doubleSpends << endl;
 }
@@ -31,6 +31,7 @@
 #include "mempoolmonitor.h"
 #include "blockindexer.h"
 #include "blockreader.h"
+#include "revreader.h"
 #include "json.hpp"
 
 using namespace std;
@@ -45,9 +46,12 @@ namespace VtcBlockIndexer {
 
 class BlockFileWatcher {
 public:
-    /** Constructs a BlockIndexer instance using the given block data directory
+    /** Constructs a BlockIndexer instance using the given block data directory.
+     * When coreBlockIndexDir is not empty, the block positions are read from
+     * that copy of the node's blocks/index database once, here, instead of
+     * scanning all block files.
      */
-    BlockFileWatcher(string blocksDir, const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor);
+    BlockFileWatcher(string blocksDir, string coreBlockIndexDir, const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor, const shared_ptr<VtcBlockIndexer::EventHub> eventHub);
 
     /** Starts watching the blocksdir for changes and will execute an incremental
      * indexing when files have changed */
@@ -59,6 +63,13 @@ public:
     /** Scan blocks for orphaned blocks double spends */
     void dumpDoubleSpends();
 
+    /** Scans the block files and returns the chain from the genesis block up
+     * to the block with the given hash, so the block's height is one less than
+     * its length. Returns an empty chain when the block is not in the block
+     * files.
+     */
+    vector<VtcBlockIndexer::ScannedBlock> findChain(const string& blockHash);
+
     
 private:
     
@@ -69,13 +80,21 @@ private:
      */
     void scanBlocks(string fileName);
 
+    /** Adds a block to the unordered map, unless it is in there already */
+    void addScannedBlock(const VtcBlockIndexer::ScannedBlock& block);
+
     /** Scans a folder for block files present and passes them to the scanBlocks
-     * method
+     * method. With the node's block index read, the scanned blocks are kept
+     * between updates and only the block files from firstBlockFile on are
+     * scanned, for the blocks written since.
      * 
      * @param dirPath The directory to scan for blockfiles.
      */
     void scanBlockFiles(string dirName);
 
+    /** Reads the blocks from the copy of the node's block index into blocks */
+    void readCoreBlockIndex();
+
     /** Orphaned blocks stay in the blockfiles. So this method is created to find out which of the canditate follow-up blocks
      * chain of work behind it.
      * @param matchingBlocks The blocks that should be investigated.
@@ -85,7 +104,41 @@ private:
     /** Adds matched blocks to an index by height. Continues to crawl orphaned chains too */
     vector<VtcBlockIndexer::ScannedBlock> indexBlocksByHeight(int height, vector<VtcBlockIndexer::ScannedBlock> matchingBlocks, VtcBlockIndexer::ScannedBlock blockOnMainChain);
     
-    void analyzeDoubleBlocks(unordered_map<int, vector<VtcBlockIndexer::Block>> doubleBlocks, json& results, vector<string>& reorgedCoinbases);
+    /** Finds outpoints spent differently in the main chain and orphaned blocks, and
+     * orphaned transactions spending coinbases that were reorged out, and appends
+     * them to results as events. The chains are numbered from 0 in doubleBlocks.
+     * Coinbases of orphaned blocks are added to reorgedCoinbases.
+     */
+    void analyzeDoubleBlocks(const unordered_map<int, vector<VtcBlockIndexer::Block>>& doubleBlocks, json& results, vector<string>& reorgedCoinbases);
+
+    /** Handles the forks found while constructing the chain: stores the blocks
+     * of each orphaned branch in the fork index and analyzes the branch for
+     * double spends.
+     */
+    void processForks();
+
+    /** Adds the blocks of an orphaned branch to the fork index, unless they are
+     * in it already. Keys are fork-<height>-<hash>, with as value the previous
+     * block hash, the time (12 digits), the height the branch forked off at
+     * (8 digits), the file name and the position in the file (12 digits).
+     * fork-hash-<hash> holds the height, to look a stale block up by hash.
+     */
+    void storeForkBlocks(int forkHeight, const vector<pair<int, VtcBlockIndexer::ScannedBlock>>& forkBlocks);
+
+    /** Runs the double spend analysis for an orphaned branch. Only the blocks of
+     * the branch and the main chain blocks at the same heights are read. A
+     * branch is analyzed again only when it grew or the main chain changed at
+     * its height.
+     */
+    void detectDoubleSpends(int forkHeight, const string& mainChainHash, const vector<pair<int, VtcBlockIndexer::ScannedBlock>>& orphanedBlocks);
+
+    /** Adds a block and all blocks building on it to forkBlocks, with their heights */
+    void collectForkBlocks(const VtcBlockIndexer::ScannedBlock& block, int height, vector<pair<int, VtcBlockIndexer::ScannedBlock>>& forkBlocks);
+
+    /** Stores a double spend event under the next id, unless the same event
+     * was stored before. Returns true if it was stored.
+     */
+    bool storeDoubleSpendEvent(json event);
 
     /** Finds the next block in line (by matching the prevBlockHash which is the
      * key in the unordered_map). Then uses the block processor to do the indexing.
@@ -96,16 +149,35 @@ private:
      */     
     string processNextBlock(string prevBlockHash);
     string blocksDir;
+    string coreBlockIndexDir;
     shared_ptr<leveldb::DB> db;
     shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor;
     unique_ptr<VtcBlockIndexer::BlockReader> blockReader;
+    unique_ptr<VtcBlockIndexer::RevReader> revReader;
     unique_ptr<VtcBlockIndexer::BlockIndexer> blockIndexer;
     int totalBlocks;
     int blockHeight;
     unordered_map<string, vector<VtcBlockIndexer::ScannedBlock>> blocks;
+    // Set when blocks holds the blocks read from the node's block index. They
+    // are kept, and block files before firstBlockFile are not scanned again.
+    bool keepScannedBlocks;
+    int firstBlockFile;
     unordered_map<int, vector<VtcBlockIndexer::ScannedBlock>> blocksByHeight;
+    // Heights where more than one block extended the chain, with the hash of the block they extend
+    vector<pair<int, string>> forks;
     struct timespec maxLastModified;
     unique_ptr<VtcBlockIndexer::ScriptSolver> scriptSolver;
+
+    // With an imported UTXO snapshot, the blocks up to its height are indexed
+    // at most backfillBlocks per update, from backfillNext on. The budget left
+    // in the current update is in backfillBudget, backfillPending is set when
+    // another update should follow to continue.
+    int snapshotHeight;
+    string snapshotBlockHash;
+    int backfillNext;
+    int backfillBlocks;
+    int backfillBudget;
+    bool backfillPending;
     json txToJson(VtcBlockIndexer::Transaction tx);
 }; 
 
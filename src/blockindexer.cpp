@@ -20,6 +20,7 @@
 #include "blockindexer.h"
 #include "scriptsolver.h"
 #include "blockchaintypes.h"
+#include "metrics.h"
 #include <iostream>
 #include <sstream>
 
@@ -34,12 +35,38 @@ using namespace std;
 // This map keeps the nextTxoIndex in memory for speed - no database fetching on every TX
 unordered_map<string, int> nextTxoIndex;
 
+namespace
+{
+    // Sums up the number of entries and bytes in a write batch
+    class BatchSizeCounter : public leveldb::WriteBatch::Handler {
+    public:
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+        void Put(const leveldb::Slice& key, const leveldb::Slice& value) {
+            entries++;
+            bytes += key.size() + value.size();
+        }
+        void Delete(const leveldb::Slice& key) {
+            entries++;
+            bytes += key.size();
+        }
+    };
+}
 
 
-VtcBlockIndexer::BlockIndexer::BlockIndexer(const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor) {
+
+VtcBlockIndexer::BlockIndexer::BlockIndexer(const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor, const shared_ptr<VtcBlockIndexer::EventHub> eventHub) {
     this->db = db;
     this->mempoolMonitor = mempoolMonitor;
+    this->eventHub = eventHub;
     this->scriptSolver = make_unique<VtcBlockIndexer::ScriptSolver>();
+
+    // Blocks up to the height of an imported UTXO snapshot are backfilled
+    string snapshotHeight;
+    this->snapshotHeight = -1;
+    if(this->db->Get(leveldb::ReadOptions(), "snapshot-height", &snapshotHeight).ok()) {
+        this->snapshotHeight = stoll(snapshotHeight);
+    }
 }
 
 
@@ -64,6 +91,40 @@ int VtcBlockIndexer::BlockIndexer::getNextTxoIndex(string prefix) {
     return nextTxoIndex[prefix];
 }
 
+vector<string> VtcBlockIndexer::BlockIndexer::getAddressesForTxo(leveldb::Iterator* it, const string& txHash, uint32_t index) {
+    vector<string> addresses;
+    stringstream txoAddressKey;
+    txoAddressKey << txHash << setw(8) << setfill('0') << index << "-address-";
+    string start(txoAddressKey.str() + "00000000");
+    string limit(txoAddressKey.str() + "99999999");
+
+    for (it->Seek(start);
+            it->Valid() && it->key().ToString() < limit;
+            it->Next()) {
+        addresses.push_back(it->value().ToString());
+    }
+    return addresses;
+}
+
+bool VtcBlockIndexer::BlockIndexer::lookupSpentOutputs(leveldb::Iterator* it, const Transaction& tx, const unordered_map<string, pair<uint64_t, vector<string>>>& blockOutputs, vector<pair<uint64_t, vector<string>>>& spent) {
+    for(const VtcBlockIndexer::TransactionInput& txi : tx.inputs) {
+        stringstream txoKey;
+        txoKey << txi.txHash << setw(8) << setfill('0') << txi.txoIndex;
+        auto inBlock = blockOutputs.find(txoKey.str());
+        if(inBlock != blockOutputs.end()) {
+            spent.push_back(inBlock->second);
+            continue;
+        }
+
+        string value;
+        if(!this->db->Get(leveldb::ReadOptions(), txoKey.str() + "-value", &value).ok()) {
+            return false;
+        }
+        spent.push_back(make_pair(stoull(value), getAddressesForTxo(it, txi.txHash, txi.txoIndex)));
+    }
+    return true;
+}
+
 bool VtcBlockIndexer::BlockIndexer::clearBlockTxos(string blockHash) {
     leveldb::WriteBatch batch;
     
@@ -107,7 +168,7 @@ bool VtcBlockIndexer::BlockIndexer::hasIndexedBlock(string blockHash, int blockH
     return false;
 }
 
-bool VtcBlockIndexer::BlockIndexer::indexBlock(Block block) {
+bool VtcBlockIndexer::BlockIndexer::indexBlock(Block block, const vector<vector<VtcBlockIndexer::TransactionOutput>>& spentOutputs) {
     //cout << "Indexing block " << block.blockHash << " (Height " << block.height << ")" << endl;
     
     
@@ -174,6 +235,24 @@ bool VtcBlockIndexer::BlockIndexer::indexBlock(Block block) {
     ssBlockTxCountHeightKey << "block-txcount-"  << setw(8) << setfill('0') << block.height;
     batch.Put(ssBlockTxCountHeightKey.str(), std::to_string(block.transactions.size()));
 
+    // Output and spent output addresses per transaction, only collected when
+    // someone listens for address events
+    bool collectAddresses = (this->eventHub != nullptr && this->eventHub->hasAddressSubscriptions());
+    vector<vector<vector<string>>> blockOutputAddresses;
+    vector<vector<vector<string>>> blockInputAddresses;
+
+    // The outputs still unspent at the snapshot height were imported already
+    const bool backfill = (block.height <= this->snapshotHeight);
+
+    // Undo data holds an entry for every transaction but the coinbase. The
+    // block file watcher can get to a block before the node wrote its undo
+    // data, then the spent outputs are looked up in the index instead.
+    const bool hasSpentOutputs = (block.transactions.size() > 0 && spentOutputs.size() == block.transactions.size() - 1);
+    unordered_map<string, pair<uint64_t, vector<string>>> blockOutputs;
+    unique_ptr<leveldb::Iterator> lookupIterator;
+    uint64_t blockFees = 0;
+    bool blockFeesKnown = true;
+
     int txIndex = -1;
     // TODO: Verify block integrity
     for(VtcBlockIndexer::Transaction tx : block.transactions) {
@@ -193,10 +272,33 @@ bool VtcBlockIndexer::BlockIndexer::indexBlock(Block block) {
         txBlockKey << "tx-" << tx.txHash << "-block";
         batch.Put(txBlockKey.str(), block.blockHash);
 
+        if(collectAddresses) {
+            blockOutputAddresses.push_back({});
+            blockInputAddresses.push_back(vector<vector<string>>(tx.inputs.size()));
+        }
+
         for(VtcBlockIndexer::TransactionOutput out : tx.outputs) {
-            vector<string> addresses = this->scriptSolver->getAddressesFromScript(out.script);
+            if(backfill) {
+                stringstream txoValueKey;
+                txoValueKey << tx.txHash << setw(8) << setfill('0') << out.index << "-value";
+                string existingValue;
+                if(this->db->Get(leveldb::ReadOptions(), txoValueKey.str(), &existingValue).ok()) {
+                    continue;
+                }
+            }
+
+            const VtcBlockIndexer::ScriptClassification scriptClass = scriptSolver->classify(out.script.data(), out.script.size());
+            vector<string> addresses = this->scriptSolver->getAddressesFromScript(out.script.data(), out.script.size(), scriptClass);
+            if(collectAddresses) {
+                blockOutputAddresses.back().push_back(addresses);
+            }
+            if(!hasSpentOutputs) {
+                stringstream txoKey;
+                txoKey << tx.txHash << setw(8) << setfill('0') << out.index;
+                blockOutputs[txoKey.str()] = make_pair(out.value, addresses);
+            }
             if(addresses.size() > 1) {
-                if(scriptSolver->isMultiSig(out.script)) {
+                if(scriptClass.type == SCRIPT_TYPE_MULTISIG) {
                     stringstream txoMultiSigKey;
                     txoMultiSigKey << "multisigtx-" << tx.txHash << "-" << setw(8) << setfill('0') << out.index;
                     batch.Put(txoMultiSigKey.str(), std::to_string(scriptSolver->requiredSignatures(out.script)));
@@ -245,12 +347,99 @@ bool VtcBlockIndexer::BlockIndexer::indexBlock(Block block) {
                 batch.Put(blockTxoSpentKey.str(), txSpentKey.str());
             }
         }
-        this->mempoolMonitor->transactionIndexed(tx.txHash);
+
+        // The value and addresses of the output spent by each input
+        vector<pair<uint64_t, vector<string>>> spentByTx;
+        bool spentKnown = false;
+        if(txIndex > 0 && hasSpentOutputs) {
+            for(const VtcBlockIndexer::TransactionOutput& spent : spentOutputs.at(txIndex - 1)) {
+                spentByTx.push_back(make_pair(spent.value, this->scriptSolver->getAddressesFromScript(spent.script.data(), spent.script.size(), scriptSolver->classify(spent.script.data(), spent.script.size()))));
+            }
+            spentKnown = true;
+        } else if(txIndex > 0) {
+            if(!lookupIterator) {
+                lookupIterator.reset(this->db->NewIterator(leveldb::ReadOptions()));
+            }
+            spentKnown = lookupSpentOutputs(lookupIterator.get(), tx, blockOutputs, spentByTx);
+            blockFeesKnown = blockFeesKnown && spentKnown;
+        }
+
+        if(spentKnown) {
+            // The value (16 digits) and addresses of the output spent by each input,
+            // saves looking up every spent output when the transaction is shown
+            uint64_t valueIn = 0;
+            for(size_t i = 0; i < spentByTx.size(); i++) {
+                const vector<string>& addresses = spentByTx.at(i).second;
+
+                stringstream txInputKey;
+                txInputKey << "tx-" << tx.txHash << "-vin-" << setw(8) << setfill('0') << i;
+                stringstream txInputValue;
+                txInputValue << setw(16) << setfill('0') << spentByTx.at(i).first;
+                for(size_t j = 0; j < addresses.size(); j++) {
+                    txInputValue << (j > 0 ? " " : "") << addresses[j];
+                }
+                batch.Put(txInputKey.str(), txInputValue.str());
+                valueIn += spentByTx.at(i).first;
+                if(collectAddresses && i < tx.inputs.size()) {
+                    blockInputAddresses.back()[i] = addresses;
+                }
+            }
+
+            uint64_t valueOut = 0;
+            for(const VtcBlockIndexer::TransactionOutput& out : tx.outputs) {
+                valueOut += out.value;
+            }
+            const uint64_t fee = (valueIn > valueOut ? valueIn - valueOut : 0);
+            batch.Put("tx-" + tx.txHash + "-fee", std::to_string(fee));
+            blockFees += fee;
+        }
+        if(this->mempoolMonitor != nullptr) {
+            this->mempoolMonitor->transactionIndexed(tx);
+        }
     }
 
-    
-    this->db->Write(leveldb::WriteOptions(), &batch);
+    // Without all spent outputs drop the fees a reorged out block at this height may have left
+    stringstream ssBlockFeesHeightKey;
+    ssBlockFeesHeightKey << "block-fees-" << setw(8) << setfill('0') << block.height;
+    if(blockFeesKnown) {
+        batch.Put(ssBlockFeesHeightKey.str(), std::to_string(blockFees));
+    } else {
+        batch.Delete(ssBlockFeesHeightKey.str());
+    }
 
+    
+    static VtcBlockIndexer::MetricHistogram& batchBytes = VtcBlockIndexer::Metrics::histogram("indexer_batch_bytes", "Size of the write batch per indexed block", VtcBlockIndexer::Metrics::sizeBuckets());
+    static VtcBlockIndexer::MetricCounter& batchEntries = VtcBlockIndexer::Metrics::counter("indexer_batch_entries_total", "Keys written or deleted by indexed blocks");
+    static VtcBlockIndexer::MetricHistogram& writeLatency = VtcBlockIndexer::Metrics::histogram("indexer_batch_write_seconds", "Time to write the batch of an indexed block", VtcBlockIndexer::Metrics::latencyBuckets());
+    static VtcBlockIndexer::MetricCounter& blocksIndexed = VtcBlockIndexer::Metrics::counter("indexer_blocks_indexed_total", "Blocks written to the index");
+    static VtcBlockIndexer::MetricCounter& transactionsIndexed = VtcBlockIndexer::Metrics::counter("indexer_transactions_indexed_total", "Transactions written to the index");
+    static VtcBlockIndexer::MetricGauge& indexedHeight = VtcBlockIndexer::Metrics::gauge("indexer_height", "Height of the last indexed block");
+    static VtcBlockIndexer::MetricCounter& blocksWithoutUndo = VtcBlockIndexer::Metrics::counter("indexer_blocks_without_undo_total", "Blocks indexed before their undo data was written, with the spent outputs looked up in the index");
+
+    BatchSizeCounter batchSize;
+    batch.Iterate(&batchSize);
+    batchBytes.observe(batchSize.bytes);
+    batchEntries.increment(batchSize.entries);
+    {
+        VtcBlockIndexer::ScopedTimer timer(writeLatency);
+        this->db->Write(leveldb::WriteOptions(), &batch);
+    }
+    blocksIndexed.increment();
+    if(!hasSpentOutputs) {
+        blocksWithoutUndo.increment();
+    }
+    transactionsIndexed.increment(block.transactions.size());
+    indexedHeight.set(block.height);
+
+    // Subscribers were told about the chain tip already, not about history
+    if(this->eventHub != nullptr && !backfill) {
+        this->eventHub->publishBlock(block);
+        if(collectAddresses) {
+            for(size_t i = 0; i < block.transactions.size(); i++) {
+                this->eventHub->publishTransaction(block.transactions.at(i), blockOutputAddresses.at(i), blockInputAddresses.at(i), block.height);
+            }
+        }
+    }
  
 
     return true;
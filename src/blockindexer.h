@@ -24,11 +24,13 @@
 
 #include <iostream>
 #include <fstream>
+#include <unordered_map>
 #include "leveldb/db.h"
 #include "leveldb/write_batch.h"
 #include "blockchaintypes.h"
 #include "scriptsolver.h"
 #include "mempoolmonitor.h"
+#include "eventhub.h"
 
 using namespace std;
 
@@ -43,13 +45,20 @@ namespace VtcBlockIndexer {
 
 class BlockIndexer {
 public:
-    /** Constructs a BlockIndexer instance using the given block data directory
+    /** Constructs a BlockIndexer instance using the given block data directory.
+     * The mempool monitor and the event hub may be null.
      */
-    BlockIndexer(const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor);
-
-    /** Indexes the contents of the block
+    BlockIndexer(const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor, const shared_ptr<VtcBlockIndexer::EventHub> eventHub);
+
+    /** Indexes the contents of the block. When spentOutputs holds the outputs
+     * spent by each transaction after the coinbase, as read from the undo
+     * files, the fees and the value and addresses of each input are stored
+     * too. Pass an empty vector when they are not known.
+     *
+     * Blocks up to the height of an imported UTXO snapshot only add the
+     * outputs that were spent before the snapshot, and are not published.
      */
-    bool indexBlock(Block block);
+    bool indexBlock(Block block, const vector<vector<VtcBlockIndexer::TransactionOutput>>& spentOutputs);
 
     /** Returns true when there's already a block with the passed hash
      * in the index at the passed blockheight. No need to reindex
@@ -66,8 +75,25 @@ private:
      */
     int getNextTxoIndex(string prefix);
 
+    /** Returns the addresses an output pays to, from the index. The iterator
+     * is reused for all the lookups of a block.
+     */
+    vector<string> getAddressesForTxo(leveldb::Iterator* it, const string& txHash, uint32_t index);
+
+    /** Looks up the value and addresses of the output each input of a
+     * transaction spends, for blocks whose undo data is not written yet.
+     * Outputs created earlier in the block come from blockOutputs, keyed by
+     * txid and output index, the others from the index. Returns false if one
+     * of them is not found.
+     */
+    bool lookupSpentOutputs(leveldb::Iterator* it, const Transaction& tx, const unordered_map<string, pair<uint64_t, vector<string>>>& blockOutputs, vector<pair<uint64_t, vector<string>>>& spent);
+
     shared_ptr<leveldb::DB> db;
     shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor;
+    shared_ptr<VtcBlockIndexer::EventHub> eventHub;
+
+    // Height of the imported UTXO snapshot, -1 without one
+    int64_t snapshotHeight;
 
     // Reference to the scriptsolver class
     unique_ptr<VtcBlockIndexer::ScriptSolver> scriptSolver;
@@ -18,9 +18,11 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "blockreader.h"
+#include "blockfile.h"
 #include "filereader.h"
 #include "blockchaintypes.h"
 #include "utility.h"
+#include "metrics.h"
 #include <string.h>
 #include <memory>
 #include <sstream>
@@ -40,7 +42,7 @@ VtcBlockIndexer::BlockReader::BlockReader(const string blocksDir) {
 std::vector<unsigned char> VtcBlockIndexer::BlockReader::readRawBlockHeader(string fileName, uint64_t filePosition) {
     stringstream ss;
     ss << blocksDir << "/" << fileName;
-    ifstream blockFile(ss.str(), ios_base::in | ios_base::binary);
+    VtcBlockIndexer::BlockFile blockFile(ss.str());
     vector<unsigned char> blockHeader(80);
     blockFile.read(reinterpret_cast<char *>(&blockHeader[0]) , 80);
     blockFile.close();
@@ -49,6 +51,9 @@ std::vector<unsigned char> VtcBlockIndexer::BlockReader::readRawBlockHeader(stri
     
 
 VtcBlockIndexer::Block VtcBlockIndexer::BlockReader::readBlock(string fileName, uint64_t filePosition, uint64_t blockHeight, bool headerOnly) {
+    static VtcBlockIndexer::MetricHistogram& readLatency = VtcBlockIndexer::Metrics::histogram("blockreader_read_seconds", "Time to read and parse a block from the block files", VtcBlockIndexer::Metrics::latencyBuckets());
+    VtcBlockIndexer::ScopedTimer timer(readLatency);
+
     VtcBlockIndexer::Block fullBlock;
 
     fullBlock.fileName = fileName;
@@ -57,7 +62,7 @@ VtcBlockIndexer::Block VtcBlockIndexer::BlockReader::readBlock(string fileName,
     
     stringstream ss;
     ss << blocksDir << "/" << fileName;
-    ifstream blockFile(ss.str(), ios_base::in | ios_base::binary);
+    VtcBlockIndexer::BlockFile blockFile(ss.str());
     
     if(!blockFile.is_open()) {
         cerr << "Block file [" << ss.str() << "] could not be opened" << endl;
@@ -67,7 +72,7 @@ VtcBlockIndexer::Block VtcBlockIndexer::BlockReader::readBlock(string fileName,
     blockFile.seekg(filePosition, ios_base::beg);
     vector<unsigned char> blockHeader(80);
     blockFile.read(reinterpret_cast<char *>(&blockHeader[0]) , 80);
-    fullBlock.blockHash = VtcBlockIndexer::Utility::hashToReverseHex(VtcBlockIndexer::Utility::sha256(VtcBlockIndexer::Utility::sha256(blockHeader)));
+    fullBlock.blockHash = VtcBlockIndexer::Utility::hashToReverseHex(VtcBlockIndexer::Utility::sha256d(blockHeader.data(), blockHeader.size()));
    
     blockFile.seekg(filePosition, ios_base::beg);
     
@@ -178,7 +183,7 @@ VtcBlockIndexer::Transaction VtcBlockIndexer::BlockReader::readTransaction(istre
     
     blockFile.seekg(endPosTx-4, ios_base::beg);
     blockFile.read(reinterpret_cast<char *>(&txHashBytes[0] + 4 + txitxoLength), sizeof(transaction.lockTime));
-    transaction.txHash = VtcBlockIndexer::Utility::hashToReverseHex(VtcBlockIndexer::Utility::sha256(VtcBlockIndexer::Utility::sha256(txHashBytes)));
+    transaction.txHash = VtcBlockIndexer::Utility::hashToReverseHex(VtcBlockIndexer::Utility::sha256d(txHashBytes.data(), txHashBytes.size()));
 
     transaction.byteSize = endPosTx-startPosTx;
         
@@ -187,7 +192,7 @@ VtcBlockIndexer::Transaction VtcBlockIndexer::BlockReader::readTransaction(istre
         uint64_t length = endPosTx-startPosTx;
         std::vector<unsigned char> transactionBytes(length);
         blockFile.read(reinterpret_cast<char *>(&transactionBytes[0]) , length);
-        transaction.txWitHash = VtcBlockIndexer::Utility::hashToReverseHex(VtcBlockIndexer::Utility::sha256(VtcBlockIndexer::Utility::sha256(transactionBytes)));
+        transaction.txWitHash = VtcBlockIndexer::Utility::hashToReverseHex(VtcBlockIndexer::Utility::sha256d(transactionBytes.data(), transactionBytes.size()));
     } else {
         transaction.txWitHash = string(transaction.txHash);
     }
@@ -19,6 +19,7 @@
 */
 #include "blockscanner.h"
 #include "utility.h"
+#include "crypto/sha256.h"
 #include <string.h>
 #include <memory>
 #include <sstream>
@@ -34,7 +35,7 @@ VtcBlockIndexer::BlockScanner::BlockScanner(const std::string blocksDir, const s
 }
 
 bool VtcBlockIndexer::BlockScanner::open() {
-    this->blockFileStream.open(this->blockFilePath, std::ios_base::in | std::ios_base::binary);
+    this->blockFileStream.open(this->blockFilePath);
     return this->blockFileStream.is_open();
 }
 
@@ -69,16 +70,56 @@ VtcBlockIndexer::ScannedBlock VtcBlockIndexer::BlockScanner::scanNextBlock() {
     // use that to read the actual block later after sorting the blockchain.
     block.fileName = this->blockFileName;
     block.filePosition = this->blockFileStream.tellg();
+    block.mainChain = false;
 
     vector<unsigned char> blockHeader(80);
     this->blockFileStream.read(reinterpret_cast<char *>(&blockHeader[0]) , 80);
 
-    block.blockHash = VtcBlockIndexer::Utility::hashToReverseHex(VtcBlockIndexer::Utility::sha256(VtcBlockIndexer::Utility::sha256(blockHeader)));
+    block.blockHash = VtcBlockIndexer::Utility::hashToReverseHex(VtcBlockIndexer::Utility::sha256d(blockHeader.data(), blockHeader.size()));
     vector<unsigned char> previousBlockHash(32);
     memcpy(&previousBlockHash[0], &blockHeader[4], 32);
     block.previousBlockHash =  VtcBlockIndexer::Utility::hashToReverseHex(previousBlockHash);
+    memcpy(&block.time, &blockHeader[68], 4);
     
     this->blockFileStream.seekg(blockSize - 80, std::ios_base::cur);
 
     return block;
+}
+
+std::vector<VtcBlockIndexer::ScannedBlock> VtcBlockIndexer::BlockScanner::scanAllBlocks() {
+    std::vector<VtcBlockIndexer::ScannedBlock> blocks;
+    std::vector<unsigned char> headers;
+
+    while(moveNext()) {
+        VtcBlockIndexer::ScannedBlock block;
+
+        uint32_t blockSize;
+        this->blockFileStream.read(reinterpret_cast<char *>(&blockSize), sizeof(blockSize));
+        block.fileName = this->blockFileName;
+        block.filePosition = this->blockFileStream.tellg();
+        block.mainChain = false;
+
+        headers.resize(headers.size() + 80);
+        this->blockFileStream.read(reinterpret_cast<char *>(&headers[headers.size() - 80]), 80);
+        if(this->blockFileStream.fail()) {
+            headers.resize(headers.size() - 80);
+            break;
+        }
+
+        vector<unsigned char> previousBlockHash(&headers[headers.size() - 76], &headers[headers.size() - 44]);
+        block.previousBlockHash = VtcBlockIndexer::Utility::hashToReverseHex(previousBlockHash);
+        memcpy(&block.time, &headers[headers.size() - 12], 4);
+        blocks.push_back(block);
+
+        this->blockFileStream.seekg(blockSize - 80, std::ios_base::cur);
+    }
+
+    std::vector<unsigned char> hashes(blocks.size() * 32);
+    if(blocks.size() > 0) {
+        SHA256D80(&hashes[0], &headers[0], blocks.size());
+    }
+    for(size_t i = 0; i < blocks.size(); i++) {
+        blocks[i].blockHash = VtcBlockIndexer::Utility::hashToReverseHex(vector<unsigned char>(&hashes[i * 32], &hashes[i * 32] + 32));
+    }
+    return blocks;
 }
\ No newline at end of file
@@ -26,6 +26,7 @@
 #include <fstream>
 
 #include "blockchaintypes.h"
+#include "blockfile.h"
 #include "coinparams.h"
 namespace VtcBlockIndexer {
 
@@ -64,6 +65,12 @@ public:
      */
     ScannedBlock scanNextBlock();
 
+    /** Scans all remaining blocks in the file. Reads the headers first and
+     *  hashes them in one batch, which lets the hasher work on several
+     *  headers at once.
+     */
+    std::vector<ScannedBlock> scanAllBlocks();
+
     /** Closes the file
      */
     bool close();
@@ -72,7 +79,7 @@ private:
 
     /** Reference to the stream when the blockfile was opened
      */
-    std::ifstream blockFileStream;
+    BlockFile blockFileStream;
     
     /** Full path to the blockfile
      */
@@ -0,0 +1,171 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the 
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+    
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "coinreader.h"
+#include "utility.h"
+#include <string.h>
+
+using namespace std;
+
+namespace
+{
+    // Core replaces scripts longer than this by OP_RETURN when storing coins
+    const uint64_t MAX_SCRIPT_SIZE = 10000;
+
+    // Inverse of Core's CompressAmount, which drops trailing zeroes
+    uint64_t decompressAmount(uint64_t x) {
+        if(x == 0) return 0;
+        x--;
+        int exponent = x % 10;
+        x /= 10;
+        uint64_t n = 0;
+        if(exponent < 9) {
+            int digit = (x % 9) + 1;
+            x /= 9;
+            n = x * 10 + digit;
+        } else {
+            n = x + 1;
+        }
+        while(exponent > 0) {
+            n *= 10;
+            exponent--;
+        }
+        return n;
+    }
+}
+
+VtcBlockIndexer::CoinReader::CoinReader(const unsigned char* data, size_t size) : data(data), size(size), offset(0), failed(false) {
+}
+
+unsigned char VtcBlockIndexer::CoinReader::readByte() {
+    if(offset >= size) {
+        failed = true;
+        return 0;
+    }
+    return data[offset++];
+}
+
+uint64_t VtcBlockIndexer::CoinReader::readCompactSize() {
+    unsigned char prefix = readByte();
+    if(prefix < 0xfd) return prefix;
+    return readInteger(prefix == 0xfd ? 2 : (prefix == 0xfe ? 4 : 8));
+}
+
+uint64_t VtcBlockIndexer::CoinReader::readVarInt() {
+    uint64_t value = 0;
+    while(true) {
+        if(value > (UINT64_MAX >> 7)) {
+            failed = true;
+            return 0;
+        }
+        unsigned char byte = readByte();
+        value = (value << 7) | (byte & 0x7f);
+        if((byte & 0x80) == 0 || failed) return value;
+        value++;
+    }
+}
+
+uint64_t VtcBlockIndexer::CoinReader::readInteger(size_t bytes) {
+    uint64_t value = 0;
+    for(size_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)readByte() << (8 * i);
+    }
+    return value;
+}
+
+const unsigned char* VtcBlockIndexer::CoinReader::readBytes(size_t length) {
+    if(size - offset < length) {
+        failed = true;
+        return nullptr;
+    }
+    const unsigned char* start = data + offset;
+    offset += length;
+    return start;
+}
+
+bool VtcBlockIndexer::CoinReader::readCoin(TransactionOutput& output, uint32_t& height, bool undoFormat) {
+    uint64_t code = readVarInt();
+    height = (uint32_t)(code >> 1);
+    if(undoFormat && height > 0) {
+        readVarInt();
+    }
+    output.value = decompressAmount(readVarInt());
+    return readScript(output.script) && !failed;
+}
+
+bool VtcBlockIndexer::CoinReader::readScript(vector<unsigned char>& script) {
+    uint64_t type = readVarInt();
+    if(failed) return false;
+
+    if(type == 0 || type == 1) {
+        const unsigned char* hash = readBytes(20);
+        if(hash == nullptr) return false;
+        if(type == 0) {
+            script = { 0x76, 0xa9, 0x14 };
+            script.insert(script.end(), hash, hash + 20);
+            script.push_back(0x88);
+            script.push_back(0xac);
+        } else {
+            script = { 0xa9, 0x14 };
+            script.insert(script.end(), hash, hash + 20);
+            script.push_back(0x87);
+        }
+        return true;
+    }
+
+    if(type < 6) {
+        const unsigned char* x = readBytes(32);
+        if(x == nullptr) return false;
+        vector<unsigned char> publicKey(33);
+        publicKey[0] = (type < 4 ? type : type - 2);
+        memcpy(&publicKey[1], x, 32);
+        if(type >= 4) {
+            // Uncompressed keys only keep the x coordinate and the parity of y
+            publicKey = VtcBlockIndexer::Utility::decompressPubKey(publicKey);
+            if(publicKey.size() != 65) return false;
+        }
+        script.clear();
+        script.push_back((unsigned char)publicKey.size());
+        script.insert(script.end(), publicKey.begin(), publicKey.end());
+        script.push_back(0xac);
+        return true;
+    }
+
+    uint64_t length = type - 6;
+    if(length > MAX_SCRIPT_SIZE) {
+        script = { 0x6a };
+        return readBytes(length) != nullptr;
+    }
+    const unsigned char* raw = readBytes(length);
+    if(raw == nullptr) return false;
+    script.assign(raw, raw + length);
+    return true;
+}
+
+bool VtcBlockIndexer::CoinReader::ok() const {
+    return !failed;
+}
+
+bool VtcBlockIndexer::CoinReader::atEnd() const {
+    return offset == size;
+}
+
+size_t VtcBlockIndexer::CoinReader::position() const {
+    return offset;
+}
@@ -0,0 +1,93 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the 
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+    
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef COINREADER_H_INCLUDED
+#define COINREADER_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "blockchaintypes.h"
+
+namespace VtcBlockIndexer {
+
+/**
+ * The CoinReader class reads the compact serialization Vertcoin Core uses to
+ * store unspent outputs, in undo records and UTXO snapshots, from a buffer.
+ * Amounts are stored without their trailing zeroes and the common script types
+ * without their opcodes. Reading past the end of the buffer sets a failed
+ * state instead of throwing, so a caller reading from a file in pieces can
+ * retry a record once more data is in the buffer.
+ */
+
+class CoinReader {
+public:
+    /** Constructs a CoinReader over size bytes of data */
+    CoinReader(const unsigned char* data, size_t size);
+
+    /** Reads Bitcoin's CompactSize encoding */
+    uint64_t readCompactSize();
+
+    /** Reads Core's VARINT encoding: 7 bits per byte, most significant first,
+     * with an offset of one added for every continuation byte
+     */
+    uint64_t readVarInt();
+
+    /** Reads a little-endian integer of the given number of bytes */
+    uint64_t readInteger(size_t bytes);
+
+    /** Returns a pointer to the next length bytes and skips them, or nullptr
+     * when there are not enough bytes left
+     */
+    const unsigned char* readBytes(size_t length);
+
+    /** Reads a coin: its height and coinbase flag, then the compressed amount
+     * and script. Undo records hold an unused version number behind the height
+     * of coins above height 0. Returns false if the coin could not be read.
+     */
+    bool readCoin(TransactionOutput& output, uint32_t& height, bool undoFormat);
+
+    bool ok() const;
+
+    bool atEnd() const;
+
+    /** Number of bytes read so far */
+    size_t position() const;
+
+private:
+    unsigned char readByte();
+
+    /** Reads a script, types 0 to 5 are stored without their opcodes and other
+     * scripts in full with their size plus 6
+     */
+    bool readScript(std::vector<unsigned char>& script);
+
+    const unsigned char* data;
+    size_t size;
+    size_t offset;
+    bool failed;
+};
+
+}
+
+#endif // COINREADER_H_INCLUDED
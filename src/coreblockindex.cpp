@@ -0,0 +1,144 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the 
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+    
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "coreblockindex.h"
+#include "utility.h"
+#include "leveldb/db.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // Status flags of a block index record
+    const uint64_t BLOCK_HAVE_DATA = 8;
+    const uint64_t BLOCK_HAVE_UNDO = 16;
+    const uint64_t BLOCK_FAILED_VALID = 32;
+    const uint64_t BLOCK_FAILED_CHILD = 64;
+
+    // Block index records are keyed by 'b' and the block hash
+    const char BLOCK_INDEX_KEY = 'b';
+    const size_t BLOCK_INDEX_KEY_SIZE = 33;
+
+    // Core's VARINT encoding: 7 bits per byte, most significant first, with
+    // an offset of one added for every continuation byte. Sets failed when
+    // the data ends early or the value does not fit.
+    uint64_t readVarInt(const unsigned char* data, size_t size, size_t& position, bool& failed) {
+        uint64_t value = 0;
+        while(!failed) {
+            if(position >= size || value > (UINT64_MAX >> 7)) {
+                failed = true;
+                break;
+            }
+            unsigned char byte = data[position++];
+            value = (value << 7) | (byte & 0x7f);
+            if((byte & 0x80) == 0) return value;
+            value++;
+        }
+        return 0;
+    }
+}
+
+VtcBlockIndexer::CoreBlockIndex::CoreBlockIndex(const string indexDir) {
+    this->indexDir = indexDir;
+}
+
+int VtcBlockIndexer::CoreBlockIndex::readBlocks(const function<void(const ScannedBlock& block)>& handler) {
+    leveldb::DB* db;
+    leveldb::Options options;
+    options.create_if_missing = false;
+    leveldb::Status status = leveldb::DB::Open(options, indexDir, &db);
+    if(!status.ok()) {
+        cerr << "Block index [" << indexDir << "] could not be opened: " << status.ToString() << endl;
+        return -1;
+    }
+    unique_ptr<leveldb::DB> database(db);
+
+    leveldb::ReadOptions readOptions;
+    readOptions.fill_cache = false;
+    unique_ptr<leveldb::Iterator> it(database->NewIterator(readOptions));
+
+    int lastFile = 0;
+    for (it->Seek(string(1, BLOCK_INDEX_KEY));
+            it->Valid() && it->key().size() > 0 && it->key().data()[0] == BLOCK_INDEX_KEY;
+            it->Next()) {
+        if(it->key().size() != BLOCK_INDEX_KEY_SIZE) {
+            continue;
+        }
+
+        // The record is a CDiskBlockIndex: the client version, height, status,
+        // number of transactions, then the file and positions depending on the
+        // status, and finally the block header
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(it->value().data());
+        const size_t size = it->value().size();
+        size_t position = 0;
+        bool failed = false;
+        readVarInt(data, size, position, failed);
+        readVarInt(data, size, position, failed);
+        const uint64_t blockStatus = readVarInt(data, size, position, failed);
+        readVarInt(data, size, position, failed);
+        uint64_t file = 0;
+        uint64_t dataPosition = 0;
+        if(blockStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)) {
+            file = readVarInt(data, size, position, failed);
+        }
+        if(blockStatus & BLOCK_HAVE_DATA) {
+            dataPosition = readVarInt(data, size, position, failed);
+        }
+        if(blockStatus & BLOCK_HAVE_UNDO) {
+            readVarInt(data, size, position, failed);
+        }
+        if(failed || size - position < 80) {
+            cerr << "Block index [" << indexDir << "] has a malformed record, falling back to scanning the block files" << endl;
+            return -1;
+        }
+
+        if((blockStatus & BLOCK_HAVE_DATA) == 0 || (blockStatus & (BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD)) != 0) {
+            continue;
+        }
+
+        // The position points at the block header, behind the magic and the
+        // block size, like the position of a scanned block
+        VtcBlockIndexer::ScannedBlock block;
+        stringstream fileName;
+        fileName << "blk" << setw(5) << setfill('0') << file << ".dat";
+        block.fileName = fileName.str();
+        block.filePosition = dataPosition;
+        block.blockSize = 0;
+        block.blockHash = VtcBlockIndexer::Utility::hashToReverseHex(vector<unsigned char>(it->key().data() + 1, it->key().data() + BLOCK_INDEX_KEY_SIZE));
+        block.previousBlockHash = VtcBlockIndexer::Utility::hashToReverseHex(vector<unsigned char>(data + position + 4, data + position + 36));
+        memcpy(&block.time, data + position + 68, 4);
+        block.mainChain = false;
+        handler(block);
+
+        lastFile = max(lastFile, (int)file);
+    }
+    if(!it->status().ok()) {
+        cerr << "Block index [" << indexDir << "] could not be read: " << it->status().ToString() << endl;
+        return -1;
+    }
+    return lastFile;
+}
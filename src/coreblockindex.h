@@ -0,0 +1,68 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the 
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+    
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef COREBLOCKINDEX_H_INCLUDED
+#define COREBLOCKINDEX_H_INCLUDED
+
+#include <functional>
+#include <string>
+
+#include "blockchaintypes.h"
+
+namespace VtcBlockIndexer {
+
+/**
+ * The CoreBlockIndex class reads block positions from the blocks/index
+ * database of Vertcoin Core, which holds a record for every block header the
+ * node knows, with the file and position of the block data. Reading it
+ * replaces scanning the headers of every blk????.dat file.
+ *
+ * The node keeps its database locked while running, so this reads a copy of
+ * the directory. Blocks written after the copy was taken are only in the block
+ * files, which is why the files from the last one the copy knows about need
+ * to be scanned still.
+ */
+
+class CoreBlockIndex {
+public:
+    /** Constructs a CoreBlockIndex instance
+     *
+     * @param indexDir required Directory holding the copy of blocks/index.
+     */
+    CoreBlockIndex(const std::string indexDir);
+
+    /** Passes every block the node has the data of, and that was not found to
+     * be invalid, to the handler as a ScannedBlock. Returns the number of the
+     * last block file holding any of them, or -1 if the database could not
+     * be read.
+     */
+    int readBlocks(const std::function<void(const ScannedBlock& block)>& handler);
+
+private:
+
+    /** Directory holding the copy of blocks/index
+     */
+    std::string indexDir;
+};
+
+}
+
+#endif // COREBLOCKINDEX_H_INCLUDED
@@ -32,8 +32,37 @@ data Cat(data x, const data& y)
     return x;
 }
 
-
-
+/** Feed one 5-bit value into a checksum computation, see PolyMod below. */
+inline uint32_t PolyModStep(uint32_t c, uint8_t v_i)
+{
+    // We want to update `c` to correspond to a polynomial with one extra term. If the initial
+    // value of `c` consists of the coefficients of c(x) = f(x) mod g(x), we modify it to
+    // correspond to c'(x) = (f(x) * x + v_i) mod g(x), where v_i is the next input to
+    // process. Simplifying:
+    // c'(x) = (f(x) * x + v_i) mod g(x)
+    //         ((f(x) mod g(x)) * x + v_i) mod g(x)
+    //         (c(x) * x + v_i) mod g(x)
+    // If c(x) = c0*x^5 + c1*x^4 + c2*x^3 + c3*x^2 + c4*x + c5, we want to compute
+    // c'(x) = (c0*x^5 + c1*x^4 + c2*x^3 + c3*x^2 + c4*x + c5) * x + v_i mod g(x)
+    //       = c0*x^6 + c1*x^5 + c2*x^4 + c3*x^3 + c4*x^2 + c5*x + v_i mod g(x)
+    //       = c0*(x^6 mod g(x)) + c1*x^5 + c2*x^4 + c3*x^3 + c4*x^2 + c5*x + v_i
+    // If we call (x^6 mod g(x)) = k(x), this can be written as
+    // c'(x) = (c1*x^5 + c2*x^4 + c3*x^3 + c4*x^2 + c5*x + v_i) + c0*k(x)
+
+    // First, determine the value of c0:
+    uint8_t c0 = c >> 25;
+
+    // Then compute c1*x^5 + c2*x^4 + c3*x^3 + c4*x^2 + c5*x + v_i:
+    c = ((c & 0x1ffffff) << 5) ^ v_i;
+
+    // Finally, for each set bit n in c0, conditionally add {2^n}k(x):
+    if (c0 & 1)  c ^= 0x3b6a57b2; //     k(x) = {29}x^5 + {22}x^4 + {20}x^3 + {21}x^2 + {29}x + {18}
+    if (c0 & 2)  c ^= 0x26508e6d; //  {2}k(x) = {19}x^5 +  {5}x^4 +     x^3 +  {3}x^2 + {19}x + {13}
+    if (c0 & 4)  c ^= 0x1ea119fa; //  {4}k(x) = {15}x^5 + {10}x^4 +  {2}x^3 +  {6}x^2 + {15}x + {26}
+    if (c0 & 8)  c ^= 0x3d4233dd; //  {8}k(x) = {30}x^5 + {20}x^4 +  {4}x^3 + {12}x^2 + {30}x + {29}
+    if (c0 & 16) c ^= 0x2a1462b3; // {16}k(x) = {21}x^5 +     x^4 +  {8}x^3 + {24}x^2 + {21}x + {19}
+    return c;
+}
 
 /** This function will compute what 6 5-bit values to XOR into the last 6 input values, in order to
  *  make the checksum 0. These 6 values are packed together in a single 30-bit integer. The higher
@@ -67,32 +96,7 @@ uint32_t PolyMod(const data& v)
     // for `c`.
     uint32_t c = 1;
     for (auto v_i : v) {
-        // We want to update `c` to correspond to a polynomial with one extra term. If the initial
-        // value of `c` consists of the coefficients of c(x) = f(x) mod g(x), we modify it to
-        // correspond to c'(x) = (f(x) * x + v_i) mod g(x), where v_i is the next input to
-        // process. Simplifying:
-        // c'(x) = (f(x) * x + v_i) mod g(x)
-        //         ((f(x) mod g(x)) * x + v_i) mod g(x)
-        //         (c(x) * x + v_i) mod g(x)
-        // If c(x) = c0*x^5 + c1*x^4 + c2*x^3 + c3*x^2 + c4*x + c5, we want to compute
-        // c'(x) = (c0*x^5 + c1*x^4 + c2*x^3 + c3*x^2 + c4*x + c5) * x + v_i mod g(x)
-        //       = c0*x^6 + c1*x^5 + c2*x^4 + c3*x^3 + c4*x^2 + c5*x + v_i mod g(x)
-        //       = c0*(x^6 mod g(x)) + c1*x^5 + c2*x^4 + c3*x^3 + c4*x^2 + c5*x + v_i
-        // If we call (x^6 mod g(x)) = k(x), this can be written as
-        // c'(x) = (c1*x^5 + c2*x^4 + c3*x^3 + c4*x^2 + c5*x + v_i) + c0*k(x)
-
-        // First, determine the value of c0:
-        uint8_t c0 = c >> 25;
-
-        // Then compute c1*x^5 + c2*x^4 + c3*x^3 + c4*x^2 + c5*x + v_i:
-        c = ((c & 0x1ffffff) << 5) ^ v_i;
-
-        // Finally, for each set bit n in c0, conditionally add {2^n}k(x):
-        if (c0 & 1)  c ^= 0x3b6a57b2; //     k(x) = {29}x^5 + {22}x^4 + {20}x^3 + {21}x^2 + {29}x + {18}
-        if (c0 & 2)  c ^= 0x26508e6d; //  {2}k(x) = {19}x^5 +  {5}x^4 +     x^3 +  {3}x^2 + {19}x + {13}
-        if (c0 & 4)  c ^= 0x1ea119fa; //  {4}k(x) = {15}x^5 + {10}x^4 +  {2}x^3 +  {6}x^2 + {15}x + {26}
-        if (c0 & 8)  c ^= 0x3d4233dd; //  {8}k(x) = {30}x^5 + {20}x^4 +  {4}x^3 + {12}x^2 + {30}x + {29}
-        if (c0 & 16) c ^= 0x2a1462b3; // {16}k(x) = {21}x^5 +     x^4 +  {8}x^3 + {24}x^2 + {21}x + {19}
+        c = PolyModStep(c, v_i);
     }
     return c;
 }
@@ -160,6 +164,57 @@ std::string Encode(const std::string& hrp, const data& values) {
     return ret;
 }
 
+/** Encode a witness program without intermediate buffers. */
+size_t EncodeWitnessProgram(char* out, const std::string& hrp, uint8_t witver, const unsigned char* program, size_t length)
+{
+    // Same checksum as CreateChecksum, fed with the expanded HRP and the
+    // 5-bit groups as they are produced instead of from a vector.
+    uint32_t c = 1;
+    for (size_t i = 0; i < hrp.size(); ++i) {
+        c = PolyModStep(c, (unsigned char)hrp[i] >> 5);
+    }
+    c = PolyModStep(c, 0);
+    for (size_t i = 0; i < hrp.size(); ++i) {
+        c = PolyModStep(c, (unsigned char)hrp[i] & 0x1f);
+    }
+
+    size_t pos = 0;
+    for (size_t i = 0; i < hrp.size(); ++i) {
+        out[pos++] = hrp[i];
+    }
+    out[pos++] = '1';
+    out[pos++] = CHARSET[witver];
+    c = PolyModStep(c, witver);
+
+    // Regroup the program from 8 to 5 bits, padding the last group with zeroes
+    uint32_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < length; ++i) {
+        acc = ((acc << 8) | program[i]) & 0xfff;
+        bits += 8;
+        while (bits >= 5) {
+            bits -= 5;
+            uint8_t v = (acc >> bits) & 31;
+            c = PolyModStep(c, v);
+            out[pos++] = CHARSET[v];
+        }
+    }
+    if (bits > 0) {
+        uint8_t v = (acc << (5 - bits)) & 31;
+        c = PolyModStep(c, v);
+        out[pos++] = CHARSET[v];
+    }
+
+    for (int i = 0; i < 6; ++i) {
+        c = PolyModStep(c, 0);
+    }
+    uint32_t mod = c ^ 1;
+    for (size_t i = 0; i < 6; ++i) {
+        out[pos++] = CHARSET[(mod >> (5 * (5 - i))) & 31];
+    }
+    return pos;
+}
+
 /** Decode a Bech32 string. */
 std::pair<std::string, data> Decode(const std::string& str) {
     bool lower = false, upper = false;
@@ -19,6 +19,11 @@ namespace bech32
 /** Encode a Bech32 string. Returns the empty string in case of failure. */
 std::string Encode(const std::string& hrp, const std::vector<uint8_t>& values);
 
+/** Encode a segwit address of the given witness version and program into out,
+ *  which needs room for hrp.size() + 2 + (length * 8 + 4) / 5 + 6 characters.
+ *  Returns the number of characters written. */
+size_t EncodeWitnessProgram(char* out, const std::string& hrp, uint8_t witver, const unsigned char* program, size_t length);
+
 /** Decode a Bech32 string. Returns (hrp, data). Empty hrp means failure. */
 std::pair<std::string, std::vector<uint8_t>> Decode(const std::string& str);
 
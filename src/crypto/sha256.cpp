@@ -0,0 +1,360 @@
+// Copyright (c) 2014-2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sha256.h"
+
+#include "common.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(ENABLE_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace sha256d80_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal SHA-256 implementation.
+namespace sha256
+{
+uint32_t inline Ch(uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); }
+uint32_t inline Maj(uint32_t x, uint32_t y, uint32_t z) { return (x & y) | (z & (x | y)); }
+uint32_t inline Sigma0(uint32_t x) { return (x >> 2 | x << 30) ^ (x >> 13 | x << 19) ^ (x >> 22 | x << 10); }
+uint32_t inline Sigma1(uint32_t x) { return (x >> 6 | x << 26) ^ (x >> 11 | x << 21) ^ (x >> 25 | x << 7); }
+uint32_t inline sigma0(uint32_t x) { return (x >> 7 | x << 25) ^ (x >> 18 | x << 14) ^ (x >> 3); }
+uint32_t inline sigma1(uint32_t x) { return (x >> 17 | x << 15) ^ (x >> 19 | x << 13) ^ (x >> 10); }
+
+/** One round of SHA-256. */
+void inline Round(uint32_t a, uint32_t b, uint32_t c, uint32_t& d, uint32_t e, uint32_t f, uint32_t g, uint32_t& h, uint32_t k)
+{
+    uint32_t t1 = h + Sigma1(e) + Ch(e, f, g) + k;
+    uint32_t t2 = Sigma0(a) + Maj(a, b, c);
+    d += t1;
+    h = t1 + t2;
+}
+
+/** Initialize SHA-256 state. */
+void inline Initialize(uint32_t* s)
+{
+    s[0] = 0x6a09e667ul;
+    s[1] = 0xbb67ae85ul;
+    s[2] = 0x3c6ef372ul;
+    s[3] = 0xa54ff53aul;
+    s[4] = 0x510e527ful;
+    s[5] = 0x9b05688cul;
+    s[6] = 0x1f83d9abul;
+    s[7] = 0x5be0cd19ul;
+}
+
+/** Perform a number of SHA-256 transformations, processing 64-byte chunks. */
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        uint32_t w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
+
+        Round(a, b, c, d, e, f, g, h, 0x428a2f98 + (w0 = ReadBE32(chunk + 0)));
+        Round(h, a, b, c, d, e, f, g, 0x71374491 + (w1 = ReadBE32(chunk + 4)));
+        Round(g, h, a, b, c, d, e, f, 0xb5c0fbcf + (w2 = ReadBE32(chunk + 8)));
+        Round(f, g, h, a, b, c, d, e, 0xe9b5dba5 + (w3 = ReadBE32(chunk + 12)));
+        Round(e, f, g, h, a, b, c, d, 0x3956c25b + (w4 = ReadBE32(chunk + 16)));
+        Round(d, e, f, g, h, a, b, c, 0x59f111f1 + (w5 = ReadBE32(chunk + 20)));
+        Round(c, d, e, f, g, h, a, b, 0x923f82a4 + (w6 = ReadBE32(chunk + 24)));
+        Round(b, c, d, e, f, g, h, a, 0xab1c5ed5 + (w7 = ReadBE32(chunk + 28)));
+        Round(a, b, c, d, e, f, g, h, 0xd807aa98 + (w8 = ReadBE32(chunk + 32)));
+        Round(h, a, b, c, d, e, f, g, 0x12835b01 + (w9 = ReadBE32(chunk + 36)));
+        Round(g, h, a, b, c, d, e, f, 0x243185be + (w10 = ReadBE32(chunk + 40)));
+        Round(f, g, h, a, b, c, d, e, 0x550c7dc3 + (w11 = ReadBE32(chunk + 44)));
+        Round(e, f, g, h, a, b, c, d, 0x72be5d74 + (w12 = ReadBE32(chunk + 48)));
+        Round(d, e, f, g, h, a, b, c, 0x80deb1fe + (w13 = ReadBE32(chunk + 52)));
+        Round(c, d, e, f, g, h, a, b, 0x9bdc06a7 + (w14 = ReadBE32(chunk + 56)));
+        Round(b, c, d, e, f, g, h, a, 0xc19bf174 + (w15 = ReadBE32(chunk + 60)));
+
+        Round(a, b, c, d, e, f, g, h, 0xe49b69c1 + (w0 += sigma1(w14) + w9 + sigma0(w1)));
+        Round(h, a, b, c, d, e, f, g, 0xefbe4786 + (w1 += sigma1(w15) + w10 + sigma0(w2)));
+        Round(g, h, a, b, c, d, e, f, 0x0fc19dc6 + (w2 += sigma1(w0) + w11 + sigma0(w3)));
+        Round(f, g, h, a, b, c, d, e, 0x240ca1cc + (w3 += sigma1(w1) + w12 + sigma0(w4)));
+        Round(e, f, g, h, a, b, c, d, 0x2de92c6f + (w4 += sigma1(w2) + w13 + sigma0(w5)));
+        Round(d, e, f, g, h, a, b, c, 0x4a7484aa + (w5 += sigma1(w3) + w14 + sigma0(w6)));
+        Round(c, d, e, f, g, h, a, b, 0x5cb0a9dc + (w6 += sigma1(w4) + w15 + sigma0(w7)));
+        Round(b, c, d, e, f, g, h, a, 0x76f988da + (w7 += sigma1(w5) + w0 + sigma0(w8)));
+        Round(a, b, c, d, e, f, g, h, 0x983e5152 + (w8 += sigma1(w6) + w1 + sigma0(w9)));
+        Round(h, a, b, c, d, e, f, g, 0xa831c66d + (w9 += sigma1(w7) + w2 + sigma0(w10)));
+        Round(g, h, a, b, c, d, e, f, 0xb00327c8 + (w10 += sigma1(w8) + w3 + sigma0(w11)));
+        Round(f, g, h, a, b, c, d, e, 0xbf597fc7 + (w11 += sigma1(w9) + w4 + sigma0(w12)));
+        Round(e, f, g, h, a, b, c, d, 0xc6e00bf3 + (w12 += sigma1(w10) + w5 + sigma0(w13)));
+        Round(d, e, f, g, h, a, b, c, 0xd5a79147 + (w13 += sigma1(w11) + w6 + sigma0(w14)));
+        Round(c, d, e, f, g, h, a, b, 0x06ca6351 + (w14 += sigma1(w12) + w7 + sigma0(w15)));
+        Round(b, c, d, e, f, g, h, a, 0x14292967 + (w15 += sigma1(w13) + w8 + sigma0(w0)));
+
+        Round(a, b, c, d, e, f, g, h, 0x27b70a85 + (w0 += sigma1(w14) + w9 + sigma0(w1)));
+        Round(h, a, b, c, d, e, f, g, 0x2e1b2138 + (w1 += sigma1(w15) + w10 + sigma0(w2)));
+        Round(g, h, a, b, c, d, e, f, 0x4d2c6dfc + (w2 += sigma1(w0) + w11 + sigma0(w3)));
+        Round(f, g, h, a, b, c, d, e, 0x53380d13 + (w3 += sigma1(w1) + w12 + sigma0(w4)));
+        Round(e, f, g, h, a, b, c, d, 0x650a7354 + (w4 += sigma1(w2) + w13 + sigma0(w5)));
+        Round(d, e, f, g, h, a, b, c, 0x766a0abb + (w5 += sigma1(w3) + w14 + sigma0(w6)));
+        Round(c, d, e, f, g, h, a, b, 0x81c2c92e + (w6 += sigma1(w4) + w15 + sigma0(w7)));
+        Round(b, c, d, e, f, g, h, a, 0x92722c85 + (w7 += sigma1(w5) + w0 + sigma0(w8)));
+        Round(a, b, c, d, e, f, g, h, 0xa2bfe8a1 + (w8 += sigma1(w6) + w1 + sigma0(w9)));
+        Round(h, a, b, c, d, e, f, g, 0xa81a664b + (w9 += sigma1(w7) + w2 + sigma0(w10)));
+        Round(g, h, a, b, c, d, e, f, 0xc24b8b70 + (w10 += sigma1(w8) + w3 + sigma0(w11)));
+        Round(f, g, h, a, b, c, d, e, 0xc76c51a3 + (w11 += sigma1(w9) + w4 + sigma0(w12)));
+        Round(e, f, g, h, a, b, c, d, 0xd192e819 + (w12 += sigma1(w10) + w5 + sigma0(w13)));
+        Round(d, e, f, g, h, a, b, c, 0xd6990624 + (w13 += sigma1(w11) + w6 + sigma0(w14)));
+        Round(c, d, e, f, g, h, a, b, 0xf40e3585 + (w14 += sigma1(w12) + w7 + sigma0(w15)));
+        Round(b, c, d, e, f, g, h, a, 0x106aa070 + (w15 += sigma1(w13) + w8 + sigma0(w0)));
+
+        Round(a, b, c, d, e, f, g, h, 0x19a4c116 + (w0 += sigma1(w14) + w9 + sigma0(w1)));
+        Round(h, a, b, c, d, e, f, g, 0x1e376c08 + (w1 += sigma1(w15) + w10 + sigma0(w2)));
+        Round(g, h, a, b, c, d, e, f, 0x2748774c + (w2 += sigma1(w0) + w11 + sigma0(w3)));
+        Round(f, g, h, a, b, c, d, e, 0x34b0bcb5 + (w3 += sigma1(w1) + w12 + sigma0(w4)));
+        Round(e, f, g, h, a, b, c, d, 0x391c0cb3 + (w4 += sigma1(w2) + w13 + sigma0(w5)));
+        Round(d, e, f, g, h, a, b, c, 0x4ed8aa4a + (w5 += sigma1(w3) + w14 + sigma0(w6)));
+        Round(c, d, e, f, g, h, a, b, 0x5b9cca4f + (w6 += sigma1(w4) + w15 + sigma0(w7)));
+        Round(b, c, d, e, f, g, h, a, 0x682e6ff3 + (w7 += sigma1(w5) + w0 + sigma0(w8)));
+        Round(a, b, c, d, e, f, g, h, 0x748f82ee + (w8 += sigma1(w6) + w1 + sigma0(w9)));
+        Round(h, a, b, c, d, e, f, g, 0x78a5636f + (w9 += sigma1(w7) + w2 + sigma0(w10)));
+        Round(g, h, a, b, c, d, e, f, 0x84c87814 + (w10 += sigma1(w8) + w3 + sigma0(w11)));
+        Round(f, g, h, a, b, c, d, e, 0x8cc70208 + (w11 += sigma1(w9) + w4 + sigma0(w12)));
+        Round(e, f, g, h, a, b, c, d, 0x90befffa + (w12 += sigma1(w10) + w5 + sigma0(w13)));
+        Round(d, e, f, g, h, a, b, c, 0xa4506ceb + (w13 += sigma1(w11) + w6 + sigma0(w14)));
+        Round(c, d, e, f, g, h, a, b, 0xbef9a3f7 + (w14 + sigma1(w12) + w7 + sigma0(w15)));
+        Round(b, c, d, e, f, g, h, a, 0xc67178f2 + (w15 + sigma1(w13) + w8 + sigma0(w0)));
+
+        s[0] += a;
+        s[1] += b;
+        s[2] += c;
+        s[3] += d;
+        s[4] += e;
+        s[5] += f;
+        s[6] += g;
+        s[7] += h;
+        chunk += 64;
+    }
+}
+
+} // namespace sha256
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+
+/** The transform used by CSHA256, picked by SHA256AutoDetect. */
+TransformType Transform = sha256::Transform;
+
+#if defined(ENABLE_AVX2)
+/** Whether SHA256D80 may use the 8-way AVX2 kernel. */
+bool UseAVX2 = false;
+#endif
+
+/** Hash the 80-byte inputs one at a time with the selected transform. */
+void SHA256D80Single(unsigned char* out, const unsigned char* in, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        SHA256D(out + 32 * i, in + 80 * i, 80);
+    }
+}
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+/** Check whether the OS saves the AVX (ymm) registers on context switch. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+const unsigned char pad[64] = {0x80};
+
+/** SHA256D of the eight 80-byte pieces of the self-test input. */
+const unsigned char SELF_TEST_D80[8 * 32] = {
+    0x85, 0x2c, 0x98, 0x04, 0x4f, 0xb0, 0x05, 0x07, 0x12, 0x2f, 0xf6, 0x3b, 0xda, 0x7b, 0x52, 0x95,
+    0x66, 0x34, 0x8f, 0xc2, 0x04, 0xf7, 0x2b, 0x00, 0xdf, 0xf1, 0xaf, 0xd7, 0xb4, 0x05, 0x01, 0xe4,
+    0x6c, 0xf0, 0xdb, 0xda, 0xf7, 0xfa, 0x9b, 0x6b, 0xca, 0xf4, 0x2d, 0x42, 0xb8, 0x7d, 0x39, 0x9e,
+    0x6f, 0xa5, 0x53, 0x01, 0x38, 0x39, 0xe4, 0xb5, 0x20, 0xb5, 0xac, 0xfe, 0x3e, 0x0e, 0x38, 0xdc,
+    0x72, 0xad, 0xa4, 0x85, 0x01, 0x25, 0x45, 0x21, 0x07, 0x2e, 0xb8, 0x5c, 0xf2, 0xf2, 0x0c, 0xc1,
+    0x67, 0x7a, 0xff, 0xe8, 0xaa, 0xa9, 0x0d, 0x04, 0x7b, 0x99, 0xab, 0x25, 0xf3, 0x14, 0x6c, 0x6f,
+    0x49, 0x03, 0x3c, 0xfc, 0x32, 0x40, 0x84, 0xd6, 0x4d, 0xa2, 0x5b, 0x70, 0xea, 0x9e, 0x9c, 0x94,
+    0x02, 0x51, 0x70, 0x4c, 0x4b, 0x4d, 0xb0, 0x74, 0xae, 0x0d, 0x73, 0xf6, 0x71, 0xe5, 0xdc, 0x1f,
+    0x60, 0x61, 0x71, 0x26, 0x04, 0xd0, 0x24, 0x4d, 0x9b, 0x41, 0x9a, 0x1d, 0x20, 0x97, 0x7e, 0xee,
+    0xb0, 0x2d, 0x2e, 0x62, 0x4b, 0x80, 0xe4, 0xe4, 0xbc, 0x58, 0xee, 0xe4, 0x39, 0x86, 0x42, 0xa9,
+    0x2d, 0xc7, 0x5c, 0x6c, 0x07, 0x61, 0xb3, 0x64, 0x7f, 0x38, 0x9c, 0xac, 0x4f, 0x4f, 0xc7, 0xe7,
+    0x32, 0x45, 0xec, 0x4d, 0x5e, 0x64, 0xf6, 0x9b, 0x23, 0xa6, 0x3f, 0x47, 0xbb, 0x64, 0x39, 0x90,
+    0x35, 0x3c, 0xdd, 0x8e, 0xd7, 0x06, 0x06, 0x18, 0x68, 0xa8, 0x48, 0x42, 0x79, 0x85, 0x25, 0x0e,
+    0x21, 0x51, 0xff, 0x4f, 0x3f, 0xa0, 0x60, 0xb2, 0xcd, 0x0d, 0x4f, 0x4a, 0xfd, 0x4c, 0xe4, 0xc9,
+    0xfc, 0x65, 0x86, 0x3e, 0x2d, 0xbb, 0xb0, 0x07, 0x6d, 0x07, 0xde, 0x41, 0x5c, 0x97, 0x2c, 0x25,
+    0xd2, 0x2f, 0xa6, 0xdb, 0x9b, 0x2b, 0x42, 0xef, 0xac, 0x91, 0x66, 0x25, 0x3e, 0x67, 0x58, 0x33,
+};
+
+/** SHA256D of the whole 640-byte self-test input. */
+const unsigned char SELF_TEST_D640[32] = {
+    0xbd, 0x2e, 0x2b, 0x05, 0xa4, 0x97, 0x09, 0x41, 0x4b, 0x01, 0x0b, 0xcb, 0x87, 0x64, 0xc9, 0xd1,
+    0xac, 0x32, 0x5e, 0x0a, 0xf0, 0x87, 0x57, 0x91, 0x6b, 0x8a, 0x44, 0xff, 0x98, 0x10, 0x47, 0x2c,
+};
+
+/** Check the selected kernels against known hashes of the bytes 0, 1, 2, ...
+ *  The 80-byte pieces go through SHA256D80, which takes the 8-way path when
+ *  it is enabled, and the whole input makes the transform process several
+ *  blocks in one call.
+ */
+bool SelfTest()
+{
+    unsigned char in[640];
+    for (size_t i = 0; i < sizeof(in); i++) {
+        in[i] = (unsigned char)i;
+    }
+    unsigned char out[8 * 32];
+    SHA256D80(out, in, 8);
+    if (memcmp(out, SELF_TEST_D80, sizeof(out)) != 0) return false;
+    SHA256D(out, in, sizeof(in));
+    return memcmp(out, SELF_TEST_D640, sizeof(SELF_TEST_D640)) == 0;
+}
+
+} // namespace
+
+
+std::string SHA256AutoDetect(sha256_implementation::UseImplementation use_implementation)
+{
+    std::string ret = "standard";
+    Transform = sha256::Transform;
+#if defined(ENABLE_AVX2)
+    UseAVX2 = false;
+#endif
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    __cpuid(1, eax, ebx, ecx, edx);
+    const bool have_sse41 = (ecx >> 19) & 1;
+    const bool have_xsave = (ecx >> 27) & 1;
+    const bool have_avx = (ecx >> 28) & 1;
+    const bool enabled_avx = have_xsave && have_avx && AVXEnabled();
+    bool have_avx2 = false, have_shani = false;
+    if (__get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+        have_shani = (ebx >> 29) & 1;
+    }
+    (void)have_sse41;
+    (void)enabled_avx;
+    (void)have_avx2;
+    (void)have_shani;
+
+#if defined(ENABLE_SHANI)
+    if (have_shani && have_sse41 && (use_implementation & sha256_implementation::USE_SHANI)) {
+        Transform = sha256_shani::Transform;
+        if (SelfTest()) {
+            ret = "shani(1way)";
+        } else {
+            Transform = sha256::Transform;
+            ret += ",shani(failed self-test)";
+        }
+    }
+#endif
+
+#if defined(ENABLE_AVX2)
+    // A single SHA-NI stream outruns eight AVX2 lanes, only batch without it
+    if (have_avx2 && enabled_avx && Transform == sha256::Transform && (use_implementation & sha256_implementation::USE_AVX2)) {
+        UseAVX2 = true;
+        if (SelfTest()) {
+            ret += ",avx2(8way)";
+        } else {
+            UseAVX2 = false;
+            ret += ",avx2(failed self-test)";
+        }
+    }
+#endif
+#endif
+
+    return ret;
+}
+
+////// SHA-256
+
+CSHA256::CSHA256() : bytes(0)
+{
+    sha256::Initialize(s);
+}
+
+CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
+{
+    const unsigned char* end = data + len;
+    size_t bufsize = bytes % 64;
+    if (bufsize && bufsize + len >= 64) {
+        // Fill the buffer, and process it.
+        memcpy(buf + bufsize, data, 64 - bufsize);
+        bytes += 64 - bufsize;
+        data += 64 - bufsize;
+        Transform(s, buf, 1);
+        bufsize = 0;
+    }
+    if (end - data >= 64) {
+        size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
+    }
+    if (end > data) {
+        // Fill the buffer with what remains.
+        memcpy(buf + bufsize, data, end - data);
+        bytes += end - data;
+    }
+    return *this;
+}
+
+void CSHA256::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    unsigned char sizedesc[8];
+    WriteBE64(sizedesc, bytes << 3);
+    Write(pad, 1 + ((119 - (bytes % 64)) % 64));
+    Write(sizedesc, 8);
+    WriteBE32(hash, s[0]);
+    WriteBE32(hash + 4, s[1]);
+    WriteBE32(hash + 8, s[2]);
+    WriteBE32(hash + 12, s[3]);
+    WriteBE32(hash + 16, s[4]);
+    WriteBE32(hash + 20, s[5]);
+    WriteBE32(hash + 24, s[6]);
+    WriteBE32(hash + 28, s[7]);
+}
+
+CSHA256& CSHA256::Reset()
+{
+    bytes = 0;
+    sha256::Initialize(s);
+    return *this;
+}
+
+void SHA256D(unsigned char out[CSHA256::OUTPUT_SIZE], const unsigned char* data, size_t len)
+{
+    unsigned char first[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(first);
+    CSHA256().Write(first, sizeof(first)).Finalize(out);
+}
+
+void SHA256D80(unsigned char* out, const unsigned char* in, size_t count)
+{
+#if defined(ENABLE_AVX2)
+    if (UseAVX2) {
+        while (count >= 8) {
+            sha256d80_avx2::Transform_8way(out, in);
+            out += 32 * 8;
+            in += 80 * 8;
+            count -= 8;
+        }
+    }
+#endif
+    SHA256D80Single(out, in, count);
+}
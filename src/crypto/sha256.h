@@ -0,0 +1,55 @@
+// Copyright (c) 2014-2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_SHA256_H
+#define BITCOIN_CRYPTO_SHA256_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** A hasher class for SHA-256. */
+class CSHA256
+{
+private:
+    uint32_t s[8];
+    unsigned char buf[64];
+    uint64_t bytes;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    CSHA256();
+    CSHA256& Write(const unsigned char* data, size_t len);
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+    CSHA256& Reset();
+};
+
+namespace sha256_implementation {
+/** The optimized implementations SHA256AutoDetect may pick. */
+enum UseImplementation : uint8_t {
+    STANDARD = 0,
+    USE_SHANI = 1 << 0,
+    USE_AVX2 = 1 << 1,
+    USE_ALL = USE_SHANI | USE_AVX2,
+};
+}
+
+/** Autodetect the best available SHA256 implementation, out of the ones
+ *  allowed by use_implementation. Every optimized kernel is checked against
+ *  known hashes before it is used, and left out when it fails.
+ *  Returns the name of the implementation.
+ */
+std::string SHA256AutoDetect(sha256_implementation::UseImplementation use_implementation = sha256_implementation::USE_ALL);
+
+/** Compute the double SHA-256 of a buffer. */
+void SHA256D(unsigned char out[CSHA256::OUTPUT_SIZE], const unsigned char* data, size_t len);
+
+/** Compute the double SHA-256 of a sequence of 80-byte inputs, such as
+ *  block headers. out receives 32 bytes per input. Batches of 8 are hashed
+ *  in parallel when AVX2 is available.
+ */
+void SHA256D80(unsigned char* out, const unsigned char* in, size_t count);
+
+#endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,137 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This file is compiled with -mavx2, and only called after the CPU and OS
+// were found to support it.
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "common.h"
+
+namespace
+{
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const uint32_t INIT[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul,
+};
+
+__m256i inline K32(uint32_t x) { return _mm256_set1_epi32(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+__m256i inline And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+template <int n> __m256i inline ShR(__m256i x) { return _mm256_srli_epi32(x, n); }
+template <int n> __m256i inline Ror(__m256i x) { return Or(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n)); }
+
+__m256i inline Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+__m256i inline Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m256i inline Sigma0(__m256i x) { return Xor(Ror<2>(x), Ror<13>(x), Ror<22>(x)); }
+__m256i inline Sigma1(__m256i x) { return Xor(Ror<6>(x), Ror<11>(x), Ror<25>(x)); }
+__m256i inline sigma0(__m256i x) { return Xor(Ror<7>(x), Ror<18>(x), ShR<3>(x)); }
+__m256i inline sigma1(__m256i x) { return Xor(Ror<17>(x), Ror<19>(x), ShR<10>(x)); }
+
+/** One SHA-256 block on 8 independent states, one per lane. */
+void inline Transform(__m256i s[8], __m256i w[16])
+{
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int r = 0; r < 64; r++) {
+        if (r >= 16) {
+            w[r & 15] = Add(w[r & 15], sigma1(w[(r - 2) & 15]), w[(r - 7) & 15], sigma0(w[(r - 15) & 15]));
+        }
+        __m256i t1 = Add(Add(h, Sigma1(e)), Ch(e, f, g), K32(K[r]), w[r & 15]);
+        __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = Add(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = Add(t1, t2);
+    }
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** Load big-endian word i of eight 80-byte inputs, input j in lane j. */
+__m256i inline Read8(const unsigned char* in, int i)
+{
+    return _mm256_set_epi32(ReadBE32(in + 560 + 4 * i), ReadBE32(in + 480 + 4 * i), ReadBE32(in + 400 + 4 * i), ReadBE32(in + 320 + 4 * i),
+                            ReadBE32(in + 240 + 4 * i), ReadBE32(in + 160 + 4 * i), ReadBE32(in + 80 + 4 * i), ReadBE32(in + 4 * i));
+}
+
+void inline Initialize(__m256i s[8])
+{
+    for (int i = 0; i < 8; i++) {
+        s[i] = K32(INIT[i]);
+    }
+}
+}
+
+namespace sha256d80_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    __m256i s[8], w[16];
+
+    // First hash, block 1: bytes 0 to 63 of each input
+    Initialize(s);
+    for (int i = 0; i < 16; i++) {
+        w[i] = Read8(in, i);
+    }
+    Transform(s, w);
+
+    // First hash, block 2: bytes 64 to 79, padding and the 640 bit length
+    for (int i = 0; i < 4; i++) {
+        w[i] = Read8(in, 16 + i);
+    }
+    w[4] = K32(0x80000000);
+    for (int i = 5; i < 15; i++) {
+        w[i] = K32(0);
+    }
+    w[15] = K32(640);
+    Transform(s, w);
+
+    // Second hash of the 32 byte digest
+    for (int i = 0; i < 8; i++) {
+        w[i] = s[i];
+    }
+    w[8] = K32(0x80000000);
+    for (int i = 9; i < 15; i++) {
+        w[i] = K32(0);
+    }
+    w[15] = K32(256);
+    Initialize(s);
+    Transform(s, w);
+
+    alignas(32) uint32_t lanes[8];
+    for (int i = 0; i < 8; i++) {
+        _mm256_store_si256((__m256i*)lanes, s[i]);
+        for (int j = 0; j < 8; j++) {
+            WriteBE32(out + 32 * j + 4 * i, lanes[j]);
+        }
+    }
+}
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Based on https://github.com/noloader/SHA-Intrinsics/blob/master/sha256-x86.c,
+// written and placed in the public domain by Jeffrey Walton, based on code from
+// Intel and Sean Gulley for the miTLS project.
+
+// This file is compiled with -msse4.1 -msha, and only called after the CPU
+// was found to support those instructions.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+namespace
+{
+alignas(16) const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Four rounds, with the message schedule for the rounds 12 to 16 ahead.
+ *  msg[i % 4] holds the message words for rounds 4i to 4i+3. */
+template <int i>
+void inline QuadRound(__m128i& state0, __m128i& state1, __m128i msg[4])
+{
+    __m128i m = _mm_add_epi32(msg[i % 4], _mm_load_si128((const __m128i*)&K[4 * i]));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+    if (i >= 3 && i < 15) {
+        // Finish the words for rounds 4(i+1) to 4(i+1)+3
+        __m128i tmp = _mm_alignr_epi8(msg[i % 4], msg[(i + 3) % 4], 4);
+        msg[(i + 1) % 4] = _mm_add_epi32(msg[(i + 1) % 4], tmp);
+        msg[(i + 1) % 4] = _mm_sha256msg2_epu32(msg[(i + 1) % 4], msg[i % 4]);
+    }
+    m = _mm_shuffle_epi32(m, 0x0E);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+    if (i >= 1 && i < 13) {
+        // Start the words for rounds 4(i+3) to 4(i+3)+3
+        msg[(i + 3) % 4] = _mm_sha256msg1_epu32(msg[(i + 3) % 4], msg[i % 4]);
+    }
+}
+}
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // Reorder the state into the ABEF / CDGH layout the instructions expect
+    __m128i tmp = _mm_loadu_si128((const __m128i*)&s[0]);
+    __m128i state1 = _mm_loadu_si128((const __m128i*)&s[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);                /* CDAB */
+    state1 = _mm_shuffle_epi32(state1, 0x1B);          /* EFGH */
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);       /* CDGH */
+
+    while (blocks--) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+
+        __m128i msg[4];
+        msg[0] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 0)), MASK);
+        msg[1] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16)), MASK);
+        msg[2] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 32)), MASK);
+        msg[3] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 48)), MASK);
+
+        QuadRound<0>(state0, state1, msg);
+        QuadRound<1>(state0, state1, msg);
+        QuadRound<2>(state0, state1, msg);
+        QuadRound<3>(state0, state1, msg);
+        QuadRound<4>(state0, state1, msg);
+        QuadRound<5>(state0, state1, msg);
+        QuadRound<6>(state0, state1, msg);
+        QuadRound<7>(state0, state1, msg);
+        QuadRound<8>(state0, state1, msg);
+        QuadRound<9>(state0, state1, msg);
+        QuadRound<10>(state0, state1, msg);
+        QuadRound<11>(state0, state1, msg);
+        QuadRound<12>(state0, state1, msg);
+        QuadRound<13>(state0, state1, msg);
+        QuadRound<14>(state0, state1, msg);
+        QuadRound<15>(state0, state1, msg);
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        chunk += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);             /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xB1);          /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);       /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);          /* ABEF */
+
+    _mm_storeu_si128((__m128i*)&s[0], state0);
+    _mm_storeu_si128((__m128i*)&s[4], state1);
+}
+}
@@ -0,0 +1,188 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "eventhub.h"
+#include "json.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    string formatEvent(const string& eventType, const json& data) {
+        return "event: " + eventType + "\ndata: " + data.dump() + "\n\n";
+    }
+}
+
+VtcBlockIndexer::EventHub::EventHub() {
+    this->nextSubscriberId = 1;
+    this->addressSubscriptionCount = 0;
+}
+
+uint64_t VtcBlockIndexer::EventHub::subscribe(const string& client, vector<string> addresses, function<bool(const string&)> send) {
+    shared_ptr<EventSubscriber> subscriber = make_shared<EventSubscriber>();
+    subscriber->client = client;
+    subscriber->addresses = addresses;
+    subscriber->send = send;
+
+    lock_guard<mutex> lock(subscriptionsMutex);
+    size_t& clientCount = clientSubscriptionCount[client];
+    if(clientCount >= MAX_SUBSCRIPTIONS_PER_CLIENT) {
+        return 0;
+    }
+    clientCount++;
+    subscriber->id = nextSubscriberId++;
+    subscribers[subscriber->id] = subscriber;
+    for(string address : addresses) {
+        addressSubscribers[address].insert(subscriber->id);
+    }
+    addressSubscriptionCount = addressSubscribers.size();
+    return subscriber->id;
+}
+
+void VtcBlockIndexer::EventHub::unsubscribe(uint64_t subscriberId) {
+    lock_guard<mutex> lock(subscriptionsMutex);
+    auto it = subscribers.find(subscriberId);
+    if(it == subscribers.end()) return;
+
+    for(string address : it->second->addresses) {
+        auto addressIt = addressSubscribers.find(address);
+        if(addressIt != addressSubscribers.end()) {
+            addressIt->second.erase(subscriberId);
+            if(addressIt->second.size() == 0) {
+                addressSubscribers.erase(addressIt);
+            }
+        }
+    }
+
+    auto clientIt = clientSubscriptionCount.find(it->second->client);
+    if(clientIt != clientSubscriptionCount.end() && --clientIt->second == 0) {
+        clientSubscriptionCount.erase(clientIt);
+    }
+    subscribers.erase(it);
+    addressSubscriptionCount = addressSubscribers.size();
+}
+
+bool VtcBlockIndexer::EventHub::canSubscribe(const string& client) {
+    lock_guard<mutex> lock(subscriptionsMutex);
+    auto it = clientSubscriptionCount.find(client);
+    return it == clientSubscriptionCount.end() || it->second < MAX_SUBSCRIPTIONS_PER_CLIENT;
+}
+
+bool VtcBlockIndexer::EventHub::hasAddressSubscriptions() {
+    return addressSubscriptionCount.load() > 0;
+}
+
+void VtcBlockIndexer::EventHub::deliver(const shared_ptr<EventSubscriber>& subscriber, const string& event) {
+    bool delivered;
+    {
+        lock_guard<mutex> lock(subscriber->sendMutex);
+        delivered = subscriber->send(event);
+    }
+    if(!delivered) {
+        unsubscribe(subscriber->id);
+    }
+}
+
+void VtcBlockIndexer::EventHub::publishBlock(const Block& block) {
+    vector<shared_ptr<EventSubscriber>> recipients;
+    {
+        lock_guard<mutex> lock(subscriptionsMutex);
+        if(subscribers.size() == 0) return;
+        for(auto kvp : subscribers) {
+            recipients.push_back(kvp.second);
+        }
+    }
+
+    json j;
+    j["hash"] = block.blockHash;
+    j["height"] = block.height;
+    j["time"] = block.time;
+    j["txCount"] = block.transactions.size();
+    string event = formatEvent("block", j);
+
+    for(shared_ptr<EventSubscriber> subscriber : recipients) {
+        deliver(subscriber, event);
+    }
+}
+
+void VtcBlockIndexer::EventHub::publishTransaction(const Transaction& tx, const vector<vector<string>>& outputAddresses, const vector<vector<string>>& inputAddresses, uint64_t blockHeight) {
+    if(!hasAddressSubscriptions()) return;
+
+    vector<pair<shared_ptr<EventSubscriber>, string>> deliveries;
+    {
+        lock_guard<mutex> lock(subscriptionsMutex);
+        for(size_t i = 0; i < outputAddresses.size() && i < tx.outputs.size(); i++) {
+            for(const string& address : outputAddresses[i]) {
+                auto it = addressSubscribers.find(address);
+                if(it == addressSubscribers.end()) continue;
+
+                json j;
+                j["type"] = "receive";
+                j["address"] = address;
+                j["txid"] = tx.txHash;
+                j["vout"] = tx.outputs[i].index;
+                j["value"] = tx.outputs[i].value;
+                j["height"] = blockHeight;
+                string event = formatEvent("address", j);
+                for(uint64_t subscriberId : it->second) {
+                    deliveries.push_back(make_pair(subscribers[subscriberId], event));
+                }
+            }
+        }
+
+        for(size_t i = 0; i < inputAddresses.size() && i < tx.inputs.size(); i++) {
+            for(const string& address : inputAddresses[i]) {
+                auto it = addressSubscribers.find(address);
+                if(it == addressSubscribers.end()) continue;
+
+                json j;
+                j["type"] = "spend";
+                j["address"] = address;
+                j["txid"] = tx.txHash;
+                j["vin"] = tx.inputs[i].index;
+                j["spentTxid"] = tx.inputs[i].txHash;
+                j["spentVout"] = tx.inputs[i].txoIndex;
+                j["height"] = blockHeight;
+                string event = formatEvent("address", j);
+                for(uint64_t subscriberId : it->second) {
+                    deliveries.push_back(make_pair(subscribers[subscriberId], event));
+                }
+            }
+        }
+    }
+
+    for(auto delivery : deliveries) {
+        deliver(delivery.first, delivery.second);
+    }
+}
+
+void VtcBlockIndexer::EventHub::heartbeat() {
+    vector<shared_ptr<EventSubscriber>> recipients;
+    {
+        lock_guard<mutex> lock(subscriptionsMutex);
+        for(auto kvp : subscribers) {
+            recipients.push_back(kvp.second);
+        }
+    }
+
+    for(shared_ptr<EventSubscriber> subscriber : recipients) {
+        deliver(subscriber, ": keepalive\n\n");
+    }
+}
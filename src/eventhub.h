@@ -0,0 +1,119 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef EVENTHUB_H_INCLUDED
+#define EVENTHUB_H_INCLUDED
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "blockchaintypes.h"
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+/**
+ * A single client listening for events. The send function delivers one
+ * formatted server-sent event and returns false once the client is gone.
+ */
+struct EventSubscriber {
+    uint64_t id;
+
+    // Client identity the subscription counts against
+    string client;
+
+    // Addresses this subscriber wants address events for
+    vector<string> addresses;
+
+    function<bool(const string&)> send;
+
+    // Serializes writes to the same client from different publishing threads
+    mutex sendMutex;
+};
+
+/**
+ * The EventHub class fans out new-tip and address activity events to
+ * subscribed clients. Subscriptions are kept in a hash map by address, so
+ * matching a transaction costs one lookup per output and input. Every client
+ * may hold at most MAX_SUBSCRIPTIONS_PER_CLIENT subscriptions at a time.
+ */
+
+class EventHub {
+public:
+    /** Constructs an EventHub without subscribers */
+    EventHub();
+
+    static const size_t MAX_SUBSCRIPTIONS_PER_CLIENT = 10;
+
+    /** Registers a subscriber for new tips and for activity on the given addresses.
+     * Returns the subscriber id, or 0 when the client already holds the
+     * maximum number of subscriptions.
+     */
+    uint64_t subscribe(const string& client, vector<string> addresses, function<bool(const string&)> send);
+
+    /** Returns true if the client may open another subscription */
+    bool canSubscribe(const string& client);
+
+    /** Removes a subscriber */
+    void unsubscribe(uint64_t subscriberId);
+
+    /** Publishes a new-tip event. Called after the block was committed to the index */
+    void publishBlock(const Block& block);
+
+    /** Publishes address events for the outputs and inputs of a transaction.
+     * outputAddresses holds the addresses for each output, in output order.
+     * inputAddresses holds the addresses of the output each input spends, in
+     * input order, and is empty for an input whose spent output is not known.
+     * A blockHeight of 0 means the transaction is unconfirmed.
+     */
+    void publishTransaction(const Transaction& tx, const vector<vector<string>>& outputAddresses, const vector<vector<string>>& inputAddresses, uint64_t blockHeight);
+
+    /** Returns true if any subscriber is watching an address. Publishers use
+     * this to skip collecting address data when nobody is listening.
+     */
+    bool hasAddressSubscriptions();
+
+    /** Sends a comment line to all subscribers to keep connections alive and
+     * to detect clients that went away.
+     */
+    void heartbeat();
+
+private:
+    /** Delivers the event to the subscriber and removes it if it is gone */
+    void deliver(const shared_ptr<EventSubscriber>& subscriber, const string& event);
+
+    mutex subscriptionsMutex;
+    uint64_t nextSubscriberId;
+    atomic<size_t> addressSubscriptionCount;
+    unordered_map<uint64_t, shared_ptr<EventSubscriber>> subscribers;
+    unordered_map<string, unordered_set<uint64_t>> addressSubscribers;
+    unordered_map<string, size_t> clientSubscriptionCount;
+};
+
+}
+
+#endif // EVENTHUB_H_INCLUDED
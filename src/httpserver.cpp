@@ -26,22 +26,152 @@
 #include <vector>
 #include <memory>
 #include <cstdlib>
+#include <thread>
+#include <chrono>
 #include <restbed>
 #include "json.hpp"
 #include "utility.h"
+#include "logger.h"
 using namespace std;
+
+namespace
+{
+    // The route handled on this thread, whose metrics respond() records to
+    thread_local const VtcBlockIndexer::RouteMetrics* currentRoute = nullptr;
+
+    /** Sets the route handled on this thread for the lifetime of the scope */
+    class RouteScope {
+        public:
+            RouteScope(const VtcBlockIndexer::RouteMetrics* route) : previous(currentRoute) { currentRoute = route; }
+            ~RouteScope() { currentRoute = previous; }
+
+        private:
+            const VtcBlockIndexer::RouteMetrics* previous;
+    };
+}
 using namespace restbed;
 using json = nlohmann::json;
 
 
-VtcBlockIndexer::HttpServer::HttpServer(shared_ptr<leveldb::DB> db, shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor, string blocksDir) {
+VtcBlockIndexer::HttpServer::HttpServer(shared_ptr<leveldb::DB> db, shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor, shared_ptr<VtcBlockIndexer::EventHub> eventHub, string blocksDir) {
     this->db = db;
     this->blocksDir = blocksDir;
     this->mempoolMonitor = mempoolMonitor;
+    this->eventHub = eventHub;
     blockReader.reset(new VtcBlockIndexer::BlockReader(blocksDir));
     scriptSolver = std::make_unique<VtcBlockIndexer::ScriptSolver>();
-    httpClient.reset(new jsonrpc::HttpClient("http://" + std::string(std::getenv("COIND_RPCUSER")) + ":" + std::string(std::getenv("COIND_RPCPASSWORD")) + "@" + std::string(std::getenv("COIND_HOST")) + ":" + std::string(std::getenv("COIND_RPCPORT"))));
-    vertcoind.reset(new VertcoinClient(*httpClient));
+    const char* workers = std::getenv("HTTP_WORKERS");
+    workerCount = (workers != NULL && workers[0] != 0) ? max(atoi(workers), 1) : max(std::thread::hardware_concurrency(), 1u);
+    // One client per worker, so a handler never waits for another to finish its coind call
+    rpcPool.reset(new VtcBlockIndexer::RpcClientPool(workerCount));
+}
+
+VtcBlockIndexer::MetricCounter& VtcBlockIndexer::RouteMetrics::responsesWithStatus(int status) const {
+    for(const pair<int, MetricCounter*>& counter : responses) {
+        if(counter.first == status) {
+            return *counter.second;
+        }
+    }
+    return Metrics::counter("http_responses_total", "HTTP responses sent, by status", Metrics::label("route", route) + "," + Metrics::label("status", to_string(status)));
+}
+
+function<void(const shared_ptr<Session>)> VtcBlockIndexer::HttpServer::instrument(const string& route, const function<void(const shared_ptr<Session>)>& handler, bool timed) {
+    routeMetrics.push_back(RouteMetrics());
+    RouteMetrics* metrics = &routeMetrics.back();
+    metrics->route = route;
+    metrics->requests = &Metrics::counter("http_requests_total", "HTTP requests received", Metrics::label("route", route));
+    metrics->rejected = &Metrics::counter("http_rejected_total", "HTTP requests turned away by the rate limiter", Metrics::label("route", route));
+    metrics->latency = &Metrics::histogram("http_request_duration_seconds", "Time spent handling HTTP requests", Metrics::latencyBuckets(), Metrics::label("route", route));
+    metrics->responseBytes = &Metrics::counter("http_response_bytes_total", "HTTP response body bytes sent", Metrics::label("route", route));
+    for(int status : { (int)OK, (int)PARTIAL_CONTENT, 400, 404, 429, 503 }) {
+        metrics->responses.push_back(make_pair(status, &Metrics::counter("http_responses_total", "HTTP responses sent, by status", Metrics::label("route", route) + "," + Metrics::label("status", to_string(status)))));
+    }
+
+    return [ this, metrics, handler, timed ]( const shared_ptr< Session > session ) {
+        RouteScope scope(metrics);
+        metrics->requests->increment();
+        if(!admission.admit(clientFor(session))) {
+            metrics->rejected->increment();
+            const string message("Rate limit exceeded");
+            respond(session, 429, message, { { "Content-Type", "text/plain" }, { "Content-Length", std::to_string(message.size()) }, { "Retry-After", "1" } });
+            return;
+        }
+        if(timed) {
+            ScopedTimer timer(*metrics->latency);
+            handler(session);
+        } else {
+            handler(session);
+        }
+    };
+}
+
+void VtcBlockIndexer::HttpServer::respond(const shared_ptr<Session> session, const int status, const string& body, const multimap<string, string>& headers) {
+    // Routes that are not instrumented, like /metrics itself, are not counted
+    if(currentRoute != nullptr) {
+        currentRoute->responsesWithStatus(status).increment();
+        currentRoute->responseBytes->increment(body.size());
+    }
+    session->close(status, body, headers);
+}
+
+string VtcBlockIndexer::HttpServer::clientFor(const shared_ptr<Session> session) {
+    return admission.clientFor(session->get_request()->get_header("X-Api-Key", ""), session->get_origin());
+}
+
+bool VtcBlockIndexer::HttpServer::addressScanStart(const shared_ptr<Session> session, string& start) {
+    const auto request = session->get_request();
+    string cursor = request->get_query_parameter("cursor", "00000001");
+    if(cursor.size() != 8 || cursor.find_first_not_of("0123456789") != string::npos) {
+        const string message("Invalid cursor");
+        respond(session, 400, message, { { "Content-Type", "text/plain" }, { "Content-Length", std::to_string(message.size()) } });
+        return false;
+    }
+    start = request->get_path_parameter( "address" ) + "-txo-" + cursor;
+    return true;
+}
+
+void VtcBlockIndexer::HttpServer::respondPartial(const shared_ptr<Session> session, const string& body, const string& contentType, const string& nextCursor) {
+    if(nextCursor.size() == 0) {
+        respond(session, OK, body, { { "Content-Type",  contentType }, { "Content-Length",  std::to_string(body.size()) } } );
+        return;
+    }
+    respond(session, PARTIAL_CONTENT, body, { { "Content-Type",  contentType }, { "Content-Length",  std::to_string(body.size()) }, { "X-Next-Cursor", nextCursor } } );
+}
+
+void VtcBlockIndexer::HttpServer::metrics(const shared_ptr<Session> session) {
+    stringstream body;
+    body << Metrics::render();
+
+    body << "# HELP logger_dropped_entries_total Log entries dropped because the log buffer was full\n";
+    body << "# TYPE logger_dropped_entries_total counter\n";
+    body << "logger_dropped_entries_total " << Logger::droppedEntries() << "\n";
+
+    string value;
+    body << "# HELP leveldb_files Number of table files per level\n";
+    body << "# TYPE leveldb_files gauge\n";
+    for(int level = 0; level < 7; level++) {
+        if(this->db->GetProperty("leveldb.num-files-at-level" + to_string(level), &value)) {
+            body << "leveldb_files{level=\"" << level << "\"} " << value << "\n";
+        }
+    }
+
+    leveldb::Range everything("", "\xff");
+    uint64_t approximateSize = 0;
+    this->db->GetApproximateSizes(&everything, 1, &approximateSize);
+    body << "# HELP leveldb_approximate_size_bytes Approximate size of the index on disk\n";
+    body << "# TYPE leveldb_approximate_size_bytes gauge\n";
+    body << "leveldb_approximate_size_bytes " << approximateSize << "\n";
+
+    // The compaction statistics table is only available as text, pass it along as comments
+    if(this->db->GetProperty("leveldb.stats", &value)) {
+        stringstream stats(value);
+        string line;
+        while(getline(stats, line)) {
+            body << "# leveldb.stats " << line << "\n";
+        }
+    }
+
+    respond(session, OK, body.str(), { { "Content-Type", "text/plain; version=0.0.4" }, { "Content-Length", std::to_string(body.str().size()) } });
 }
 
 void VtcBlockIndexer::HttpServer::mempoolTransactionIds(const shared_ptr<Session> session) {
@@ -53,45 +183,129 @@ void VtcBlockIndexer::HttpServer::mempoolTransactionIds(const shared_ptr<Session
         j.push_back(txid);
     }
     string body = j.dump();
-    session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
 }
 
+void VtcBlockIndexer::HttpServer::mempoolHistogram(const shared_ptr<Session> session) {
+    json buckets = json::array();
+    uint64_t totalVsize = 0;
+    for(const FeeRateBucket& bucket : mempoolMonitor->getFeeHistogram()) {
+        if(bucket.count == 0) continue;
+        json jsonBucket;
+        jsonBucket["feeRate"] = bucket.minFeeRate;
+        jsonBucket["count"] = bucket.count;
+        jsonBucket["vsize"] = bucket.vsize;
+        jsonBucket["fees"] = bucket.fees;
+        buckets.push_back(jsonBucket);
+        totalVsize += bucket.vsize;
+    }
+
+    json j;
+    j["buckets"] = buckets;
+    j["vsize"] = totalVsize;
+    j["unknownFeeCount"] = mempoolMonitor->getUnknownFeeCount();
+    string body = j.dump();
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+}
+
+void VtcBlockIndexer::HttpServer::feeEstimates(const shared_ptr<Session> session) {
+    json j;
+    for(uint32_t targetBlocks : { 1, 2, 3, 6, 12, 24 }) {
+        j[std::to_string(targetBlocks)] = mempoolMonitor->estimateFeeRate(targetBlocks);
+    }
+    string body = j.dump();
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+}
+
+namespace
+{
+    // Values in the fork index start with the previous block hash, the time and
+    // the height the branch forked off at, followed by the file name and position
+    const size_t FORK_FILENAME_OFFSET = 64 + 12 + 8;
+
+    json conflictsToJson(const vector<VtcBlockIndexer::MempoolConflict>& conflicts) {
+        json j = json::array();
+        for(const VtcBlockIndexer::MempoolConflict& conflict : conflicts) {
+            json jsonConflict;
+            jsonConflict["id"] = conflict.id;
+            jsonConflict["txid"] = conflict.txid;
+            jsonConflict["vout"] = conflict.vout;
+            jsonConflict["existingSpender"] = conflict.existingSpender;
+            jsonConflict["newSpender"] = conflict.newSpender;
+            jsonConflict["kind"] = conflict.kind;
+            jsonConflict["detectedAt"] = (uint64_t)conflict.detectedAt;
+            j.push_back(jsonConflict);
+        }
+        return j;
+    }
+}
+
+void VtcBlockIndexer::HttpServer::mempoolConflicts(const shared_ptr<Session> session) {
+    const auto request = session->get_request();
+    uint64_t since = 0;
+    try {
+        since = stoull(request->get_query_parameter("since", "0"));
+    } catch(const std::exception& e) {
+        const string message = "Invalid since parameter";
+        respond(session, 400, message, { { "Content-Type",  "text/plain" }, { "Content-Length",  std::to_string(message.size()) } } );
+        return;
+    }
+
+    string body = conflictsToJson(mempoolMonitor->getConflicts(since)).dump();
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+}
+
+void VtcBlockIndexer::HttpServer::outpointConflicts(const shared_ptr<Session> session) {
+    const auto request = session->get_request();
+    const string txid = request->get_path_parameter("txid", "");
+    const uint32_t vout = (uint32_t)stoul(request->get_path_parameter("vout", "0"));
+
+    string body = conflictsToJson(mempoolMonitor->getOutpointConflicts(txid, vout)).dump();
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+}
 
 void VtcBlockIndexer::HttpServer::getTransaction(const shared_ptr<Session> session) {
     const auto request = session->get_request();
+    const uint64_t requestId = Logger::nextRequestId();
     
-    cout << "Looking up txid " << request->get_path_parameter("id") << endl;
+    LOG_DEBUG(requestId, "Looking up txid " << request->get_path_parameter("id"));
     
     try {
-        const Json::Value tx = vertcoind->getrawtransaction(request->get_path_parameter("id"), true);
+        const Json::Value tx = rpcPool->lease()->getrawtransaction(request->get_path_parameter("id"), true);
         
         stringstream body;
         body << tx.toStyledString();
         
-        session->close(OK, body.str(), {{"Content-Type","application/json"},{"Content-Length",  std::to_string(body.str().size())}});
+        respond(session, OK, body.str(), {{"Content-Type","application/json"},{"Content-Length",  std::to_string(body.str().size())}});
     } catch(const jsonrpc::JsonRpcException& e) {
         const std::string message(e.what());
-        cout << "Not found " << message << endl;
-        session->close(404, message, {{"Content-Type","application/json"},{"Content-Length",  std::to_string(message.size())}});
+        LOG_INFO(requestId, "Transaction not found " << message);
+        respond(session, 404, message, {{"Content-Type","application/json"},{"Content-Length",  std::to_string(message.size())}});
     }
 }
 
 void VtcBlockIndexer::HttpServer::getBlock(const shared_ptr<Session> session) {
+    ReadContext ctx(this->db);
     const auto request = session->get_request();
     
     string highestBlockString;
-    this->db->Get(leveldb::ReadOptions(),"highestblock",&highestBlockString);
+    ctx.get("highestblock",&highestBlockString);
 
     uint64_t highestBlock = stoll(highestBlockString);
 
     std::string blockHashString = request->get_path_parameter("hash","");
 
+    // Blocks that were reorged out still have their block-hash key, stale
+    // blocks that were never on the main chain are only in the fork index
     string blockHeightString;
-    leveldb::Status s = this->db->Get(leveldb::ReadOptions(),"block-hash-" + blockHashString,&blockHeightString);
+    leveldb::Status s = ctx.get("block-hash-" + blockHashString,&blockHeightString);
+    if(!s.ok()) {
+        s = ctx.get("fork-hash-" + blockHashString,&blockHeightString);
+    }
     if(!s.ok()) // no key found
     { 
         const std::string message("Block not found");
-        session->close(404, message, {{"Content-Length",  std::to_string(message.size())}});
+        respond(session, 404, message, {{"Content-Length",  std::to_string(message.size())}});
         return;
     }
 
@@ -99,20 +313,38 @@ void VtcBlockIndexer::HttpServer::getBlock(const shared_ptr<Session> session) {
 
     uint64_t blockHeight = stoll(blockHeightString);
 
-    stringstream blockKey;
-    blockKey << "block-filePosition-" << setw(8) << setfill('0') << blockHeight;
+    string mainChainHash;
+    ctx.get("block-" + blockHeightString, &mainChainHash);
+    const bool isMainChain = (mainChainHash == blockHashString);
 
+    std::string fileName;
+    uint64_t filePosition = 0;
+    if(isMainChain) {
+        stringstream blockKey;
+        blockKey << "block-filePosition-" << setw(8) << setfill('0') << blockHeight;
 
-    std::string filePosition;
-    s = this->db->Get(leveldb::ReadOptions(), blockKey.str(), &filePosition);
-    if(!s.ok()) // no key found
+        std::string filePositionString;
+        s = ctx.get(blockKey.str(), &filePositionString);
+        if(s.ok()) {
+            fileName = filePositionString.substr(0,12);
+            filePosition = stoll(filePositionString.substr(12,12));
+        }
+    } else {
+        std::string forkValue;
+        s = ctx.get("fork-" + blockHeightString + "-" + blockHashString, &forkValue);
+        if(s.ok() && forkValue.size() > FORK_FILENAME_OFFSET + 12) {
+            fileName = forkValue.substr(FORK_FILENAME_OFFSET, forkValue.size() - FORK_FILENAME_OFFSET - 12);
+            filePosition = stoll(forkValue.substr(forkValue.size() - 12));
+        }
+    }
+    if(fileName.empty()) // no key found
     {
         const std::string message("Block not found");
-        session->close(404, message, {{"Content-Length",  std::to_string(message.size())}});
+        respond(session, 404, message, {{"Content-Length",  std::to_string(message.size())}});
         return;
     }
     
-    Block block = this->blockReader->readBlock(filePosition.substr(0,12),stoll(filePosition.substr(12,12)),blockHeight,false);
+    Block block = this->blockReader->readBlock(fileName,filePosition,blockHeight,false);
 
     json jsonBlock;
     jsonBlock["hash"] = block.blockHash;
@@ -123,9 +355,15 @@ void VtcBlockIndexer::HttpServer::getBlock(const shared_ptr<Session> session) {
     jsonBlock["bits"] = block.bits;
     jsonBlock["nonce"] = block.nonce;
     jsonBlock["height"] = block.height;
-    jsonBlock["confirmations"] = highestBlock-block.height+1;
+    // Like coind, blocks off the main chain have -1 confirmations
+    jsonBlock["confirmations"] = isMainChain ? (int64_t)(highestBlock-block.height+1) : -1;
     jsonBlock["size"] = block.byteSize;
 
+    string fees;
+    if(isMainChain && ctx.get("block-fees-" + blockHeightString, &fees).ok()) {
+        jsonBlock["fees"] = stoll(fees);
+    }
+
     json txs = json::array();
 
 
@@ -134,11 +372,11 @@ void VtcBlockIndexer::HttpServer::getBlock(const shared_ptr<Session> session) {
     }
 
     jsonBlock["tx"] = txs;
-    jsonBlock["ismainchain"] = true;
+    jsonBlock["ismainchain"] = isMainChain;
 
     string body = jsonBlock.dump();
     
-    session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
 }
 /*
 package models
@@ -200,28 +438,30 @@ type TxsResponse struct {
 	Txs					[]Transaction			`json:"txs"`
 }*/
 
-vector<string> VtcBlockIndexer::HttpServer::getAddressesForTxo(string txHash, uint64_t idx) {
+vector<string> VtcBlockIndexer::HttpServer::getAddressesForTxo(ReadContext& ctx, string txHash, uint64_t idx) {
     vector<string> returnValue = {};
     stringstream txoAddressKey;
     txoAddressKey << txHash << setw(8) << setfill('0') << idx << "-address-";
     string start(txoAddressKey.str() + "00000000");
     string limit(txoAddressKey.str() + "99999999");
     
-    leveldb::Iterator* it = this->db->NewIterator(leveldb::ReadOptions());
+    leveldb::Iterator* it = ctx.acquireIterator(true);
     for (it->Seek(start);
             it->Valid() && it->key().ToString() < limit;
             it->Next()) {
         returnValue.push_back(it->value().ToString());
     }
+    assert(it->status().ok());  // Check for any errors found during the scan
+    ctx.releaseIterator(it);
 
     return returnValue;
 }
 
-uint64_t VtcBlockIndexer::HttpServer::getValueForTxo(string txHash, uint64_t idx) {
+uint64_t VtcBlockIndexer::HttpServer::getValueForTxo(ReadContext& ctx, string txHash, uint64_t idx) {
     stringstream txoValueKey;
     txoValueKey << txHash << setw(8) << setfill('0') << idx << "-value";
     string valueString;
-    leveldb::Status s = this->db->Get(leveldb::ReadOptions(), txoValueKey.str(), &valueString);
+    leveldb::Status s = ctx.get(txoValueKey.str(), &valueString);
     if(!s.ok()) // no key found
     { 
         return 0;
@@ -230,10 +470,11 @@ uint64_t VtcBlockIndexer::HttpServer::getValueForTxo(string txHash, uint64_t idx
 }
 
 void VtcBlockIndexer::HttpServer::getBlockTransactions(const shared_ptr<Session> session) {
+    ReadContext ctx(this->db);
     const auto request = session->get_request();
     
     string highestBlockString;
-    this->db->Get(leveldb::ReadOptions(),"highestblock",&highestBlockString);
+    ctx.get("highestblock",&highestBlockString);
 
     uint64_t highestBlock = stoll(highestBlockString);
 
@@ -241,11 +482,11 @@ void VtcBlockIndexer::HttpServer::getBlockTransactions(const shared_ptr<Session>
     int pageNum = stoi(request->get_path_parameter("page","0"));
 
     string blockHeightString;
-    leveldb::Status s = this->db->Get(leveldb::ReadOptions(),"block-hash-" + blockHashString,&blockHeightString);
+    leveldb::Status s = ctx.get("block-hash-" + blockHashString,&blockHeightString);
     if(!s.ok()) // no key found
     { 
         const std::string message("Block not found");
-        session->close(404, message, {{"Content-Length",  std::to_string(message.size())}});
+        respond(session, 404, message, {{"Content-Length",  std::to_string(message.size())}});
         return;
     }
 
@@ -255,11 +496,11 @@ void VtcBlockIndexer::HttpServer::getBlockTransactions(const shared_ptr<Session>
     blockKey << "block-filePosition-" << setw(8) << setfill('0') << blockHeight;
 
     std::string filePosition;
-    s = this->db->Get(leveldb::ReadOptions(), blockKey.str(), &filePosition);
+    s = ctx.get(blockKey.str(), &filePosition);
     if(!s.ok()) // no key found
     {
         const std::string message("Block not found");
-        session->close(404, message, {{"Content-Length",  std::to_string(message.size())}});
+        respond(session, 404, message, {{"Content-Length",  std::to_string(message.size())}});
         return;
     }
     
@@ -287,6 +528,27 @@ void VtcBlockIndexer::HttpServer::getBlockTransactions(const shared_ptr<Session>
             jtx["blockhash"] = block.blockHash;
             jtx["blockheight"] = block.height;
             jtx["isCoinBase"] = false;
+
+            // Blocks indexed with undo data have the value and addresses of each
+            // input stored with the transaction
+            vector<string> spentOutputs;
+            leveldb::Iterator* it = ctx.acquireIterator(true);
+            string vinStart("tx-" + tx.txHash + "-vin-00000000");
+            string vinLimit("tx-" + tx.txHash + "-vin-99999999");
+            for (it->Seek(vinStart);
+                    it->Valid() && it->key().ToString() < vinLimit;
+                    it->Next()) {
+                spentOutputs.push_back(it->value().ToString());
+            }
+            assert(it->status().ok());  // Check for any errors found during the scan
+            ctx.releaseIterator(it);
+            const bool hasSpentOutputs = (spentOutputs.size() == tx.inputs.size());
+
+            string fee;
+            if(ctx.get("tx-" + tx.txHash + "-fee", &fee).ok()) {
+                jtx["fees"] = stoll(fee);
+            }
+
             json vins = json::array();
             for (VtcBlockIndexer::TransactionInput txi : tx.inputs) {
                 if(txi.coinbase) jtx["isCoinBase"] = true;
@@ -299,14 +561,20 @@ void VtcBlockIndexer::HttpServer::getBlockTransactions(const shared_ptr<Session>
                 json scriptSig;
                 scriptSig["hex"] = Utility::hashToHex(txi.script);
                 vin["scriptSig"] = scriptSig;
-                vector<string> addresses = getAddressesForTxo(txi.txHash, txi.txoIndex);
-                string addressesConcatenated = "";
-                
-                for(size_t i = 0; i < addresses.size(); i++) {
-                    addressesConcatenated += (i > 0 ? " " : "") + addresses[i];
+                if(hasSpentOutputs) {
+                    const string& spent = spentOutputs.at(txi.index);
+                    vin["addr"] = spent.substr(16);
+                    vin["valueSat"] = stoll(spent.substr(0, 16));
+                } else {
+                    vector<string> addresses = getAddressesForTxo(ctx, txi.txHash, txi.txoIndex);
+                    string addressesConcatenated = "";
+
+                    for(size_t i = 0; i < addresses.size(); i++) {
+                        addressesConcatenated += (i > 0 ? " " : "") + addresses[i];
+                    }
+                    vin["addr"] = addressesConcatenated;
+                    vin["valueSat"] = getValueForTxo(ctx, txi.txHash, txi.txoIndex);
                 }
-                vin["addr"] = addressesConcatenated;
-                vin["valueSat"] = getValueForTxo(txi.txHash, txi.txoIndex);
                 
                 vins.push_back(vin);
             }
@@ -319,14 +587,14 @@ void VtcBlockIndexer::HttpServer::getBlockTransactions(const shared_ptr<Session>
                 stringstream txoKey;
                 txoKey << "txo-" << tx.txHash << "-" << setw(8) << setfill('0') << txo.index << "-spent";
 
-                leveldb::Status s = this->db->Get(leveldb::ReadOptions(), txoKey.str(), &spentTx);
+                leveldb::Status s = ctx.get(txoKey.str(), &spentTx);
                 if(s.ok()) // no key found, not spent. Add balance.
                 {
                     vout["spentTxId"] = spentTx.substr(64, 64);
                     vout["spentIndex"] = stoll(spentTx.substr(128, 8));
                     vout["spentBlock"] = spentTx.substr(0, 64);
                     std::string blockHeightString;
-                    s = this->db->Get(leveldb::ReadOptions(), "block-hash-" + spentTx.substr(0, 64), &blockHeightString);
+                    s = ctx.get("block-hash-" + spentTx.substr(0, 64), &blockHeightString);
                     if(s.ok()) 
                     {
                         vout["spentHeight"] = stoll(blockHeightString);
@@ -336,7 +604,7 @@ void VtcBlockIndexer::HttpServer::getBlockTransactions(const shared_ptr<Session>
                 json scriptPubKey;
                 scriptPubKey["hex"] = Utility::hashToHex(txo.script);
                 scriptPubKey["addresses"] = json::array();
-                vector<string> addresses = getAddressesForTxo(tx.txHash, txo.index);
+                vector<string> addresses = getAddressesForTxo(ctx, tx.txHash, txo.index);
                 for(string address : addresses) {
                     scriptPubKey["addresses"].push_back(address);
                 }
@@ -353,29 +621,30 @@ void VtcBlockIndexer::HttpServer::getBlockTransactions(const shared_ptr<Session>
     response["txs"] = txs;
     string body = response.dump();
     
-    session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
 }
 
 
 void VtcBlockIndexer::HttpServer::getTransactionProof(const shared_ptr<Session> session) {
+    ReadContext ctx(this->db);
     const auto request = session->get_request();
     
     std::string blockHash;
     std::string txId = request->get_path_parameter("id","");
-    leveldb::Status s = this->db->Get(leveldb::ReadOptions(), "tx-" + txId + "-block", &blockHash);
+    leveldb::Status s = ctx.get("tx-" + txId + "-block", &blockHash);
     if(!s.ok()) // no key found
     {
         const std::string message("TX not found");
-        session->close(404, message, {{"Content-Length",  std::to_string(message.size())}});
+        respond(session, 404, message, {{"Content-Length",  std::to_string(message.size())}});
         return;
     }
 
     std::string blockHeightString;
-    s = this->db->Get(leveldb::ReadOptions(), "block-hash-" + blockHash, &blockHeightString);
+    s = ctx.get("block-hash-" + blockHash, &blockHeightString);
     if(!s.ok()) // no key found
     {
         const std::string message("Block not found");
-        session->close(404, message, {{"Content-Length",  std::to_string(message.size())}});
+        respond(session, 404, message, {{"Content-Length",  std::to_string(message.size())}});
         return;
     }
     uint64_t blockHeight = stoll(blockHeightString);
@@ -389,11 +658,11 @@ void VtcBlockIndexer::HttpServer::getTransactionProof(const shared_ptr<Session>
         blockKey << "block-filePosition-" << setw(8) << setfill('0') << i;
    
         std::string filePosition;
-        s = this->db->Get(leveldb::ReadOptions(), blockKey.str(), &filePosition);
+        s = ctx.get(blockKey.str(), &filePosition);
         if(!s.ok()) // no key found
         {
             const std::string message("Block not found");
-            session->close(404, message, {{"Content-Length",  std::to_string(message.size())}});
+            respond(session, 404, message, {{"Content-Length",  std::to_string(message.size())}});
             return;
         }
        
@@ -414,21 +683,22 @@ void VtcBlockIndexer::HttpServer::getTransactionProof(const shared_ptr<Session>
     j["chain"] = chain;
     string body = j.dump();
     
-   session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+   respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
 }
 
 void VtcBlockIndexer::HttpServer::sync(const shared_ptr<Session> session) {
+    ReadContext ctx(this->db);
     json j;
 
     const auto request = session->get_request( );
 
     string highestBlockString;
-    this->db->Get(leveldb::ReadOptions(),"highestblock",&highestBlockString);
+    ctx.get("highestblock",&highestBlockString);
 
     j["error"] = nullptr;
     j["height"] = stoll(highestBlockString);
     try {
-        const Json::Value blockCount = vertcoind->getblockcount();
+        const Json::Value blockCount = rpcPool->lease()->getblockcount();
         
         j["blockChainHeight"] = blockCount.asInt();
     } catch(const jsonrpc::JsonRpcException& e) {
@@ -446,16 +716,152 @@ void VtcBlockIndexer::HttpServer::sync(const shared_ptr<Session> session) {
     }
 
     string body = j.dump();
-    session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+}
+
+void VtcBlockIndexer::HttpServer::events(const shared_ptr<Session> session) {
+    const auto request = session->get_request( );
+
+    // Comma separated list of addresses to receive address events for
+    vector<string> addresses;
+    stringstream addressList(request->get_query_parameter("addresses", ""));
+    string address;
+    while(getline(addressList, address, ',')) {
+        if(address.size() > 0 && addresses.size() < 1000) {
+            addresses.push_back(address);
+        }
+    }
+
+    // Subscriptions outlive the request, so they are capped per client on top of the rate limit
+    const string client = clientFor(session);
+    if(!this->eventHub->canSubscribe(client)) {
+        const string message("Too many event subscriptions");
+        respond(session, 429, message, { { "Content-Type", "text/plain" }, { "Content-Length", std::to_string(message.size()) } });
+        return;
+    }
+
+    // The stream stays open, so the response is counted when it starts
+    if(currentRoute != nullptr) {
+        currentRoute->responsesWithStatus(OK).increment();
+    }
+    session->yield(OK, ": connected\n\n", { { "Content-Type", "text/event-stream" }, { "Cache-Control", "no-cache" }, { "Connection", "keep-alive" } }, [ this, client, addresses ]( const shared_ptr< Session > session ) {
+        const uint64_t subscriberId = this->eventHub->subscribe(client, addresses, [ session ]( const string& event ) {
+            if(session->is_closed()) return false;
+            session->yield(event);
+            return true;
+        });
+        // Another stream of the same client took the last slot in the meantime
+        if(subscriberId == 0) {
+            session->close();
+        }
+    });
+}
+
+void VtcBlockIndexer::HttpServer::doubleSpends(const shared_ptr<Session> session) {
+    const auto request = session->get_request();
+    uint64_t since = 0;
+    try {
+        since = stoull(request->get_query_parameter("since", "0"));
+    } catch(const std::exception& e) {
+        const string message = "Invalid since parameter";
+        respond(session, 400, message, { { "Content-Type",  "text/plain" }, { "Content-Length",  std::to_string(message.size()) } } );
+        return;
+    }
+
+    ReadContext ctx(this->db);
+    stringstream start;
+    start << "doublespend-" << setw(8) << setfill('0') << (since + 1);
+    string limit("doublespend-99999999");
+
+    // Events are stored as the JSON the viewer reads, with their id added.
+    // At most 1000 per response, the client continues from the last id.
+    string body = "[";
+    leveldb::Iterator* it = ctx.acquireIterator(false);
+    size_t count = 0;
+    for (it->Seek(start.str());
+            it->Valid() && it->key().ToString() <= limit && count < 1000;
+            it->Next()) {
+        if(count > 0) body += ",";
+        body += it->value().ToString();
+        count++;
+    }
+    assert(it->status().ok());  // Check for any errors found during the scan
+    ctx.releaseIterator(it);
+    body += "]";
+
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+}
+
+void VtcBlockIndexer::HttpServer::getForks(const shared_ptr<Session> session) {
+    ReadContext ctx(this->db);
+    json j = json::array();
+
+    const auto request = session->get_request( );
+    uint64_t fromHeight = 0;
+    try {
+        fromHeight = stoull(request->get_query_parameter("fromHeight", "0"));
+    } catch(const std::exception& e) {
+        const string message = "Invalid fromHeight parameter";
+        respond(session, 400, message, { { "Content-Type",  "text/plain" }, { "Content-Length",  std::to_string(message.size()) } } );
+        return;
+    }
+
+    stringstream start;
+    start << "fork-" << setw(8) << setfill('0') << fromHeight;
+    string limit("fork-99999999");
+
+    leveldb::Iterator* it = ctx.acquireIterator(false);
+    for (it->Seek(start.str());
+            it->Valid() && it->key().ToString() < limit && j.size() < 100;
+            it->Next()) {
+        // fork-<height>-<hash>
+        const string key = it->key().ToString();
+        const string value = it->value().ToString();
+        if(key.size() != 78 || value.size() <= FORK_FILENAME_OFFSET) {
+            continue;
+        }
+        const string heightString = key.substr(5, 8);
+        const string hash = key.substr(14);
+
+        // A branch that took over is on the main chain now
+        string mainChainHash;
+        ctx.get("block-" + heightString, &mainChainHash);
+        if(mainChainHash == hash) {
+            continue;
+        }
+
+        json forkObj;
+        const uint64_t height = stoll(heightString);
+        const uint64_t forkHeight = stoll(value.substr(76, 8));
+        forkObj["hash"] = hash;
+        forkObj["height"] = height;
+        forkObj["previousBlockHash"] = value.substr(0, 64);
+        forkObj["time"] = stoll(value.substr(64, 12));
+        forkObj["forkHeight"] = forkHeight;
+        forkObj["depth"] = height - forkHeight + 1;
+        forkObj["mainChainHash"] = mainChainHash;
+        forkObj["ismainchain"] = false;
+        j.push_back(forkObj);
+    }
+    assert(it->status().ok());  // Check for any errors found during the scan
+    ctx.releaseIterator(it);
+
+    string body = j.dump();
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
 }
 
 void VtcBlockIndexer::HttpServer::getBlocks(const shared_ptr<Session> session) {
+    ReadContext ctx(this->db);
     json j = json::array();
 
     const auto request = session->get_request( );
 
     string highestBlockString;
-    this->db->Get(leveldb::ReadOptions(),"highestblock",&highestBlockString);
+    if(!ctx.get("highestblock",&highestBlockString).ok()) {
+        const string body = j.dump();
+        respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+        return;
+    }
     
    
     long long limitParam = stoi(request->get_query_parameter("limit","0"));
@@ -469,19 +875,27 @@ void VtcBlockIndexer::HttpServer::getBlocks(const shared_ptr<Session> session) {
     string start("block-" + highestBlockString);
     string limit("block-" + lowestBlockString.str());
     
-    leveldb::Iterator* it = this->db->NewIterator(leveldb::ReadOptions());
+    leveldb::Iterator* it = ctx.acquireIterator(false);
     for (it->Seek(start);
             it->Valid() && it->key().ToString() > limit;
             it->Prev()) {
-        json blockObj;
+        // After a UTXO snapshot import the heights up to the snapshot have no
+        // block records until they are backfilled, and the seek may land on
+        // another block- key. Only complete block-<height> records are listed.
         string blockHeightString = it->key().ToString().substr(6);
+        if(blockHeightString.size() != 8 || blockHeightString.find_first_not_of("0123456789") != string::npos) {
+            continue;
+        }
+        json blockObj;
         blockObj["hash"] = it->value().ToString();
         string blockSizeString;
         string blockTxesString;
         string blockTimeString;
-        this->db->Get(leveldb::ReadOptions(),"block-size-" + blockHeightString,&blockSizeString);
-        this->db->Get(leveldb::ReadOptions(),"block-txcount-" + blockHeightString,&blockTxesString);
-        this->db->Get(leveldb::ReadOptions(),"block-time-" + blockHeightString,&blockTimeString);
+        if(!ctx.get("block-size-" + blockHeightString,&blockSizeString).ok() ||
+           !ctx.get("block-txcount-" + blockHeightString,&blockTxesString).ok() ||
+           !ctx.get("block-time-" + blockHeightString,&blockTimeString).ok()) {
+            continue;
+        }
         blockObj["height"] = stoll(blockHeightString);
         blockObj["size"] = stoll(blockSizeString);
         blockObj["time"] = stoll(blockTimeString);
@@ -489,14 +903,17 @@ void VtcBlockIndexer::HttpServer::getBlocks(const shared_ptr<Session> session) {
         blockObj["poolInfo"] = nullptr;
         j.push_back(blockObj);
     }
+    assert(it->status().ok());  // Check for any errors found during the scan
+    ctx.releaseIterator(it);
 
     string body = j.dump();
     
-   session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+   respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
 
 }
 
 void VtcBlockIndexer::HttpServer::getBlocksByDate(const shared_ptr<Session> session) {
+    ReadContext ctx(this->db);
     json j = json::array();
  
     const auto request = session->get_request( );
@@ -513,20 +930,20 @@ void VtcBlockIndexer::HttpServer::getBlocksByDate(const shared_ptr<Session> sess
     string start(ssBlockHeightTimeStartKey.str());
     string limit(ssBlockHeightTimeEndKey.str());
     
-    leveldb::Iterator* it = this->db->NewIterator(leveldb::ReadOptions());
+    leveldb::Iterator* it = ctx.acquireIterator(false);
     for (it->Seek(start);
             it->Valid() && it->key().ToString() <= limit;
             it->Next()) {
         json blockObj;
         string blockHashString = it->value().ToString();
         string blockHeightString;
-        this->db->Get(leveldb::ReadOptions(),"block-hash-" + blockHashString,&blockHeightString);
+        ctx.get("block-hash-" + blockHashString,&blockHeightString);
         string blockSizeString;
         string blockTxesString;
         string blockTimeString;
-        this->db->Get(leveldb::ReadOptions(),"block-size-" + blockHeightString,&blockSizeString);
-        this->db->Get(leveldb::ReadOptions(),"block-txcount-" + blockHeightString,&blockTxesString);
-        this->db->Get(leveldb::ReadOptions(),"block-time-" + blockHeightString,&blockTimeString);
+        ctx.get("block-size-" + blockHeightString,&blockSizeString);
+        ctx.get("block-txcount-" + blockHeightString,&blockTxesString);
+        ctx.get("block-time-" + blockHeightString,&blockTimeString);
         blockObj["hash"] = it->value().ToString();
         blockObj["height"] = stoll(blockHeightString);
         blockObj["size"] = stoll(blockSizeString);
@@ -535,15 +952,18 @@ void VtcBlockIndexer::HttpServer::getBlocksByDate(const shared_ptr<Session> sess
         blockObj["poolInfo"] = nullptr;
         j.push_back(blockObj);
     }
+    assert(it->status().ok());  // Check for any errors found during the scan
+    ctx.releaseIterator(it);
 
     string body = j.dump();
      
-   session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+   respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
 
 }
 
 void VtcBlockIndexer::HttpServer::addressBalance( const shared_ptr< Session > session )
 {
+    ReadContext ctx(this->db);
     long long balance = 0;
     long long unconfirmedBalance = 0;
     long long txCount = 0;
@@ -551,24 +971,35 @@ void VtcBlockIndexer::HttpServer::addressBalance( const shared_ptr< Session > se
     int txoCount = 0;
     const auto request = session->get_request( );
     int details = stoi(request->get_query_parameter("details","0"));
+    const uint64_t requestId = Logger::nextRequestId();
     
-    cout << "Checking balance for address " << request->get_path_parameter( "address" ) << endl;
+    LOG_SAMPLED(LOG_LEVEL_INFO, 100, requestId, "Checking balance for address " << request->get_path_parameter( "address" ));
 
-    string start(request->get_path_parameter( "address" ) + "-txo-00000001");
+    string start;
+    if(!addressScanStart(session, start)) return;
     string limit(request->get_path_parameter( "address" ) + "-txo-99999999");
+    RequestBudget budget(admission.limits());
+    string nextCursor;
     
-    leveldb::Iterator* it = this->db->NewIterator(leveldb::ReadOptions());
+    leveldb::Iterator* it = ctx.acquireIterator(false);
     
     for (it->Seek(start);
             it->Valid() && it->key().ToString() < limit;
             it->Next()) {
 
+        if(budget.exhausted()) {
+            // Resume from this TXO; the client adds up the partial balances
+            nextCursor = it->key().ToString().substr(limit.size() - 8);
+            break;
+        }
+        budget.chargeKey();
+
         string spentTx;
         txoCount++;
         txCount++;
         string txo = it->value().ToString();
 
-        leveldb::Status s = this->db->Get(leveldb::ReadOptions(), "txo-" + txo.substr(0,64) + "-" + txo.substr(64,8) + "-spent", &spentTx);
+        leveldb::Status s = ctx.get("txo-" + txo.substr(0,64) + "-" + txo.substr(64,8) + "-spent", &spentTx);
         if(!s.ok()) // no key found, not spent. Add balance.
         {
             balance += stoll(txo.substr(80));
@@ -584,17 +1015,32 @@ void VtcBlockIndexer::HttpServer::addressBalance( const shared_ptr< Session > se
         }
     }
     assert(it->status().ok());  // Check for any errors found during the scan
-    delete it;
+    ctx.releaseIterator(it);
+
+    LOG_DEBUG(requestId, "Analyzed " << txoCount << " TXOs - Balance is " << balance);
+    admission.charge(clientFor(session), budget.cost());
 
-    cout << "Analyzed " << txoCount << " TXOs - Balance is " << balance << endl;
+    // A partial sum is only useful to clients that page through the balance
+    // themselves, so it is only returned to those that pass a cursor
+    if(nextCursor.size() > 0 && !request->has_query_parameter("cursor")) {
+        LOG_INFO(requestId, "Balance scan exceeded the request budget after " << txoCount << " TXOs");
+        const string message("Request budget exceeded, pass cursor=00000001 to page through the balance");
+        respond(session, 503, message, { { "Content-Type", "text/plain" }, { "Content-Length", std::to_string(message.size()) } });
+        return;
+    }
  
-    // Add mempool transactions
-    vector<VtcBlockIndexer::TransactionOutput> mempoolOutputs = mempoolMonitor->getTxos(request->get_path_parameter( "address" ));
+    // Add mempool transactions, only once at the end of the scan
+    vector<VtcBlockIndexer::TransactionOutput> mempoolOutputs;
+    if(nextCursor.size() == 0) {
+        mempoolOutputs = mempoolMonitor->getTxos(request->get_path_parameter( "address" ));
+    } else {
+        LOG_INFO(requestId, "Balance scan cut short by the request budget after " << txoCount << " TXOs");
+    }
     for (VtcBlockIndexer::TransactionOutput txo : mempoolOutputs) {
         txoCount++;
         unconfirmedTxCount++;
         string spender = mempoolMonitor->outpointSpend(txo.txHash, txo.index);
-        cout << "Spender for " << txo.txHash << "/" << txo.index << " = " << spender;
+        LOG_DEBUG(requestId, "Spender for " << txo.txHash << "/" << txo.index << " = " << spender);
         if(spender.compare("") == 0) {
             unconfirmedBalance += txo.value;
         } else {
@@ -602,7 +1048,7 @@ void VtcBlockIndexer::HttpServer::addressBalance( const shared_ptr< Session > se
         }
     }
 
-    cout << "Including mempool: Analyzed " << txoCount << " TXOs - Balance is " << balance << endl;
+    LOG_DEBUG(requestId, "Including mempool: Analyzed " << txoCount << " TXOs - Balance is " << balance);
     
     if(details != 0) {
         json j;
@@ -611,18 +1057,19 @@ void VtcBlockIndexer::HttpServer::addressBalance( const shared_ptr< Session > se
         j["unconfirmedBalance"] = unconfirmedBalance;
         j["unconfirmedTxCount"] = unconfirmedTxCount;
         string body = j.dump();
-        session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+        respondPartial(session, body, "application/json", nextCursor);
     } else {
         stringstream body;
         body << balance;
         
-        session->close( OK, body.str(), { {"Content-Type","text/plain"}, { "Content-Length",  std::to_string(body.str().size()) } } );
+        respondPartial(session, body.str(), "text/plain", nextCursor);
     }
     
 }
 
 void VtcBlockIndexer::HttpServer::addressTxos( const shared_ptr< Session > session )
 {
+    ReadContext ctx(this->db);
     json j = json::array();
 
     const auto request = session->get_request( );
@@ -634,29 +1081,40 @@ void VtcBlockIndexer::HttpServer::addressTxos( const shared_ptr< Session > sessi
     int unspent = stoi(request->get_query_parameter("unspent","0"));
     int unconfirmed = stoi(request->get_query_parameter("unconfirmed","0"));
     int scripts = stoi(request->get_query_parameter("script","0"));
-    cout << "Fetching address txos for address " << request->get_path_parameter( "address" ) << endl;
+    const uint64_t requestId = Logger::nextRequestId();
+    LOG_SAMPLED(LOG_LEVEL_INFO, 100, requestId, "Fetching address txos for address " << request->get_path_parameter( "address" ));
    
-    string start(request->get_path_parameter( "address" ) + "-txo-00000001");
+    string start;
+    if(!addressScanStart(session, start)) return;
     string limit(request->get_path_parameter( "address" ) + "-txo-99999999");
+    RequestBudget budget(admission.limits());
+    string nextCursor;
     
-    leveldb::Iterator* it = this->db->NewIterator(leveldb::ReadOptions());
+    leveldb::Iterator* it = ctx.acquireIterator(false);
     
     for (it->Seek(start);
             it->Valid() && it->key().ToString() < limit;
             it->Next()) {
 
+        if(budget.exhausted()) {
+            nextCursor = it->key().ToString().substr(limit.size() - 8);
+            break;
+        }
+        budget.chargeKey();
+
         string spentTx;
         string txo = it->value().ToString();
 
-        leveldb::Status s = this->db->Get(leveldb::ReadOptions(), "txo-" + txo.substr(0,64) + "-" + txo.substr(64,8) + "-spent", &spentTx);
+        leveldb::Status s = ctx.get("txo-" + txo.substr(0,64) + "-" + txo.substr(64,8) + "-spent", &spentTx);
         long long block = stoll(txo.substr(72,8));
 
         stringstream ssBlockTimeHeightKey;
         string blockTimeStr;
         ssBlockTimeHeightKey << "block-time-" << setw(8) << setfill('0') << block;
-        this->db->Get(leveldb::ReadOptions(), ssBlockTimeHeightKey.str(), &blockTimeStr);
+        ctx.get(ssBlockTimeHeightKey.str(), &blockTimeStr);
 
-        const long long blockTime = stoll(blockTimeStr);
+        // A block time that was never recorded counts as 0 rather than failing the request
+        const long long blockTime = blockTimeStr.empty() ? 0 : stoll(blockTimeStr);
 
         // If the block count param is greater than 2000/1/1 consider
         // it as a timestamp rather than block height
@@ -688,25 +1146,27 @@ void VtcBlockIndexer::HttpServer::addressTxos( const shared_ptr< Session > sessi
 
             if(raw != 0) {
                 try {
-                    const Json::Value tx = vertcoind->getrawtransaction(txo.substr(0,64), false);
+                    budget.chargeRpc();
+                    const Json::Value tx = rpcPool->lease()->getrawtransaction(txo.substr(0,64), false);
                     txoObj["tx"] = tx.asString();
                 } catch(const jsonrpc::JsonRpcException& e) {
                     const std::string message(e.what());
-                    session->close(400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
-                    cout << "Not found " << message << endl;
+                    respond(session, 400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
+                    LOG_WARNING(requestId, "RPC lookup failed " << message);
                     return;
                 }
             }
 
             if(raw == 0 && scripts != 0) {
                  try {
-                    const Json::Value tx = vertcoind->getrawtransaction(txo.substr(0,64), true);
+                    budget.chargeRpc();
+                    const Json::Value tx = rpcPool->lease()->getrawtransaction(txo.substr(0,64), true);
                     const Json::Value scriptHex = tx["vout"][stoi(txo.substr(64,8))]["scriptPubKey"]["hex"];
                     txoObj["script"] = scriptHex.asString();
                 } catch(const jsonrpc::JsonRpcException& e) {
                     const std::string message(e.what());
-                    session->close(400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
-                    cout << "Not found " << message << endl;
+                    respond(session, 400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
+                    LOG_WARNING(requestId, "RPC lookup failed " << message);
                     return;
                 }
             }
@@ -715,12 +1175,13 @@ void VtcBlockIndexer::HttpServer::addressTxos( const shared_ptr< Session > sessi
 
             if(raw != 0 && txoObj["spender"].is_string()) {
                 try {
-                    const Json::Value tx = vertcoind->getrawtransaction(txoObj["spender"].get<string>(), false);
+                    budget.chargeRpc();
+                    const Json::Value tx = rpcPool->lease()->getrawtransaction(txoObj["spender"].get<string>(), false);
                     txoObj["spender"] = tx.asString();
                 } catch(const jsonrpc::JsonRpcException& e) {
                     const std::string message(e.what());
-                    session->close(400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
-                    cout << "Not found " << message << endl;
+                    respond(session, 400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
+                    LOG_WARNING(requestId, "RPC lookup failed " << message);
                     return;
                 }
             }
@@ -737,9 +1198,12 @@ void VtcBlockIndexer::HttpServer::addressTxos( const shared_ptr< Session > sessi
         }
     }
     assert(it->status().ok());  // Check for any errors found during the scan
-    delete it;
+    ctx.releaseIterator(it);
+    admission.charge(clientFor(session), budget.cost());
 
-    if(unconfirmed == 1) {
+    if(nextCursor.size() > 0) {
+        LOG_INFO(requestId, "TXO scan cut short by the request budget, next cursor " << nextCursor);
+    } else if(unconfirmed == 1) {
         // Add mempool transactions
         vector<VtcBlockIndexer::TransactionOutput> mempoolOutputs = mempoolMonitor->getTxos(request->get_path_parameter( "address" ));
         for (VtcBlockIndexer::TransactionOutput txo : mempoolOutputs) {
@@ -760,23 +1224,25 @@ void VtcBlockIndexer::HttpServer::addressTxos( const shared_ptr< Session > sessi
 
     string body = j.dump();
      
-    session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+    respondPartial(session, body, "application/json", nextCursor);
 }
 
 void VtcBlockIndexer::HttpServer::outpointSpend( const shared_ptr< Session > session )
 {
+    ReadContext ctx(this->db);
     json j;
     j["error"] = false;
     const auto request = session->get_request( );
     int raw = stoi(request->get_query_parameter("raw","0"));
     int unconfirmed = stoi(request->get_query_parameter("unconfirmed","0"));
+    const uint64_t requestId = Logger::nextRequestId();
     
     long long vout = stoll(request->get_path_parameter( "vout", "0" ));
     string txid = request->get_path_parameter("txid", "");
     stringstream txBlockKey;
     string txBlock;
     txBlockKey << "tx-" << txid << "-block";
-    leveldb::Status s = this->db->Get(leveldb::ReadOptions(), txBlockKey.str(), &txBlock);
+    leveldb::Status s = ctx.get(txBlockKey.str(), &txBlock);
     if(!s.ok()) {
         j["error"] = true;
         j["errorDescription"] = "Transaction ID not found";
@@ -787,7 +1253,7 @@ void VtcBlockIndexer::HttpServer::outpointSpend( const shared_ptr< Session > ses
         txoId << "txo-" << txid << "-" << setw(8) << setfill('0') << vout << "-spent";
         string spentTx;
 
-        s = this->db->Get(leveldb::ReadOptions(), txoId.str(), &spentTx);
+        s = ctx.get(txoId.str(), &spentTx);
         j["spent"] = s.ok();
         if(s.ok()) {
             j["spender"] = spentTx.substr(64, 64);
@@ -795,7 +1261,7 @@ void VtcBlockIndexer::HttpServer::outpointSpend( const shared_ptr< Session > ses
             string blockHeightStr;
             stringstream blockHashId;
             blockHashId << "block-hash-" << spentTx.substr(0,64);
-            s = this->db->Get(leveldb::ReadOptions(), blockHashId.str(), &blockHeightStr);
+            s = ctx.get(blockHashId.str(), &blockHeightStr);
             if(s.ok()) {
                 j["height"] = stol(blockHeightStr);
             }
@@ -810,13 +1276,13 @@ void VtcBlockIndexer::HttpServer::outpointSpend( const shared_ptr< Session > ses
 
         if(raw != 0 && j["spender"].is_string()) {
             try {
-                const Json::Value tx = vertcoind->getrawtransaction(j["spender"].get<string>(), false);
+                const Json::Value tx = rpcPool->lease()->getrawtransaction(j["spender"].get<string>(), false);
                 j["spenderRaw"] = tx.asString();
                 j["spender"] = nullptr;
             } catch(const jsonrpc::JsonRpcException& e) {
                 const std::string message(e.what());
-                session->close(400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
-                cout << "Not found " << message << endl;
+                respond(session, 400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
+                LOG_WARNING(requestId, "RPC lookup failed " << message);
                 return;
             }
         }
@@ -828,7 +1294,7 @@ void VtcBlockIndexer::HttpServer::outpointSpend( const shared_ptr< Session > ses
    
     string body = j.dump();
      
-    session->close( OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
+    respond(session, OK, body, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(body.size()) } } );
 } 
 
 
@@ -840,12 +1306,18 @@ void VtcBlockIndexer::HttpServer::outpointSpends( const shared_ptr< Session > se
     
     
     
-    session->fetch( content_length, [ request, this ]( const shared_ptr< Session > session, const Bytes & body )
+    // The body may arrive on another thread, take the route along
+    const VtcBlockIndexer::RouteMetrics* route = currentRoute;
+    session->fetch( content_length, [ request, this, route ]( const shared_ptr< Session > session, const Bytes & body )
     {
+        RouteScope scope(route);
+        ScopedTimer timer(*route->latency);
         const auto request = session->get_request( );
         int raw = stoi(request->get_query_parameter("raw","0"));
         int unconfirmed = stoi(request->get_query_parameter("unconfirmed","0"));
         
+        ReadContext ctx(this->db);
+        const uint64_t requestId = Logger::nextRequestId();
 
         string content =string(body.begin(), body.end());
         json output = json::array();
@@ -855,7 +1327,7 @@ void VtcBlockIndexer::HttpServer::outpointSpends( const shared_ptr< Session > se
                 if(txo.is_object() && txo["txid"].is_string() && txo["vout"].is_number()) {
                     stringstream txoId;
                     txoId << "txo-" << txo["txid"].get<string>() << "-" << setw(8) << setfill('0') << txo["vout"].get<int>() << "-spent";
-                    cout << "Checking outpoint spent " << txoId.str() << endl;
+                    LOG_DEBUG(requestId, "Checking outpoint spent " << txoId.str());
             
                     json j;
                     j["txid"] = txo["txid"];
@@ -864,7 +1336,7 @@ void VtcBlockIndexer::HttpServer::outpointSpends( const shared_ptr< Session > se
                     stringstream txBlockKey;
                     string txBlock;
                     txBlockKey << "tx-" << txo["txid"].get<string>() << "-block";
-                    leveldb::Status s = this->db->Get(leveldb::ReadOptions(), txBlockKey.str(), &txBlock);
+                    leveldb::Status s = ctx.get(txBlockKey.str(), &txBlock);
                     if(!s.ok()) {
                         j["error"] = true;
                         j["errorDescription"] = "Transaction ID not found";
@@ -872,14 +1344,14 @@ void VtcBlockIndexer::HttpServer::outpointSpends( const shared_ptr< Session > se
                     else 
                     {
                         string spentTx;
-                        s = this->db->Get(leveldb::ReadOptions(), txoId.str(), &spentTx);
+                        s = ctx.get(txoId.str(), &spentTx);
                         if(s.ok()) {
                             j["spender"] = spentTx.substr(64, 64);
                             j["spent"] = true;
                             string blockHeightStr;
                             stringstream blockHashId;
                             blockHashId << "block-hash-" << spentTx.substr(0,64);
-                            s = this->db->Get(leveldb::ReadOptions(), blockHashId.str(), &blockHeightStr);
+                            s = ctx.get(blockHashId.str(), &blockHeightStr);
                             if(s.ok()) {
                                 j["height"] = stol(blockHeightStr);
                             }   
@@ -898,12 +1370,12 @@ void VtcBlockIndexer::HttpServer::outpointSpends( const shared_ptr< Session > se
 
                     if(raw != 0 && j["spender"].is_string()) {
                         try {
-                            const Json::Value tx = vertcoind->getrawtransaction(j["spender"].get<string>(), false);
+                            const Json::Value tx = rpcPool->lease()->getrawtransaction(j["spender"].get<string>(), false);
                             j["spenderRaw"] = tx.asString();
                             j["spender"] = nullptr;
                         } catch(const jsonrpc::JsonRpcException& e) {
                             const std::string message(e.what());
-                            cout << "Not found " << message << endl;
+                            LOG_WARNING(requestId, "RPC lookup failed " << message);
                         }
                     }
 
@@ -914,7 +1386,7 @@ void VtcBlockIndexer::HttpServer::outpointSpends( const shared_ptr< Session > se
         }
     
         string resultBody = output.dump();
-        session->close( OK, resultBody, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(resultBody.size()) } } );
+        respond(session, OK, resultBody, { { "Content-Type",  "application/json" }, { "Content-Length",  std::to_string(resultBody.size()) } } );
     } );
 } 
 
@@ -922,17 +1394,21 @@ void VtcBlockIndexer::HttpServer::sendRawTransaction( const shared_ptr< Session
 {
     const auto request = session->get_request( );
     const size_t content_length = request->get_header( "Content-Length", 0);
-    session->fetch( content_length, [ request, this ]( const shared_ptr< Session > session, const Bytes & body )
+    // The body may arrive on another thread, take the route along
+    const VtcBlockIndexer::RouteMetrics* route = currentRoute;
+    session->fetch( content_length, [ request, this, route ]( const shared_ptr< Session > session, const Bytes & body )
     {
+        RouteScope scope(route);
+        ScopedTimer timer(*route->latency);
         const string rawtx = string(body.begin(), body.end());
         
         try {
-            const auto txid = vertcoind->sendrawtransaction(rawtx);
+            const auto txid = rpcPool->lease()->sendrawtransaction(rawtx);
             
-            session->close(OK, txid, {{"Content-Type","text/plain"}, {"Content-Length",  std::to_string(txid.size())}});
+            respond(session, OK, txid, {{"Content-Type","text/plain"}, {"Content-Length",  std::to_string(txid.size())}});
         } catch(const jsonrpc::JsonRpcException& e) {
             const std::string message(e.what());
-            session->close(400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
+            respond(session, 400, message, {{"Content-Type","text/plain"},{"Content-Length",  std::to_string(message.size())}});
         }
     });
 } 
@@ -941,66 +1417,108 @@ void VtcBlockIndexer::HttpServer::run()
 {
     auto addressBalanceResource = make_shared< Resource >( );
     addressBalanceResource->set_path( "/addressBalance/{address: .*}" );
-    addressBalanceResource->set_method_handler( "GET", bind( &VtcBlockIndexer::HttpServer::addressBalance, this, std::placeholders::_1) );
+    addressBalanceResource->set_method_handler( "GET", instrument( "addressBalance", bind( &VtcBlockIndexer::HttpServer::addressBalance, this, std::placeholders::_1) ) );
 
     auto addressTxosResource = make_shared< Resource >( );
     addressTxosResource->set_path( "/addressTxos/{address: .*}" );
-    addressTxosResource->set_method_handler( "GET", bind( &VtcBlockIndexer::HttpServer::addressTxos, this, std::placeholders::_1) );
+    addressTxosResource->set_method_handler( "GET", instrument( "addressTxos", bind( &VtcBlockIndexer::HttpServer::addressTxos, this, std::placeholders::_1) ) );
 
     auto addressTxosSinceBlockResource = make_shared< Resource >( );
     addressTxosSinceBlockResource->set_path( "/addressTxosSince/{sinceBlock: ^[0-9]*$}/{address: .*}" );
-    addressTxosSinceBlockResource->set_method_handler( "GET", bind( &VtcBlockIndexer::HttpServer::addressTxos, this, std::placeholders::_1) );
+    addressTxosSinceBlockResource->set_method_handler( "GET", instrument( "addressTxosSince", bind( &VtcBlockIndexer::HttpServer::addressTxos, this, std::placeholders::_1) ) );
     
     auto getTransactionResource = make_shared<Resource>();
     getTransactionResource->set_path( "/getTransaction/{id: [0-9a-f]*}" );
-    getTransactionResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::getTransaction, this, std::placeholders::_1) );
+    getTransactionResource->set_method_handler("GET", instrument("getTransaction", bind(&VtcBlockIndexer::HttpServer::getTransaction, this, std::placeholders::_1)) );
 
     auto getTransactionProofResource = make_shared<Resource>();
     getTransactionProofResource->set_path( "/getTransactionProof/{id: [0-9a-f]*}" );
-    getTransactionProofResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::getTransactionProof, this, std::placeholders::_1) );
+    getTransactionProofResource->set_method_handler("GET", instrument("getTransactionProof", bind(&VtcBlockIndexer::HttpServer::getTransactionProof, this, std::placeholders::_1)) );
 
     auto outpointSpendResource = make_shared<Resource>();
     outpointSpendResource->set_path( "/outpointSpend/{txid: .*}/{vout: .*}" );
-    outpointSpendResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::outpointSpend, this, std::placeholders::_1) );
+    outpointSpendResource->set_method_handler("GET", instrument("outpointSpend", bind(&VtcBlockIndexer::HttpServer::outpointSpend, this, std::placeholders::_1)) );
 
     auto outpointSpendsResource = make_shared<Resource>();
     outpointSpendsResource->set_path( "/outpointSpends" );
-    outpointSpendsResource->set_method_handler("POST", bind(&VtcBlockIndexer::HttpServer::outpointSpends, this, std::placeholders::_1) );
+    outpointSpendsResource->set_method_handler("POST", instrument("outpointSpends", bind(&VtcBlockIndexer::HttpServer::outpointSpends, this, std::placeholders::_1), false) );
 
     auto sendRawTransactionResource = make_shared<Resource>();
     sendRawTransactionResource->set_path( "/sendRawTransaction" );
-    sendRawTransactionResource->set_method_handler("POST", bind(&VtcBlockIndexer::HttpServer::sendRawTransaction, this, std::placeholders::_1) );
+    sendRawTransactionResource->set_method_handler("POST", instrument("sendRawTransaction", bind(&VtcBlockIndexer::HttpServer::sendRawTransaction, this, std::placeholders::_1), false) );
 
     auto blocksResource = make_shared<Resource>();
     blocksResource->set_path( "/blocks" );
-    blocksResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::getBlocks, this, std::placeholders::_1) );
+    blocksResource->set_method_handler("GET", instrument("blocks", bind(&VtcBlockIndexer::HttpServer::getBlocks, this, std::placeholders::_1)) );
 
     auto blockResource = make_shared<Resource>();
     blockResource->set_path( "/block/{hash: [0-9a-f]*}" );
-    blockResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::getBlock, this, std::placeholders::_1) );
+    blockResource->set_method_handler("GET", instrument("block", bind(&VtcBlockIndexer::HttpServer::getBlock, this, std::placeholders::_1)) );
 
     auto blockTransactionResource = make_shared<Resource>();
     blockTransactionResource->set_path( "/blocktxs/{hash: [0-9a-f]*}/{page: [0-9]*}" );
-    blockTransactionResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::getBlockTransactions, this, std::placeholders::_1) );
+    blockTransactionResource->set_method_handler("GET", instrument("blocktxs", bind(&VtcBlockIndexer::HttpServer::getBlockTransactions, this, std::placeholders::_1)) );
 
     auto blocksByDateResource = make_shared<Resource>();
     blocksByDateResource->set_path( "/blocksbydate" );
-    blocksByDateResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::getBlocksByDate, this, std::placeholders::_1) );
+    blocksByDateResource->set_method_handler("GET", instrument("blocksbydate", bind(&VtcBlockIndexer::HttpServer::getBlocksByDate, this, std::placeholders::_1)) );
 
     auto mempoolResource = make_shared<Resource>();
     mempoolResource->set_path( "/mempool" );
-    mempoolResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::mempoolTransactionIds, this, std::placeholders::_1) );
+    mempoolResource->set_method_handler("GET", instrument("mempool", bind(&VtcBlockIndexer::HttpServer::mempoolTransactionIds, this, std::placeholders::_1)) );
+
+
+    auto mempoolHistogramResource = make_shared<Resource>();
+    mempoolHistogramResource->set_path( "/mempool/histogram" );
+    mempoolHistogramResource->set_method_handler("GET", instrument("mempool/histogram", bind(&VtcBlockIndexer::HttpServer::mempoolHistogram, this, std::placeholders::_1)) );
 
+    auto feeEstimatesResource = make_shared<Resource>();
+    feeEstimatesResource->set_path( "/feeEstimates" );
+    feeEstimatesResource->set_method_handler("GET", instrument("feeEstimates", bind(&VtcBlockIndexer::HttpServer::feeEstimates, this, std::placeholders::_1)) );
+
+    auto mempoolConflictsResource = make_shared<Resource>();
+    mempoolConflictsResource->set_path( "/mempool/conflicts" );
+    mempoolConflictsResource->set_method_handler("GET", instrument("mempool/conflicts", bind(&VtcBlockIndexer::HttpServer::mempoolConflicts, this, std::placeholders::_1)) );
+
+    auto outpointConflictsResource = make_shared<Resource>();
+    outpointConflictsResource->set_path( "/mempool/conflicts/{txid: [0-9a-f]{64}}/{vout: [0-9]{1,9}}" );
+    outpointConflictsResource->set_method_handler("GET", instrument("mempool/conflicts/outpoint", bind(&VtcBlockIndexer::HttpServer::outpointConflicts, this, std::placeholders::_1)) );
+
+    auto doubleSpendsResource = make_shared<Resource>();
+    doubleSpendsResource->set_path( "/doublespends" );
+    doubleSpendsResource->set_method_handler("GET", instrument("doublespends", bind(&VtcBlockIndexer::HttpServer::doubleSpends, this, std::placeholders::_1)) );
+
+    auto forksResource = make_shared<Resource>();
+    forksResource->set_path( "/forks" );
+    forksResource->set_method_handler("GET", instrument("forks", bind(&VtcBlockIndexer::HttpServer::getForks, this, std::placeholders::_1)) );
 
     auto syncResource = make_shared<Resource>();
     syncResource->set_path( "/sync" );
-    syncResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::sync, this, std::placeholders::_1) );
+    syncResource->set_method_handler("GET", instrument("sync", bind(&VtcBlockIndexer::HttpServer::sync, this, std::placeholders::_1)) );
+
+    auto eventsResource = make_shared<Resource>();
+    eventsResource->set_path( "/events" );
+    eventsResource->set_method_handler("GET", instrument("events", bind(&VtcBlockIndexer::HttpServer::events, this, std::placeholders::_1), false) );
+
+    auto metricsResource = make_shared<Resource>();
+    metricsResource->set_path( "/metrics" );
+    metricsResource->set_method_handler("GET", bind(&VtcBlockIndexer::HttpServer::metrics, this, std::placeholders::_1) );
+
+    // Keep event streams alive and drop the ones whose clients went away
+    std::thread heartbeatThread([this]() {
+        while(true) {
+            std::this_thread::sleep_for(std::chrono::seconds(15));
+            this->eventHub->heartbeat();
+        }
+    });
+    heartbeatThread.detach();
 
 
 
 
     auto settings = make_shared< Settings >( );
     settings->set_port( 8888 );
+    settings->set_worker_limit( workerCount );
     settings->set_default_header( "Connection", "close" );
     settings->set_default_header( "Access-Control-Allow-Origin", "*" );
     
@@ -1018,6 +1536,14 @@ void VtcBlockIndexer::HttpServer::run()
     service.publish( blocksResource );
     service.publish( blocksByDateResource );
     service.publish( mempoolResource );
+    service.publish( mempoolHistogramResource );
+    service.publish( feeEstimatesResource );
+    service.publish( mempoolConflictsResource );
+    service.publish( outpointConflictsResource );
+    service.publish( doubleSpendsResource );
+    service.publish( forksResource );
     service.publish( syncResource );
+    service.publish( eventsResource );
+    service.publish( metricsResource );
     service.start( settings );
 }
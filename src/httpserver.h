@@ -22,20 +22,41 @@
 */
 
 #include <restbed>
-#include <jsonrpccpp/client/connectors/httpclient.h>
+#include <list>
 
 #include "leveldb/db.h"
 #include "leveldb/write_batch.h"
 
-#include "vertcoinrpc.h"
+#include "rpcclientpool.h"
 #include "blockreader.h"
 #include "scriptsolver.h"
 #include "mempoolmonitor.h"
+#include "readcontext.h"
+#include "eventhub.h"
+#include "metrics.h"
+#include "admission.h"
 
 using namespace std;
 using namespace restbed;
 
 namespace VtcBlockIndexer {
+
+    /**
+     * The metrics of a published route. They are looked up in the registry once
+     * when the route is published, so requests only touch their atomics.
+     */
+    struct RouteMetrics {
+        string route;
+        MetricCounter* requests;
+        MetricCounter* rejected;
+        MetricHistogram* latency;
+        MetricCounter* responseBytes;
+        // Responses per status, for the statuses the handlers send
+        vector<pair<int, MetricCounter*>> responses;
+
+        /** Returns the response counter for a status */
+        MetricCounter& responsesWithStatus(int status) const;
+    };
     
     /**
      * The HttpServer class contains the methods used to run the HTTP public interface for
@@ -44,7 +65,7 @@ namespace VtcBlockIndexer {
     
     class HttpServer {
         public:
-            HttpServer(const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor, string blocksDir);
+            HttpServer(const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor, const shared_ptr<VtcBlockIndexer::EventHub> eventHub, string blocksDir);
             void run();
             /* REST Api for returning the balance of a given address */
             void addressBalance( const shared_ptr< Session > session );
@@ -79,22 +100,74 @@ namespace VtcBlockIndexer {
             /* REST Api for returning list of transactionids in the memory pool */
             void mempoolTransactionIds( const shared_ptr< Session > session );
             
+            /* REST Api for returning the fee rate histogram of the memory pool */
+            void mempoolHistogram( const shared_ptr< Session > session );
+
+            /* REST Api for returning fee rate estimates for confirmation within 1 to 24 blocks */
+            void feeEstimates( const shared_ptr< Session > session );
+
+            /* REST Api for returning recently detected conflicting spends, after the id in ?since= */
+            void mempoolConflicts( const shared_ptr< Session > session );
+
+            /* REST Api for returning recently detected conflicting spends of one outpoint */
+            void outpointConflicts( const shared_ptr< Session > session );
+
+            /* REST Api for returning double spends found in orphaned blocks, after the id in ?since= */
+            void doubleSpends( const shared_ptr< Session > session );
+
+            /* REST Api for returning blocks that are not on the main chain, from the height in ?fromHeight= */
+            void getForks( const shared_ptr< Session > session );
+
             /* REST Api for returning sync status */
             void sync( const shared_ptr< Session > session );
 
-            vector<string> getAddressesForTxo(string txHash, uint64_t idx);
-            uint64_t getValueForTxo(string txHash, uint64_t idx);
+            /* Server-sent event stream for new blocks and activity on watched addresses */
+            void events( const shared_ptr< Session > session );
+
+            /* Metrics in the Prometheus text exposition format */
+            void metrics( const shared_ptr< Session > session );
+
+            vector<string> getAddressesForTxo(ReadContext& ctx, string txHash, uint64_t idx);
+            uint64_t getValueForTxo(ReadContext& ctx, string txHash, uint64_t idx);
 
             /* REST Api for sending a hex transaction on the VTC p2p network*/
             void sendRawTransaction( const shared_ptr< Session > session );
             
         private:
+            /** Closes the session with the response and records its status and size
+             * with the metrics of the route being handled on this thread
+             */
+            void respond(const shared_ptr<Session> session, const int status, const string& body, const multimap<string, string>& headers);
+
+            /** Wraps a handler to count its requests and, when timed is set, measure the
+             * time spent in it. Handlers that fetch a request body measure their own
+             * latency in the fetch callback, with the route metrics they were called with.
+             */
+            function<void(const shared_ptr<Session>)> instrument(const string& route, const function<void(const shared_ptr<Session>)>& handler, bool timed = true);
+
+            /** Returns the identity the rate limiter knows the client by */
+            string clientFor(const shared_ptr<Session> session);
+
+            /** Determines where an address scan starts, from the cursor query parameter.
+             * Responds with 400 and returns false when the cursor is malformed.
+             */
+            bool addressScanStart(const shared_ptr<Session> session, string& start);
+
+            /** Sends a scan result that may have been cut short by the request budget.
+             * When a cursor is given the response is 206 with an X-Next-Cursor header.
+             */
+            void respondPartial(const shared_ptr<Session> session, const string& body, const string& contentType, const string& nextCursor);
+
             shared_ptr<leveldb::DB> db;
-            unique_ptr<VertcoinClient> vertcoind;
-            unique_ptr<jsonrpc::HttpClient> httpClient;
+            unique_ptr<VtcBlockIndexer::RpcClientPool> rpcPool;
+            unsigned int workerCount;
             unique_ptr<VtcBlockIndexer::BlockReader> blockReader;
             unique_ptr<VtcBlockIndexer::ScriptSolver> scriptSolver;
             shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor;
+            shared_ptr<VtcBlockIndexer::EventHub> eventHub;
+            AdmissionControl admission;
+            // Metrics of the published routes, a list so their addresses stay put
+            list<RouteMetrics> routeMetrics;
             /** Directory containing the blocks
              */
             string blocksDir; 
@@ -0,0 +1,168 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    // Must be a power of two
+    const uint64_t LOG_BUFFER_SIZE = 8192;
+    const size_t LOG_MESSAGE_SIZE = 240;
+
+    struct LogEntry {
+        // Sequence number used to hand the slot over between producers and the flusher
+        atomic<uint64_t> sequence;
+        uint8_t level;
+        uint64_t requestId;
+        uint64_t timestampMs;
+        size_t length;
+        char message[LOG_MESSAGE_SIZE];
+    };
+
+    LogEntry logBuffer[LOG_BUFFER_SIZE];
+    atomic<uint64_t> enqueuePosition(0);
+    uint64_t dequeuePosition = 0;
+    atomic<bool> flusherStarted(false);
+    uint64_t reportedDropped = 0;
+
+    const char* levelNames[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+}
+
+atomic<uint8_t> VtcBlockIndexer::Logger::minLevel(LOG_LEVEL_INFO);
+atomic<uint64_t> VtcBlockIndexer::Logger::requestIdCounter(0);
+atomic<uint32_t> VtcBlockIndexer::Logger::sampleCounter(0);
+atomic<uint64_t> VtcBlockIndexer::Logger::dropped(0);
+
+void VtcBlockIndexer::Logger::start(uint8_t minLevel) {
+    Logger::minLevel = minLevel;
+    if(flusherStarted.load()) return;
+
+    for(uint64_t i = 0; i < LOG_BUFFER_SIZE; i++) {
+        logBuffer[i].sequence.store(i, memory_order_relaxed);
+    }
+    flusherStarted.store(true);
+
+    std::thread flusherThread(flusher);
+    flusherThread.detach();
+}
+
+bool VtcBlockIndexer::Logger::isEnabled(uint8_t level) {
+    return flusherStarted.load(memory_order_relaxed) && level >= minLevel.load(memory_order_relaxed);
+}
+
+bool VtcBlockIndexer::Logger::sample(uint32_t sampleRate) {
+    if(sampleRate <= 1) return true;
+    return (sampleCounter.fetch_add(1, memory_order_relaxed) % sampleRate) == 0;
+}
+
+uint64_t VtcBlockIndexer::Logger::nextRequestId() {
+    return requestIdCounter.fetch_add(1, memory_order_relaxed) + 1;
+}
+
+uint64_t VtcBlockIndexer::Logger::droppedEntries() {
+    return dropped.load(memory_order_relaxed);
+}
+
+uint8_t VtcBlockIndexer::Logger::levelFromString(string level) {
+    if(level == "debug") return LOG_LEVEL_DEBUG;
+    if(level == "warning") return LOG_LEVEL_WARNING;
+    if(level == "error") return LOG_LEVEL_ERROR;
+    return LOG_LEVEL_INFO;
+}
+
+void VtcBlockIndexer::Logger::log(uint8_t level, uint64_t requestId, const string& message) {
+    uint64_t position = enqueuePosition.load(memory_order_relaxed);
+    LogEntry* entry;
+    while(true) {
+        entry = &logBuffer[position & (LOG_BUFFER_SIZE - 1)];
+        uint64_t sequence = entry->sequence.load(memory_order_acquire);
+        int64_t difference = (int64_t)sequence - (int64_t)position;
+        if(difference == 0) {
+            if(enqueuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if(difference < 0) {
+            // Buffer is full - the flusher has not caught up. Drop rather than block.
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        } else {
+            position = enqueuePosition.load(memory_order_relaxed);
+        }
+    }
+
+    entry->level = level;
+    entry->requestId = requestId;
+    entry->timestampMs = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    entry->length = min(message.size(), LOG_MESSAGE_SIZE);
+    memcpy(entry->message, message.data(), entry->length);
+    entry->sequence.store(position + 1, memory_order_release);
+}
+
+bool VtcBlockIndexer::Logger::flushPending() {
+    string output;
+    while(true) {
+        LogEntry* entry = &logBuffer[dequeuePosition & (LOG_BUFFER_SIZE - 1)];
+        if(entry->sequence.load(memory_order_acquire) != dequeuePosition + 1) {
+            break;
+        }
+
+        time_t seconds = entry->timestampMs / 1000;
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        char prefix[64];
+        size_t prefixLength = strftime(prefix, sizeof(prefix), "%Y-%m-%dT%H:%M:%S", &utc);
+        prefixLength += snprintf(prefix + prefixLength, sizeof(prefix) - prefixLength, ".%03dZ %s ", (int)(entry->timestampMs % 1000), levelNames[min(entry->level, (uint8_t)LOG_LEVEL_ERROR)]);
+        output.append(prefix, prefixLength);
+        if(entry->requestId != 0) {
+            output.append("[req " + to_string(entry->requestId) + "] ");
+        }
+        output.append(entry->message, entry->length);
+        output.push_back('\n');
+
+        entry->sequence.store(dequeuePosition + LOG_BUFFER_SIZE, memory_order_release);
+        dequeuePosition++;
+    }
+
+    uint64_t droppedNow = dropped.load(memory_order_relaxed);
+    if(droppedNow != reportedDropped) {
+        output.append("Logger dropped " + to_string(droppedNow - reportedDropped) + " entries because the buffer was full\n");
+        reportedDropped = droppedNow;
+    }
+
+    if(output.size() == 0) return false;
+    fwrite(output.data(), 1, output.size(), stdout);
+    fflush(stdout);
+    return true;
+}
+
+void VtcBlockIndexer::Logger::flusher() {
+    while(true) {
+        if(!flushPending()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOGGER_H_INCLUDED
+#define LOGGER_H_INCLUDED
+
+#include <atomic>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+#define LOG_LEVEL_DEBUG     0x00
+#define LOG_LEVEL_INFO      0x01
+#define LOG_LEVEL_WARNING   0x02
+#define LOG_LEVEL_ERROR     0x03
+
+// Debug lines are compiled out unless the indexer is built with -DVTC_LOG_DEBUG
+#ifdef VTC_LOG_DEBUG
+#define LOG_DEBUG(requestId, message) LOG_AT_LEVEL(LOG_LEVEL_DEBUG, requestId, message)
+#else
+#define LOG_DEBUG(requestId, message) do { } while(0)
+#endif
+
+#define LOG_INFO(requestId, message) LOG_AT_LEVEL(LOG_LEVEL_INFO, requestId, message)
+#define LOG_WARNING(requestId, message) LOG_AT_LEVEL(LOG_LEVEL_WARNING, requestId, message)
+#define LOG_ERROR(requestId, message) LOG_AT_LEVEL(LOG_LEVEL_ERROR, requestId, message)
+
+// Logs only one in every sampleRate calls, for lines on hot paths
+#define LOG_SAMPLED(level, sampleRate, requestId, message) \
+    do { if(VtcBlockIndexer::Logger::sample(sampleRate)) { LOG_AT_LEVEL(level, requestId, message); } } while(0)
+
+// The message is only formatted when the level is enabled
+#define LOG_AT_LEVEL(level, requestId, message) \
+    do { \
+        if(VtcBlockIndexer::Logger::isEnabled(level)) { \
+            std::stringstream logStream; \
+            logStream << message; \
+            VtcBlockIndexer::Logger::log(level, requestId, logStream.str()); \
+        } \
+    } while(0)
+
+namespace VtcBlockIndexer {
+
+    /**
+     * The Logger class provides asynchronous, leveled logging. Callers enqueue
+     * entries on a bounded lock-free ring buffer; a background thread formats
+     * them and writes them to stdout in batches. When the buffer is full,
+     * entries are dropped (and counted) rather than blocking the caller.
+     */
+
+    class Logger {
+        public:
+            /** Starts the background flusher thread. Entries below minLevel are
+             * discarded at the call site.
+             */
+            static void start(uint8_t minLevel);
+
+            /** Enqueues a log entry. Messages longer than the entry size are truncated.
+             * Use requestId 0 for entries that don't belong to a request.
+             */
+            static void log(uint8_t level, uint64_t requestId, const string& message);
+
+            /** Returns true if entries at this level are logged */
+            static bool isEnabled(uint8_t level);
+
+            /** Returns true once every sampleRate calls */
+            static bool sample(uint32_t sampleRate);
+
+            /** Returns a new unique id to correlate the log lines of a request */
+            static uint64_t nextRequestId();
+
+            /** Parses a level name (debug, info, warning, error). Defaults to info. */
+            static uint8_t levelFromString(string level);
+
+            /** Returns the number of entries dropped because the buffer was full */
+            static uint64_t droppedEntries();
+
+        private:
+            Logger() {}
+            static void flusher();
+            static bool flushPending();
+
+            static atomic<uint8_t> minLevel;
+            static atomic<uint64_t> requestIdCounter;
+            static atomic<uint32_t> sampleCounter;
+            static atomic<uint64_t> dropped;
+    };
+}
+
+#endif // LOGGER_H_INCLUDED
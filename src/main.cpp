@@ -36,9 +36,14 @@
 #include "httpserver.h"
 #include "mempoolmonitor.h"
 #include "blockfilewatcher.h"
+#include "eventhub.h"
 #include <thread>
 #include "cxxopts.hpp"
 #include "coinparams.h"
+#include "blockfile.h"
+#include "utxosnapshot.h"
+#include "logger.h"
+#include "crypto/sha256.h"
 
 using namespace std;
 
@@ -47,6 +52,7 @@ shared_ptr<leveldb::DB> database;
 shared_ptr<VtcBlockIndexer::HttpServer> httpServer;
 shared_ptr<VtcBlockIndexer::BlockFileWatcher> blockFileWatcher;
 shared_ptr<VtcBlockIndexer::MempoolMonitor> mempoolMonitor;
+shared_ptr<VtcBlockIndexer::EventHub> eventHub;
 
 void runBlockfileWatcher() {
     cout << "Starting blockfile watcher..." << endl;
@@ -69,6 +75,31 @@ void openDatabase(std::string indexDir) {
     database.reset(db);
 }
 
+/** Loads the unspent outputs of a dumptxoutset snapshot into an empty index,
+ * unless one was imported before. Exits when the import fails.
+ */
+void importUtxoSnapshot(std::string path, std::string blocksDir, std::string coreBlockIndexDir) {
+    VtcBlockIndexer::UtxoSnapshot snapshot(database);
+    if(snapshot.isImported()) {
+        cout << "A UTXO snapshot was imported before, not importing [" << path << "]" << endl;
+        return;
+    }
+    if(!snapshot.open(path)) {
+        exit(-1);
+    }
+
+    // The snapshot holds the hash of its base block, the height is found in the block files
+    cout << "Looking up the height of block " << snapshot.getBaseBlockHash() << "..." << endl;
+    VtcBlockIndexer::BlockFileWatcher watcher(blocksDir, coreBlockIndexDir, database, nullptr, nullptr);
+    vector<VtcBlockIndexer::ScannedBlock> chain = watcher.findChain(snapshot.getBaseBlockHash());
+    if(chain.empty()) {
+        cerr << "The base block of the UTXO snapshot is not in the block files. Exiting." << endl;
+        exit(-1);
+    }
+    if(!snapshot.import(chain)) {
+        exit(-1);
+    }
+}
 
 int main(int argc, char* argv[]) {
     cxxopts::Options options("vtc_indexer", "Block file indexer for blockchains");
@@ -77,7 +108,10 @@ int main(int argc, char* argv[]) {
     ("coinParams", "Coin parameters file", cxxopts::value<std::string>())
     ("indexDir", "Directory to save the indexes [Default: /index]", cxxopts::value<std::string>()->default_value("/index"))
     ("blocksDir", "Directory where the block files are located [Default: /blocks]", cxxopts::value<std::string>()->default_value("/blocks"))
+    ("coreBlockIndexDir", "Copy of the node's blocks/index directory to read block positions from instead of scanning all block files [Default: none]", cxxopts::value<std::string>()->default_value(""))
     ("dumpDoubleSpends", "Only run through the blockchain to found reorgd blocks containing double spends [default: no]", cxxopts::value<std::string>()->default_value("no"))
+    ("importUtxoSnapshot", "UTXO snapshot written by the node's dumptxoutset command to load into an empty index before indexing [Default: none]", cxxopts::value<std::string>()->default_value(""))
+    ("logLevel", "Minimum level of log lines written by the HTTP server: debug, info, warning or error [Default: info]", cxxopts::value<std::string>()->default_value("info"))
    
     ;
 
@@ -88,28 +122,51 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
+    // Start the asynchronous logger
+    VtcBlockIndexer::Logger::start(VtcBlockIndexer::Logger::levelFromString(options["logLevel"].as<string>()));
+
+    // Pick the fastest SHA-256 implementation this CPU supports
+    cout << "Using SHA256 implementation: " << SHA256AutoDetect() << endl;
+
     // Open the database
     openDatabase(options["indexDir"].as<string>());
 
     // Read coin parameters
     VtcBlockIndexer::CoinParams::readFromFile(options["coinParams"].as<string>());
 
+    // Newer nodes obfuscate their block files with a key kept next to them
+    if(VtcBlockIndexer::BlockFile::readObfuscationKey(options["blocksDir"].as<string>())) {
+        cout << "Block files are obfuscated, reading them with the key from xor.dat" << endl;
+    }
+
+    // A failed UTXO snapshot import leaves an index without part of the outputs
+    if(VtcBlockIndexer::UtxoSnapshot(database).isUnfinished()) {
+        cerr << "The UTXO snapshot import into the index did not finish. Remove the index and import the snapshot again. Exiting." << endl;
+        return -1;
+    }
+
+    // Serve balances from a UTXO snapshot before the history is indexed
+    if(!options["importUtxoSnapshot"].as<string>().empty()) {
+        importUtxoSnapshot(options["importUtxoSnapshot"].as<string>(), options["blocksDir"].as<string>(), options["coreBlockIndexDir"].as<string>());
+    }
+
     // Start blockfile watcher on separate thread
     
     if(options.count("dumpDoubleSpends") > 0) {
-        blockFileWatcher.reset(new VtcBlockIndexer::BlockFileWatcher(options["blocksDir"].as<string>(), database, mempoolMonitor));
+        blockFileWatcher.reset(new VtcBlockIndexer::BlockFileWatcher(options["blocksDir"].as<string>(), options["coreBlockIndexDir"].as<string>(), database, mempoolMonitor, eventHub));
         blockFileWatcher->dumpDoubleSpends();
     } else {
         std::thread watcherThread(runBlockfileWatcher);   
 
         // Start memory pool monitor on a separate thread
-        mempoolMonitor = make_shared<VtcBlockIndexer::MempoolMonitor>();
+        eventHub = make_shared<VtcBlockIndexer::EventHub>();
+        mempoolMonitor = make_shared<VtcBlockIndexer::MempoolMonitor>(database, eventHub, options["indexDir"].as<string>() + "/mempool.dat");
         std::thread mempoolThread(runMempoolMonitor);   
                 
-        blockFileWatcher.reset(new VtcBlockIndexer::BlockFileWatcher(options["blocksDir"].as<string>(), database, mempoolMonitor));
+        blockFileWatcher.reset(new VtcBlockIndexer::BlockFileWatcher(options["blocksDir"].as<string>(), options["coreBlockIndexDir"].as<string>(), database, mempoolMonitor, eventHub));
         
         // Start webserver on main thread.
-        httpServer.reset(new VtcBlockIndexer::HttpServer(database, mempoolMonitor, options["blocksDir"].as<string>()));
+        httpServer.reset(new VtcBlockIndexer::HttpServer(database, mempoolMonitor, eventHub, options["blocksDir"].as<string>()));
         httpServer->run(); 
     }
 }
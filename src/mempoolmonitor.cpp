@@ -19,117 +19,724 @@
 */
 #include "mempoolmonitor.h"
 #include "utility.h"
+#include "metrics.h"
 #include "scriptsolver.h"
 #include "blockchaintypes.h"
 #include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <time.h>
+#include <sstream>
+#include <iomanip>
 #include "byte_array_buffer.h"
+#include "zmqsubscriber.h"
+#include "mempoolsnapshot.h"
 using namespace std;
 
-// This map keeps the memorypool transactions deserialized in memory.
+namespace
+{
+    // Lower bounds of the fee rate histogram buckets, in satoshis per virtual byte
+    const double FEE_RATE_BUCKETS[] = { 0, 1, 2, 3, 4, 5, 6, 8, 10, 12, 15, 20, 30, 40, 50, 60, 70, 80, 90, 100,
+                                        125, 150, 175, 200, 250, 300, 350, 400, 500, 600, 700, 800, 900, 1000,
+                                        1200, 1400, 1600, 1800, 2000, 2500, 3000, 4000, 5000, 7500, 10000 };
+    const size_t FEE_RATE_BUCKET_COUNT = sizeof(FEE_RATE_BUCKETS) / sizeof(FEE_RATE_BUCKETS[0]);
 
+    // Virtual size a block has room for: the 4M weight limit over 4
+    const uint64_t BLOCK_VSIZE = 1000000;
 
-VtcBlockIndexer::MempoolMonitor::MempoolMonitor() {
-    httpClient.reset(new jsonrpc::HttpClient("http://" + std::string(std::getenv("COIND_RPCUSER")) + ":" + std::string(std::getenv("COIND_RPCPASSWORD")) + "@" + std::string(std::getenv("COIND_HOST")) + ":" + std::string(std::getenv("COIND_RPCPORT"))));
-    vertcoind.reset(new VertcoinClient(*httpClient));
+    // How long a transaction has to be missing from the node's mempool before
+    // it is dropped. A transaction confirmed in a block leaves the node's
+    // mempool before the indexer has read the block, which removes it then.
+    const chrono::seconds EVICTION_GRACE(300);
+
+    uint64_t varIntSize(uint64_t value) {
+        return value < 0xfd ? 1 : (value <= 0xffff ? 3 : (value <= 0xffffffff ? 5 : 9));
+    }
+
+    // Virtual size as defined in BIP141: witness bytes count for a quarter
+    uint64_t virtualSize(const VtcBlockIndexer::Transaction& tx) {
+        uint64_t witnessSize = 0;
+        for(const VtcBlockIndexer::TransactionInput& txi : tx.inputs) {
+            if(txi.witnessData.size() > 0) {
+                // Marker and flag bytes
+                witnessSize = 2;
+                break;
+            }
+        }
+        if(witnessSize > 0) {
+            for(const VtcBlockIndexer::TransactionInput& txi : tx.inputs) {
+                witnessSize += varIntSize(txi.witnessData.size());
+                for(const vector<unsigned char>& item : txi.witnessData) {
+                    witnessSize += varIntSize(item.size()) + item.size();
+                }
+            }
+        }
+        uint64_t strippedSize = tx.byteSize - witnessSize;
+        return (strippedSize * 3 + tx.byteSize + 3) / 4;
+    }
+
+    size_t feeRateBucket(double feeRate) {
+        return (upper_bound(FEE_RATE_BUCKETS, FEE_RATE_BUCKETS + FEE_RATE_BUCKET_COUNT, feeRate) - FEE_RATE_BUCKETS) - 1;
+    }
+
+    // The output index in the last four bytes of an outpoint key
+    uint32_t outpointIndex(const string& key) {
+        uint32_t index = 0;
+        for(size_t i = 0; i < 4; i++) {
+            index |= (uint32_t)(unsigned char)key[32 + i] << (8 * i);
+        }
+        return index;
+    }
+}
+
+VtcBlockIndexer::MempoolMonitor::MempoolMonitor(const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::EventHub> eventHub, const string snapshotPath) {
+    this->db = db;
+    this->eventHub = eventHub;
+    this->unknownFeeCount = 0;
+    this->nextConflictId = 1;
+    for(size_t i = 0; i < FEE_RATE_BUCKET_COUNT; i++) {
+        FeeRateBucket bucket;
+        bucket.minFeeRate = FEE_RATE_BUCKETS[i];
+        bucket.count = 0;
+        bucket.vsize = 0;
+        bucket.fees = 0;
+        feeHistogram.push_back(bucket);
+    }
+    this->snapshotPath = snapshotPath;
+    this->changes = 0;
+    this->snapshotChanges = 0;
+    // Only the watcher thread calls coind
+    rpcPool.reset(new VtcBlockIndexer::RpcClientPool(1));
     blockReader.reset(new VtcBlockIndexer::BlockReader(""));
     scriptSolver.reset(new VtcBlockIndexer::ScriptSolver());
 }
 
 void VtcBlockIndexer::MempoolMonitor::startWatcher() {
+    // Start from the last snapshot, the first poll then only fetches the difference
+    loadSnapshot();
+
+    const char* zmqEndpoint = std::getenv("COIND_ZMQ_ENDPOINT");
+    if(zmqEndpoint != NULL && zmqEndpoint[0] != 0) {
+        watchNotifications(zmqEndpoint);
+        return;
+    }
+
     while(true) {
-        try {
-            const Json::Value mempool = vertcoind->getrawmempool();
-            for ( uint index = 0; index < mempool.size(); ++index )
+        pollMempool();
+        persistSnapshot();
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
+void VtcBlockIndexer::MempoolMonitor::loadSnapshot() {
+    if(snapshotPath.size() == 0) return;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t loaded = 0;
+    size_t entries = VtcBlockIndexer::MempoolSnapshot::read(snapshotPath, [this, &loaded](const vector<unsigned char>& rawTx, const vector<vector<string>>& outputAddresses) {
+        VtcBlockIndexer::Transaction tx = parseTransaction(rawTx);
+        if(tx.outputs.size() != outputAddresses.size()) return;
+        if(insertTransaction(tx, rawTx, outputAddresses, nullptr)) {
+            loaded++;
+        }
+    });
+
+    unique_lock<shared_timed_mutex> lock(mempoolMutex);
+    snapshotChanges = changes;
+    cout << "Loaded " << loaded << " of " << entries << " mempool transactions from the snapshot in "
+         << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() << "ms" << endl;
+}
+
+void VtcBlockIndexer::MempoolMonitor::persistSnapshot() {
+    if(snapshotPath.size() == 0) return;
+    if(chrono::steady_clock::now() - lastSnapshot < chrono::seconds(30)) return;
+    lastSnapshot = chrono::steady_clock::now();
+
+    string entries;
+    uint64_t snapshotOf;
+    {
+        shared_lock<shared_timed_mutex> lock(mempoolMutex);
+        if(changes == snapshotChanges) return;
+        snapshotOf = changes;
+        for(const auto& kvp : mempoolTransactions) {
+            VtcBlockIndexer::MempoolSnapshot::appendEntry(entries, kvp.second.raw(), kvp.second.rawSize(), outputAddresses(kvp.second));
+        }
+    }
+
+    if(!VtcBlockIndexer::MempoolSnapshot::write(snapshotPath, entries)) {
+        cout << "Could not write the mempool snapshot to " << snapshotPath << endl;
+        return;
+    }
+    unique_lock<shared_timed_mutex> lock(mempoolMutex);
+    snapshotChanges = snapshotOf;
+}
+
+void VtcBlockIndexer::MempoolMonitor::pollMempool() {
+    static VtcBlockIndexer::MetricHistogram& pollLatency = VtcBlockIndexer::Metrics::histogram("mempool_poll_seconds", "Time to poll the node mempool and fetch new transactions", VtcBlockIndexer::Metrics::latencyBuckets());
+    static VtcBlockIndexer::MetricGauge& mempoolSize = VtcBlockIndexer::Metrics::gauge("mempool_transactions", "Transactions currently held in the mempool monitor");
+    static VtcBlockIndexer::MetricCounter& evicted = VtcBlockIndexer::Metrics::counter("mempool_evicted_total", "Transactions dropped because they left the node mempool unconfirmed");
+    try {
+        VtcBlockIndexer::ScopedTimer timer(pollLatency);
+
+        // Only transactions we had before asking the node can be judged missing,
+        // newer ones may have been pushed to us after the node answered
+        unordered_set<string> known;
+        {
+            shared_lock<shared_timed_mutex> lock(mempoolMutex);
+            known.reserve(mempoolTransactions.size());
+            for(const auto& kvp : mempoolTransactions) {
+                known.insert(kvp.first);
+            }
+        }
+
+        const Json::Value mempool = rpcPool->lease()->getrawmempool();
+        vector<string> missing;
+        for ( uint index = 0; index < mempool.size(); ++index )
+        {
+            const string txid = mempool[index].asString();
+            if(known.erase(txid) > 0) {
+                continue;
+            }
             {
-                if(mempoolTransactions.find(mempool[index].asString()) == mempoolTransactions.end()) {
-                    const Json::Value rawTx = vertcoind->getrawtransaction(mempool[index].asString(), false);
-                    std::vector<unsigned char> rawTxBytes = VtcBlockIndexer::Utility::hexToBytes(rawTx.asString());
-
-                    byte_array_buffer streambuf(&rawTxBytes[0], rawTxBytes.size());
-                    std::istream stream(&streambuf);
-
-                    VtcBlockIndexer::Transaction tx = blockReader->readTransaction(stream);
-                    mempoolTransactions[mempool[index].asString()] = tx;
-
-                  
-                    for(VtcBlockIndexer::TransactionOutput out : tx.outputs) {
-                        out.txHash = tx.txHash;
-                        vector<string> addresses = scriptSolver->getAddressesFromScript(out.script);
-                        for(string address : addresses) {
-                            if(addressMempoolTransactions.find(address) == addressMempoolTransactions.end())
-                            {
-                                addressMempoolTransactions[address] = {};
+                shared_lock<shared_timed_mutex> lock(mempoolMutex);
+                if(mempoolTransactions.find(txid) != mempoolTransactions.end()) {
+                    continue;
+                }
+            }
+            missing.push_back(txid);
+        }
+
+        // Fetch the new transactions in batches, outside the lock so readers don't wait for coind
+        const size_t batchSize = 500;
+        for(size_t batchStart = 0; batchStart < missing.size(); batchStart += batchSize) {
+            vector<string> batch(missing.begin() + batchStart, missing.begin() + min(missing.size(), batchStart + batchSize));
+            const vector<Json::Value> rawTxs = rpcPool->lease()->getrawtransactions(batch);
+            for(const Json::Value& rawTx : rawTxs) {
+                // Null when the transaction left the mempool since the node listed it
+                if(rawTx.isString()) {
+                    addTransaction(VtcBlockIndexer::Utility::hexToBytes(rawTx.asString()));
+                }
+            }
+        }
+
+        // What is left expired, was replaced or was evicted by the node, or was
+        // confirmed in a block the indexer has not read yet. Nothing makes the
+        // indexer get there first, so only drop transactions that stay missing
+        // longer than it takes to index a block. The ones that came back or
+        // were removed by the indexer in the meantime are not in known.
+        const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        unordered_map<string, chrono::steady_clock::time_point> stillMissing;
+        vector<string> expired;
+        for(const string& txid : known) {
+            auto since = missingSince.find(txid);
+            const chrono::steady_clock::time_point missingFrom = (since == missingSince.end() ? now : since->second);
+            if(now - missingFrom >= EVICTION_GRACE) {
+                expired.push_back(txid);
+            } else {
+                stillMissing[txid] = missingFrom;
+            }
+        }
+        missingSince.swap(stillMissing);
+
+        if(expired.size() > 0) {
+            unique_lock<shared_timed_mutex> lock(mempoolMutex);
+            for(const string& txid : expired) {
+                evicted.increment(removeLocked(txid, true));
+            }
+        }
+    } catch(const jsonrpc::JsonRpcException& e) {
+        const std::string message(e.what());
+        cout << "Error reading mempool " << message << endl;
+    }
+    {
+        shared_lock<shared_timed_mutex> lock(mempoolMutex);
+        mempoolSize.set(mempoolTransactions.size());
+    }
+}
+
+void VtcBlockIndexer::MempoolMonitor::watchNotifications(const string& endpoint) {
+    VtcBlockIndexer::MetricCounter& notifications = VtcBlockIndexer::Metrics::counter("mempool_notifications_total", "Mempool notifications received from the node");
+    VtcBlockIndexer::MetricCounter& resyncs = VtcBlockIndexer::Metrics::counter("mempool_resyncs_total", "Full mempool polls done because notifications were lost");
+    VtcBlockIndexer::MetricCounter& fetches = VtcBlockIndexer::Metrics::counter("mempool_notification_fetches_total", "Mempool acceptances whose raw transaction had to be fetched over RPC");
+    VtcBlockIndexer::MetricGauge& mempoolSize = VtcBlockIndexer::Metrics::gauge("mempool_transactions", "Transactions currently held in the mempool monitor");
+
+    // rawtx is published for mempool acceptance and for transactions in connected
+    // blocks alike. Raw transactions wait here until the sequence topic tells
+    // which of the two it was. Only the most recent ones are kept.
+    const size_t maxPendingTransactions = 5000;
+    unordered_map<string, vector<unsigned char>> pendingTransactions;
+    deque<string> pendingOrder;
+
+    while(true) {
+        try {
+            VtcBlockIndexer::ZmqSubscriber subscriber(endpoint, { "rawtx", "sequence" });
+            cout << "Listening for mempool notifications on " << endpoint << endl;
+
+            // Pick up everything that entered the mempool before we subscribed
+            pollMempool();
+            chrono::steady_clock::time_point lastPoll = chrono::steady_clock::now();
+
+            VtcBlockIndexer::ZmqNotification notification;
+            while(true) {
+                if(subscriber.receive(notification, 1000)) {
+                    notifications.increment();
+                    if(notification.gap) {
+                        cout << "Missed mempool notifications on " << notification.topic << ", polling the full mempool" << endl;
+                        resyncs.increment();
+                        pollMempool();
+                        lastPoll = chrono::steady_clock::now();
+                    }
+
+                    if(notification.topic == "rawtx") {
+                        vector<unsigned char> rawTx(notification.body.begin(), notification.body.end());
+                        const string txid = parseTransaction(rawTx).txHash;
+                        pendingOrder.push_back(txid);
+                        pendingTransactions[txid] = move(rawTx);
+                        while(pendingOrder.size() > maxPendingTransactions) {
+                            pendingTransactions.erase(pendingOrder.front());
+                            pendingOrder.pop_front();
+                        }
+                    } else if(notification.topic == "sequence" && notification.body.size() >= 33) {
+                        // <32 byte hash in display order><label>[<8 byte mempool sequence>]
+                        const string txid = VtcBlockIndexer::Utility::hashToHex(vector<unsigned char>(notification.body.begin(), notification.body.begin() + 32));
+                        const char label = notification.body[32];
+                        if(label == 'A') {
+                            auto pending = pendingTransactions.find(txid);
+                            if(pending != pendingTransactions.end()) {
+                                addTransaction(pending->second);
+                                pendingTransactions.erase(pending);
+                            } else {
+                                fetches.increment();
+                                try {
+                                    addTransaction(fetchTransaction(txid));
+                                } catch(const jsonrpc::JsonRpcException& e) {
+                                    // Already gone from the mempool again
+                                }
                             }
-                            addressMempoolTransactions[address].push_back(out);
+                        } else if(label == 'R') {
+                            removeTransaction(txid);
                         }
+                        // Connected and disconnected blocks (C and D) reach us through the block files
                     }
                 }
+
+                // The node does not announce every way a transaction can leave or
+                // re-enter the mempool, so reconcile with a full poll once in a while
+                if(chrono::steady_clock::now() - lastPoll > chrono::seconds(60)) {
+                    pollMempool();
+                    lastPoll = chrono::steady_clock::now();
+                }
+                persistSnapshot();
+
+                shared_lock<shared_timed_mutex> lock(mempoolMutex);
+                mempoolSize.set(mempoolTransactions.size());
             }
-        } catch(const jsonrpc::JsonRpcException& e) {
-            const std::string message(e.what());
-            cout << "Error reading mempool " << message << endl;
+        } catch(const runtime_error& e) {
+            cout << "Error receiving mempool notifications " << e.what() << endl;
         }
-        
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::this_thread::sleep_for(std::chrono::seconds(5));
     }
 }
 
-string VtcBlockIndexer::MempoolMonitor::outpointSpend(string txid, uint32_t vout) {
-    for (auto kvp : mempoolTransactions) {
-        VtcBlockIndexer::Transaction tx = kvp.second;
-        for (VtcBlockIndexer::TransactionInput txi : tx.inputs) {
-            if(txi.txHash.compare(txid) == 0 && txi.txoIndex == vout) {
-                return tx.txHash;
+vector<unsigned char> VtcBlockIndexer::MempoolMonitor::fetchTransaction(const string& txid) {
+    const Json::Value rawTx = rpcPool->lease()->getrawtransaction(txid, false);
+    return VtcBlockIndexer::Utility::hexToBytes(rawTx.asString());
+}
+
+VtcBlockIndexer::Transaction VtcBlockIndexer::MempoolMonitor::parseTransaction(const vector<unsigned char>& rawTx) {
+    byte_array_buffer streambuf(rawTx.data(), rawTx.size());
+    std::istream stream(&streambuf);
+
+    return blockReader->readTransaction(stream);
+}
+
+string VtcBlockIndexer::MempoolMonitor::outpointKey(const string& txid, uint32_t vout) {
+    string key = txidKey(txid);
+    for(size_t i = 0; i < 4; i++) {
+        key.push_back((char)(vout >> (8 * i)));
+    }
+    return key;
+}
+
+string VtcBlockIndexer::MempoolMonitor::txidKey(const string& txid) {
+    string key(32, 0);
+    if(txid.size() != 64 || !VtcBlockIndexer::Utility::hexToBytes(txid.data(), txid.size(), (unsigned char*)&key[0])) {
+        // Not a txid, so no transaction has this key
+        return "";
+    }
+    reverse(key.begin(), key.end());
+    return key;
+}
+
+string VtcBlockIndexer::MempoolMonitor::txidFromKey(const string& key) {
+    return VtcBlockIndexer::Utility::hashToReverseHex(vector<unsigned char>(key.begin(), key.begin() + min(key.size(), (size_t)32)));
+}
+
+vector<vector<string>> VtcBlockIndexer::MempoolMonitor::outputAddresses(const VtcBlockIndexer::MempoolTransaction& tx) {
+    vector<vector<string>> addresses(tx.outputCount());
+    for(size_t i = 0; i < tx.outputCount(); i++) {
+        addresses[i] = scriptSolver->getAddressesFromScript(tx.output(i, "").script);
+    }
+    return addresses;
+}
+
+void VtcBlockIndexer::MempoolMonitor::addTransaction(const vector<unsigned char>& rawTx) {
+    VtcBlockIndexer::Transaction tx = parseTransaction(rawTx);
+    vector<vector<string>> outputAddresses;
+    for(VtcBlockIndexer::TransactionOutput& out : tx.outputs) {
+        out.txHash = tx.txHash;
+        outputAddresses.push_back(scriptSolver->getAddressesFromScript(out.script));
+    }
+
+    // The spent outputs are only resolved when someone listens for address events
+    const bool publish = (eventHub != nullptr && eventHub->hasAddressSubscriptions());
+    vector<vector<string>> inputAddresses;
+    if(insertTransaction(tx, rawTx, outputAddresses, publish ? &inputAddresses : nullptr) && publish) {
+        eventHub->publishTransaction(tx, outputAddresses, inputAddresses, 0);
+    }
+}
+
+bool VtcBlockIndexer::MempoolMonitor::computeFee(const VtcBlockIndexer::Transaction& tx, uint64_t& fee, uint64_t& vsize, vector<vector<string>>* inputAddresses) {
+    if(inputAddresses != nullptr) {
+        inputAddresses->assign(tx.inputs.size(), vector<string>());
+    }
+
+    uint64_t inputValue = 0;
+    bool inputValueKnown = true;
+    unique_ptr<leveldb::Iterator> it;
+    for(size_t i = 0; i < tx.inputs.size(); i++) {
+        const VtcBlockIndexer::TransactionInput& txi = tx.inputs[i];
+        if(txi.coinbase) return false;
+
+        bool found = false;
+        VtcBlockIndexer::TransactionOutput parentOutput;
+        {
+            // Unconfirmed parent
+            shared_lock<shared_timed_mutex> lock(mempoolMutex);
+            auto parent = mempoolTransactions.find(txi.txHash);
+            if(parent != mempoolTransactions.end() && txi.txoIndex < parent->second.outputCount()) {
+                inputValue += parent->second.outputValue(txi.txoIndex);
+                if(inputAddresses != nullptr) {
+                    parentOutput = parent->second.output(txi.txoIndex, txi.txHash);
+                }
+                found = true;
+            }
+        }
+
+        if(found) {
+            if(inputAddresses != nullptr) {
+                (*inputAddresses)[i] = scriptSolver->getAddressesFromScript(parentOutput.script);
+            }
+            continue;
+        }
+
+        stringstream txoKey;
+        txoKey << txi.txHash << setw(8) << setfill('0') << txi.txoIndex;
+        string valueString;
+        if(!db->Get(leveldb::ReadOptions(), txoKey.str() + "-value", &valueString).ok()) {
+            inputValueKnown = false;
+            continue;
+        }
+        inputValue += stoll(valueString);
+
+        if(inputAddresses != nullptr) {
+            if(!it) {
+                it.reset(db->NewIterator(leveldb::ReadOptions()));
+            }
+            const string limit(txoKey.str() + "-address-99999999");
+            for(it->Seek(txoKey.str() + "-address-00000000"); it->Valid() && it->key().ToString() < limit; it->Next()) {
+                (*inputAddresses)[i].push_back(it->value().ToString());
             }
         }
     }
-    return "";
+
+    uint64_t outputValue = 0;
+    for(const VtcBlockIndexer::TransactionOutput& txo : tx.outputs) {
+        outputValue += txo.value;
+    }
+    if(!inputValueKnown || outputValue > inputValue) return false;
+
+    fee = inputValue - outputValue;
+    vsize = virtualSize(tx);
+    return vsize > 0;
+}
+
+void VtcBlockIndexer::MempoolMonitor::updateFeeHistogram(const string& txid, int direction) {
+    auto feeIt = transactionFees.find(txid);
+    if(feeIt == transactionFees.end()) {
+        unknownFeeCount += direction;
+        return;
+    }
+
+    const uint64_t fee = feeIt->second.first;
+    const uint64_t vsize = feeIt->second.second;
+    FeeRateBucket& bucket = feeHistogram[feeRateBucket((double)fee / vsize)];
+    bucket.count += direction;
+    bucket.vsize += direction * (int64_t)vsize;
+    bucket.fees += direction * (int64_t)fee;
+}
+
+bool VtcBlockIndexer::MempoolMonitor::insertTransaction(const VtcBlockIndexer::Transaction& tx, const vector<unsigned char>& rawTx, const vector<vector<string>>& outputAddresses, vector<vector<string>>* inputAddresses) {
+    unique_ptr<VtcBlockIndexer::MempoolTransaction> compact;
+    try {
+        compact.reset(new VtcBlockIndexer::MempoolTransaction(rawTx.data(), rawTx.size()));
+    } catch(const runtime_error& e) {
+        cout << "Skipping mempool transaction " << tx.txHash << ": " << e.what() << endl;
+        return false;
+    }
+
+    uint64_t fee = 0, vsize = 0;
+    const bool feeKnown = computeFee(tx, fee, vsize, inputAddresses);
+
+    // Inputs already spent by a different transaction in the index
+    vector<pair<const VtcBlockIndexer::TransactionInput*, string>> confirmedConflicts;
+    for(const VtcBlockIndexer::TransactionInput& txi : tx.inputs) {
+        if(txi.coinbase) continue;
+        stringstream txoSpentKey;
+        txoSpentKey << "txo-" << txi.txHash << "-" << setw(8) << setfill('0') << txi.txoIndex << "-spent";
+        string spentTx;
+        if(db->Get(leveldb::ReadOptions(), txoSpentKey.str(), &spentTx).ok() && spentTx.size() >= 128) {
+            if(spentTx.substr(64, 64) != tx.txHash) {
+                confirmedConflicts.push_back(make_pair(&txi, spentTx.substr(64, 64)));
+            }
+        }
+    }
+
+    unique_lock<shared_timed_mutex> lock(mempoolMutex);
+    if(!mempoolTransactions.emplace(tx.txHash, move(*compact)).second) {
+        return false;
+    }
+    changes++;
+
+    if(feeKnown) {
+        transactionFees[tx.txHash] = make_pair(fee, vsize);
+    }
+    updateFeeHistogram(tx.txHash, 1);
+
+    for(const auto& conflict : confirmedConflicts) {
+        recordConflict(conflict.first->txHash, conflict.first->txoIndex, conflict.second, tx.txHash, "confirmed");
+    }
+
+    const string txKey = txidKey(tx.txHash);
+    for(const VtcBlockIndexer::TransactionInput& txi : tx.inputs) {
+        if(!txi.coinbase) {
+            string& spender = outpointSpenders[outpointKey(txi.txHash, txi.txoIndex)];
+            if(spender.size() > 0 && spender != txKey) {
+                recordConflict(txi.txHash, txi.txoIndex, txidFromKey(spender), tx.txHash, "mempool");
+            }
+            spender = txKey;
+        }
+    }
+
+    for(size_t i = 0; i < tx.outputs.size(); i++) {
+        for(const string& address : outputAddresses[i]) {
+            addressMempoolTransactions[address].push_back(outpointKey(tx.txHash, tx.outputs[i].index));
+        }
+    }
+    return true;
+}
+
+string VtcBlockIndexer::MempoolMonitor::outpointSpend(string txid, uint32_t vout) {
+    shared_lock<shared_timed_mutex> lock(mempoolMutex);
+    auto it = outpointSpenders.find(outpointKey(txid, vout));
+    if(it == outpointSpenders.end()) {
+        return "";
+    }
+    return txidFromKey(it->second);
 }
 
 vector<std::string> VtcBlockIndexer::MempoolMonitor::getTxIds() {
-    vector<std::string> result = {};
-    for (auto kvp : mempoolTransactions) {
-        VtcBlockIndexer::Transaction tx = kvp.second;
-        result.push_back(tx.txHash);
+    shared_lock<shared_timed_mutex> lock(mempoolMutex);
+    vector<std::string> result;
+    result.reserve(mempoolTransactions.size());
+    for (const auto& kvp : mempoolTransactions) {
+        result.push_back(kvp.first);
     }
     return result;
 }
  
+vector<VtcBlockIndexer::FeeRateBucket> VtcBlockIndexer::MempoolMonitor::getFeeHistogram() {
+    shared_lock<shared_timed_mutex> lock(mempoolMutex);
+    return feeHistogram;
+}
+
+uint64_t VtcBlockIndexer::MempoolMonitor::getUnknownFeeCount() {
+    shared_lock<shared_timed_mutex> lock(mempoolMutex);
+    return unknownFeeCount;
+}
+
+double VtcBlockIndexer::MempoolMonitor::estimateFeeRate(uint32_t targetBlocks) {
+    vector<FeeRateBucket> histogram = getFeeHistogram();
+
+    // Fill the next blocks from the highest fee rate down, the bucket where the
+    // target runs out of room sets the fee rate to beat
+    const uint64_t capacity = BLOCK_VSIZE * max(targetBlocks, (uint32_t)1);
+    uint64_t cumulativeVsize = 0;
+    for(auto bucket = histogram.rbegin(); bucket != histogram.rend(); ++bucket) {
+        cumulativeVsize += bucket->vsize;
+        if(cumulativeVsize >= capacity) {
+            return max(bucket->minFeeRate, 1.0);
+        }
+    }
+
+    // Everything fits, the minimum relay fee will do
+    return 1.0;
+}
+
 vector<VtcBlockIndexer::TransactionOutput> VtcBlockIndexer::MempoolMonitor::getTxos(std::string address) {
-    if(addressMempoolTransactions.find(address) == addressMempoolTransactions.end())
+    shared_lock<shared_timed_mutex> lock(mempoolMutex);
+    auto it = addressMempoolTransactions.find(address);
+    if(it == addressMempoolTransactions.end())
     {
         return {};
-    } 
-    return vector<VtcBlockIndexer::TransactionOutput>(addressMempoolTransactions[address]);
+    }
+
+    vector<VtcBlockIndexer::TransactionOutput> result;
+    result.reserve(it->second.size());
+    for(const string& outpoint : it->second) {
+        const string txid = txidFromKey(outpoint);
+        result.push_back(mempoolTransactions.at(txid).output(outpointIndex(outpoint), txid));
+    }
+    return result;
 }
 
-void VtcBlockIndexer::MempoolMonitor::transactionIndexed(std::string txid) {
-    if(mempoolTransactions.find(txid) != mempoolTransactions.end()) {
-        mempoolTransactions.erase(txid);
+void VtcBlockIndexer::MempoolMonitor::transactionIndexed(const VtcBlockIndexer::Transaction& tx) {
+    static VtcBlockIndexer::MetricCounter& conflictsRemoved = VtcBlockIndexer::Metrics::counter("mempool_conflicts_removed_total", "Mempool transactions removed because a block spent the same outpoint");
 
-        unordered_map<string, std::vector<VtcBlockIndexer::TransactionOutput>> changedMempoolAddressTxes;
-        for (auto kvp : addressMempoolTransactions) {
+    unique_lock<shared_timed_mutex> lock(mempoolMutex);
+    if(mempoolTransactions.size() == 0) {
+        return;
+    }
+    removeLocked(tx.txHash, false);
 
-            vector<VtcBlockIndexer::TransactionOutput> newVector = {};
-            bool itemsRemoved = false;
-            for (VtcBlockIndexer::TransactionOutput txo : kvp.second) {
-                if(txo.txHash.compare(txid) != 0) {
-                    newVector.push_back(txo);
-                } else {
-                    itemsRemoved = true;
-                }
+    // Anything left in the mempool spending the same outputs can never confirm
+    for(const VtcBlockIndexer::TransactionInput& txi : tx.inputs) {
+        if(txi.coinbase) continue;
+        auto spenderIt = outpointSpenders.find(outpointKey(txi.txHash, txi.txoIndex));
+        if(spenderIt != outpointSpenders.end()) {
+            const string spender = txidFromKey(spenderIt->second);
+            recordConflict(txi.txHash, txi.txoIndex, spender, tx.txHash, "block");
+            conflictsRemoved.increment(removeLocked(spender, true));
+        }
+    }
+}
+
+void VtcBlockIndexer::MempoolMonitor::recordConflict(const string& txid, uint32_t vout, const string& existingSpender, const string& newSpender, const string& kind) {
+    static VtcBlockIndexer::MetricCounter& mempoolConflicts = VtcBlockIndexer::Metrics::counter("mempool_conflicts_total", "Conflicting spends of the same outpoint", VtcBlockIndexer::Metrics::label("kind", "mempool"));
+    static VtcBlockIndexer::MetricCounter& confirmedConflicts = VtcBlockIndexer::Metrics::counter("mempool_conflicts_total", "Conflicting spends of the same outpoint", VtcBlockIndexer::Metrics::label("kind", "confirmed"));
+    static VtcBlockIndexer::MetricCounter& blockConflicts = VtcBlockIndexer::Metrics::counter("mempool_conflicts_total", "Conflicting spends of the same outpoint", VtcBlockIndexer::Metrics::label("kind", "block"));
+    (kind == "mempool" ? mempoolConflicts : (kind == "confirmed" ? confirmedConflicts : blockConflicts)).increment();
+
+    MempoolConflict conflict;
+    conflict.id = nextConflictId++;
+    conflict.txid = txid;
+    conflict.vout = vout;
+    conflict.existingSpender = existingSpender;
+    conflict.newSpender = newSpender;
+    conflict.kind = kind;
+    conflict.detectedAt = time(NULL);
+
+    const string key = outpointKey(txid, vout);
+    conflicts.push_back(conflict);
+    conflictsByOutpoint[key].push_back(conflict.id);
+
+    if(conflicts.size() > MAX_CONFLICTS) {
+        // The oldest conflict is also the oldest one for its outpoint
+        const MempoolConflict& oldest = conflicts.front();
+        auto outpointIt = conflictsByOutpoint.find(outpointKey(oldest.txid, oldest.vout));
+        outpointIt->second.pop_front();
+        if(outpointIt->second.size() == 0) {
+            conflictsByOutpoint.erase(outpointIt);
+        }
+        conflicts.pop_front();
+    }
+}
+
+vector<VtcBlockIndexer::MempoolConflict> VtcBlockIndexer::MempoolMonitor::getConflicts(uint64_t sinceId) {
+    shared_lock<shared_timed_mutex> lock(mempoolMutex);
+    vector<MempoolConflict> result;
+    if(conflicts.size() == 0) return result;
+
+    // Ids are consecutive, so the position in the ring follows from the id
+    const uint64_t firstId = conflicts.front().id;
+    size_t start = (sinceId < firstId ? 0 : sinceId - firstId + 1);
+    for(size_t i = start; i < conflicts.size(); i++) {
+        result.push_back(conflicts[i]);
+    }
+    return result;
+}
+
+vector<VtcBlockIndexer::MempoolConflict> VtcBlockIndexer::MempoolMonitor::getOutpointConflicts(const string& txid, uint32_t vout) {
+    shared_lock<shared_timed_mutex> lock(mempoolMutex);
+    vector<MempoolConflict> result;
+    auto outpointIt = conflictsByOutpoint.find(outpointKey(txid, vout));
+    if(outpointIt == conflictsByOutpoint.end() || conflicts.size() == 0) return result;
+
+    const uint64_t firstId = conflicts.front().id;
+    for(uint64_t id : outpointIt->second) {
+        result.push_back(conflicts[id - firstId]);
+    }
+    return result;
+}
+
+void VtcBlockIndexer::MempoolMonitor::removeTransaction(const string& txid) {
+    unique_lock<shared_timed_mutex> lock(mempoolMutex);
+    removeLocked(txid, true);
+}
+
+size_t VtcBlockIndexer::MempoolMonitor::removeLocked(const string& txid, bool withDescendants) {
+    size_t removed = 0;
+    vector<string> pending = { txid };
+    while(pending.size() > 0) {
+        const string current = pending.back();
+        pending.pop_back();
+
+        auto txIt = mempoolTransactions.find(current);
+        if(txIt == mempoolTransactions.end()) {
+            continue;
+        }
+
+        const VtcBlockIndexer::MempoolTransaction& tx = txIt->second;
+        const string currentKey = txidKey(current);
+        for(size_t i = 0; i < tx.inputCount(); i++) {
+            auto spenderIt = outpointSpenders.find(tx.inputOutpoint(i));
+            if(spenderIt != outpointSpenders.end() && spenderIt->second == currentKey) {
+                outpointSpenders.erase(spenderIt);
             }
+        }
 
-            if(itemsRemoved) {
-                changedMempoolAddressTxes[kvp.first] = newVector;
+        if(withDescendants) {
+            for(size_t i = 0; i < tx.outputCount(); i++) {
+                auto spenderIt = outpointSpenders.find(outpointKey(current, i));
+                if(spenderIt != outpointSpenders.end()) {
+                    pending.push_back(txidFromKey(spenderIt->second));
+                }
             }
         }
 
-        for (auto kvp : changedMempoolAddressTxes) {
-            addressMempoolTransactions[kvp.first] = kvp.second;
+        for(const vector<string>& paidAddresses : outputAddresses(tx)) {
+            for(const string& address : paidAddresses) {
+                auto addressIt = addressMempoolTransactions.find(address);
+                if(addressIt == addressMempoolTransactions.end()) continue;
+
+                vector<string>& txos = addressIt->second;
+                txos.erase(remove_if(txos.begin(), txos.end(), [&currentKey](const string& outpoint) {
+                    return outpoint.compare(0, 32, currentKey) == 0;
+                }), txos.end());
+                if(txos.size() == 0) {
+                    addressMempoolTransactions.erase(addressIt);
+                }
+            }
         }
+
+        updateFeeHistogram(current, -1);
+        transactionFees.erase(current);
+        mempoolTransactions.erase(txIt);
+        changes++;
+        removed++;
     }
+    return removed;
 }
@@ -18,12 +18,18 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "vertcoinrpc.h"
-#include <jsonrpccpp/client/connectors/httpclient.h>
+#include "rpcclientpool.h"
+#include "mempooltransaction.h"
 #include <memory>
 #include "blockreader.h"
 #include "scriptsolver.h"
+#include "eventhub.h"
+#include "leveldb/db.h"
 #include <unordered_map>
+#include <shared_mutex>
+#include <chrono>
+#include <deque>
+#include <time.h>
 #ifndef MEMPOOLMONITOR_H_INCLUDED
 #define MEMPOOLMONITOR_H_INCLUDED
 
@@ -31,22 +37,60 @@ using namespace std;
 
 namespace VtcBlockIndexer {
 
+/** Mempool transactions paying a fee rate from minFeeRate up to the next bucket */
+struct FeeRateBucket {
+    // Lower bound of the bucket in satoshis per virtual byte
+    double minFeeRate;
+    uint64_t count;
+    uint64_t vsize;
+    uint64_t fees;
+};
+
+/** Two transactions spending the same outpoint */
+struct MempoolConflict {
+    // Increases by one for every conflict detected
+    uint64_t id;
+
+    // The outpoint spent twice
+    string txid;
+    uint32_t vout;
+
+    // The spender we knew of, and the one that conflicts with it
+    string existingSpender;
+    string newSpender;
+
+    // "mempool" when both are unconfirmed, "confirmed" when a new mempool
+    // transaction spends an outpoint already spent in the index, and "block"
+    // when a newly indexed block spends an outpoint of a mempool transaction
+    string kind;
+
+    time_t detectedAt;
+};
+
 /**
- * The BlockFileWatcher class provides methods to watch and scan a blocks directory
- * and process the blockfiles when changes occur.
+ * The MempoolMonitor class polls the node for unconfirmed transactions and keeps
+ * them indexed by outpoint and by address until they are confirmed. It is safe
+ * to use from the watcher, indexer and HTTP threads at the same time.
  */
 
 class MempoolMonitor {
 public:
-    /** Constructs a MempoolMonitor instance
+    /** Constructs a MempoolMonitor instance. The index is used to look up the
+     * values of confirmed outputs spent by mempool transactions. The mempool is
+     * saved to and restored from snapshotPath, unless it is empty.
      */
-    MempoolMonitor();
+    MempoolMonitor(const shared_ptr<leveldb::DB> db, const shared_ptr<VtcBlockIndexer::EventHub> eventHub, const string snapshotPath);
 
-    /** Starts watching the mempool for new transactions */
+    /** Starts watching the mempool for new transactions. When COIND_ZMQ_ENDPOINT
+     * is set, new transactions are pushed by the node over ZMQ. Otherwise the
+     * node's mempool is polled every second.
+     */
     void startWatcher();
 
-    /** Notify a transaction has been indexed - remove it from the mempool */
-    void transactionIndexed(string txid);
+    /** Notify a transaction has been indexed - remove it from the mempool, along
+     * with mempool transactions spending the same outpoints and their descendants
+     */
+    void transactionIndexed(const VtcBlockIndexer::Transaction& tx);
 
     /** Returns the spender txid if an outpoint is spent */
     string outpointSpend(string txid, uint32_t vout);
@@ -56,14 +100,143 @@ public:
 
     /** Returns all TX IDs in the mempool */
     vector<std::string> getTxIds();
+
+    /** Returns the fee rate histogram of the mempool, lowest fee rate first.
+     * Transactions spending outputs of unknown value are not included.
+     */
+    vector<FeeRateBucket> getFeeHistogram();
+
+    /** Returns the fee rate in satoshis per virtual byte that is expected to
+     * get a transaction confirmed within the given number of blocks, assuming
+     * full blocks and no new transactions
+     */
+    double estimateFeeRate(uint32_t targetBlocks);
+
+    /** Returns the number of mempool transactions missing from the histogram */
+    uint64_t getUnknownFeeCount();
+
+    /** Returns the recently detected conflicts with an id above sinceId, oldest first */
+    vector<MempoolConflict> getConflicts(uint64_t sinceId);
+
+    /** Returns the recently detected conflicts on an outpoint, oldest first */
+    vector<MempoolConflict> getOutpointConflicts(const string& txid, uint32_t vout);
     
 private:
-    unique_ptr<VertcoinClient> vertcoind;
-    unique_ptr<jsonrpc::HttpClient> httpClient;
-    unordered_map<string, VtcBlockIndexer::Transaction> mempoolTransactions;
-    unordered_map<string, vector<VtcBlockIndexer::TransactionOutput>> addressMempoolTransactions;
+    /** Fetches the transactions in the node's mempool that we don't have yet,
+     * and drops the ones that have been missing from it for a while
+     */
+    void pollMempool();
+
+    /** Follows the node's rawtx and sequence notifications on a ZMQ endpoint.
+     * Falls back to a full poll when notifications were lost.
+     */
+    void watchNotifications(const string& endpoint);
+
+    /** Fetches a raw transaction from the node */
+    vector<unsigned char> fetchTransaction(const string& txid);
+
+    /** Parses a raw transaction */
+    VtcBlockIndexer::Transaction parseTransaction(const vector<unsigned char>& rawTx);
+
+    /** Adds a raw transaction and its outputs and inputs to the indexes, and
+     * publishes it to event subscribers
+     */
+    void addTransaction(const vector<unsigned char>& rawTx);
+
+    /** Adds a transaction with known output addresses to the indexes. Only the
+     * raw transaction is kept. Returns false if it was already there. When
+     * inputAddresses is not null, it receives the addresses of the outputs
+     * the inputs spend, as found by computeFee.
+     */
+    bool insertTransaction(const VtcBlockIndexer::Transaction& tx, const vector<unsigned char>& rawTx, const vector<vector<string>>& outputAddresses, vector<vector<string>>* inputAddresses);
+
+    /** Determines the fee and virtual size of a transaction. Returns false if
+     * the value of one of its inputs is unknown. When inputAddresses is not
+     * null, it is filled with the addresses of the output each input spends,
+     * from the same lookups, and left empty for the inputs that are unknown.
+     */
+    bool computeFee(const VtcBlockIndexer::Transaction& tx, uint64_t& fee, uint64_t& vsize, vector<vector<string>>* inputAddresses);
+
+    /** Adds or removes a transaction from the fee rate histogram. Caller holds
+     * mempoolMutex exclusively.
+     */
+    void updateFeeHistogram(const string& txid, int direction);
+
+    /** Adds a conflict to the ring of recent conflicts, evicting the oldest
+     * when it is full. Caller holds mempoolMutex exclusively.
+     */
+    void recordConflict(const string& txid, uint32_t vout, const string& existingSpender, const string& newSpender, const string& kind);
+
+    /** Restores the mempool from the snapshot file */
+    void loadSnapshot();
+
+    /** Writes the mempool to the snapshot file if it changed, at most every 30 seconds */
+    void persistSnapshot();
+
+    /** Removes a transaction and its descendants from the indexes */
+    void removeTransaction(const string& txid);
+
+    /** Removes a transaction, and optionally the mempool transactions spending
+     * its outputs. Caller holds mempoolMutex exclusively. Returns the number of
+     * transactions removed.
+     */
+    size_t removeLocked(const string& txid, bool withDescendants);
+
+    /** Returns the 36 byte key for an outpoint, in the layout of
+     * MempoolTransaction::inputOutpoint
+     */
+    static string outpointKey(const string& txid, uint32_t vout);
+
+    /** Returns the 32 byte key for a txid, in internal byte order */
+    static string txidKey(const string& txid);
+
+    /** Returns the txid for a key from txidKey, or the first 32 bytes of an outpoint key */
+    static string txidFromKey(const string& key);
+
+    /** Returns the addresses paid by each output of a mempool transaction.
+     * They are not stored, the script solver derives them through the
+     * address cache.
+     */
+    vector<vector<string>> outputAddresses(const VtcBlockIndexer::MempoolTransaction& tx);
+
+    unique_ptr<VtcBlockIndexer::RpcClientPool> rpcPool;
+    shared_ptr<leveldb::DB> db;
+
+    // Guards the maps below. The watcher and the indexer take it exclusively
+    // to change the mempool, HTTP workers take it shared to read it.
+    shared_timed_mutex mempoolMutex;
+    unordered_map<string, VtcBlockIndexer::MempoolTransaction> mempoolTransactions;
+
+    // Outputs paying each address, as outpoint keys
+    unordered_map<string, vector<string>> addressMempoolTransactions;
+
+    // Spending mempool txid by outpoint, as binary keys. Keys from outpointKey
+    // and txidKey are less than half the size of their hex forms.
+    unordered_map<string, string> outpointSpenders;
+
+    // Fee and virtual size of mempool transactions whose fee is known
+    unordered_map<string, pair<uint64_t, uint64_t>> transactionFees;
+    vector<FeeRateBucket> feeHistogram;
+    uint64_t unknownFeeCount;
+
+    // The most recent conflicts, and their ids by outpoint
+    static const size_t MAX_CONFLICTS = 10000;
+    deque<MempoolConflict> conflicts;
+    unordered_map<string, deque<uint64_t>> conflictsByOutpoint;
+    uint64_t nextConflictId;
+
+    // When each transaction that is gone from the node's mempool was first
+    // found missing. Only used by the watcher thread.
+    unordered_map<string, chrono::steady_clock::time_point> missingSince;
+
+    // Counts additions and removals, to skip writing unchanged snapshots
+    uint64_t changes;
+    uint64_t snapshotChanges;
+    string snapshotPath;
+    chrono::steady_clock::time_point lastSnapshot;
     unique_ptr<VtcBlockIndexer::BlockReader> blockReader;
     unique_ptr<VtcBlockIndexer::ScriptSolver> scriptSolver;
+    shared_ptr<VtcBlockIndexer::EventHub> eventHub;
 }; 
 
 }
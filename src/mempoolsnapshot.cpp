@@ -0,0 +1,182 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "mempoolsnapshot.h"
+#include <stdio.h>
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+
+namespace
+{
+    const char SNAPSHOT_MAGIC[8] = { 'V', 'T', 'C', 'M', 'E', 'M', 'P', 'L' };
+    const uint32_t SNAPSHOT_VERSION = 1;
+
+    // Nothing in a snapshot is legitimately larger than this
+    const uint64_t MAX_FIELD_SIZE = 4000000;
+
+    template <typename T>
+    void appendInteger(T& out, uint64_t value, size_t bytes) {
+        for(size_t i = 0; i < bytes; i++) {
+            out.push_back((unsigned char)(value >> (8 * i)));
+        }
+    }
+
+    // Bitcoin's CompactSize encoding
+    template <typename T>
+    void appendVarInt(T& out, uint64_t value) {
+        if(value < 0xfd) {
+            out.push_back((unsigned char)value);
+        } else if(value <= 0xffff) {
+            out.push_back((unsigned char)0xfd);
+            appendInteger(out, value, 2);
+        } else if(value <= 0xffffffff) {
+            out.push_back((unsigned char)0xfe);
+            appendInteger(out, value, 4);
+        } else {
+            out.push_back((unsigned char)0xff);
+            appendInteger(out, value, 8);
+        }
+    }
+
+    template <typename T, typename B>
+    void appendBytes(T& out, const B& bytes) {
+        appendVarInt(out, bytes.size());
+        out.insert(out.end(), bytes.begin(), bytes.end());
+    }
+
+    class SnapshotReader {
+        public:
+            SnapshotReader(const string& data) : data(data), position(0), failed(false) {}
+
+            uint64_t readVarInt() {
+                unsigned char prefix = readByte();
+                if(prefix < 0xfd) return prefix;
+                size_t bytes = (prefix == 0xfd ? 2 : (prefix == 0xfe ? 4 : 8));
+                uint64_t value = 0;
+                for(size_t i = 0; i < bytes; i++) {
+                    value |= (uint64_t)readByte() << (8 * i);
+                }
+                return value;
+            }
+
+            unsigned char readByte() {
+                if(position >= data.size()) {
+                    failed = true;
+                    return 0;
+                }
+                return (unsigned char)data[position++];
+            }
+
+            bool readBytes(size_t length, const char** start) {
+                if(length > MAX_FIELD_SIZE || data.size() - position < length) {
+                    failed = true;
+                    return false;
+                }
+                *start = data.data() + position;
+                position += length;
+                return true;
+            }
+
+            bool ok() const { return !failed; }
+
+        private:
+            const string& data;
+            size_t position;
+            bool failed;
+    };
+}
+
+void VtcBlockIndexer::MempoolSnapshot::appendEntry(string& buffer, const unsigned char* rawTx, size_t rawLength, const vector<vector<string>>& outputAddresses) {
+    appendVarInt(buffer, rawLength);
+    buffer.append((const char*)rawTx, rawLength);
+    appendVarInt(buffer, outputAddresses.size());
+    for(const vector<string>& addresses : outputAddresses) {
+        appendVarInt(buffer, addresses.size());
+        for(const string& address : addresses) {
+            appendBytes(buffer, address);
+        }
+    }
+}
+
+bool VtcBlockIndexer::MempoolSnapshot::write(const string& path, const string& entries) {
+    const string temporaryPath = path + ".tmp";
+    {
+        ofstream file(temporaryPath, ios::binary | ios::trunc);
+        if(!file.is_open()) return false;
+
+        string header(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        appendInteger(header, SNAPSHOT_VERSION, 4);
+        file.write(header.data(), header.size());
+        file.write(entries.data(), entries.size());
+        file.put(0);
+        file.flush();
+        if(!file.good()) return false;
+    }
+    return rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+size_t VtcBlockIndexer::MempoolSnapshot::read(const string& path, const function<void(const vector<unsigned char>& rawTx, const vector<vector<string>>& outputAddresses)>& handler) {
+    ifstream file(path, ios::binary);
+    if(!file.is_open()) return 0;
+    string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    if(data.size() < sizeof(SNAPSHOT_MAGIC) + 4 || data.compare(0, sizeof(SNAPSHOT_MAGIC), string(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC))) != 0) {
+        return 0;
+    }
+    SnapshotReader reader(data);
+    const char* field;
+    reader.readBytes(sizeof(SNAPSHOT_MAGIC), &field);
+    uint32_t version = 0;
+    for(size_t i = 0; i < 4; i++) {
+        version |= (uint32_t)reader.readByte() << (8 * i);
+    }
+    if(version != SNAPSHOT_VERSION) return 0;
+
+    // Parse everything before handing out entries, a truncated file is ignored as a whole
+    vector<pair<vector<unsigned char>, vector<vector<string>>>> entries;
+    while(reader.ok()) {
+        uint64_t rawLength = reader.readVarInt();
+        if(rawLength == 0) break;
+        if(!reader.readBytes(rawLength, &field)) break;
+        vector<unsigned char> rawTx(field, field + rawLength);
+
+        uint64_t outputCount = reader.readVarInt();
+        if(outputCount > MAX_FIELD_SIZE) return 0;
+        vector<vector<string>> outputAddresses(outputCount);
+        for(uint64_t i = 0; i < outputCount && reader.ok(); i++) {
+            uint64_t addressCount = reader.readVarInt();
+            if(addressCount > MAX_FIELD_SIZE) return 0;
+            for(uint64_t j = 0; j < addressCount && reader.ok(); j++) {
+                uint64_t addressLength = reader.readVarInt();
+                if(reader.readBytes(addressLength, &field)) {
+                    outputAddresses[i].push_back(string(field, addressLength));
+                }
+            }
+        }
+        entries.push_back(make_pair(move(rawTx), move(outputAddresses)));
+    }
+    if(!reader.ok()) return 0;
+
+    for(const auto& entry : entries) {
+        handler(entry.first, entry.second);
+    }
+    return entries.size();
+}
@@ -0,0 +1,69 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MEMPOOLSNAPSHOT_H_INCLUDED
+#define MEMPOOLSNAPSHOT_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+/**
+ * The MempoolSnapshot class writes and reads the parsed mempool to and from a
+ * compact binary file, so a restart does not have to fetch and parse every
+ * mempool transaction again. Each entry holds the transaction in its network
+ * serialization, followed by the addresses of each output, which saves
+ * running the script solver again on load. The spent outpoints are derived
+ * from the transaction itself.
+ *
+ * Layout: "VTCMEMPL", uint32 version, then entries of
+ *   varint length, raw transaction,
+ *   varint outputs, per output: varint addresses, per address: varint length, address
+ * and finally a varint 0 as end marker. Integers are little-endian.
+ */
+
+class MempoolSnapshot {
+public:
+    /** Appends one raw transaction and the addresses of its outputs to the buffer */
+    static void appendEntry(string& buffer, const unsigned char* rawTx, size_t rawLength, const vector<vector<string>>& outputAddresses);
+
+    /** Writes a buffer of entries to the file. Writes to a temporary file first
+     * and renames it, so a crash never leaves a half written snapshot behind.
+     * Returns false if the file could not be written.
+     */
+    static bool write(const string& path, const string& entries);
+
+    /** Reads a snapshot and calls the handler for each entry. Returns the number
+     * of entries read, or 0 if the file is missing or not a valid snapshot.
+     */
+    static size_t read(const string& path, const function<void(const vector<unsigned char>& rawTx, const vector<vector<string>>& outputAddresses)>& handler);
+
+private:
+    MempoolSnapshot() {}
+};
+
+}
+
+#endif // MEMPOOLSNAPSHOT_H_INCLUDED
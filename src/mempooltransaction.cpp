@@ -0,0 +1,162 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "mempooltransaction.h"
+#include "utility.h"
+#include <string.h>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    class RawCursor {
+        public:
+            RawCursor(const unsigned char* raw, size_t length) : raw(raw), length(length), position(0) {}
+
+            void skip(uint64_t bytes) {
+                if(bytes > length - position) {
+                    throw runtime_error("Truncated raw transaction");
+                }
+                position += bytes;
+            }
+
+            unsigned char readByte() {
+                skip(1);
+                return raw[position - 1];
+            }
+
+            // Bitcoin's CompactSize encoding
+            uint64_t readVarInt() {
+                unsigned char prefix = readByte();
+                if(prefix < 0xfd) return prefix;
+                size_t bytes = (prefix == 0xfd ? 2 : (prefix == 0xfe ? 4 : 8));
+                uint64_t value = 0;
+                for(size_t i = 0; i < bytes; i++) {
+                    value |= (uint64_t)readByte() << (8 * i);
+                }
+                return value;
+            }
+
+            size_t tell() const { return position; }
+
+        private:
+            const unsigned char* raw;
+            size_t length;
+            size_t position;
+    };
+
+    uint64_t readLittleEndian(const unsigned char* bytes, size_t count) {
+        uint64_t value = 0;
+        for(size_t i = 0; i < count; i++) {
+            value |= (uint64_t)bytes[i] << (8 * i);
+        }
+        return value;
+    }
+}
+
+VtcBlockIndexer::MempoolTransaction::MempoolTransaction(const unsigned char* raw, size_t length) {
+    // Offsets are kept in 32 bits
+    if(length > UINT32_MAX) {
+        throw runtime_error("Raw transaction too large");
+    }
+
+    vector<uint32_t> offsets;
+    RawCursor cursor(raw, length);
+    cursor.skip(4);
+
+    const bool segwit = (length > 6 && raw[4] == 0x00 && raw[5] != 0x00);
+    if(segwit) cursor.skip(2);
+
+    // Every input and output takes more than a byte, so this bounds the counts
+    // before anything is allocated for them
+    uint64_t inputCount = cursor.readVarInt();
+    if(inputCount > length) throw runtime_error("Invalid input count");
+    for(uint64_t i = 0; i < inputCount; i++) {
+        offsets.push_back(cursor.tell());
+        cursor.skip(36);
+        cursor.skip(cursor.readVarInt());
+        cursor.skip(4);
+    }
+
+    uint64_t outputCount = cursor.readVarInt();
+    if(outputCount > length) throw runtime_error("Invalid output count");
+    for(uint64_t i = 0; i < outputCount; i++) {
+        offsets.push_back(cursor.tell());
+        cursor.skip(8);
+        cursor.skip(cursor.readVarInt());
+    }
+
+    if(segwit) {
+        for(uint64_t i = 0; i < inputCount; i++) {
+            uint64_t items = cursor.readVarInt();
+            for(uint64_t j = 0; j < items; j++) {
+                cursor.skip(cursor.readVarInt());
+            }
+        }
+    }
+    cursor.skip(4);
+
+    rawLength = (uint32_t)cursor.tell();
+    inputs = (uint32_t)inputCount;
+    outputs = (uint32_t)outputCount;
+    data.reset(new unsigned char[rawLength + offsets.size() * sizeof(uint32_t)]);
+    memcpy(data.get(), raw, rawLength);
+    if(offsets.size() > 0) {
+        memcpy(data.get() + rawLength, &offsets[0], offsets.size() * sizeof(uint32_t));
+    }
+}
+
+uint32_t VtcBlockIndexer::MempoolTransaction::offset(size_t position) const {
+    uint32_t value;
+    memcpy(&value, data.get() + rawLength + position * sizeof(uint32_t), sizeof(value));
+    return value;
+}
+
+string VtcBlockIndexer::MempoolTransaction::inputTxHash(size_t input) const {
+    const unsigned char* hash = data.get() + offset(input);
+    return VtcBlockIndexer::Utility::hashToReverseHex(vector<unsigned char>(hash, hash + 32));
+}
+
+uint32_t VtcBlockIndexer::MempoolTransaction::inputTxoIndex(size_t input) const {
+    return (uint32_t)readLittleEndian(data.get() + offset(input) + 32, 4);
+}
+
+string VtcBlockIndexer::MempoolTransaction::inputOutpoint(size_t input) const {
+    return string((const char*)data.get() + offset(input), 36);
+}
+
+uint64_t VtcBlockIndexer::MempoolTransaction::outputValue(size_t output) const {
+    return readLittleEndian(data.get() + offset(inputs + output), 8);
+}
+
+VtcBlockIndexer::TransactionOutput VtcBlockIndexer::MempoolTransaction::output(size_t output, const string& txHash) const {
+    const size_t start = offset(inputs + output);
+    RawCursor cursor(data.get(), rawLength);
+    cursor.skip(start + 8);
+    uint64_t scriptLength = cursor.readVarInt();
+    const size_t scriptStart = cursor.tell();
+
+    VtcBlockIndexer::TransactionOutput txo;
+    txo.value = outputValue(output);
+    txo.script = vector<unsigned char>(data.get() + scriptStart, data.get() + scriptStart + scriptLength);
+    txo.index = (uint32_t)output;
+    txo.txHash = txHash;
+    return txo;
+}
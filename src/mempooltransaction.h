@@ -0,0 +1,93 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MEMPOOLTRANSACTION_H_INCLUDED
+#define MEMPOOLTRANSACTION_H_INCLUDED
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "blockchaintypes.h"
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+/**
+ * The MempoolTransaction class keeps an unconfirmed transaction as its raw
+ * network serialization, followed by a table with the offset of each input's
+ * outpoint and each output's value, in a single allocation. Fields are decoded
+ * when they are asked for. A parsed Transaction costs a heap allocation per
+ * script, witness item and hash string, which is several times the size of
+ * the raw transaction; this costs the raw size plus four bytes per input and
+ * output.
+ */
+
+class MempoolTransaction {
+public:
+    /** Indexes a raw transaction. Throws a runtime_error if it is malformed. */
+    MempoolTransaction(const unsigned char* raw, size_t length);
+
+    MempoolTransaction(MempoolTransaction&& other) = default;
+    MempoolTransaction& operator=(MempoolTransaction&& other) = default;
+
+    /** The raw transaction as received from the node */
+    const unsigned char* raw() const { return data.get(); }
+    size_t rawSize() const { return rawLength; }
+
+    size_t inputCount() const { return inputs; }
+
+    /** Returns the hash of the transaction spent by an input, as used on block explorers */
+    string inputTxHash(size_t input) const;
+
+    /** Returns the index of the output spent by an input */
+    uint32_t inputTxoIndex(size_t input) const;
+
+    /** Returns the outpoint spent by an input as it is serialized: the 32 byte
+     * hash in internal byte order followed by the output index, little-endian
+     */
+    string inputOutpoint(size_t input) const;
+
+    size_t outputCount() const { return outputs; }
+
+    /** Returns the value of an output in satoshis */
+    uint64_t outputValue(size_t output) const;
+
+    /** Returns an output, with txHash set to the given hash */
+    VtcBlockIndexer::TransactionOutput output(size_t output, const string& txHash) const;
+
+private:
+    MempoolTransaction(const MempoolTransaction&);
+    MempoolTransaction& operator=(const MempoolTransaction&);
+
+    /** Returns the offset stored in the table at the given position */
+    uint32_t offset(size_t position) const;
+
+    unique_ptr<unsigned char[]> data;
+    uint32_t rawLength;
+    uint32_t inputs;
+    uint32_t outputs;
+};
+
+}
+
+#endif // MEMPOOLTRANSACTION_H_INCLUDED
@@ -0,0 +1,153 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "metrics.h"
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    struct MetricFamily {
+        string help;
+        string type;
+        map<string, unique_ptr<VtcBlockIndexer::MetricCounter>> counters;
+        map<string, unique_ptr<VtcBlockIndexer::MetricGauge>> gauges;
+        map<string, unique_ptr<VtcBlockIndexer::MetricHistogram>> histograms;
+    };
+
+    mutex registryMutex;
+    map<string, MetricFamily> registry;
+
+    MetricFamily& family(const string& name, const string& help, const string& type) {
+        MetricFamily& metricFamily = registry[name];
+        if(metricFamily.type.size() == 0) {
+            metricFamily.help = help;
+            metricFamily.type = type;
+        }
+        return metricFamily;
+    }
+
+    string withLabels(const string& name, const string& labels) {
+        if(labels.size() == 0) return name;
+        return name + "{" + labels + "}";
+    }
+
+    void atomicAdd(atomic<double>& target, double value) {
+        double current = target.load(memory_order_relaxed);
+        while(!target.compare_exchange_weak(current, current + value, memory_order_relaxed)) {}
+    }
+}
+
+void VtcBlockIndexer::MetricGauge::add(double value) {
+    atomicAdd(current, value);
+}
+
+VtcBlockIndexer::MetricHistogram::MetricHistogram(const vector<double> bucketBounds) {
+    this->bucketBounds = bucketBounds;
+    sort(this->bucketBounds.begin(), this->bucketBounds.end());
+    this->buckets.reset(new atomic<uint64_t>[this->bucketBounds.size() + 1]);
+    for(size_t i = 0; i <= this->bucketBounds.size(); i++) {
+        this->buckets[i] = 0;
+    }
+    this->observations = 0;
+    this->total = 0;
+}
+
+void VtcBlockIndexer::MetricHistogram::observe(double value) {
+    size_t bucket = lower_bound(bucketBounds.begin(), bucketBounds.end(), value) - bucketBounds.begin();
+    buckets[bucket].fetch_add(1, memory_order_relaxed);
+    observations.fetch_add(1, memory_order_relaxed);
+    atomicAdd(total, value);
+}
+
+VtcBlockIndexer::MetricCounter& VtcBlockIndexer::Metrics::counter(const string& name, const string& help, const string& labels) {
+    lock_guard<mutex> lock(registryMutex);
+    unique_ptr<MetricCounter>& metric = family(name, help, "counter").counters[labels];
+    if(!metric) metric.reset(new MetricCounter());
+    return *metric;
+}
+
+VtcBlockIndexer::MetricGauge& VtcBlockIndexer::Metrics::gauge(const string& name, const string& help, const string& labels) {
+    lock_guard<mutex> lock(registryMutex);
+    unique_ptr<MetricGauge>& metric = family(name, help, "gauge").gauges[labels];
+    if(!metric) metric.reset(new MetricGauge());
+    return *metric;
+}
+
+VtcBlockIndexer::MetricHistogram& VtcBlockIndexer::Metrics::histogram(const string& name, const string& help, const vector<double>& bucketBounds, const string& labels) {
+    lock_guard<mutex> lock(registryMutex);
+    unique_ptr<MetricHistogram>& metric = family(name, help, "histogram").histograms[labels];
+    if(!metric) metric.reset(new MetricHistogram(bucketBounds));
+    return *metric;
+}
+
+vector<double> VtcBlockIndexer::Metrics::latencyBuckets() {
+    return { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30 };
+}
+
+vector<double> VtcBlockIndexer::Metrics::sizeBuckets() {
+    return { 1024, 4096, 16384, 65536, 262144, 1048576, 4194304, 16777216, 67108864 };
+}
+
+string VtcBlockIndexer::Metrics::label(const string& name, const string& value) {
+    string escaped;
+    for(char c : value) {
+        if(c == '"' || c == '\\') escaped.push_back('\\');
+        if(c == '\n') { escaped.append("\\n"); continue; }
+        escaped.push_back(c);
+    }
+    return name + "=\"" + escaped + "\"";
+}
+
+string VtcBlockIndexer::Metrics::render() {
+    lock_guard<mutex> lock(registryMutex);
+    stringstream out;
+    out.precision(12);
+    for(auto& kvp : registry) {
+        const string& name = kvp.first;
+        MetricFamily& metricFamily = kvp.second;
+        out << "# HELP " << name << " " << metricFamily.help << "\n";
+        out << "# TYPE " << name << " " << metricFamily.type << "\n";
+
+        for(auto& counter : metricFamily.counters) {
+            out << withLabels(name, counter.first) << " " << counter.second->value() << "\n";
+        }
+        for(auto& gauge : metricFamily.gauges) {
+            out << withLabels(name, gauge.first) << " " << gauge.second->value() << "\n";
+        }
+        for(auto& histogram : metricFamily.histograms) {
+            const string separator = (histogram.first.size() > 0 ? "," : "");
+            uint64_t cumulative = 0;
+            const vector<double>& bounds = histogram.second->bounds();
+            for(size_t i = 0; i < bounds.size(); i++) {
+                cumulative += histogram.second->bucketCount(i);
+                out << name << "_bucket{" << histogram.first << separator << "le=\"" << bounds[i] << "\"} " << cumulative << "\n";
+            }
+            cumulative += histogram.second->bucketCount(bounds.size());
+            out << name << "_bucket{" << histogram.first << separator << "le=\"+Inf\"} " << cumulative << "\n";
+            out << withLabels(name + "_sum", histogram.first) << " " << histogram.second->sum() << "\n";
+            out << withLabels(name + "_count", histogram.first) << " " << histogram.second->count() << "\n";
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,111 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+    /** A monotonically increasing count */
+    class MetricCounter {
+        public:
+            MetricCounter() : count(0) {}
+            void increment(uint64_t by = 1) { count.fetch_add(by, memory_order_relaxed); }
+            uint64_t value() const { return count.load(memory_order_relaxed); }
+        private:
+            atomic<uint64_t> count;
+    };
+
+    /** A value that can go up and down */
+    class MetricGauge {
+        public:
+            MetricGauge() : current(0) {}
+            void set(double value) { current.store(value, memory_order_relaxed); }
+            void add(double value);
+            double value() const { return current.load(memory_order_relaxed); }
+        private:
+            atomic<double> current;
+    };
+
+    /** Counts observations into fixed buckets, with their sum */
+    class MetricHistogram {
+        public:
+            MetricHistogram(const vector<double> bucketBounds);
+            void observe(double value);
+            const vector<double>& bounds() const { return bucketBounds; }
+            uint64_t bucketCount(size_t bucket) const { return buckets[bucket].load(memory_order_relaxed); }
+            uint64_t count() const { return observations.load(memory_order_relaxed); }
+            double sum() const { return total.load(memory_order_relaxed); }
+        private:
+            vector<double> bucketBounds;
+            unique_ptr<atomic<uint64_t>[]> buckets;
+            atomic<uint64_t> observations;
+            atomic<double> total;
+    };
+
+    /** Observes the seconds elapsed between construction and destruction */
+    class ScopedTimer {
+        public:
+            ScopedTimer(MetricHistogram& histogram) : histogram(histogram), start(chrono::steady_clock::now()) {}
+            ~ScopedTimer() { histogram.observe(chrono::duration<double>(chrono::steady_clock::now() - start).count()); }
+        private:
+            MetricHistogram& histogram;
+            chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * The Metrics class is the process wide registry of counters, gauges and
+     * histograms. Registration takes a lock, so callers on hot paths should look
+     * up their metric once and keep the reference. Updating a metric is lock-free.
+     * Labels are passed preformatted, for instance: route="sync",status="200"
+     */
+
+    class Metrics {
+        public:
+            static MetricCounter& counter(const string& name, const string& help, const string& labels = "");
+            static MetricGauge& gauge(const string& name, const string& help, const string& labels = "");
+            static MetricHistogram& histogram(const string& name, const string& help, const vector<double>& bucketBounds, const string& labels = "");
+
+            /** Renders all metrics in the Prometheus text exposition format */
+            static string render();
+
+            /** Default buckets for latencies, in seconds */
+            static vector<double> latencyBuckets();
+
+            /** Default buckets for sizes, in bytes */
+            static vector<double> sizeBuckets();
+
+            /** Formats a label value, escaping quotes and backslashes */
+            static string label(const string& name, const string& value);
+
+        private:
+            Metrics() {}
+    };
+}
+
+#endif // METRICS_H_INCLUDED
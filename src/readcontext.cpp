@@ -0,0 +1,69 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "readcontext.h"
+#include <algorithm>
+
+using namespace std;
+
+VtcBlockIndexer::ReadContext::ReadContext(const shared_ptr<leveldb::DB> db) {
+    this->db = db;
+    this->snapshot = this->db->GetSnapshot();
+}
+
+VtcBlockIndexer::ReadContext::~ReadContext() {
+    // Iterators must be gone before the snapshot they read from is released
+    this->iterators.clear();
+    this->db->ReleaseSnapshot(this->snapshot);
+}
+
+leveldb::Status VtcBlockIndexer::ReadContext::get(const string& key, string* value) {
+    leveldb::ReadOptions options;
+    options.snapshot = this->snapshot;
+    return this->db->Get(options, key, value);
+}
+
+leveldb::Iterator* VtcBlockIndexer::ReadContext::acquireIterator(bool fillCache) {
+    vector<leveldb::Iterator*>& idle = (fillCache ? this->idleCachedIterators : this->idleUncachedIterators);
+    if(idle.size() > 0) {
+        leveldb::Iterator* it = idle.back();
+        idle.pop_back();
+        return it;
+    }
+
+    leveldb::ReadOptions options;
+    options.snapshot = this->snapshot;
+    options.fill_cache = fillCache;
+    leveldb::Iterator* it = this->db->NewIterator(options);
+    this->iterators.push_back(unique_ptr<leveldb::Iterator>(it));
+    if(!fillCache) {
+        this->uncachedIterators.push_back(it);
+    }
+    return it;
+}
+
+void VtcBlockIndexer::ReadContext::releaseIterator(leveldb::Iterator* it) {
+    if(it == NULL) return;
+    bool uncached = find(this->uncachedIterators.begin(), this->uncachedIterators.end(), it) != this->uncachedIterators.end();
+    if(uncached) {
+        this->idleUncachedIterators.push_back(it);
+    } else {
+        this->idleCachedIterators.push_back(it);
+    }
+}
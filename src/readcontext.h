@@ -0,0 +1,87 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef READCONTEXT_H_INCLUDED
+#define READCONTEXT_H_INCLUDED
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "leveldb/db.h"
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+/**
+ * The ReadContext class bundles all database reads done while serving a single
+ * request. It pins one leveldb::Snapshot so every Get and scan sees the same
+ * state of the index, even while the indexer keeps writing. Iterators handed
+ * out by the context are pooled and reused, and are all deleted when the
+ * context goes out of scope.
+ */
+
+class ReadContext {
+public:
+    /** Constructs a ReadContext and takes a snapshot of the database
+     */
+    ReadContext(const shared_ptr<leveldb::DB> db);
+
+    /** Deletes all iterators and releases the snapshot
+     */
+    ~ReadContext();
+
+    /** Reads a single key from the snapshot
+     */
+    leveldb::Status get(const string& key, string* value);
+
+    /** Returns an iterator on the snapshot. Long scans should pass
+     * fillCache = false so they don't evict hot blocks from the block cache.
+     * The iterator remains owned by the context; hand it back using
+     * releaseIterator when done so it can be reused.
+     */
+    leveldb::Iterator* acquireIterator(bool fillCache);
+
+    /** Returns an iterator to the pool
+     */
+    void releaseIterator(leveldb::Iterator* it);
+
+private:
+    ReadContext(const ReadContext&);
+    ReadContext& operator=(const ReadContext&);
+
+    shared_ptr<leveldb::DB> db;
+    const leveldb::Snapshot* snapshot;
+
+    // All iterators created by this context
+    vector<unique_ptr<leveldb::Iterator>> iterators;
+
+    // Iterators that are currently not in use, split by their fill_cache setting
+    vector<leveldb::Iterator*> idleCachedIterators;
+    vector<leveldb::Iterator*> idleUncachedIterators;
+
+    // Keeps track of the fill_cache setting an iterator was created with
+    vector<leveldb::Iterator*> uncachedIterators;
+};
+
+}
+
+#endif // READCONTEXT_H_INCLUDED
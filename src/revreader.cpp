@@ -0,0 +1,175 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the 
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+    
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "revreader.h"
+#include "blockfile.h"
+#include "filereader.h"
+#include "coinreader.h"
+#include "coinparams.h"
+#include "utility.h"
+#include "metrics.h"
+#include "crypto/sha256.h"
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+    // Core ends each undo record with a double SHA-256 checksum
+    const size_t CHECKSUM_SIZE = 32;
+}
+
+VtcBlockIndexer::RevReader::RevReader(const string blocksDir) {
+    this->blocksDir = blocksDir;
+}
+
+void VtcBlockIndexer::RevReader::scanRecords(istream& revFile, UndoFile& undoFile) {
+    revFile.clear();
+    revFile.seekg(0, ios_base::end);
+    const uint64_t fileSize = revFile.tellg();
+    revFile.seekg(undoFile.scannedUntil, ios_base::beg);
+
+    // Core preallocates the file with zeroes, which ends the scan like the end
+    // of the file does. A record still being written is picked up next time.
+    vector<unsigned char> magic(4);
+    while(undoFile.scannedUntil + 8 <= fileSize) {
+        uint32_t size = 0;
+        revFile.read(reinterpret_cast<char *>(&magic[0]), 4);
+        revFile.read(reinterpret_cast<char *>(&size), sizeof(size));
+        if(revFile.fail() || !equal(magic.begin(), magic.end(), VtcBlockIndexer::CoinParams::magic.begin())) {
+            break;
+        }
+
+        UndoRecord record;
+        record.position = undoFile.scannedUntil + 8;
+        record.size = size;
+        if(record.position + size + CHECKSUM_SIZE > fileSize) {
+            break;
+        }
+        record.transactions = VtcBlockIndexer::FileReader::readVarInt(revFile);
+        if(revFile.fail()) {
+            break;
+        }
+        undoFile.records.push_back(record);
+        undoFile.scannedUntil = record.position + size + CHECKSUM_SIZE;
+        revFile.seekg(undoFile.scannedUntil, ios_base::beg);
+    }
+    revFile.clear();
+}
+
+bool VtcBlockIndexer::RevReader::readRecord(istream& revFile, const UndoRecord& record, const Block& block, const unsigned char* previousHash, vector<vector<TransactionOutput>>& spentOutputs) {
+    vector<unsigned char> data(record.size + CHECKSUM_SIZE);
+    revFile.clear();
+    revFile.seekg(record.position, ios_base::beg);
+    revFile.read(reinterpret_cast<char *>(&data[0]), data.size());
+    if(revFile.fail()) {
+        return false;
+    }
+
+    unsigned char checksum[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(previousHash, 32).Write(data.data(), record.size).Finalize(checksum);
+    CSHA256().Write(checksum, sizeof(checksum)).Finalize(checksum);
+    if(memcmp(checksum, &data[record.size], CHECKSUM_SIZE) != 0) {
+        return false;
+    }
+
+    // The record holds a list of spent outputs per transaction after the coinbase
+    VtcBlockIndexer::CoinReader parser(data.data(), record.size);
+    if(parser.readCompactSize() != block.transactions.size() - 1) {
+        return false;
+    }
+
+    spentOutputs.clear();
+    spentOutputs.resize(block.transactions.size() - 1);
+    for(size_t i = 1; i < block.transactions.size(); i++) {
+        const VtcBlockIndexer::Transaction& tx = block.transactions[i];
+        if(parser.readCompactSize() != tx.inputs.size()) {
+            return false;
+        }
+        vector<VtcBlockIndexer::TransactionOutput>& outputs = spentOutputs[i - 1];
+        outputs.resize(tx.inputs.size());
+        for(size_t j = 0; j < tx.inputs.size(); j++) {
+            uint32_t height;
+            if(!parser.readCoin(outputs[j], height, true)) {
+                return false;
+            }
+            outputs[j].txHash = tx.inputs[j].txHash;
+            outputs[j].index = tx.inputs[j].txoIndex;
+        }
+    }
+    return parser.ok() && parser.atEnd();
+}
+
+bool VtcBlockIndexer::RevReader::readSpentOutputs(const Block& block, vector<vector<TransactionOutput>>& spentOutputs) {
+    static VtcBlockIndexer::MetricCounter& undoRead = VtcBlockIndexer::Metrics::counter("revreader_blocks_read_total", "Blocks whose spent outputs were read from the undo files");
+    static VtcBlockIndexer::MetricCounter& undoMissing = VtcBlockIndexer::Metrics::counter("revreader_blocks_missing_total", "Blocks for which no undo record was found");
+
+    spentOutputs.clear();
+    if(block.transactions.empty() || block.fileName.compare(0, 3, "blk") != 0) {
+        undoMissing.increment();
+        return false;
+    }
+
+    const string revFileName = "rev" + block.fileName.substr(3);
+    stringstream ss;
+    ss << blocksDir << "/" << revFileName;
+    VtcBlockIndexer::BlockFile revFile(ss.str());
+    if(!revFile.is_open()) {
+        undoMissing.increment();
+        return false;
+    }
+
+    // The checksum covers the previous block hash in its internal byte order
+    vector<unsigned char> previousHash = VtcBlockIndexer::Utility::hexToBytes(block.previousBlockHash);
+    reverse(previousHash.begin(), previousHash.end());
+    if(previousHash.size() != 32) {
+        undoMissing.increment();
+        return false;
+    }
+
+    UndoFile& undoFile = undoFiles[revFileName];
+    const uint64_t transactions = block.transactions.size() - 1;
+
+    // Try the record after the last match first, then the other known records,
+    // and finally the records written since the last scan
+    const size_t known = undoFile.records.size();
+    for(size_t n = 0; n < known; n++) {
+        const size_t i = (undoFile.nextRecord + n) % known;
+        if(undoFile.records[i].transactions == transactions && readRecord(revFile, undoFile.records[i], block, previousHash.data(), spentOutputs)) {
+            undoFile.nextRecord = i + 1;
+            undoRead.increment();
+            return true;
+        }
+    }
+
+    scanRecords(revFile, undoFile);
+    for(size_t i = known; i < undoFile.records.size(); i++) {
+        if(undoFile.records[i].transactions == transactions && readRecord(revFile, undoFile.records[i], block, previousHash.data(), spentOutputs)) {
+            undoFile.nextRecord = i + 1;
+            undoRead.increment();
+            return true;
+        }
+    }
+
+    spentOutputs.clear();
+    undoMissing.increment();
+    return false;
+}
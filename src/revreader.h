@@ -0,0 +1,102 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the 
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+    
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef REVREADER_H_INCLUDED
+#define REVREADER_H_INCLUDED
+
+#include <stdint.h>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "blockchaintypes.h"
+
+namespace VtcBlockIndexer {
+
+/**
+ * The RevReader class reads the undo data Vertcoin Core writes to the rev????.dat
+ * file next to each blk????.dat file. The undo record of a block holds the
+ * outputs spent by its transactions, so input values and addresses are known
+ * when the block is indexed without looking up each spent output.
+ *
+ * Core writes the records in the order blocks are connected, which is not the
+ * order of the block file. The record positions of each file are kept after the
+ * first scan, and a record is matched to its block by the checksum Core stores
+ * behind it: the double SHA-256 of the previous block hash and the record.
+ * Not safe to share between threads.
+ */
+
+class RevReader {
+public:
+    /** Constructs a RevReader instance using the given block data directory
+     *
+     * @param blocksDir required Directory where the blockfiles are located.
+     */
+    RevReader(const std::string blocksDir);
+
+    /** Reads the outputs spent by a fully read block. spentOutputs gets an entry
+     * per transaction after the coinbase, holding the output spent by each of
+     * its inputs with txHash and index set to the outpoint. Returns false when
+     * there is no undo record for the block, like for the genesis block or
+     * blocks the node never connected.
+     */
+    bool readSpentOutputs(const Block& block, std::vector<std::vector<TransactionOutput>>& spentOutputs);
+
+private:
+    struct UndoRecord {
+        // Position of the undo data in the file
+        uint64_t position;
+
+        // Size of the undo data, the checksum follows it
+        uint32_t size;
+
+        // Number of transactions the record holds spent outputs for
+        uint64_t transactions;
+    };
+
+    struct UndoFile {
+        // The records found so far
+        std::vector<UndoRecord> records;
+
+        // Where the next scan for records continues
+        uint64_t scannedUntil = 0;
+
+        // The record after the last one matched, blocks are mostly connected in order
+        size_t nextRecord = 0;
+    };
+
+    /** Adds the records appended to the rev file since the last scan */
+    void scanRecords(std::istream& revFile, UndoFile& undoFile);
+
+    /** Reads the record and parses it when its checksum matches the block */
+    bool readRecord(std::istream& revFile, const UndoRecord& record, const Block& block, const unsigned char* previousHash, std::vector<std::vector<TransactionOutput>>& spentOutputs);
+
+    /** Directory containing the blocks
+     */
+    std::string blocksDir;
+
+    std::unordered_map<std::string, UndoFile> undoFiles;
+};
+
+}
+
+#endif // REVREADER_H_INCLUDED
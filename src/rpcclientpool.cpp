@@ -0,0 +1,65 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "rpcclientpool.h"
+#include <stdlib.h>
+#include <algorithm>
+
+using namespace std;
+
+VtcBlockIndexer::RpcClientLease::~RpcClientLease() {
+    if(client != nullptr) {
+        pool->release(client);
+    }
+}
+
+VtcBlockIndexer::RpcClientPool::RpcClientPool(size_t size) {
+    const string url = "http://" + std::string(std::getenv("COIND_RPCUSER")) + ":" + std::string(std::getenv("COIND_RPCPASSWORD")) + "@" + std::string(std::getenv("COIND_HOST")) + ":" + std::string(std::getenv("COIND_RPCPORT"));
+    const char* timeout = std::getenv("COIND_RPC_TIMEOUT_MS");
+    const long timeoutMs = (timeout != NULL && timeout[0] != 0) ? atol(timeout) : 30000;
+
+    size = max(size, (size_t)1);
+    for(size_t i = 0; i < size; i++) {
+        unique_ptr<jsonrpc::HttpClient> connector(new jsonrpc::HttpClient(url));
+        connector->SetTimeout(timeoutMs);
+        unique_ptr<VertcoinClient> client(new VertcoinClient(*connector));
+        idleClients.push_back(client.get());
+        connectors.push_back(move(connector));
+        clients.push_back(move(client));
+    }
+}
+
+VtcBlockIndexer::RpcClientLease VtcBlockIndexer::RpcClientPool::lease() {
+    static VtcBlockIndexer::MetricHistogram& leaseWait = VtcBlockIndexer::Metrics::histogram("rpc_pool_wait_seconds", "Time spent waiting for an idle coind client", VtcBlockIndexer::Metrics::latencyBuckets());
+    VtcBlockIndexer::ScopedTimer timer(leaseWait);
+
+    unique_lock<mutex> lock(idleMutex);
+    idleAvailable.wait(lock, [this]() { return idleClients.size() > 0; });
+    VertcoinClient* client = idleClients.back();
+    idleClients.pop_back();
+    return RpcClientLease(this, client);
+}
+
+void VtcBlockIndexer::RpcClientPool::release(VertcoinClient* client) {
+    {
+        lock_guard<mutex> lock(idleMutex);
+        idleClients.push_back(client);
+    }
+    idleAvailable.notify_one();
+}
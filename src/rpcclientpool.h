@@ -0,0 +1,92 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef RPCCLIENTPOOL_H_INCLUDED
+#define RPCCLIENTPOOL_H_INCLUDED
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <jsonrpccpp/client/connectors/httpclient.h>
+#include "vertcoinrpc.h"
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+class RpcClientPool;
+
+/**
+ * Exclusive use of one pooled client. The client goes back to the pool when
+ * the lease goes out of scope, so a lease taken as a temporary lasts for a
+ * single call: rpcPool->lease()->getblockcount()
+ */
+class RpcClientLease {
+public:
+    RpcClientLease(RpcClientPool* pool, VertcoinClient* client) : pool(pool), client(client) {}
+    RpcClientLease(RpcClientLease&& other) : pool(other.pool), client(other.client) { other.client = nullptr; }
+    ~RpcClientLease();
+
+    VertcoinClient* operator->() { return client; }
+
+private:
+    RpcClientLease(const RpcClientLease&);
+    RpcClientLease& operator=(const RpcClientLease&);
+
+    RpcClientPool* pool;
+    VertcoinClient* client;
+};
+
+/**
+ * The RpcClientPool class keeps a fixed number of coind clients, each with
+ * its own HTTP connection that stays open between calls. A jsonrpc client is
+ * not safe to share between threads, so every thread leases one for the
+ * duration of its calls. The connection details are read from COIND_HOST,
+ * COIND_RPCPORT, COIND_RPCUSER and COIND_RPCPASSWORD, and the per-call timeout
+ * from COIND_RPC_TIMEOUT_MS (default 30000).
+ */
+
+class RpcClientPool {
+public:
+    /** Constructs a pool of the given number of clients */
+    RpcClientPool(size_t size);
+
+    /** Waits for an idle client and leases it */
+    RpcClientLease lease();
+
+private:
+    friend class RpcClientLease;
+
+    /** Returns a leased client to the pool */
+    void release(VertcoinClient* client);
+
+    vector<unique_ptr<jsonrpc::HttpClient>> connectors;
+    vector<unique_ptr<VertcoinClient>> clients;
+
+    mutex idleMutex;
+    condition_variable idleAvailable;
+    vector<VertcoinClient*> idleClients;
+};
+
+}
+
+#endif // RPCCLIENTPOOL_H_INCLUDED
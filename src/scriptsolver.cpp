@@ -20,6 +20,7 @@
 #include "scriptsolver.h"
 #include "blockchaintypes.h"
 #include "utility.h"
+#include "addresscache.h"
 #include <iostream>
 #include <sstream>
 #include "leveldb/db.h"
@@ -32,152 +33,149 @@ VtcBlockIndexer::ScriptSolver::ScriptSolver() {
 
 }
 
-uint8_t  VtcBlockIndexer::ScriptSolver::getScriptType(vector<unsigned char> script) {
-    uint64_t scriptSize = script.size();
-    
-    // The most common output script type that pays to hash160(pubKey)
-    if(
-        
-            (25==scriptSize                  &&
-            0x76==script.at(0)              &&  // OP_DUP
-            0xA9==script.at(1)              &&  // OP_HASH160
-              20==script.at(2)              &&  // OP_PUSHDATA(20)
-            
-            (0x88==script.at(scriptSize-2)   &&  // OP_EQUALVERIFY
-            0xAC==script.at(scriptSize-1)))      // OP_CHECKSIG
-
-            ||
-// scripts appended with OP_NOP1. Since OP_NOP1 does nothing, this should still be valid.
-
-            (25==scriptSize                  &&
-                0x76==script.at(0)              &&  // OP_DUP
-                0xA9==script.at(1)              &&  // OP_HASH160
-                  20==script.at(2)              &&  // OP_PUSHDATA(20)
-                
-                (0x88==script.at(scriptSize-2)   &&  // OP_EQUALVERIFY
-                0xB0==script.at(scriptSize-1)))      // OP_NOP1
-    
-                ||
+namespace
+{
+    const unsigned char OP_0 = 0x00;
+    const unsigned char OP_PUSHDATA_20 = 0x14;
+    const unsigned char OP_PUSHDATA_32 = 0x20;
+    const unsigned char OP_PUSHDATA_33 = 0x21;
+    const unsigned char OP_PUSHDATA_65 = 0x41;
+    const unsigned char OP_1 = 0x51;
+    const unsigned char OP_16 = 0x60;
+    const unsigned char OP_NOP = 0x61;
+    const unsigned char OP_RETURN = 0x6A;
+    const unsigned char OP_DUP = 0x76;
+    const unsigned char OP_EQUAL = 0x87;
+    const unsigned char OP_EQUALVERIFY = 0x88;
+    const unsigned char OP_HASH160 = 0xA9;
+    const unsigned char OP_CHECKSIG = 0xAC;
+    const unsigned char OP_CHECKMULTISIG = 0xAE;
+    const unsigned char OP_NOP1 = 0xB0;
 
-            // scripts appended with OP_NOP. Since OP_NOP does nothing, this should still be valid.
+    const char* SCRIPT_TYPE_NAMES[] = { "", "pay-to-pubkeyhash", "pay-to-pubkey", "pay-to-scripthash", "pay-to-witness-pubkeyhash",
+                                        "pay-to-witnessscripthash", "nulldata", "multisig", "pay-to-pubkey", "nonstandard" };
 
-            (26==scriptSize                  &&
-            0x76==script.at(0)              &&  // OP_DUP
-            0xA9==script.at(1)              &&  // OP_HASH160
-              20==script.at(2)              &&  // OP_PUSHDATA(20)
-
-            
-            (0x88==script.at(scriptSize-3)   &&  // OP_EQUALVERIFY
-            0xAC==script.at(scriptSize-2)   &&  // OP_CHECKSIG
-            0x61==script.at(scriptSize-1)))     // OP_NOP
-            
-              
-        
-    ) { 
-        return SCRIPT_TYPE_P2PKH;
-    }
-
-    // Output script commonly found in block reward TX, that pays to an explicit pubKey
-    if(
-                67==scriptSize                &&  
-                65==script.at(0)            &&  // OP_PUSHDATA(65)
-                0xAC==script.at(scriptSize-1) // OP_CHECKSIG
-                
-        ) {
-        return SCRIPT_TYPE_P2PK;
+    VtcBlockIndexer::ScriptClassification classified(uint8_t type, uint32_t offset, uint32_t length) {
+        VtcBlockIndexer::ScriptClassification result;
+        result.type = type;
+        result.payloadCount = (length > 0 ? 1 : 0);
+        result.payloadOffsets[0] = offset;
+        result.payloadLengths[0] = length;
+        result.multiSigRequired = 0;
+        result.multiSigKeys = 0;
+        return result;
     }
 
-    // Pay to compressed pubkey script
-     if(
-        35==scriptSize                &&
-        0x21==script.at(0)            &&  // OP_PUSHDATA(33)
-        0xAC==script.at(scriptSize-1)     // OP_CHECKSIG
-    ) {
-        return SCRIPT_TYPE_P2CPK;
-    }
-
-    // Pay to witness script hash
-    if(
-        22 == scriptSize            &&
-        0x00 == script.at(0)        &&  
-        0x14 == script.at(1)        
-    ) {
-        return SCRIPT_TYPE_P2WSH;
-    }
-
-    // P2WPKH
-    if(
-        34 == scriptSize            &&
-        0x00 == script.at(0)        &&  
-        0x20 == script.at(1)        
-    ) {
-        return SCRIPT_TYPE_P2WPKH;
+    uint8_t smallInteger(unsigned char opcode) {
+        return (opcode >= OP_1 && opcode <= OP_16) ? opcode - OP_1 + 1 : 0;
     }
+}
 
-     if(
-        23 == scriptSize                &&
-            0xA9==script.at(0)             &&  // OP_HASH160
-              20==script.at(1)             &&  // OP_PUSHDATA(20)
-            0x87==script.at(scriptSize-1)      // OP_EQUAL
-              
-        
-    ) {
-        return SCRIPT_TYPE_P2SH;
+VtcBlockIndexer::ScriptClassification VtcBlockIndexer::ScriptSolver::classify(const unsigned char* script, size_t scriptSize) {
+    // Fixed size templates first, by length and leading opcode
+    switch(scriptSize) {
+        case 25:
+            // The most common output script type that pays to hash160(pubKey). Also
+            // accept scripts ending in OP_NOP1, since OP_NOP1 does nothing.
+            if(script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == OP_PUSHDATA_20 &&
+               script[23] == OP_EQUALVERIFY && (script[24] == OP_CHECKSIG || script[24] == OP_NOP1)) {
+                return classified(SCRIPT_TYPE_P2PKH, 3, 20);
+            }
+            break;
+        case 26:
+            // Scripts appended with OP_NOP. Since OP_NOP does nothing, this should still be valid.
+            if(script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == OP_PUSHDATA_20 &&
+               script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG && script[25] == OP_NOP) {
+                return classified(SCRIPT_TYPE_P2PKH, 3, 20);
+            }
+            break;
+        case 67:
+            // Output script commonly found in block reward TX, that pays to an explicit pubKey
+            if(script[0] == OP_PUSHDATA_65 && script[66] == OP_CHECKSIG) {
+                return classified(SCRIPT_TYPE_P2PK, 1, 65);
+            }
+            break;
+        case 35:
+            // Pay to compressed pubkey script
+            if(script[0] == OP_PUSHDATA_33 && script[34] == OP_CHECKSIG) {
+                return classified(SCRIPT_TYPE_P2CPK, 1, 33);
+            }
+            break;
+        case 22:
+            // Witness v0 with a 20 byte program
+            if(script[0] == OP_0 && script[1] == OP_PUSHDATA_20) {
+                return classified(SCRIPT_TYPE_P2WSH, 2, 20);
+            }
+            break;
+        case 34:
+            // Witness v0 with a 32 byte program
+            if(script[0] == OP_0 && script[1] == OP_PUSHDATA_32) {
+                return classified(SCRIPT_TYPE_P2WPKH, 2, 32);
+            }
+            break;
+        case 23:
+            if(script[0] == OP_HASH160 && script[1] == OP_PUSHDATA_20 && script[22] == OP_EQUAL) {
+                return classified(SCRIPT_TYPE_P2SH, 2, 20);
+            }
+            break;
     }
 
-    // NULLDATA
-    if(
-            scriptSize > 0        && 
-            0x6A == script.at(0)    
-        ) {
-            uint32_t pos = 1;
-            
-            bool foundOpcodes = false;
-            while(pos < script.size()) {
-                if(script.at(pos) >= 0x01 && script.at(pos) <= 0x4B) { 
-                    pos += script.at(pos) + 1;
-                } else {
-                    foundOpcodes = true;
-                    break;
-                } 
+    // NULLDATA: OP_RETURN followed by nothing but data pushes
+    if(scriptSize > 0 && script[0] == OP_RETURN) {
+        size_t pos = 1;
+        while(pos < scriptSize) {
+            if(script[pos] >= 0x01 && script[pos] <= 0x4B) {
+                pos += script[pos] + 1;
+            } else {
+                return classified(SCRIPT_TYPE_UNKNOWN, 0, 0);
             }
-
-        if(!foundOpcodes)
-            return SCRIPT_TYPE_NULLDATA;
-        else
-            return SCRIPT_TYPE_UNKNOWN;
+        }
+        return classified(SCRIPT_TYPE_NULLDATA, 0, 0);
     }
 
-    if(isMultiSig(script)) {
-        return SCRIPT_TYPE_MULTISIG;
+    if(scriptSize > 0 && script[scriptSize - 1] == OP_CHECKMULTISIG) {
+        ScriptClassification result = classified(SCRIPT_TYPE_MULTISIG, 0, 0);
+        result.multiSigRequired = smallInteger(script[0]);
+        result.multiSigKeys = (scriptSize >= 2 ? smallInteger(script[scriptSize - 2]) : 0);
+
+        // The public keys pushed between OP_m and OP_n
+        size_t pos = 1;
+        while(pos + 2 < scriptSize && result.payloadCount < MAX_SCRIPT_PAYLOADS) {
+            const size_t keyLength = (script[pos] == OP_PUSHDATA_33 ? 33 : (script[pos] == OP_PUSHDATA_65 ? 65 : 0));
+            if(keyLength == 0 || pos + 1 + keyLength > scriptSize) break;
+            result.payloadOffsets[result.payloadCount] = pos + 1;
+            result.payloadLengths[result.payloadCount] = keyLength;
+            result.payloadCount++;
+            pos += keyLength + 1;
+        }
+        return result;
     }
 
-    
     if(
         // OP_PUSHDATA(32) + data only (Found in litecoin chain - nonstandard script)
         // Public block explorers show these as "unknown" (https://bchain.info/LTC/tx/265278e51d1b29cdce906a858251b7ce15e2dab09de7dede0acb4c629f780b91)  
         (   33==scriptSize                  &&
-            0x20==script.at(0))
+            0x20==script[0])
         ||
         // OP_PUSHDATA(36) + data only (Found in litecoin chain - nonstandard script)
         // Public block explorers show these as "unknown" (http://explorer.litecoin.net/tx/936e8ed1cfca736320fdced61c2d03886b232497ea975e41d101f1d83bb74c44)
         (   37==scriptSize                  &&
-            0x24==script.at(0))
+            0x24==script[0])
         ||
         // OP_PUSHDATA(20) + data only. Unparseable (BTC)
         // Public block explorers show these as "unknown" (https://blockchain.info/tx/b8fd633e7713a43d5ac87266adc78444669b987a56b3a65fb92d58c2c4b0e84d)
         (   24==scriptSize                  &&
-            0x14==script.at(0))
+            0x14==script[0])
         ||
         // Unknown (seems malformed) output script found on Litecoin in p2pool blocks
         // For example https://bchain.info/LTC/tx/8f1220670b5d4ade8f9c6a82fde3d88a28d2e1c290f2edc6d7a7a13aa0352fc7 
         (   6 == scriptSize                &&
-            0x73==script.at(0)             &&  // OP_IFDUP
-            0x63==script.at(1)             &&  // OP_IF
-            0x72==script.at(2)             &&  // OP_2SWAP
-            0x69==script.at(3)             &&  // OP_VERIFY
-            0x70==script.at(4)             &&  // OP_2OVER
-            0x74==script.at(5))              // OP_DEPTH)
+            0x73==script[0]                &&  // OP_IFDUP
+            0x63==script[1]                &&  // OP_IF
+            0x72==script[2]                &&  // OP_2SWAP
+            0x69==script[3]                &&  // OP_VERIFY
+            0x70==script[4]                &&  // OP_2OVER
+            0x74==script[5])                   // OP_DEPTH)
         ||
         // A challenge: anyone who can find X such that 0==RIPEMD160(X) stands to earn a bunch of coins
         (
@@ -189,68 +187,43 @@ uint8_t  VtcBlockIndexer::ScriptSolver::getScriptType(vector<unsigned char> scri
             0xAC==script[4])                    // OP_CHECKSIG
     )
     {
-        return SCRIPT_TYPE_KNOWN_NONSTANDARD;
+        return classified(SCRIPT_TYPE_KNOWN_NONSTANDARD, 0, 0);
     }
 
-    return SCRIPT_TYPE_UNKNOWN;
+    return classified(SCRIPT_TYPE_UNKNOWN, 0, 0);
 }
 
-string VtcBlockIndexer::ScriptSolver::getScriptTypeName(vector<unsigned char> script) {
-    vector<string> scriptTypeNames = {"", "pay-to-pubkeyhash", "pay-to-pubkey", "pay-to-scripthash", "pay-to-witness-pubkeyhash", "pay-to-witnessscripthash","nulldata","multisig","pay-to-pubkey"};
-    uint8_t scriptType = getScriptType(script);
-    if(scriptType == SCRIPT_TYPE_UNKNOWN) return string("Unknown");
-    return scriptTypeNames.at(scriptType);
+uint8_t VtcBlockIndexer::ScriptSolver::getScriptType(const vector<unsigned char>& script) {
+    return classify(script.data(), script.size()).type;
 }
 
-vector<string> VtcBlockIndexer::ScriptSolver::getAddressesFromScript(vector<unsigned char> script) {
-    vector<string> addresses;
+string VtcBlockIndexer::ScriptSolver::getScriptTypeName(const vector<unsigned char>& script) {
+    return getScriptTypeName(getScriptType(script));
+}
+
+string VtcBlockIndexer::ScriptSolver::getScriptTypeName(uint8_t scriptType) {
+    if(scriptType >= sizeof(SCRIPT_TYPE_NAMES) / sizeof(SCRIPT_TYPE_NAMES[0])) return string("Unknown");
+    return string(SCRIPT_TYPE_NAMES[scriptType]);
+}
+
+vector<string> VtcBlockIndexer::ScriptSolver::getAddressesFromScript(const vector<unsigned char>& script) {
+    return getAddressesFromScript(script.data(), script.size(), classify(script.data(), script.size()));
+}
 
+vector<string> VtcBlockIndexer::ScriptSolver::getAddressesFromScript(const unsigned char* script, size_t scriptSize, const ScriptClassification& classification) {
+    vector<string> addresses;
 
-    uint8_t scriptType = getScriptType(script);
-    switch(scriptType) {
+    switch(classification.type) {
         case SCRIPT_TYPE_P2PKH:
-        {
-            addresses.push_back(VtcBlockIndexer::Utility::ripeMD160ToP2PKAddress(vector<unsigned char>(&script[3], &script[23])));
-            break;
-        }
         case SCRIPT_TYPE_P2PK:
-        {
-            addresses.push_back(VtcBlockIndexer::Utility::publicKeyToAddress(vector<unsigned char>(&script[1], &script[66])));
-            break;
-        }
         case SCRIPT_TYPE_P2CPK:
-        {
-            addresses.push_back(VtcBlockIndexer::Utility::publicKeyToAddress(vector<unsigned char>(&script[1], &script[34])));
-            break;
-        }
         case SCRIPT_TYPE_P2WSH:
-        {
-            addresses.push_back(VtcBlockIndexer::Utility::bech32Address(vector<unsigned char>(&script[2], &script[22])));
-            break;
-        }
         case SCRIPT_TYPE_P2WPKH:
-        {
-            addresses.push_back(VtcBlockIndexer::Utility::bech32Address(vector<unsigned char>(&script[2], &script[34])));
-            break;
-        }
         case SCRIPT_TYPE_P2SH:
-        {
-            addresses.push_back(VtcBlockIndexer::Utility::ripeMD160ToP2SHAddress(vector<unsigned char>(&script[2], &script[22])));
-            break;
-        }
         case SCRIPT_TYPE_MULTISIG:
         {
-            uint32_t pos = 1;
-            while(pos < script.size()-2) {
-                if(script.at(pos) == 0x21) {
-                    addresses.push_back(VtcBlockIndexer::Utility::publicKeyToAddress(vector<unsigned char>(&script[pos+1], &script[pos+34]))); 
-                    pos += 34;
-                }
-                else if(script.at(pos) == 0x41) {
-                    addresses.push_back(VtcBlockIndexer::Utility::publicKeyToAddress(vector<unsigned char>(&script[pos+1], &script[pos+66])));
-                    pos += 66;
-                }
-                else pos = script.size();
+            for(uint32_t i = 0; i < classification.payloadCount; i++) {
+                addresses.push_back(payloadAddress(classification.type, script + classification.payloadOffsets[i], classification.payloadLengths[i]));
             }
             break;
         }
@@ -267,21 +240,38 @@ vector<string> VtcBlockIndexer::ScriptSolver::getAddressesFromScript(vector<unsi
         case SCRIPT_TYPE_UNKNOWN:
         default:
         {
-            cout << "Before unrecognized script" << endl;
-            cout << "Unrecognized script : [" << Utility::hashToHex(script) << "]" << endl;
+            cout << "Unrecognized script : [" << Utility::hashToHex(vector<unsigned char>(script, script + scriptSize)) << "]" << endl;
         }
     }
 
     return addresses;
 }
 
-bool VtcBlockIndexer::ScriptSolver::isMultiSig(vector<unsigned char> script) {
+string VtcBlockIndexer::ScriptSolver::payloadAddress(uint8_t scriptType, const unsigned char* payload, size_t payloadLength) {
+    return VtcBlockIndexer::AddressCache::get(scriptType, payload, payloadLength, [scriptType, payload, payloadLength]() {
+        const vector<unsigned char> bytes(payload, payload + payloadLength);
+        switch(scriptType) {
+            case SCRIPT_TYPE_P2PKH:
+                return VtcBlockIndexer::Utility::ripeMD160ToP2PKAddress(bytes);
+            case SCRIPT_TYPE_P2SH:
+                return VtcBlockIndexer::Utility::ripeMD160ToP2SHAddress(bytes);
+            case SCRIPT_TYPE_P2WSH:
+            case SCRIPT_TYPE_P2WPKH:
+                return VtcBlockIndexer::Utility::bech32Address(bytes);
+            default:
+                // Public keys of P2PK, P2CPK and multisig scripts
+                return VtcBlockIndexer::Utility::publicKeyToAddress(bytes);
+        }
+    });
+}
+
+bool VtcBlockIndexer::ScriptSolver::isMultiSig(const vector<unsigned char>& script) {
     if(script.size() == 0) return false;
-    return (script.at(script.size()-1) == 0xAE);
+    return (script.back() == OP_CHECKMULTISIG);
 }
 
-int VtcBlockIndexer::ScriptSolver::requiredSignatures(vector<unsigned char> script) {
+int VtcBlockIndexer::ScriptSolver::requiredSignatures(const vector<unsigned char>& script) {
     if(!isMultiSig(script)) return -1;
 
-    return (int)script.at(0);
-}
\ No newline at end of file
+    return (int)script[0];
+}
@@ -24,6 +24,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <stdint.h>
+#include <vector>
 
 #include "blockchaintypes.h"
 using namespace std;
@@ -43,6 +45,25 @@ using namespace std;
 
 namespace VtcBlockIndexer {
 
+// The most public keys OP_CHECKMULTISIG accepts
+#define MAX_SCRIPT_PAYLOADS             20
+
+/** The result of classifying an output script in a single pass */
+struct ScriptClassification {
+    // One of the SCRIPT_TYPE_ constants
+    uint8_t type;
+
+    // Position and length in the script of the hash or public key that can
+    // spend it. Multisig scripts have one for each public key.
+    uint32_t payloadCount;
+    uint32_t payloadOffsets[MAX_SCRIPT_PAYLOADS];
+    uint32_t payloadLengths[MAX_SCRIPT_PAYLOADS];
+
+    // m and n of an m-of-n multisig script, 0 when they are not small integers
+    uint8_t multiSigRequired;
+    uint8_t multiSigKeys;
+};
+
 /**
  * The ScriptSolver class provides methods to parse the bitcoin script language used in
  * transaction outputs and determine the public keys / addresses that can spend it.
@@ -54,25 +75,42 @@ public:
      */
     ScriptSolver();
 
+    /** Classifies a script and locates its payload without copying it. The
+     * common script types are recognized by their length and leading opcode.
+     */
+    ScriptClassification classify(const unsigned char* script, size_t scriptSize);
+
     /** Get the script type
      */
-    uint8_t getScriptType(vector<unsigned char> scriptString);
+    uint8_t getScriptType(const vector<unsigned char>& scriptString);
 
     // Get a friendly name for the script type
-    string getScriptTypeName(vector<unsigned char> scriptString);
+    string getScriptTypeName(const vector<unsigned char>& scriptString);
 
+    // Get a friendly name for a script type constant
+    string getScriptTypeName(uint8_t scriptType);
 
     /** Read addresses from script
      */
-    vector<string> getAddressesFromScript(vector<unsigned char> scriptString);
+    vector<string> getAddressesFromScript(const vector<unsigned char>& scriptString);
+
+    /** Read addresses from a classified script
+     */
+    vector<string> getAddressesFromScript(const unsigned char* script, size_t scriptSize, const ScriptClassification& classification);
 
     /** Returns if the script is multisig
      */
-    bool isMultiSig(vector<unsigned char> scriptString);
+    bool isMultiSig(const vector<unsigned char>& scriptString);
 
-    /** Returns the number of required signatures
+    /** Returns the number of required signatures. This is the first byte of
+     * the script, the OP_m opcode itself, as it has always been stored in
+     * the index.
      */
-    int requiredSignatures(vector<unsigned char> scriptString);
+    int requiredSignatures(const vector<unsigned char>& scriptString);
+
+private:
+    /** Encodes the hash or public key of a script as an address, through the address cache */
+    string payloadAddress(uint8_t scriptType, const unsigned char* payload, size_t payloadLength);
 };
 
 }
@@ -19,17 +19,20 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <openssl/sha.h>
 #include <iostream>
 #include <fstream>
 #include <memory>
-#include <iomanip>
 #include <vector>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include <secp256k1.h>
 #include "crypto/ripemd160.h"
+#include "crypto/sha256.h"
 #include "crypto/bech32.h"
 #include "coinparams.h"
-#include <assert.h>     /* assert */
 
 using namespace std;
 
@@ -38,60 +41,108 @@ namespace
     /* Global secp256k1_context object used for verification. */
     secp256k1_context* secp256k1_context_verify = NULL;
 
-    typedef std::vector<uint8_t> data;
-
-    template<int frombits, int tobits, bool pad>
-    bool convertbits(data& out, const data& in) {
-        int acc = 0;
-        int bits = 0;
-        const int maxv = (1 << tobits) - 1;
-        const int max_acc = (1 << (frombits + tobits - 1)) - 1;
-        for (size_t i = 0; i < in.size(); ++i) {
-            int value = in[i];
-            acc = ((acc << frombits) | value) & max_acc;
-            bits += frombits;
-            while (bits >= tobits) {
-                bits -= tobits;
-                out.push_back((acc >> bits) & maxv);
+    const char HEX_DIGITS[] = "0123456789abcdef";
+
+    /** Lookup tables for hex: the two characters for each byte, and the value of each character */
+    struct HexTables {
+        char pairs[512];
+        int8_t values[256];
+
+        HexTables() {
+            for(int i = 0; i < 256; i++) {
+                pairs[2 * i] = HEX_DIGITS[i >> 4];
+                pairs[2 * i + 1] = HEX_DIGITS[i & 0x0F];
+                values[i] = -1;
+            }
+            for(int i = 0; i < 10; i++) values['0' + i] = i;
+            for(int i = 0; i < 6; i++) {
+                values['a' + i] = 10 + i;
+                values['A' + i] = 10 + i;
             }
         }
-        if (pad) {
-            if (bits) out.push_back((acc << (tobits - bits)) & maxv);
-        } else if (bits >= frombits || ((acc << (tobits - bits)) & maxv)) {
-            return false;
+    };
+    const HexTables hexTables;
+
+#if defined(__SSE2__)
+    /** Turns sixteen nibbles into their hex characters */
+    inline __m128i nibblesToHex(__m128i nibbles) {
+        const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+        return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+    }
+
+    /** Writes 32 hex characters for 16 bytes, optionally last byte first */
+    inline void hex16(const unsigned char* in, char* out, bool reverse) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)in);
+        if(reverse) {
+            bytes = _mm_shuffle_epi32(bytes, 0x1B);
+            bytes = _mm_shufflelo_epi16(bytes, 0xB1);
+            bytes = _mm_shufflehi_epi16(bytes, 0xB1);
+            bytes = _mm_or_si128(_mm_slli_epi16(bytes, 8), _mm_srli_epi16(bytes, 8));
         }
-        return true;
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        const __m128i high = nibblesToHex(_mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+        const __m128i low = nibblesToHex(_mm_and_si128(bytes, mask));
+        _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi8(high, low));
     }
+#endif
+
+    const char* BASE58_DIGITS = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+    // Base58 is computed in limbs of five digits, which leaves room in 64 bits
+    // to multiply a limb by 2^32
+    const uint64_t BASE58_LIMB = 58ULL * 58 * 58 * 58 * 58;
+    const size_t BASE58_LIMB_DIGITS = 5;
+}
+
+vector<unsigned char> VtcBlockIndexer::Utility::sha256(const vector<unsigned char>& input)
+{
+    vector<unsigned char> hash(CSHA256::OUTPUT_SIZE);
+    CSHA256().Write(input.data(), input.size()).Finalize(&hash[0]);
+    return hash;
 }
 
-vector<unsigned char> VtcBlockIndexer::Utility::sha256(vector<unsigned char> input)
+vector<unsigned char> VtcBlockIndexer::Utility::sha256d(const unsigned char* data, size_t length)
 {
-    unique_ptr<unsigned char> hash(new unsigned char [SHA256_DIGEST_LENGTH]);
+    vector<unsigned char> hash(CSHA256::OUTPUT_SIZE);
+    SHA256D(&hash[0], data, length);
+    return hash;
+}
+
+std::string VtcBlockIndexer::Utility::hashToHex(const vector<unsigned char>& hash) {
+    string hex(hash.size() * 2, '0');
+    bytesToHex(hash.data(), hash.size(), &hex[0], false);
+    return hex;
+}
 
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, &input[0], input.size());
-    SHA256_Final(hash.get(), &sha256);
-    return vector<unsigned char>(hash.get(), hash.get()+SHA256_DIGEST_LENGTH);
+std::string VtcBlockIndexer::Utility::hashToReverseHex(const vector<unsigned char>& hash) {
+    string hex(hash.size() * 2, '0');
+    bytesToHex(hash.data(), hash.size(), &hex[0], true);
+    return hex;
 }
 
-std::string VtcBlockIndexer::Utility::hashToHex(vector<unsigned char> hash) {
-    stringstream ss;
-    for(uint i = 0; i < hash.size(); i++)
-    {
-        ss << hex << setw(2) << setfill('0') << (int)hash.at(i);
+void VtcBlockIndexer::Utility::bytesToHex(const unsigned char* in, size_t length, char* out, bool reverse) {
+    size_t done = 0;
+#if defined(__SSE2__)
+    for(; length - done >= 16; done += 16) {
+        hex16(reverse ? in + length - done - 16 : in + done, out + 2 * done, reverse);
+    }
+#endif
+    for(; done < length; done++) {
+        const unsigned char byte = reverse ? in[length - done - 1] : in[done];
+        out[2 * done] = hexTables.pairs[2 * byte];
+        out[2 * done + 1] = hexTables.pairs[2 * byte + 1];
     }
-    return ss.str();
 }
 
-std::string VtcBlockIndexer::Utility::hashToReverseHex(vector<unsigned char> hash) {
-    if(hash.size() == 0) return "";
-    stringstream ss;
-    for(uint i = hash.size(); i-- > 0;)
-    {
-        ss << hex << setw(2) << setfill('0') << (int)hash.at(i);
+bool VtcBlockIndexer::Utility::hexToBytes(const char* hex, size_t length, unsigned char* out) {
+    for(size_t i = 0; i + 1 < length; i += 2) {
+        const int8_t high = hexTables.values[(unsigned char)hex[i]];
+        const int8_t low = hexTables.values[(unsigned char)hex[i + 1]];
+        if(high < 0 || low < 0) return false;
+        out[i / 2] = (unsigned char)((high << 4) | low);
     }
-    return ss.str();
+    return true;
 }
 
 void VtcBlockIndexer::Utility::initECCContextIfNeeded() {
@@ -139,26 +190,36 @@ string VtcBlockIndexer::Utility::ripeMD160ToP2SHAddress(vector<unsigned char> ri
 }
 
 string VtcBlockIndexer::Utility::ripeMD160ToAddress(unsigned char versionByte, vector<unsigned char> ripeMD) {
-    ripeMD.insert(ripeMD.begin(), versionByte);
-    vector<unsigned char> doubleHashedRipeMD = sha256(sha256(ripeMD));
-    for(int i = 0; i < 4; i++) {
-        ripeMD.push_back(doubleHashedRipeMD.at(i));
+    // Version byte, hash and the first four bytes of its double SHA-256
+    const size_t length = 1 + ripeMD.size() + 4;
+    unsigned char stackPayload[64];
+    vector<unsigned char> heapPayload;
+    unsigned char* payload = stackPayload;
+    if(length + CSHA256::OUTPUT_SIZE - 4 > sizeof(stackPayload)) {
+        heapPayload.resize(length + CSHA256::OUTPUT_SIZE - 4);
+        payload = heapPayload.data();
     }
-   
-    string returnValue = base58(ripeMD);
-    return returnValue;
+    payload[0] = versionByte;
+    memcpy(payload + 1, ripeMD.data(), ripeMD.size());
+    SHA256D(payload + 1 + ripeMD.size(), payload, 1 + ripeMD.size());
+
+    string address(length * 138 / 100 + 1, '1');
+    address.resize(base58(payload, length, &address[0]));
+    return address;
 
 }
 
-vector<unsigned char> VtcBlockIndexer::Utility::hexToBytes(const std::string hex) {
-    vector<unsigned char> bytes;
-  
-    for (unsigned int i = 0; i < hex.length(); i += 2) {
-      string byteString = hex.substr(i, 2);
-      unsigned char byte = (unsigned char) strtol(byteString.c_str(), NULL, 16);
-      bytes.push_back(byte);
+vector<unsigned char> VtcBlockIndexer::Utility::hexToBytes(const std::string& hex) {
+    vector<unsigned char> bytes((hex.length() + 1) / 2);
+    if(hexToBytes(hex.data(), hex.length(), bytes.data()) && hex.length() % 2 == 0) {
+        return bytes;
+    }
+
+    // Not valid hex, parse it pair by pair as before so the result does not change
+    for (size_t i = 0; i < hex.length(); i += 2) {
+        string byteString = hex.substr(i, 2);
+        bytes[i / 2] = (unsigned char)strtol(byteString.c_str(), NULL, 16);
     }
-  
     return bytes;
 }
 
@@ -168,61 +229,81 @@ vector<unsigned char> VtcBlockIndexer::Utility::ripeMD160(vector<unsigned char>
     return vector<unsigned char>(hash, hash + CRIPEMD160::OUTPUT_SIZE);
 }
 
-static const char* pszBase58 = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+std::string VtcBlockIndexer::Utility::base58(const vector<unsigned char>& in)
+{
+    string encoded(in.size() * 138 / 100 + 1, '1');
+    encoded.resize(base58(in.data(), in.size(), &encoded[0]));
+    return encoded;
+}
 
-std::string VtcBlockIndexer::Utility::base58(vector<unsigned char> in)
+size_t VtcBlockIndexer::Utility::base58(const unsigned char* in, size_t length, char* out)
 {
-    unsigned char* pbegin = &in[0];
-    unsigned char* pend = &in[0] + in.size();
-
-    // Skip & count leading zeroes.
-    int zeroes = 0;
-    int length = 0;
-    while (pbegin != pend && *pbegin == 0) {
-        pbegin++;
+    // Leading zero bytes are written as '1' each
+    size_t zeroes = 0;
+    while (zeroes < length && in[zeroes] == 0) {
+        out[zeroes] = '1';
         zeroes++;
     }
 
-
-    // Allocate enough space in big-endian base58 representation.
-    int size = (in.size()-zeroes) * 138 / 100 + 1; // log(256) / log(58), rounded up.
-
-    std::vector<unsigned char> b58(size);
-    // Process the bytes.
-    while (pbegin != pend) {
-        int carry = *pbegin;
-        int i = 0;
-        // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
-            carry += 256 * (*it);
-            *it = carry % 58;
-            carry /= 58;
-        }
-
-        assert(carry == 0);
-        length = i;
-        pbegin++;
+    // Little-endian base 58^5 limbs. Addresses fit the buffer on the stack.
+    uint32_t stackLimbs[32];
+    vector<uint32_t> heapLimbs;
+    const size_t maxLimbs = (length - zeroes) * 138 / 100 / BASE58_LIMB_DIGITS + 2;
+    uint32_t* limbs = stackLimbs;
+    if (maxLimbs > 32) {
+        heapLimbs.resize(maxLimbs);
+        limbs = heapLimbs.data();
     }
-    // Skip leading zeroes in base58 result.
-    std::vector<unsigned char>::iterator it = b58.begin() + (size - length);
-    while (it != b58.end() && *it == 0)
-        it++;
-    // Translate the result into a string.
-    std::string str;
-    str.reserve(zeroes + (b58.end() - it));
-    str.assign(zeroes, '1');
-    while (it != b58.end())
-        str += pszBase58[*(it++)];
-    return str;
-}
-
-string VtcBlockIndexer::Utility::bech32Address(vector<unsigned char> in) {
-    vector<unsigned char> enc;
-    enc.push_back(0); // witness version
-    if(convertbits<8, 5, true>(enc, in)) {
-        return bech32::Encode(VtcBlockIndexer::CoinParams::bech32Prefix, enc);
+    size_t limbCount = 0;
+
+    // Feed the input four bytes at a time: limbs = limbs * 2^32 + word. The
+    // first group takes whatever is left over, so the rest are whole words.
+    const unsigned char* pos = in + zeroes;
+    const unsigned char* end = in + length;
+    size_t groupSize = (end - pos) % 4;
+    if (groupSize == 0) groupSize = 4;
+    while (pos < end) {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < groupSize; i++) {
+            carry = (carry << 8) | *(pos++);
+        }
+        const uint64_t multiplier = 1ULL << (8 * groupSize);
+        for (size_t i = 0; i < limbCount; i++) {
+            carry += limbs[i] * multiplier;
+            limbs[i] = carry % BASE58_LIMB;
+            carry /= BASE58_LIMB;
+        }
+        while (carry > 0) {
+            limbs[limbCount++] = carry % BASE58_LIMB;
+            carry /= BASE58_LIMB;
+        }
+        groupSize = 4;
     }
-    else{
-        return "";
+
+    // Most significant limb first, without its leading zero digits
+    size_t written = zeroes;
+    for (size_t i = limbCount; i-- > 0;) {
+        char digits[BASE58_LIMB_DIGITS];
+        uint32_t limb = limbs[i];
+        for (size_t j = BASE58_LIMB_DIGITS; j-- > 0;) {
+            digits[j] = BASE58_DIGITS[limb % 58];
+            limb /= 58;
+        }
+        size_t first = 0;
+        if (i == limbCount - 1) {
+            while (first < BASE58_LIMB_DIGITS - 1 && digits[first] == '1') first++;
+        }
+        for (size_t j = first; j < BASE58_LIMB_DIGITS; j++) {
+            out[written++] = digits[j];
+        }
     }
+    return written;
+}
+
+string VtcBlockIndexer::Utility::bech32Address(const vector<unsigned char>& in) {
+    const string& prefix = VtcBlockIndexer::CoinParams::bech32Prefix;
+    string address(prefix.size() + 1 + 1 + (in.size() * 8 + 4) / 5 + 6, ' ');
+    // Witness version 0
+    address.resize(bech32::EncodeWitnessProgram(&address[0], prefix, 0, in.data(), in.size()));
+    return address;
 }
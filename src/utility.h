@@ -35,17 +35,37 @@ namespace VtcBlockIndexer {
              * 
              * @param input the value to hash
              */
-            static vector<unsigned char> sha256(vector<unsigned char> input);
-            static string hashToHex(vector<unsigned char> hash);
-            static string hashToReverseHex(vector<unsigned char> hash);
+            static vector<unsigned char> sha256(const vector<unsigned char>& input);
+
+            /** Calculates the double SHA-256 hash used for block and transaction ids */
+            static vector<unsigned char> sha256d(const unsigned char* data, size_t length);
+            static string hashToHex(const vector<unsigned char>& hash);
+            static string hashToReverseHex(const vector<unsigned char>& hash);
             static vector<unsigned char> decompressPubKey(vector<unsigned char> compressedKey);
             static string publicKeyToAddress(vector<unsigned char> publicKey);
             static vector<unsigned char> ripeMD160(vector<unsigned char> in);
-            static string base58(vector<unsigned char> in);
+            static string base58(const vector<unsigned char>& in);
             static string ripeMD160ToP2PKAddress(vector<unsigned char> ripeMD);
             static string ripeMD160ToP2SHAddress(vector<unsigned char> ripeMD);
-            static string bech32Address(vector<unsigned char> in);
-            static vector<unsigned char> hexToBytes(string hex);
+            static string bech32Address(const vector<unsigned char>& in);
+            static vector<unsigned char> hexToBytes(const string& hex);
+
+            /** Writes 2 * length lowercase hex characters to out. With reverse set
+             * the bytes are written last to first, as hashes are shown on block
+             * explorers.
+             */
+            static void bytesToHex(const unsigned char* in, size_t length, char* out, bool reverse);
+
+            /** Decodes length / 2 bytes of hex into out. Returns false if one of
+             * the characters is not a hex digit.
+             */
+            static bool hexToBytes(const char* hex, size_t length, unsigned char* out);
+
+            /** Base58 encodes length bytes into out, which needs room for
+             * length * 138 / 100 + 1 characters. Returns the number of characters
+             * written.
+             */
+            static size_t base58(const unsigned char* in, size_t length, char* out);
             ~Utility();
             
         private:
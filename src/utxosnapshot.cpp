@@ -0,0 +1,379 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "utxosnapshot.h"
+#include "coinreader.h"
+#include "coinparams.h"
+#include "scriptsolver.h"
+#include "utility.h"
+#include "leveldb/write_batch.h"
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+    const unsigned char SNAPSHOT_MAGIC[5] = { 'u', 't', 'x', 'o', 0xff };
+    const uint16_t SNAPSHOT_VERSION = 2;
+
+    // An output never takes more than this in the file: the outpoint, the
+    // height, the amount and a script of at most 10000 bytes
+    const size_t MAX_COIN_SIZE = 11000;
+
+    // and never less than this: the output index, the height, the amount
+    // and the script type
+    const uint64_t MIN_COIN_SIZE = 4;
+
+    const size_t BUFFER_SIZE = 16 * 1024 * 1024;
+    const uint64_t COINS_PER_CHUNK = 50000;
+}
+
+VtcBlockIndexer::UtxoSnapshot::UtxoSnapshot(const shared_ptr<leveldb::DB> db) {
+    this->db = db;
+    this->coinsCount = 0;
+    this->groupedByTransaction = false;
+    this->groupCoinsLeft = 0;
+    this->bufferStart = 0;
+    this->bufferEnd = 0;
+}
+
+bool VtcBlockIndexer::UtxoSnapshot::isImported() {
+    string snapshotHeight;
+    return this->db->Get(leveldb::ReadOptions(), "snapshot-height", &snapshotHeight).ok();
+}
+
+bool VtcBlockIndexer::UtxoSnapshot::isUnfinished() {
+    string snapshotBlockHash;
+    return this->db->Get(leveldb::ReadOptions(), "snapshot-blockhash", &snapshotBlockHash).ok() && !isImported();
+}
+
+void VtcBlockIndexer::UtxoSnapshot::fill(size_t length) {
+    if(bufferEnd - bufferStart >= length) {
+        return;
+    }
+    if(buffer.size() < BUFFER_SIZE) {
+        buffer.resize(BUFFER_SIZE);
+    }
+    memmove(buffer.data(), buffer.data() + bufferStart, bufferEnd - bufferStart);
+    bufferEnd -= bufferStart;
+    bufferStart = 0;
+    while(bufferEnd < length && file.good()) {
+        file.read(reinterpret_cast<char *>(buffer.data() + bufferEnd), buffer.size() - bufferEnd);
+        bufferEnd += file.gcount();
+    }
+}
+
+bool VtcBlockIndexer::UtxoSnapshot::open(const string& path) {
+    file.open(path, ios_base::in | ios_base::binary);
+    if(!file.is_open()) {
+        cerr << "UTXO snapshot [" << path << "] could not be opened" << endl;
+        return false;
+    }
+
+    file.seekg(0, ios_base::end);
+    const uint64_t fileSize = (uint64_t)file.tellg();
+    file.seekg(0, ios_base::beg);
+
+    fill(MAX_COIN_SIZE);
+    VtcBlockIndexer::CoinReader reader(buffer.data() + bufferStart, bufferEnd - bufferStart);
+    groupedByTransaction = (bufferEnd - bufferStart >= sizeof(SNAPSHOT_MAGIC) && memcmp(buffer.data() + bufferStart, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0);
+    if(groupedByTransaction) {
+        reader.readBytes(sizeof(SNAPSHOT_MAGIC));
+        const uint64_t version = reader.readInteger(2);
+        const unsigned char* networkMagic = reader.readBytes(4);
+        if(version != SNAPSHOT_VERSION) {
+            cerr << "UTXO snapshot [" << path << "] has unsupported version " << version << endl;
+            return false;
+        }
+        if(networkMagic == nullptr || !equal(networkMagic, networkMagic + 4, VtcBlockIndexer::CoinParams::magic.begin())) {
+            cerr << "UTXO snapshot [" << path << "] is for a different network" << endl;
+            return false;
+        }
+    }
+
+    const unsigned char* hash = reader.readBytes(32);
+    coinsCount = reader.readInteger(8);
+    if(!reader.ok()) {
+        cerr << "UTXO snapshot [" << path << "] is too short" << endl;
+        return false;
+    }
+    // The count sizes the import, so it has to fit in the rest of the file
+    if(coinsCount > (fileSize - reader.position()) / MIN_COIN_SIZE) {
+        cerr << "UTXO snapshot [" << path << "] claims " << coinsCount << " unspent outputs, more than fit in the file" << endl;
+        return false;
+    }
+    baseBlockHash = VtcBlockIndexer::Utility::hashToReverseHex(vector<unsigned char>(hash, hash + 32));
+    bufferStart += reader.position();
+    return true;
+}
+
+string VtcBlockIndexer::UtxoSnapshot::getBaseBlockHash() {
+    return baseBlockHash;
+}
+
+uint64_t VtcBlockIndexer::UtxoSnapshot::getCoinsCount() {
+    return coinsCount;
+}
+
+bool VtcBlockIndexer::UtxoSnapshot::readChunk(Chunk& chunk, uint64_t count) {
+    char txHash[64];
+    chunk.coins.resize(count);
+    for(uint64_t i = 0; i < count; i++) {
+        fill(MAX_COIN_SIZE);
+        VtcBlockIndexer::CoinReader reader(buffer.data() + bufferStart, bufferEnd - bufferStart);
+        SnapshotCoin& coin = chunk.coins[i];
+
+        if(groupedByTransaction) {
+            // The txid and the number of outputs start each transaction
+            if(groupCoinsLeft == 0) {
+                const unsigned char* hash = reader.readBytes(32);
+                groupCoinsLeft = reader.readCompactSize();
+                if(hash == nullptr || groupCoinsLeft == 0) {
+                    return false;
+                }
+                VtcBlockIndexer::Utility::bytesToHex(hash, 32, txHash, true);
+                groupTxHash.assign(txHash, 64);
+            }
+            coin.output.txHash = groupTxHash;
+            coin.output.index = (uint32_t)reader.readCompactSize();
+            groupCoinsLeft--;
+        } else {
+            const unsigned char* hash = reader.readBytes(32);
+            if(hash == nullptr) {
+                return false;
+            }
+            VtcBlockIndexer::Utility::bytesToHex(hash, 32, txHash, true);
+            coin.output.txHash.assign(txHash, 64);
+            coin.output.index = (uint32_t)reader.readInteger(4);
+        }
+
+        if(!reader.readCoin(coin.output, coin.height, false)) {
+            return false;
+        }
+        bufferStart += reader.position();
+    }
+    return true;
+}
+
+void VtcBlockIndexer::UtxoSnapshot::writeChunk(const Chunk& chunk, unordered_map<string, uint32_t>& txoCounts) {
+    // The same records the BlockIndexer writes for an output, without the
+    // per block lists used to undo a block in a reorg
+    leveldb::WriteBatch batch;
+    for(size_t i = 0; i < chunk.coins.size(); i++) {
+        const VtcBlockIndexer::TransactionOutput& out = chunk.coins[i].output;
+        const vector<string>& addresses = chunk.addresses[i];
+
+        if(chunk.requiredSignatures[i] > 0) {
+            stringstream txoMultiSigKey;
+            txoMultiSigKey << "multisigtx-" << out.txHash << "-" << setw(8) << setfill('0') << out.index;
+            batch.Put(txoMultiSigKey.str(), std::to_string(chunk.requiredSignatures[i]));
+        }
+
+        for(size_t j = 0; j < addresses.size(); j++) {
+            stringstream txoKey;
+            txoKey << addresses[j] << "-txo-" << setw(8) << setfill('0') << ++txoCounts[addresses[j]];
+            stringstream txoValue;
+            txoValue << out.txHash << setw(8) << setfill('0') << out.index << setw(8) << setfill('0') << chunk.coins[i].height << out.value;
+            batch.Put(txoKey.str(), txoValue.str());
+
+            stringstream txoAddressKey;
+            txoAddressKey << out.txHash << setw(8) << setfill('0') << out.index << "-address-" << setw(8) << setfill('0') << (j + 1);
+            batch.Put(txoAddressKey.str(), addresses[j]);
+        }
+
+        stringstream txoValueKey;
+        txoValueKey << out.txHash << setw(8) << setfill('0') << out.index << "-value";
+        batch.Put(txoValueKey.str(), std::to_string(out.value));
+    }
+    this->db->Write(leveldb::WriteOptions(), &batch);
+}
+
+void VtcBlockIndexer::UtxoSnapshot::writeBlockTimes(const vector<ScannedBlock>& chain) {
+    leveldb::WriteBatch batch;
+    for(size_t height = 0; height < chain.size(); height++) {
+        stringstream blockHeight;
+        blockHeight << setw(8) << setfill('0') << height;
+        batch.Put("block-hash-" + chain[height].blockHash, blockHeight.str());
+        batch.Put("block-time-" + blockHeight.str(), std::to_string(chain[height].time));
+
+        if((height + 1) % 10000 == 0) {
+            this->db->Write(leveldb::WriteOptions(), &batch);
+            batch.Clear();
+        }
+    }
+    this->db->Write(leveldb::WriteOptions(), &batch);
+}
+
+bool VtcBlockIndexer::UtxoSnapshot::import(const vector<ScannedBlock>& chain) {
+    if(chain.empty() || chain.back().blockHash != baseBlockHash) {
+        cerr << "The chain does not end at the base block of the UTXO snapshot" << endl;
+        return false;
+    }
+    const int baseHeight = (int)chain.size() - 1;
+
+    string existing;
+    if(this->db->Get(leveldb::ReadOptions(), "snapshot-blockhash", &existing).ok()) {
+        cerr << "A previous UTXO snapshot import did not finish, start again with an empty index" << endl;
+        return false;
+    }
+    if(this->db->Get(leveldb::ReadOptions(), "highestblock", &existing).ok()) {
+        cerr << "A UTXO snapshot can only be imported into an empty index" << endl;
+        return false;
+    }
+    this->db->Put(leveldb::WriteOptions(), "snapshot-blockhash", baseBlockHash);
+
+    cout << "Importing " << coinsCount << " unspent outputs at block " << baseBlockHash << " (height " << baseHeight << ")" << endl;
+
+    const size_t chunkCount = (coinsCount + COINS_PER_CHUNK - 1) / COINS_PER_CHUNK;
+    const size_t workerCount = max(std::thread::hardware_concurrency(), 1u);
+    const size_t window = workerCount * 4;
+    // Chunk index lives in slot index % window, which the writer has emptied
+    // before the reader gets that far ahead
+    vector<unique_ptr<Chunk>> chunks(window);
+    mutex chunkMutex;
+    condition_variable changed;
+    size_t chunksRead = 0;
+    size_t nextToProcess = 0;
+    size_t written = 0;
+    bool readDone = false;
+    bool readFailed = false;
+
+    // One thread reads the file, up to a window of chunks ahead of the writer
+    thread readerThread([&]() {
+        for(size_t index = 0; index < chunkCount; index++) {
+            {
+                unique_lock<mutex> lock(chunkMutex);
+                changed.wait(lock, [&]() { return index < written + window; });
+            }
+            unique_ptr<Chunk> chunk(new Chunk());
+            if(!readChunk(*chunk, min(COINS_PER_CHUNK, coinsCount - index * COINS_PER_CHUNK))) {
+                lock_guard<mutex> lock(chunkMutex);
+                readFailed = true;
+                break;
+            }
+            {
+                lock_guard<mutex> lock(chunkMutex);
+                chunks[index % window] = move(chunk);
+                chunksRead = index + 1;
+            }
+            changed.notify_all();
+        }
+        {
+            lock_guard<mutex> lock(chunkMutex);
+            readDone = true;
+        }
+        changed.notify_all();
+    });
+
+    // The workers find the addresses of the outputs
+    vector<thread> workers;
+    for(size_t i = 0; i < workerCount; i++) {
+        workers.push_back(thread([&]() {
+            VtcBlockIndexer::ScriptSolver scriptSolver;
+            while(true) {
+                Chunk* chunk;
+                {
+                    unique_lock<mutex> lock(chunkMutex);
+                    changed.wait(lock, [&]() { return nextToProcess < chunksRead || readDone; });
+                    if(nextToProcess >= chunksRead) {
+                        return;
+                    }
+                    chunk = chunks[nextToProcess++ % window].get();
+                }
+
+                chunk->addresses.resize(chunk->coins.size());
+                chunk->requiredSignatures.resize(chunk->coins.size());
+                for(size_t j = 0; j < chunk->coins.size(); j++) {
+                    const vector<unsigned char>& script = chunk->coins[j].output.script;
+                    const VtcBlockIndexer::ScriptClassification scriptClass = scriptSolver.classify(script.data(), script.size());
+                    chunk->addresses[j] = scriptSolver.getAddressesFromScript(script.data(), script.size(), scriptClass);
+                    chunk->requiredSignatures[j] = (chunk->addresses[j].size() > 1 && scriptClass.type == SCRIPT_TYPE_MULTISIG) ? scriptSolver.requiredSignatures(script) : 0;
+                }
+                {
+                    lock_guard<mutex> lock(chunkMutex);
+                    chunk->processed = true;
+                }
+                changed.notify_all();
+            }
+        }));
+    }
+
+    // This thread writes the chunks in order
+    unordered_map<string, uint32_t> txoCounts;
+    time_t start = time(NULL);
+    double nextUpdate = 10;
+    bool failed = false;
+    for(size_t index = 0; index < chunkCount; index++) {
+        unique_ptr<Chunk> chunk;
+        {
+            unique_lock<mutex> lock(chunkMutex);
+            unique_ptr<Chunk>& slot = chunks[index % window];
+            changed.wait(lock, [&]() { return (slot != nullptr && slot->processed) || (readFailed && index >= chunksRead); });
+            if(slot == nullptr) {
+                failed = true;
+                break;
+            }
+            chunk = move(slot);
+        }
+        writeChunk(*chunk, txoCounts);
+        {
+            lock_guard<mutex> lock(chunkMutex);
+            written = index + 1;
+        }
+        changed.notify_all();
+
+        if(difftime(time(NULL), start) >= nextUpdate) {
+            nextUpdate += 10;
+            cout << "Imported " << min(written * COINS_PER_CHUNK, coinsCount) << " of " << coinsCount << " unspent outputs" << endl;
+        }
+    }
+
+    readerThread.join();
+    for(thread& worker : workers) {
+        worker.join();
+    }
+
+    // All outputs must be read, and nothing may follow them
+    fill(1);
+    if(failed || readFailed || groupCoinsLeft != 0 || bufferEnd != bufferStart) {
+        cerr << "UTXO snapshot is malformed, start again with an empty index" << endl;
+        return false;
+    }
+
+    writeBlockTimes(chain);
+
+    stringstream height;
+    height << setw(8) << setfill('0') << baseHeight;
+    leveldb::WriteBatch batch;
+    batch.Put("snapshot-height", height.str());
+    batch.Put("snapshot-backfill-next", "00000000");
+    batch.Put("highestblock", height.str());
+    this->db->Write(leveldb::WriteOptions(), &batch);
+
+    cout << "Imported " << coinsCount << " unspent outputs for " << txoCounts.size() << " addresses in " << difftime(time(NULL), start) << " seconds" << endl;
+    return true;
+}
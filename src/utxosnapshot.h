@@ -0,0 +1,142 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef UTXOSNAPSHOT_H_INCLUDED
+#define UTXOSNAPSHOT_H_INCLUDED
+
+#include <stdint.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "leveldb/db.h"
+#include "blockchaintypes.h"
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+/**
+ * The UtxoSnapshot class loads the unspent outputs in a snapshot written by
+ * the node's dumptxoutset command into the index, as the TXOs of their
+ * addresses. Balances are then served as of the block the snapshot was taken
+ * at, without indexing the history leading up to it first. The indexer
+ * continues from that block, and can fill in the history before it later
+ * (see BlockFileWatcher).
+ *
+ * Both the format of Core 28 and later, which starts with "utxo\xff" and
+ * groups the outputs by transaction, and the earlier format with a full
+ * outpoint in front of every output are read. The file is read in chunks of
+ * outputs, a pool of workers finds the addresses of the outputs in each chunk,
+ * and the chunks are written to the index in the order of the file.
+ *
+ * The import writes snapshot-blockhash when it starts, and snapshot-height,
+ * snapshot-backfill-next and highestblock when it is done. An index with only
+ * snapshot-blockhash is left by an import that failed, and must be removed.
+ */
+
+class UtxoSnapshot {
+public:
+    /** Constructs a UtxoSnapshot instance writing to the given index */
+    UtxoSnapshot(const shared_ptr<leveldb::DB> db);
+
+    /** Returns true when a snapshot was imported into the index before */
+    bool isImported();
+
+    /** Returns true when an import into the index was started but did not
+     * finish, which leaves only part of the outputs in it
+     */
+    bool isUnfinished();
+
+    /** Opens a snapshot and reads its header. Returns false if the file could
+     * not be opened or is not a snapshot for this coin.
+     */
+    bool open(const string& path);
+
+    /** Hash of the block the snapshot was taken at */
+    string getBaseBlockHash();
+
+    /** Number of unspent outputs in the snapshot */
+    uint64_t getCoinsCount();
+
+    /** Writes the unspent outputs to the index, as of the base block at the
+     * end of the given chain, and the height and time of the blocks in the
+     * chain. Needs an empty index. Returns false if that is not the case or
+     * the snapshot is malformed.
+     */
+    bool import(const vector<ScannedBlock>& chain);
+
+private:
+    struct SnapshotCoin {
+        TransactionOutput output;
+        uint32_t height;
+    };
+
+    struct Chunk {
+        vector<SnapshotCoin> coins;
+
+        // Filled in by the workers: the addresses of each output, and the
+        // required number of signatures for multisig outputs (0 otherwise)
+        vector<vector<string>> addresses;
+        vector<int> requiredSignatures;
+        bool processed = false;
+    };
+
+    /** Reads the next count outputs into the chunk */
+    bool readChunk(Chunk& chunk, uint64_t count);
+
+    /** Reads from the file until the buffer holds at least length unread
+     * bytes, or the file ends
+     */
+    void fill(size_t length);
+
+    /** Writes the outputs of a processed chunk to the index. txoCounts holds
+     * the number of TXOs written per address so far.
+     */
+    void writeChunk(const Chunk& chunk, unordered_map<string, uint32_t>& txoCounts);
+
+    /** Writes block-hash- and block-time- for the blocks up to the base block,
+     * which the outputs refer to by height. The other block records, among
+     * which block-<height> that marks a block as indexed, are written when
+     * the history is backfilled.
+     */
+    void writeBlockTimes(const vector<ScannedBlock>& chain);
+
+    shared_ptr<leveldb::DB> db;
+    ifstream file;
+
+    string baseBlockHash;
+    uint64_t coinsCount;
+
+    // Core 28 and later write the txid once for all outputs of a transaction
+    bool groupedByTransaction;
+    string groupTxHash;
+    uint64_t groupCoinsLeft;
+
+    vector<unsigned char> buffer;
+    size_t bufferStart;
+    size_t bufferEnd;
+};
+
+}
+
+#endif // UTXOSNAPSHOT_H_INCLUDED
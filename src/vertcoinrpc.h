@@ -2,8 +2,11 @@
 #define VERTCOINRPC_INCLUDED_
 
 #include <iostream>
+#include <map>
+#include <vector>
 
 #include <jsonrpccpp/client.h>
+#include "metrics.h"
 
 namespace VtcBlockIndexer {
     class VertcoinClient : public jsonrpc::Client {
@@ -11,14 +14,47 @@ namespace VtcBlockIndexer {
             VertcoinClient(jsonrpc::IClientConnector &conn,
                            jsonrpc::clientVersion_t type 
                            = jsonrpc::JSONRPC_CLIENT_V1) : 
-                           jsonrpc::Client(conn, type) {}
+                           jsonrpc::Client(conn, type) {
+                callLatencies();
+            }
+
+            /** Returns the latency histograms of the RPC methods. They are looked up
+             * in the registry once, when the first client is constructed, so calls
+             * do not take the registry lock.
+             */
+            static const std::map<std::string, VtcBlockIndexer::MetricHistogram*>& callLatencies() {
+                static const std::map<std::string, VtcBlockIndexer::MetricHistogram*> histograms = []() {
+                    std::map<std::string, VtcBlockIndexer::MetricHistogram*> histograms;
+                    for(const std::string& method : { "getblock", "getblockcount", "getblockhash", "getrawmempool", "getrawtransaction", "getrawtransaction_batch", "sendrawtransaction" }) {
+                        histograms[method] = &VtcBlockIndexer::Metrics::histogram("rpc_call_seconds", "Latency of JSON-RPC calls to the coin daemon", VtcBlockIndexer::Metrics::latencyBuckets(), VtcBlockIndexer::Metrics::label("method", method));
+                    }
+                    return histograms;
+                }();
+                return histograms;
+            }
+
+            /** Returns the latency histogram of an RPC method */
+            static VtcBlockIndexer::MetricHistogram& callLatency(const std::string& method) {
+                const std::map<std::string, VtcBlockIndexer::MetricHistogram*>& histograms = callLatencies();
+                const auto histogram = histograms.find(method);
+                if(histogram != histograms.end()) {
+                    return *histogram->second;
+                }
+                return VtcBlockIndexer::Metrics::histogram("rpc_call_seconds", "Latency of JSON-RPC calls to the coin daemon", VtcBlockIndexer::Metrics::latencyBuckets(), VtcBlockIndexer::Metrics::label("method", method));
+            }
+
+            /** Calls the RPC method and records its latency */
+            Json::Value timedCall(const std::string& method, const Json::Value& params) {
+                VtcBlockIndexer::ScopedTimer timer(callLatency(method));
+                return this->CallMethod(method, params);
+            }
                                      
             Json::Value getrawtransaction(const std::string& id, const bool verbose) 
             throw (jsonrpc::JsonRpcException) {
                 Json::Value p;
                 p.append(id);
                 p.append(verbose);
-                const Json::Value result = this->CallMethod("getrawtransaction", p);
+                const Json::Value result = this->timedCall("getrawtransaction", p);
                 if((result.isObject() && verbose) || (result.isString() && !verbose)) {
                     return result;
                 } else {
@@ -27,10 +63,36 @@ namespace VtcBlockIndexer {
                 }
             }
 
+            /** Fetches many raw transactions in a single batch request. Returns one
+             * hex string per id, in the same order, or a null value for ids the
+             * node does not know.
+             */
+            std::vector<Json::Value> getrawtransactions(const std::vector<std::string>& ids)
+            throw (jsonrpc::JsonRpcException) {
+                jsonrpc::BatchCall batch;
+                std::vector<int> callIds;
+                for(const std::string& id : ids) {
+                    Json::Value p;
+                    p.append(id);
+                    p.append(false);
+                    callIds.push_back(batch.addCall("getrawtransaction", p));
+                }
+
+                VtcBlockIndexer::ScopedTimer timer(callLatency("getrawtransaction_batch"));
+                jsonrpc::BatchResponse response = this->CallProcedures(batch);
+
+                std::vector<Json::Value> results;
+                for(int callId : callIds) {
+                    const Json::Value result = response.getResult(callId);
+                    results.push_back(result.isString() ? result : Json::Value());
+                }
+                return results;
+            }
+
             Json::Value getrawmempool() 
             throw (jsonrpc::JsonRpcException) {
                 Json::Value p;
-                const Json::Value result = this->CallMethod("getrawmempool", p);
+                const Json::Value result = this->timedCall("getrawmempool", p);
                 if(result.isArray()) {
                     return result;
                 } else {
@@ -42,7 +104,7 @@ namespace VtcBlockIndexer {
             Json::Value getblockcount() 
             throw (jsonrpc::JsonRpcException) {
                 Json::Value p;
-                const Json::Value result = this->CallMethod("getblockcount", p);
+                const Json::Value result = this->timedCall("getblockcount", p);
                 if(result.isNumeric()) {
                     return result;
                 } else {
@@ -55,7 +117,7 @@ namespace VtcBlockIndexer {
             throw (jsonrpc::JsonRpcException) {
                 Json::Value p;
                 p.append(rawTx);
-                const Json::Value result = this->CallMethod("sendrawtransaction", p);
+                const Json::Value result = this->timedCall("sendrawtransaction", p);
                 if(result.isString()) {
                     return result.asString();
                 } else {
@@ -69,7 +131,7 @@ namespace VtcBlockIndexer {
                 Json::Value p;
                 p.append(id);
                 p.append(verbose);
-                const Json::Value result = this->CallMethod("getblock", p);
+                const Json::Value result = this->timedCall("getblock", p);
                 if((result.isObject() && verbose) || (result.isString() && !verbose)) {
                     return result;
                 } else {
@@ -82,7 +144,7 @@ namespace VtcBlockIndexer {
             throw (jsonrpc::JsonRpcException) {
                 Json::Value p;
                 p.append(height);
-                const Json::Value result = this->CallMethod("getblockhash", p);
+                const Json::Value result = this->timedCall("getblockhash", p);
                 if(result.isString()) {
                     return result.asString();
                 } else {
@@ -0,0 +1,109 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "zmqsubscriber.h"
+#include <zmq.h>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    string zmqError(const string& operation) {
+        return operation + " failed: " + zmq_strerror(zmq_errno());
+    }
+}
+
+VtcBlockIndexer::ZmqSubscriber::ZmqSubscriber(const string& endpoint, const vector<string>& topics) {
+    context = zmq_ctx_new();
+    socket = zmq_socket(context, ZMQ_SUB);
+    if(socket == NULL) {
+        zmq_ctx_term(context);
+        throw runtime_error(zmqError("zmq_socket"));
+    }
+
+    // The node drops messages when our queue is full, keep it large enough to
+    // absorb a burst of transactions while the mempool lock is held
+    int highWaterMark = 100000;
+    int keepAlive = 1;
+    int linger = 0;
+    zmq_setsockopt(socket, ZMQ_RCVHWM, &highWaterMark, sizeof(highWaterMark));
+    zmq_setsockopt(socket, ZMQ_TCP_KEEPALIVE, &keepAlive, sizeof(keepAlive));
+    zmq_setsockopt(socket, ZMQ_LINGER, &linger, sizeof(linger));
+
+    for(const string& topic : topics) {
+        zmq_setsockopt(socket, ZMQ_SUBSCRIBE, topic.data(), topic.size());
+    }
+
+    if(zmq_connect(socket, endpoint.c_str()) != 0) {
+        string message = zmqError("zmq_connect to " + endpoint);
+        zmq_close(socket);
+        zmq_ctx_term(context);
+        throw runtime_error(message);
+    }
+}
+
+VtcBlockIndexer::ZmqSubscriber::~ZmqSubscriber() {
+    zmq_close(socket);
+    zmq_ctx_term(context);
+}
+
+bool VtcBlockIndexer::ZmqSubscriber::receive(ZmqNotification& notification, int timeoutMs) {
+    zmq_pollitem_t item;
+    item.socket = socket;
+    item.fd = 0;
+    item.events = ZMQ_POLLIN;
+    item.revents = 0;
+    int ready = zmq_poll(&item, 1, timeoutMs);
+    if(ready < 0) {
+        throw runtime_error(zmqError("zmq_poll"));
+    }
+    if(ready == 0) {
+        return false;
+    }
+
+    vector<string> parts;
+    bool more = true;
+    while(more) {
+        zmq_msg_t part;
+        zmq_msg_init(&part);
+        if(zmq_msg_recv(&part, socket, 0) < 0) {
+            zmq_msg_close(&part);
+            throw runtime_error(zmqError("zmq_msg_recv"));
+        }
+        parts.push_back(string((const char*)zmq_msg_data(&part), zmq_msg_size(&part)));
+        more = zmq_msg_more(&part) != 0;
+        zmq_msg_close(&part);
+    }
+
+    if(parts.size() != 3 || parts[2].size() != 4) {
+        throw runtime_error("Malformed ZMQ notification with " + to_string(parts.size()) + " parts");
+    }
+
+    notification.topic = parts[0];
+    notification.body = parts[1];
+    const unsigned char* sequenceBytes = (const unsigned char*)parts[2].data();
+    notification.sequence = (uint32_t)sequenceBytes[0] | ((uint32_t)sequenceBytes[1] << 8) |
+                            ((uint32_t)sequenceBytes[2] << 16) | ((uint32_t)sequenceBytes[3] << 24);
+
+    auto last = lastSequence.find(notification.topic);
+    notification.gap = (last != lastSequence.end() && notification.sequence != last->second + 1);
+    lastSequence[notification.topic] = notification.sequence;
+    return true;
+}
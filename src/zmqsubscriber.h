@@ -0,0 +1,78 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ZMQSUBSCRIBER_H_INCLUDED
+#define ZMQSUBSCRIBER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+using namespace std;
+
+namespace VtcBlockIndexer {
+
+/** A single notification published by the node */
+struct ZmqNotification {
+    string topic;
+    string body;
+
+    // Per-topic message counter set by the publisher
+    uint32_t sequence;
+
+    // True when messages on this topic were lost before this one
+    bool gap;
+};
+
+/**
+ * The ZmqSubscriber class receives notifications published by the node over
+ * ZeroMQ (started with -zmqpubrawtx=..., -zmqpubsequence=...). Every message
+ * has three parts: the topic, the body and a little-endian message counter,
+ * which is used to detect messages that were dropped.
+ */
+
+class ZmqSubscriber {
+public:
+    /** Connects to the endpoint and subscribes to the given topics. Throws
+     * a runtime_error when the socket cannot be set up.
+     */
+    ZmqSubscriber(const string& endpoint, const vector<string>& topics);
+
+    /** Closes the socket */
+    ~ZmqSubscriber();
+
+    /** Waits up to timeoutMs for a notification. Returns false when nothing
+     * arrived in time. Throws a runtime_error when receiving fails.
+     */
+    bool receive(ZmqNotification& notification, int timeoutMs);
+
+private:
+    ZmqSubscriber(const ZmqSubscriber&);
+    ZmqSubscriber& operator=(const ZmqSubscriber&);
+
+    void* context;
+    void* socket;
+    unordered_map<string, uint32_t> lastSequence;
+};
+
+}
+
+#endif // ZMQSUBSCRIBER_H_INCLUDED
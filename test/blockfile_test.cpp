@@ -0,0 +1,136 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "blockfile.h"
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * Reads an obfuscated file through a BlockFile and the same file without the
+ * obfuscation through an ifstream, with the same random sequence of reads and
+ * seeks, and checks that both streams return the same bytes and states.
+ */
+
+namespace
+{
+    void writeFile(const string& path, const vector<unsigned char>& data) {
+        ofstream file(path, ios::binary);
+        file.write((const char*)data.data(), data.size());
+    }
+}
+
+int main() {
+    const string dir = "/tmp/vtc_indexer_blockfile_test_" + to_string(getpid());
+    mkdir(dir.c_str(), 0700);
+    const string plainPath = dir + "/plain.dat";
+    const string obfuscatedPath = dir + "/blk00000.dat";
+    const string keyPath = dir + "/xor.dat";
+
+    // Random contents, obfuscated with a random 8 byte key like the node writes
+    mt19937_64 random(1);
+    vector<unsigned char> plain(3 * 1024 * 1024 + 12345);
+    for(unsigned char& byte : plain) {
+        byte = (unsigned char)random();
+    }
+    vector<unsigned char> key(8);
+    for(unsigned char& byte : key) {
+        byte = (unsigned char)random();
+    }
+    vector<unsigned char> obfuscated = plain;
+    for(size_t i = 0; i < obfuscated.size(); i++) {
+        obfuscated[i] ^= key[i % key.size()];
+    }
+    writeFile(plainPath, plain);
+    writeFile(obfuscatedPath, obfuscated);
+    writeFile(keyPath, key);
+
+    CHECK(VtcBlockIndexer::BlockFile::readObfuscationKey(dir));
+
+    ifstream expected(plainPath, ios::binary);
+    VtcBlockIndexer::BlockFile actual(obfuscatedPath);
+    CHECK(actual.is_open());
+
+    vector<char> expectedBytes;
+    vector<char> actualBytes;
+    for(int round = 0; round < 20000; round++) {
+        const int operation = random() % 5;
+        if(operation == 0) {
+            // Mostly small reads, some larger than the buffer
+            const size_t length = random() % (random() % 4 == 0 ? 200000 : 100);
+            expectedBytes.assign(length, 0);
+            actualBytes.assign(length, 1);
+            expected.read(expectedBytes.data(), length);
+            actual.read(actualBytes.data(), length);
+            CHECK_EQUAL(actual.gcount(), expected.gcount());
+            CHECK(memcmp(actualBytes.data(), expectedBytes.data(), expected.gcount()) == 0);
+            CHECK_EQUAL(actual.eof(), expected.eof());
+            CHECK_EQUAL(actual.fail(), expected.fail());
+        } else if(operation == 1) {
+            const uint64_t position = random() % (plain.size() + 10);
+            expected.clear();
+            actual.clear();
+            expected.seekg(position, ios_base::beg);
+            actual.seekg(position, ios_base::beg);
+        } else if(operation == 2) {
+            const long offset = (long)(random() % 4000) - 1000;
+            expected.seekg(offset, ios_base::cur);
+            actual.seekg(offset, ios_base::cur);
+            CHECK_EQUAL(actual.fail(), expected.fail());
+            expected.clear();
+            actual.clear();
+        } else if(operation == 3) {
+            CHECK_EQUAL((long)actual.tellg(), (long)expected.tellg());
+        } else {
+            const long offset = -(long)(random() % 100);
+            expected.clear();
+            actual.clear();
+            expected.seekg(offset, ios_base::end);
+            actual.seekg(offset, ios_base::end);
+            CHECK_EQUAL((long)actual.tellg(), (long)expected.tellg());
+        }
+    }
+    actual.close();
+
+    // Data read elsewhere from a block file is deobfuscated by position
+    vector<unsigned char> part(obfuscated.begin() + 1001, obfuscated.begin() + 2001);
+    VtcBlockIndexer::BlockFile::deobfuscate(part.data(), part.size(), 1001);
+    CHECK(equal(part.begin(), part.end(), plain.begin() + 1001));
+
+    // A key of zeros leaves the files as they are
+    writeFile(keyPath, vector<unsigned char>(8, 0));
+    CHECK(!VtcBlockIndexer::BlockFile::readObfuscationKey(dir));
+    VtcBlockIndexer::BlockFile unobfuscated(plainPath);
+    vector<unsigned char> head(64);
+    unobfuscated.read((char*)head.data(), head.size());
+    CHECK(equal(head.begin(), head.end(), plain.begin()));
+
+    unlink(plainPath.c_str());
+    unlink(obfuscatedPath.c_str());
+    unlink(keyPath.c_str());
+    rmdir(dir.c_str());
+    return VtcBlockIndexerTest::result("blockfile_test");
+}
@@ -0,0 +1,88 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "blocks.h"
+#include "blockfilewatcher.h"
+#include "leveldb/db.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace VtcBlockIndexerTest;
+
+/**
+ * Indexes blocks whose undo data the node has not written yet, as happens
+ * when the watcher gets to a new block first. The chain is G-B1 in
+ * blk00000.dat, without a rev00000.dat. In B1 a transaction spends the
+ * coinbase of G, and a second one spends the output of the first, so one
+ * spent output comes from the index and the other from the block itself.
+ */
+
+int main() {
+    const string dir = "/tmp/vtc_indexer_blockindexer_test_" + to_string(getpid());
+    const string blocksDir = dir + "/blocks";
+    mkdir(dir.c_str(), 0700);
+    mkdir(blocksDir.c_str(), 0700);
+    VtcBlockIndexer::CoinParams::readFromFile("coins/vertcoin-testnet.json");
+
+    const Bytes coinbaseG = transaction({}, 5000000000ULL, 0x01);
+    const Bytes genesis = block(string(64, '0'), 1500000000, { coinbaseG });
+    const Bytes spendCoinbase = transaction({ { txHash(coinbaseG), 0 } }, 4000000000ULL, 0x03);
+    const Bytes spendInBlock = transaction({ { txHash(spendCoinbase), 0 } }, 3900000000ULL, 0x04);
+    const Bytes b1 = block(blockHash(genesis), 1500000100, { transaction({}, 5000000000ULL, 0x02), spendCoinbase, spendInBlock });
+    writeBlockFile(blocksDir + "/blk00000.dat", { genesis, b1 });
+
+    leveldb::DB* database;
+    leveldb::Options options;
+    options.create_if_missing = true;
+    CHECK(leveldb::DB::Open(options, dir + "/index", &database).ok());
+    shared_ptr<leveldb::DB> db(database);
+
+    {
+        VtcBlockIndexer::BlockFileWatcher watcher(blocksDir, "", db, nullptr, nullptr);
+        watcher.updateIndex();
+
+        string value;
+        CHECK(db->Get(leveldb::ReadOptions(), "block-00000001", &value).ok() && value == blockHash(b1));
+
+        const string addressG = VtcBlockIndexer::Utility::ripeMD160ToP2PKAddress(vector<unsigned char>(20, 0x01));
+        const string addressSpend = VtcBlockIndexer::Utility::ripeMD160ToP2PKAddress(vector<unsigned char>(20, 0x03));
+        CHECK(db->Get(leveldb::ReadOptions(), "tx-" + txHash(spendCoinbase) + "-vin-00000000", &value).ok());
+        CHECK_EQUAL(value, "0000005000000000" + addressG);
+        CHECK(db->Get(leveldb::ReadOptions(), "tx-" + txHash(spendCoinbase) + "-fee", &value).ok());
+        CHECK_EQUAL(value, string("1000000000"));
+        CHECK(db->Get(leveldb::ReadOptions(), "tx-" + txHash(spendInBlock) + "-vin-00000000", &value).ok());
+        CHECK_EQUAL(value, "0000004000000000" + addressSpend);
+        CHECK(db->Get(leveldb::ReadOptions(), "tx-" + txHash(spendInBlock) + "-fee", &value).ok());
+        CHECK_EQUAL(value, string("100000000"));
+        CHECK(db->Get(leveldb::ReadOptions(), "block-fees-00000001", &value).ok());
+        CHECK_EQUAL(value, string("1100000000"));
+        CHECK(db->Get(leveldb::ReadOptions(), "block-fees-00000000", &value).ok());
+        CHECK_EQUAL(value, string("0"));
+    }
+
+    db.reset();
+    CHECK(system(("rm -rf " + dir).c_str()) == 0);
+    return VtcBlockIndexerTest::result("blockindexer_test");
+}
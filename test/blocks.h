@@ -0,0 +1,136 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TEST_BLOCKS_H_INCLUDED
+#define TEST_BLOCKS_H_INCLUDED
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "utility.h"
+#include "coinparams.h"
+
+/**
+ * Builds blocks and block files for the tests. The blocks are only as valid as
+ * the indexer needs them to be: their headers link up and their transactions
+ * parse, but the merkle roots, proof of work and signatures are left empty.
+ */
+
+namespace VtcBlockIndexerTest {
+    typedef std::vector<unsigned char> Bytes;
+
+    inline void appendInteger(Bytes& out, uint64_t value, int length) {
+        for(int i = 0; i < length; i++) {
+            out.push_back((unsigned char)(value >> (8 * i)));
+        }
+    }
+
+    /** Appends a hash given as the hex shown on block explorers, in the byte order of the files */
+    inline void appendHash(Bytes& out, const std::string& hash) {
+        Bytes bytes = VtcBlockIndexer::Utility::hexToBytes(hash);
+        out.insert(out.end(), bytes.rbegin(), bytes.rend());
+    }
+
+    /** Hash of a transaction or a block header, as shown on block explorers */
+    inline std::string hashOf(const Bytes& data, size_t length) {
+        return VtcBlockIndexer::Utility::hashToReverseHex(VtcBlockIndexer::Utility::sha256d(data.data(), length));
+    }
+
+    /** A transaction spending the given outpoints, or a coinbase when there
+     * are none, with one P2PKH output of the given value. The tag goes into
+     * the input scripts and the output, so transactions with the same inputs
+     * differ.
+     */
+    inline Bytes transaction(const std::vector<std::pair<std::string, uint32_t>>& outpoints, uint64_t value, unsigned char tag) {
+        Bytes tx;
+        appendInteger(tx, 1, 4);
+        if(outpoints.empty()) {
+            tx.push_back(1);
+            appendHash(tx, std::string(64, '0'));
+            appendInteger(tx, 0xFFFFFFFF, 4);
+            tx.push_back(2);
+            tx.push_back(0x01);
+            tx.push_back(tag);
+            appendInteger(tx, 0xFFFFFFFF, 4);
+        } else {
+            tx.push_back((unsigned char)outpoints.size());
+            for(const std::pair<std::string, uint32_t>& outpoint : outpoints) {
+                appendHash(tx, outpoint.first);
+                appendInteger(tx, outpoint.second, 4);
+                tx.push_back(2);
+                tx.push_back(0x01);
+                tx.push_back(tag);
+                appendInteger(tx, 0xFFFFFFFF, 4);
+            }
+        }
+        tx.push_back(1);
+        appendInteger(tx, value, 8);
+        tx.push_back(25);
+        tx.push_back(0x76);
+        tx.push_back(0xA9);
+        tx.push_back(0x14);
+        tx.insert(tx.end(), 20, tag);
+        tx.push_back(0x88);
+        tx.push_back(0xAC);
+        appendInteger(tx, 0, 4);
+        return tx;
+    }
+
+    inline std::string txHash(const Bytes& tx) {
+        return hashOf(tx, tx.size());
+    }
+
+    /** A block on top of the given previous block holding the transactions */
+    inline Bytes block(const std::string& previousBlockHash, uint32_t time, const std::vector<Bytes>& transactions) {
+        Bytes block;
+        appendInteger(block, 4, 4);
+        appendHash(block, previousBlockHash);
+        block.insert(block.end(), 32, 0);
+        appendInteger(block, time, 4);
+        appendInteger(block, 0x207FFFFF, 4);
+        appendInteger(block, 0, 4);
+        block.push_back((unsigned char)transactions.size());
+        for(const Bytes& tx : transactions) {
+            block.insert(block.end(), tx.begin(), tx.end());
+        }
+        return block;
+    }
+
+    inline std::string blockHash(const Bytes& block) {
+        return hashOf(block, 80);
+    }
+
+    /** Writes the blocks to a block file, each behind the magic and its size */
+    inline void writeBlockFile(const std::string& path, const std::vector<Bytes>& blocks) {
+        Bytes file;
+        for(const Bytes& block : blocks) {
+            file.insert(file.end(), VtcBlockIndexer::CoinParams::magic.begin(), VtcBlockIndexer::CoinParams::magic.end());
+            appendInteger(file, block.size(), 4);
+            file.insert(file.end(), block.begin(), block.end());
+        }
+        std::ofstream out(path, std::ios::binary);
+        out.write((const char*)file.data(), file.size());
+    }
+}
+
+#endif // TEST_BLOCKS_H_INCLUDED
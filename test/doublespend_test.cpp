@@ -0,0 +1,118 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "blocks.h"
+#include "blockfilewatcher.h"
+#include "leveldb/db.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace VtcBlockIndexerTest;
+
+/**
+ * Indexes a chain with an orphaned branch and checks the double spend events
+ * stored for the branch. The main chain is G-M1-M2-M3 in blk00000.dat, the
+ * orphaned branch G-O1-O2 in blk00001.dat. M1 and O1 spend the coinbase of G
+ * in different transactions, and O2 spends the coinbase of O1.
+ */
+
+int main() {
+    const string dir = "/tmp/vtc_indexer_doublespend_test_" + to_string(getpid());
+    const string blocksDir = dir + "/blocks";
+    mkdir(dir.c_str(), 0700);
+    mkdir(blocksDir.c_str(), 0700);
+    VtcBlockIndexer::CoinParams::readFromFile("coins/vertcoin-testnet.json");
+
+    const Bytes coinbaseG = transaction({}, 5000000000ULL, 0x01);
+    const Bytes genesis = block(string(64, '0'), 1500000000, { coinbaseG });
+
+    const Bytes coinbaseM1 = transaction({}, 5000000000ULL, 0x02);
+    const Bytes spendMain = transaction({ { txHash(coinbaseG), 0 } }, 4000000000ULL, 0x03);
+    const Bytes m1 = block(blockHash(genesis), 1500000100, { coinbaseM1, spendMain });
+    const Bytes m2 = block(blockHash(m1), 1500000200, { transaction({}, 5000000000ULL, 0x04) });
+    const Bytes m3 = block(blockHash(m2), 1500000300, { transaction({}, 5000000000ULL, 0x05) });
+
+    const Bytes coinbaseO1 = transaction({}, 5000000000ULL, 0x06);
+    const Bytes spendOrphan = transaction({ { txHash(coinbaseG), 0 } }, 4900000000ULL, 0x07);
+    const Bytes o1 = block(blockHash(genesis), 1500000110, { coinbaseO1, spendOrphan });
+    const Bytes spendCoinbase = transaction({ { txHash(coinbaseO1), 0 } }, 4000000000ULL, 0x08);
+    const Bytes o2 = block(blockHash(o1), 1500000210, { transaction({}, 5000000000ULL, 0x09), spendCoinbase });
+
+    writeBlockFile(blocksDir + "/blk00000.dat", { genesis, m1, m2, m3 });
+    writeBlockFile(blocksDir + "/blk00001.dat", { o1, o2 });
+
+    leveldb::DB* database;
+    leveldb::Options options;
+    options.create_if_missing = true;
+    CHECK(leveldb::DB::Open(options, dir + "/index", &database).ok());
+    shared_ptr<leveldb::DB> db(database);
+
+    {
+        VtcBlockIndexer::BlockFileWatcher watcher(blocksDir, "", db, nullptr, nullptr);
+        watcher.updateIndex();
+
+        string value;
+        CHECK(db->Get(leveldb::ReadOptions(), "block-00000003", &value).ok() && value == blockHash(m3));
+        CHECK(db->Get(leveldb::ReadOptions(), "fork-hash-" + blockHash(o2), &value).ok() && value == "00000002");
+        CHECK(db->Get(leveldb::ReadOptions(), "doublespend-lastid", &value).ok() && value == "00000002");
+
+        // The main chain spend with the conflicting spend in the orphaned branch
+        CHECK(db->Get(leveldb::ReadOptions(), "doublespend-00000001", &value).ok());
+        json doubleSpend = json::parse(value.empty() ? "{}" : value);
+        CHECK(doubleSpend["event"] == "doubleSpend");
+        CHECK(doubleSpend["id"] == 1);
+        CHECK(doubleSpend["details"]["mainChainBlock"]["hash"] == blockHash(m1));
+        CHECK(doubleSpend["details"]["mainChainBlock"]["height"] == 1);
+        CHECK(doubleSpend["details"]["mainChainTx"]["txid"] == txHash(spendMain));
+        CHECK(doubleSpend["details"]["doubleSpentOutpoints"].size() == 1);
+        CHECK(doubleSpend["details"]["doubleSpentOutpoints"][0]["outpoint"] == txHash(coinbaseG) + "00000000");
+        CHECK(doubleSpend["details"]["doubleSpentOutpoints"][0]["alsoSpentIn"]["tx"]["txid"] == txHash(spendOrphan));
+        CHECK(doubleSpend["details"]["doubleSpentOutpoints"][0]["alsoSpentIn"]["block"]["hash"] == blockHash(o1));
+
+        // The orphaned transaction spending the coinbase that was reorged out
+        CHECK(db->Get(leveldb::ReadOptions(), "doublespend-00000002", &value).ok());
+        json coinbaseSpend = json::parse(value.empty() ? "{}" : value);
+        CHECK(coinbaseSpend["event"] == "spendingReorgedCoinbase");
+        CHECK(coinbaseSpend["details"]["orphanedTx"]["txid"] == txHash(spendCoinbase));
+        CHECK(coinbaseSpend["details"]["orphanedBlock"]["hash"] == blockHash(o2));
+        CHECK(coinbaseSpend["details"]["orphanedBlock"]["height"] == 2);
+        CHECK(coinbaseSpend["details"]["coinbasesSpent"] == json::array({ txHash(coinbaseO1) + "00000000" }));
+
+        // An unchanged branch is not analyzed again
+        watcher.updateIndex();
+        CHECK(db->Get(leveldb::ReadOptions(), "doublespend-lastid", &value).ok() && value == "00000002");
+
+        // When it is, the events found again are not stored twice
+        db->Delete(leveldb::WriteOptions(), "doublespend-fork-" + blockHash(o1));
+        watcher.updateIndex();
+        CHECK(db->Get(leveldb::ReadOptions(), "doublespend-fork-" + blockHash(o1), &value).ok());
+        CHECK(db->Get(leveldb::ReadOptions(), "doublespend-lastid", &value).ok() && value == "00000002");
+        CHECK(!db->Get(leveldb::ReadOptions(), "doublespend-00000003", &value).ok());
+    }
+
+    db.reset();
+    CHECK(system(("rm -rf " + dir).c_str()) == 0);
+    return VtcBlockIndexerTest::result("doublespend_test");
+}
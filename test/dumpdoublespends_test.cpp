@@ -0,0 +1,113 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "blocks.h"
+#include "blockfilewatcher.h"
+#include "leveldb/db.h"
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace VtcBlockIndexerTest;
+
+/**
+ * Runs the double spend dump over two competing block files. blk00000.dat
+ * holds the main chain G-C1-M2-M3-M4, blk00001.dat a branch C1-O2-O3. M2 and
+ * O2 each spend the coinbases of G and C1 in one transaction, and O3 spends
+ * the coinbase of O2.
+ */
+
+int main() {
+    const string dir = "/tmp/vtc_indexer_dumpdoublespends_test_" + to_string(getpid());
+    const string blocksDir = dir + "/blocks";
+    mkdir(dir.c_str(), 0700);
+    mkdir(blocksDir.c_str(), 0700);
+    VtcBlockIndexer::CoinParams::readFromFile("coins/vertcoin-testnet.json");
+
+    const Bytes coinbaseG = transaction({}, 5000000000ULL, 0x01);
+    const Bytes genesis = block(string(64, '0'), 1500000000, { coinbaseG });
+    const Bytes coinbaseC1 = transaction({}, 5000000000ULL, 0x02);
+    const Bytes c1 = block(blockHash(genesis), 1500000100, { coinbaseC1 });
+
+    const Bytes spendMain = transaction({ { txHash(coinbaseG), 0 }, { txHash(coinbaseC1), 0 } }, 9000000000ULL, 0x03);
+    const Bytes m2 = block(blockHash(c1), 1500000200, { transaction({}, 5000000000ULL, 0x04), spendMain });
+    const Bytes m3 = block(blockHash(m2), 1500000300, { transaction({}, 5000000000ULL, 0x05) });
+    const Bytes m4 = block(blockHash(m3), 1500000400, { transaction({}, 5000000000ULL, 0x06) });
+
+    const Bytes coinbaseO2 = transaction({}, 5000000000ULL, 0x07);
+    const Bytes spendOrphan = transaction({ { txHash(coinbaseG), 0 }, { txHash(coinbaseC1), 0 } }, 9900000000ULL, 0x08);
+    const Bytes o2 = block(blockHash(c1), 1500000210, { coinbaseO2, spendOrphan });
+    const Bytes spendCoinbase = transaction({ { txHash(coinbaseO2), 0 } }, 4000000000ULL, 0x09);
+    const Bytes o3 = block(blockHash(o2), 1500000310, { transaction({}, 5000000000ULL, 0x0A), spendCoinbase });
+
+    writeBlockFile(blocksDir + "/blk00000.dat", { genesis, c1, m2, m3, m4 });
+    writeBlockFile(blocksDir + "/blk00001.dat", { o2, o3 });
+
+    leveldb::DB* database;
+    leveldb::Options options;
+    options.create_if_missing = true;
+    CHECK(leveldb::DB::Open(options, dir + "/index", &database).ok());
+    shared_ptr<leveldb::DB> db(database);
+
+    // The dump is written to stdout as a JSON array
+    stringstream output;
+    {
+        VtcBlockIndexer::BlockFileWatcher watcher(blocksDir, "", db, nullptr, nullptr);
+        streambuf* stdoutBuffer = cout.rdbuf(output.rdbuf());
+        watcher.dumpDoubleSpends();
+        cout.rdbuf(stdoutBuffer);
+    }
+
+    json events = json::parse(output.str().empty() ? "[]" : output.str());
+    CHECK_EQUAL(events.size(), (size_t)2);
+    if(events.size() == 2) {
+        // One event for the main chain transaction, with both outpoints the
+        // orphaned transaction also spent
+        const json& doubleSpend = events[0];
+        CHECK(doubleSpend["event"] == "doubleSpend");
+        CHECK(doubleSpend["details"]["mainChainBlock"]["hash"] == blockHash(m2));
+        CHECK(doubleSpend["details"]["mainChainTx"]["txid"] == txHash(spendMain));
+        const json& outpoints = doubleSpend["details"]["doubleSpentOutpoints"];
+        CHECK_EQUAL(outpoints.size(), (size_t)2);
+        if(outpoints.size() == 2) {
+            CHECK(outpoints[0]["outpoint"] == txHash(coinbaseG) + "00000000");
+            CHECK(outpoints[1]["outpoint"] == txHash(coinbaseC1) + "00000000");
+            for(const json& outpoint : outpoints) {
+                CHECK(outpoint["alsoSpentIn"]["tx"]["txid"] == txHash(spendOrphan));
+                CHECK(outpoint["alsoSpentIn"]["block"]["hash"] == blockHash(o2));
+            }
+        }
+
+        const json& coinbaseSpend = events[1];
+        CHECK(coinbaseSpend["event"] == "spendingReorgedCoinbase");
+        CHECK(coinbaseSpend["details"]["orphanedTx"]["txid"] == txHash(spendCoinbase));
+        CHECK(coinbaseSpend["details"]["orphanedBlock"]["hash"] == blockHash(o3));
+        CHECK(coinbaseSpend["details"]["coinbasesSpent"] == json::array({ txHash(coinbaseO2) + "00000000" }));
+    }
+
+    db.reset();
+    CHECK(system(("rm -rf " + dir).c_str()) == 0);
+    return VtcBlockIndexerTest::result("dumpdoublespends_test");
+}
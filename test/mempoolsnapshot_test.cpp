@@ -0,0 +1,129 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "mempoolsnapshot.h"
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * Writes mempool snapshots and reads them back. The raw transactions are
+ * opaque to the snapshot, so the entries hold arbitrary bytes: a short one
+ * with two outputs, and one longer than 253 bytes, whose length takes a
+ * three byte varint, with an output without addresses and one with a
+ * multisig-like list of two.
+ */
+
+namespace
+{
+    typedef pair<vector<unsigned char>, vector<vector<string>>> Entry;
+
+    vector<Entry> fixtureEntries() {
+        vector<Entry> entries(2);
+        entries[0].first = { 0x01, 0x00, 0x00, 0x00, 0xff, 0x00, 0x42 };
+        entries[0].second = { { "VbXwx5nu9uEdbtvbuWMTYbxAbNqMxzyTkQ" }, { "vtc1qn9l2c4jzvvmu6n6qa8cmxyjnvr2vd0xjf0uw8g" } };
+        for(int i = 0; i < 300; i++) {
+            entries[1].first.push_back((unsigned char)i);
+        }
+        entries[1].second = { {}, { "33tDkpLXExA7dWmAUQQvLoQL5ns1j4PuUE", "3MWsZyMbJFJABuHbhrjzkdKGTq9TYNF6Ah" } };
+        return entries;
+    }
+
+    vector<Entry> readEntries(const string& path, size_t& count) {
+        vector<Entry> entries;
+        count = VtcBlockIndexer::MempoolSnapshot::read(path, [&entries]( const vector<unsigned char>& rawTx, const vector<vector<string>>& outputAddresses ) {
+            entries.push_back(make_pair(rawTx, outputAddresses));
+        });
+        return entries;
+    }
+
+    string fileContents(const string& path) {
+        ifstream file(path, ios::binary);
+        return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    }
+
+    void writeContents(const string& path, const string& data) {
+        ofstream file(path, ios::binary | ios::trunc);
+        file.write(data.data(), data.size());
+    }
+}
+
+int main() {
+    const string dir = "/tmp/vtc_indexer_mempoolsnapshot_test_" + to_string(getpid());
+    mkdir(dir.c_str(), 0700);
+    const string path = dir + "/mempool.dat";
+    size_t count = 0;
+
+    // A missing file holds no entries
+    CHECK(readEntries(path, count).empty());
+    CHECK_EQUAL(count, (size_t)0);
+
+    // Round trip
+    const vector<Entry> entries = fixtureEntries();
+    string buffer;
+    for(const Entry& entry : entries) {
+        VtcBlockIndexer::MempoolSnapshot::appendEntry(buffer, entry.first.data(), entry.first.size(), entry.second);
+    }
+    CHECK(VtcBlockIndexer::MempoolSnapshot::write(path, buffer));
+    CHECK(access((path + ".tmp").c_str(), F_OK) != 0);
+    const vector<Entry> loaded = readEntries(path, count);
+    CHECK_EQUAL(count, entries.size());
+    CHECK(loaded == entries);
+
+    // The header and the end marker around the entries
+    const string data = fileContents(path);
+    CHECK_EQUAL(data.size(), 8 + 4 + buffer.size() + 1);
+    CHECK_EQUAL(data.substr(0, 8), string("VTCMEMPL"));
+    CHECK(data.substr(8, 4) == string("\x01\x00\x00\x00", 4));
+    CHECK_EQUAL((int)data.back(), 0);
+
+    // An empty mempool
+    CHECK(VtcBlockIndexer::MempoolSnapshot::write(path, ""));
+    CHECK(readEntries(path, count).empty());
+    CHECK_EQUAL(count, (size_t)0);
+
+    // A file cut off anywhere, even right before the end marker, is ignored as a whole
+    const string truncatedPath = dir + "/truncated.dat";
+    for(size_t length = 0; length < data.size(); length++) {
+        writeContents(truncatedPath, data.substr(0, length));
+        size_t truncatedCount = 1;
+        CHECK(readEntries(truncatedPath, truncatedCount).empty());
+        CHECK_EQUAL(truncatedCount, (size_t)0);
+    }
+
+    // Other versions and files that are not snapshots are ignored
+    string otherVersion = data;
+    otherVersion[8] = 2;
+    writeContents(truncatedPath, otherVersion);
+    CHECK(readEntries(truncatedPath, count).empty());
+    string otherMagic = data;
+    otherMagic[0] = 'X';
+    writeContents(truncatedPath, otherMagic);
+    CHECK(readEntries(truncatedPath, count).empty());
+
+    CHECK(system(("rm -rf " + dir).c_str()) == 0);
+    return VtcBlockIndexerTest::result("mempoolsnapshot_test");
+}
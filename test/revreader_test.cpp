@@ -0,0 +1,108 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "revreader.h"
+#include "coinparams.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Reads the undo data of a block from test/fixtures/rev00001.dat. The file
+ * holds two undo records with the testnet magic: one for a block that is not
+ * asked for, then the one for a block whose previous block hash ends in ab,
+ * followed by the zero bytes Core preallocates. That block spends a P2PKH
+ * coinbase output, a P2SH and a compressed P2PK output in its second
+ * transaction, and a P2WPKH output in its third.
+ */
+
+namespace
+{
+    vector<unsigned char> withPayload(vector<unsigned char> prefix, size_t length, unsigned char first, vector<unsigned char> suffix) {
+        for(size_t i = 0; i < length; i++) {
+            prefix.push_back((unsigned char)(first + i));
+        }
+        prefix.insert(prefix.end(), suffix.begin(), suffix.end());
+        return prefix;
+    }
+
+    VtcBlockIndexer::Block fixtureBlock() {
+        VtcBlockIndexer::Block block;
+        block.fileName = "blk00001.dat";
+        block.previousBlockHash = string(62, '0') + "ab";
+        block.transactions.resize(3);
+        block.transactions[1].inputs.resize(3);
+        for(int i = 0; i < 3; i++) {
+            block.transactions[1].inputs[i].txHash = "aa" + to_string(i);
+            block.transactions[1].inputs[i].txoIndex = i;
+        }
+        block.transactions[2].inputs.resize(1);
+        block.transactions[2].inputs[0].txHash = "bb";
+        block.transactions[2].inputs[0].txoIndex = 7;
+        return block;
+    }
+}
+
+int main() {
+    VtcBlockIndexer::CoinParams::magic = { 0xfa, 0xbf, 0xb5, 0xda };
+    VtcBlockIndexer::RevReader reader("test/fixtures");
+    VtcBlockIndexer::Block block = fixtureBlock();
+
+    vector<vector<VtcBlockIndexer::TransactionOutput>> spentOutputs;
+    CHECK(reader.readSpentOutputs(block, spentOutputs));
+    CHECK_EQUAL(spentOutputs.size(), (size_t)2);
+    if(spentOutputs.size() == 2) {
+        CHECK_EQUAL(spentOutputs[0].size(), (size_t)3);
+        CHECK_EQUAL(spentOutputs[1].size(), (size_t)1);
+    }
+    if(spentOutputs.size() == 2 && spentOutputs[0].size() == 3 && spentOutputs[1].size() == 1) {
+        const vector<VtcBlockIndexer::TransactionOutput> spent = { spentOutputs[0][0], spentOutputs[0][1], spentOutputs[0][2], spentOutputs[1][0] };
+        const vector<uint64_t> values = { 5000000000ULL, 123456789, 100, 0 };
+        const vector<vector<unsigned char>> scripts = {
+            withPayload({ 0x76, 0xa9, 0x14 }, 20, 1, { 0x88, 0xac }),
+            withPayload({ 0xa9, 0x14 }, 20, 1, { 0x87 }),
+            withPayload({ 0x21, 0x03 }, 32, 0x40, { 0xac }),
+            withPayload({ 0x00, 0x14 }, 20, 1, {})
+        };
+        for(size_t i = 0; i < spent.size(); i++) {
+            CHECK_EQUAL(spent[i].value, values[i]);
+            CHECK(spent[i].script == scripts[i]);
+        }
+        CHECK_EQUAL(spent[0].txHash, string("aa0"));
+        CHECK_EQUAL(spent[2].index, (uint32_t)2);
+        CHECK_EQUAL(spent[3].txHash, string("bb"));
+        CHECK_EQUAL(spent[3].index, (uint32_t)7);
+    }
+
+    // Found again from the records kept after the first scan
+    CHECK(reader.readSpentOutputs(block, spentOutputs));
+    CHECK_EQUAL(spentOutputs.size(), (size_t)2);
+
+    // No record matches another previous block, or a block file without undo data
+    block.previousBlockHash = string(62, '0') + "ac";
+    CHECK(!reader.readSpentOutputs(block, spentOutputs));
+    CHECK(spentOutputs.empty());
+    block.previousBlockHash = string(62, '0') + "ab";
+    block.fileName = "blk00002.dat";
+    CHECK(!reader.readSpentOutputs(block, spentOutputs));
+
+    return VtcBlockIndexerTest::result("revreader_test");
+}
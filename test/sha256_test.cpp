@@ -0,0 +1,103 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "crypto/sha256.h"
+#include "utility.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Checks SHA256D and SHA256D80 against known hashes with every
+ * implementation SHA256AutoDetect can pick. An implementation the CPU does
+ * not support falls back to the standard one, which is then checked again.
+ * The headers are the Bitcoin genesis block header with the nonce counted
+ * up, nine of them so SHA256D80 hashes a batch of eight and one more.
+ */
+
+namespace
+{
+    const char* GENESIS_HEADER = "0100000000000000000000000000000000000000000000000000000000000000000000003ba3edfd7a7b12b27ac72c3e67768f617fc81bc3888a51323a9fb8aa4b1e5e4a29ab5f49ffff001d1dac2b7c";
+
+    // SHA256D of the headers, in internal byte order
+    const char* HEADER_HASHES[] = {
+        "6fe28c0ab6f1b372c1a6a246ae63f74f931e8365e15a089c68d6190000000000",
+        "1c1ba4714930063bebadce0a323e51d097775dbc444187e6ba0caa5d4a7a229b",
+        "9d5344899444ca15fcf48fdec884321511a321ff3082ca1de7621f798947ef8f",
+        "6cdc92a7e14c3a94f3d57922f6f36f30b22697994c554b31451c141d73fcdc8f",
+        "a46c463f25bcc7b0c1a45b9cb947dda3b0def3d99bec400e3b4f5a4be8cc29e4",
+        "8bae0062ff2dd75030d4236d2c6e40ffd219b4fb51489e687a0d3188e21eee97",
+        "1218f7ce198d347890d02fc80b484c6c26f3eba2d09cd0c12e6dad71c4c5fb02",
+        "6a9c739afaf4b9f11ebfa0c77705807c4345cc1abfb2ed0d06bf7d433120ccc1",
+        "64539040dcc6e7e24ede4a351c9c0bcf8e1c3b7fce39f4218a586d854a1567e0"
+    };
+    const size_t HEADER_COUNT = sizeof(HEADER_HASHES) / sizeof(HEADER_HASHES[0]);
+
+    string sha256d(const string& input) {
+        vector<unsigned char> hash(CSHA256::OUTPUT_SIZE);
+        SHA256D(hash.data(), (const unsigned char*)input.data(), input.size());
+        return VtcBlockIndexer::Utility::hashToHex(hash);
+    }
+
+    void checkVectors() {
+        CHECK_EQUAL(sha256d(""), string("5df6e0e2761359d30a8275058e299fcc0381534545f55cf43e41983f5d4c9456"));
+        CHECK_EQUAL(sha256d("abc"), string("4f8b42c22dd3729b519ba6f68d2da7cc5b2d606d05daed5ad5128cc03e6c6358"));
+        CHECK_EQUAL(sha256d("abcdbcdecdefdefgefghfghighijhijkijkljklmjklmnlmnomnopnopq"), string("29cf5c90911915a6cf25e26ac0c52e16a0898da4ead97abadad7d8d93aa711cf"));
+        CHECK_EQUAL(sha256d(string(1000, 'a')), string("f2b6fd3c03e69a9201ec5826310c02da24d154d2fe3c9041527696bb1f693dce"));
+
+        const vector<unsigned char> genesis = VtcBlockIndexer::Utility::hexToBytes(GENESIS_HEADER);
+        vector<unsigned char> headers;
+        for(size_t i = 0; i < HEADER_COUNT; i++) {
+            vector<unsigned char> header = genesis;
+            header[76] += (unsigned char)i;
+            headers.insert(headers.end(), header.begin(), header.end());
+        }
+        vector<unsigned char> hashes(32 * HEADER_COUNT);
+        SHA256D80(hashes.data(), headers.data(), HEADER_COUNT);
+        for(size_t i = 0; i < HEADER_COUNT; i++) {
+            CHECK_EQUAL(VtcBlockIndexer::Utility::hashToHex(vector<unsigned char>(hashes.begin() + 32 * i, hashes.begin() + 32 * (i + 1))), string(HEADER_HASHES[i]));
+        }
+        CHECK_EQUAL(VtcBlockIndexer::Utility::hashToReverseHex(vector<unsigned char>(hashes.begin(), hashes.begin() + 32)), string("000000000019d6689c085ae165831e934ff763ae46a2a6c172b3f1b60a8ce26f"));
+
+        // An empty batch writes nothing
+        SHA256D80(nullptr, nullptr, 0);
+    }
+}
+
+int main() {
+    const sha256_implementation::UseImplementation implementations[] = {
+        sha256_implementation::STANDARD,
+        sha256_implementation::USE_SHANI,
+        sha256_implementation::USE_AVX2,
+        sha256_implementation::USE_ALL
+    };
+    for(sha256_implementation::UseImplementation implementation : implementations) {
+        const string name = SHA256AutoDetect(implementation);
+        cout << "sha256_test: checking " << name << endl;
+        CHECK(name.find("failed") == string::npos);
+        if(implementation == sha256_implementation::STANDARD) {
+            CHECK_EQUAL(name, string("standard"));
+        }
+        checkVectors();
+    }
+    return VtcBlockIndexerTest::result("sha256_test");
+}
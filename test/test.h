@@ -0,0 +1,67 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TEST_H_INCLUDED
+#define TEST_H_INCLUDED
+
+#include <iostream>
+#include <stdlib.h>
+
+/**
+ * Minimal checks for the test drivers in this directory. Every test is a
+ * program that runs its checks and exits with a non-zero status when one of
+ * them failed, `make test` builds and runs them all.
+ */
+
+namespace VtcBlockIndexerTest {
+    inline int& failures() {
+        static int count = 0;
+        return count;
+    }
+
+    /** Prints the result and returns the exit status for main */
+    inline int result(const char* name) {
+        if(failures() > 0) {
+            std::cerr << name << ": " << failures() << " check(s) failed" << std::endl;
+            return 1;
+        }
+        std::cout << name << ": ok" << std::endl;
+        return 0;
+    }
+}
+
+#define CHECK(condition) \
+    do { \
+        if(!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            VtcBlockIndexerTest::failures()++; \
+        } \
+    } while(0)
+
+#define CHECK_EQUAL(actual, expected) \
+    do { \
+        if(!((actual) == (expected))) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #actual " == " #expected " (got " << (actual) << ", expected " << (expected) << ")" << std::endl; \
+            VtcBlockIndexerTest::failures()++; \
+        } \
+    } while(0)
+
+#endif // TEST_H_INCLUDED
@@ -0,0 +1,186 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "utxosnapshot.h"
+#include "utility.h"
+#include "coinparams.h"
+#include "leveldb/db.h"
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * Imports the UTXO snapshots in test/fixtures into empty indexes. Both hold the
+ * same four outputs at a base block with hash 1f1e..00, for Vertcoin testnet:
+ * utxo-grouped.dat in the format of Core 28 and later, utxo-legacy.dat in the
+ * earlier one. The outputs are a P2PKH and a P2SH output of transaction 11..11
+ * (outputs 0 and 2, coinbase at height 100), a P2WPKH output of 22..22 (output
+ * 1, height 200) and a compressed P2PK output of 33..33 (output 0, height 300).
+ * utxo-truncated.dat misses the end of the last output, utxo-trailing.dat has
+ * a byte after it.
+ */
+
+namespace
+{
+    const string BASE_BLOCK_HASH = "1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100";
+
+    shared_ptr<leveldb::DB> openIndex(const string& path) {
+        leveldb::DB* database = nullptr;
+        leveldb::Options options;
+        options.create_if_missing = true;
+        CHECK(leveldb::DB::Open(options, path, &database).ok());
+        return shared_ptr<leveldb::DB>(database);
+    }
+
+    map<string, string> contents(const shared_ptr<leveldb::DB>& db) {
+        map<string, string> records;
+        leveldb::Iterator* it = db->NewIterator(leveldb::ReadOptions());
+        for(it->SeekToFirst(); it->Valid(); it->Next()) {
+            records[it->key().ToString()] = it->value().ToString();
+        }
+        delete it;
+        return records;
+    }
+
+    /** A chain of three blocks ending at the base block */
+    vector<VtcBlockIndexer::ScannedBlock> baseChain() {
+        vector<VtcBlockIndexer::ScannedBlock> chain(3);
+        for(size_t i = 0; i < chain.size(); i++) {
+            chain[i].blockHash = string(63, 'a') + to_string(i);
+            chain[i].time = 1500000000 + i;
+        }
+        chain.back().blockHash = BASE_BLOCK_HASH;
+        return chain;
+    }
+
+    map<string, string> importSnapshot(const string& fixture, const string& indexPath) {
+        shared_ptr<leveldb::DB> db = openIndex(indexPath);
+        VtcBlockIndexer::UtxoSnapshot snapshot(db);
+        CHECK(snapshot.open("test/fixtures/" + fixture));
+        CHECK_EQUAL(snapshot.getBaseBlockHash(), BASE_BLOCK_HASH);
+        CHECK_EQUAL(snapshot.getCoinsCount(), (uint64_t)4);
+        CHECK(snapshot.import(baseChain()));
+        CHECK(snapshot.isImported());
+        CHECK(!snapshot.isUnfinished());
+        return contents(db);
+    }
+
+    /** The import of a malformed snapshot fails, and leaves an index the indexer refuses to run on */
+    void importMalformed(const string& fixture, const string& indexPath) {
+        shared_ptr<leveldb::DB> db = openIndex(indexPath);
+        VtcBlockIndexer::UtxoSnapshot snapshot(db);
+        CHECK(snapshot.open("test/fixtures/" + fixture));
+        CHECK(!snapshot.import(baseChain()));
+        CHECK(!snapshot.isImported());
+        CHECK(snapshot.isUnfinished());
+    }
+}
+
+int main() {
+    const string dir = "/tmp/vtc_indexer_utxosnapshot_test_" + to_string(getpid());
+    mkdir(dir.c_str(), 0700);
+    VtcBlockIndexer::CoinParams::readFromFile("coins/vertcoin-testnet.json");
+
+    const map<string, string> grouped = importSnapshot("utxo-grouped.dat", dir + "/grouped");
+    const map<string, string> legacy = importSnapshot("utxo-legacy.dat", dir + "/legacy");
+    CHECK(grouped == legacy);
+
+    const string p2pkh = VtcBlockIndexer::Utility::ripeMD160ToP2PKAddress(vector<unsigned char>(20, 0x01));
+    const string p2sh = VtcBlockIndexer::Utility::ripeMD160ToP2SHAddress(vector<unsigned char>(20, 0x02));
+    const string p2wpkh = VtcBlockIndexer::Utility::bech32Address(vector<unsigned char>(20, 0x03));
+    vector<unsigned char> publicKey(33, 0x04);
+    publicKey[0] = 0x02;
+    const string p2pk = VtcBlockIndexer::Utility::publicKeyToAddress(publicKey);
+    const string tx1(64, '1');
+    const string tx2(64, '2');
+    const string tx3(64, '3');
+
+    map<string, string> expected = {
+        { p2pkh + "-txo-00000001", tx1 + "00000000" + "00000100" + "5000000000" },
+        { p2sh + "-txo-00000001", tx1 + "00000002" + "00000100" + "123456789" },
+        { p2wpkh + "-txo-00000001", tx2 + "00000001" + "00000200" + "1000" },
+        { p2pk + "-txo-00000001", tx3 + "00000000" + "00000300" + "42" },
+        { tx1 + "00000000-address-00000001", p2pkh },
+        { tx1 + "00000002-address-00000001", p2sh },
+        { tx2 + "00000001-address-00000001", p2wpkh },
+        { tx3 + "00000000-address-00000001", p2pk },
+        { tx1 + "00000000-value", "5000000000" },
+        { tx1 + "00000002-value", "123456789" },
+        { tx2 + "00000001-value", "1000" },
+        { tx3 + "00000000-value", "42" },
+        { "block-hash-" + string(63, 'a') + "0", "00000000" },
+        { "block-hash-" + string(63, 'a') + "1", "00000001" },
+        { "block-hash-" + BASE_BLOCK_HASH, "00000002" },
+        { "block-time-00000000", "1500000000" },
+        { "block-time-00000001", "1500000001" },
+        { "block-time-00000002", "1500000002" },
+        { "snapshot-blockhash", BASE_BLOCK_HASH },
+        { "snapshot-height", "00000002" },
+        { "snapshot-backfill-next", "00000000" },
+        { "highestblock", "00000002" }
+    };
+    CHECK_EQUAL(grouped.size(), expected.size());
+    for(const pair<const string, string>& record : expected) {
+        auto found = grouped.find(record.first);
+        CHECK(found != grouped.end());
+        if(found != grouped.end()) {
+            CHECK_EQUAL(found->second, record.second);
+        }
+    }
+
+    importMalformed("utxo-truncated.dat", dir + "/truncated");
+    importMalformed("utxo-trailing.dat", dir + "/trailing");
+
+    // A count that cannot fit in the file is refused when the snapshot is opened,
+    // before the import sizes anything by it
+    {
+        ifstream source("test/fixtures/utxo-grouped.dat", ios_base::binary);
+        string bytes((istreambuf_iterator<char>(source)), istreambuf_iterator<char>());
+        // The count follows the magic, the version, the network magic and the block hash
+        bytes.replace(5 + 2 + 4 + 32, 8, string(8, '\xff'));
+        ofstream(dir + "/overcount.dat", ios_base::binary) << bytes;
+
+        shared_ptr<leveldb::DB> db = openIndex(dir + "/overcount");
+        VtcBlockIndexer::UtxoSnapshot snapshot(db);
+        CHECK(!snapshot.open(dir + "/overcount.dat"));
+        CHECK(contents(db).empty());
+    }
+
+    // A chain that does not end at the base block is refused before anything is written
+    {
+        shared_ptr<leveldb::DB> db = openIndex(dir + "/otherchain");
+        VtcBlockIndexer::UtxoSnapshot snapshot(db);
+        CHECK(snapshot.open("test/fixtures/utxo-grouped.dat"));
+        vector<VtcBlockIndexer::ScannedBlock> chain = baseChain();
+        chain.pop_back();
+        CHECK(!snapshot.import(chain));
+        CHECK(contents(db).empty());
+    }
+
+    CHECK(system(("rm -rf " + dir).c_str()) == 0);
+    return VtcBlockIndexerTest::result("utxosnapshot_test");
+}
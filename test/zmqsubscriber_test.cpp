@@ -0,0 +1,139 @@
+/*  VTC Blockindexer - A utility to build additional indexes to the
+    Vertcoin blockchain by scanning and indexing the blockfiles
+    downloaded by Vertcoin Core.
+
+    Copyright (C) 2017  Gert-Jaap Glasbergen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "zmqsubscriber.h"
+#include <zmq.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Checks the ZmqSubscriber against a stand-in for the node: a PUB socket
+ * sending messages laid out the way the node publishes them.
+ */
+
+namespace
+{
+    void publish(void* publisher, const vector<string>& parts) {
+        for(size_t i = 0; i < parts.size(); i++) {
+            zmq_send(publisher, parts[i].data(), parts[i].size(), i + 1 < parts.size() ? ZMQ_SNDMORE : 0);
+        }
+    }
+
+    string sequenceBytes(uint32_t sequence) {
+        string bytes;
+        for(int i = 0; i < 4; i++) {
+            bytes.push_back((char)(sequence >> (8 * i)));
+        }
+        return bytes;
+    }
+
+    void publishNotification(void* publisher, const string& topic, const string& body, uint32_t sequence) {
+        publish(publisher, { topic, body, sequenceBytes(sequence) });
+    }
+}
+
+int main() {
+    const string endpoint = "ipc:///tmp/vtc_indexer_zmq_test_" + to_string(getpid());
+    void* context = zmq_ctx_new();
+    void* publisher = zmq_socket(context, ZMQ_PUB);
+    int linger = 0;
+    zmq_setsockopt(publisher, ZMQ_LINGER, &linger, sizeof(linger));
+    if(zmq_bind(publisher, endpoint.c_str()) != 0) {
+        cerr << "Could not bind the stand-in publisher to " << endpoint << endl;
+        return 1;
+    }
+
+    {
+        VtcBlockIndexer::ZmqSubscriber subscriber(endpoint, { "rawtx", "sequence", "hello" });
+        VtcBlockIndexer::ZmqNotification notification;
+
+        // A subscription takes a moment to reach the publisher, messages sent
+        // before that are dropped. Greet until the subscriber hears it.
+        bool connected = false;
+        for(int attempt = 0; attempt < 100 && !connected; attempt++) {
+            publishNotification(publisher, "hello", "", 0);
+            connected = subscriber.receive(notification, 50);
+        }
+        CHECK(connected);
+        while(subscriber.receive(notification, 50)) {}
+
+        // Nothing published, nothing received
+        CHECK(!subscriber.receive(notification, 10));
+
+        publishNotification(publisher, "rawtx", "\x01\x02\x03", 7);
+        CHECK(subscriber.receive(notification, 1000));
+        CHECK_EQUAL(notification.topic, "rawtx");
+        CHECK_EQUAL(notification.body, "\x01\x02\x03");
+        CHECK_EQUAL(notification.sequence, 7u);
+        CHECK(!notification.gap);
+
+        // Sequence numbers are counted per topic
+        publishNotification(publisher, "sequence", string(32, '\xaa') + "A" + string(8, '\0'), 0x01020304);
+        CHECK(subscriber.receive(notification, 1000));
+        CHECK_EQUAL(notification.topic, "sequence");
+        CHECK_EQUAL(notification.body.size(), 41u);
+        CHECK_EQUAL(notification.sequence, 0x01020304u);
+        CHECK(!notification.gap);
+
+        publishNotification(publisher, "rawtx", "next", 8);
+        CHECK(subscriber.receive(notification, 1000));
+        CHECK_EQUAL(notification.sequence, 8u);
+        CHECK(!notification.gap);
+
+        // A skipped number means the node dropped messages
+        publishNotification(publisher, "rawtx", "after a drop", 10);
+        CHECK(subscriber.receive(notification, 1000));
+        CHECK_EQUAL(notification.body, "after a drop");
+        CHECK(notification.gap);
+
+        publishNotification(publisher, "sequence", "", 0x01020305);
+        CHECK(subscriber.receive(notification, 1000));
+        CHECK(!notification.gap);
+
+        // The counter wraps around
+        publishNotification(publisher, "rawtx", "", 0xffffffff);
+        CHECK(subscriber.receive(notification, 1000));
+        publishNotification(publisher, "rawtx", "", 0);
+        CHECK(subscriber.receive(notification, 1000));
+        CHECK(!notification.gap);
+
+        // Topics that were not subscribed to are filtered by the publisher
+        publishNotification(publisher, "hashblock", string(32, '\0'), 1);
+        CHECK(!subscriber.receive(notification, 100));
+
+        // Messages without a counter are rejected
+        publish(publisher, { "rawtx", "no counter" });
+        bool threw = false;
+        try {
+            subscriber.receive(notification, 1000);
+        } catch(const runtime_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+
+    zmq_close(publisher);
+    zmq_ctx_term(context);
+    return VtcBlockIndexerTest::result("zmqsubscriber_test");
+}